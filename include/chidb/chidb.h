@@ -36,6 +36,9 @@ typedef struct chidb chidb;
 #define CHIDB_ROW (100)
 #define CHIDB_DONE (101)
 
+/* Flags for chidb_open_v2 */
+#define CHIDB_OPEN_COMPRESSED (0x01)
+
 /* Opens a chidb file.
  *
  * If the file does not exist, it will be created
@@ -59,6 +62,32 @@ typedef struct chidb chidb;
 int chidb_open(const char *file, chidb **db); 
 
 
+/* Opens a chidb file, with options
+ *
+ * This is the same as chidb_open, except that the way the file is
+ * opened can be changed with the following flags:
+ *
+ * - CHIDB_OPEN_COMPRESSED: If the file is created, its pages are stored
+ *   compressed. Files with compressed pages are recognized when they
+ *   are opened, whether or not this flag is given, and the flag has no
+ *   effect on files that already exist.
+ *
+ * Parameters
+ * - file: Filename of the chidb file to open/create
+ * - db: Out parameter. Returns a pointer to a chidb struct
+ *       (see chidb_open)
+ * - flags: Zero or more CHIDB_OPEN_* flags, or'd together
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ECANTOPEN: Unable to open the database file
+ * - CHIDB_ECORRUPT: The database file is not well formed
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_open_v2(const char *file, chidb **db, int flags);
+
+
 /* Prepares a SQL statement for execution
  *
  * Parameters
@@ -66,6 +95,8 @@ int chidb_open(const char *file, chidb **db);
  * - sql: SQL statement
  * - stmt: Out parameter. Returns a pointer to a chidb_stmt. The chidb_stmt
  *         type is an opaque type representing a prepared SQL statement.
+ *         If the statement can't be prepared, it is set to NULL (and
+ *         there is nothing to finalize).
  *
  * Return
  * - CHIDB_OK: Operation successful
@@ -112,6 +143,110 @@ int chidb_step(chidb_stmt *stmt);
 int chidb_finalize(chidb_stmt *stmt);
 
 
+/* Resets a SQL statement, so it can be run again
+ *
+ * The statement goes back to the state it was in before chidb_step was
+ * first called on it, without having to prepare it again. Values bound
+ * to the statement's parameters are not cleared.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_reset(chidb_stmt *stmt);
+
+
+/* Binds an integer to a parameter of a SQL statement
+ *
+ * A SQL statement can include parameters (written as "?") instead of
+ * literal values. Parameters are numbered, from 1, in the order in which
+ * they appear in the statement. A parameter with no value bound to it
+ * is NULL.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter (parameters are numbered from 1)
+ * - value: Integer value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The statement has no such parameter
+ */
+int chidb_bind_int(chidb_stmt *stmt, int param, int value);
+
+
+/* Binds a string to a parameter of a SQL statement
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter (parameters are numbered from 1)
+ * - value: Null-terminated string. The string is copied, so the API
+ *          client can free it once this function returns.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The statement has no such parameter
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value);
+
+
+/* Binds NULL to a parameter of a SQL statement (replacing any value
+ * that was bound to it before)
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter (parameters are numbered from 1)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The statement has no such parameter
+ */
+int chidb_bind_null(chidb_stmt *stmt, int param);
+
+
+/* A value of a row inserted with chidb_insert_batch */
+typedef struct chidb_value
+{
+    int type;         /* SQL_NULL, SQL_INTEGER_4BYTE or SQL_TEXT */
+    int i;            /* Value, if it is an integer */
+    const char *s;    /* Null-terminated value, if it is a string */
+} chidb_value;
+
+
+/* Inserts several rows into a table
+ *
+ * The rows are sorted by their primary key, and inserted with INSERT
+ * statements of several rows each, which are only prepared once, so
+ * the table's B-Tree (and those of its indexes) are updated in order
+ * of their keys. The rows are not inserted atomically: if one of them
+ * can't be inserted, some of the rows may have been inserted already.
+ *
+ * Parameters
+ * - db: chidb database
+ * - table: Name of the table
+ * - values: The values of the rows, one row after the other. Each row
+ *           has a value for each of the table's columns, in the order
+ *           in which they were declared. The primary key must be an
+ *           integer.
+ * - nrows: Number of rows
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EINVALIDSQL: The table does not exist, or has no INTEGER
+ *                      PRIMARY KEY
+ * - CHIDB_EMISMATCH: The primary key of a row is not an integer, or a
+ *                    value has a type other than those of chidb_value
+ *                    (nothing is inserted in that case)
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - Any other error returned when running the INSERT statements (for
+ *   example, if a row has the same primary key as another row)
+ */
+int chidb_insert_batch(chidb *db, const char *table, const chidb_value *values, int nrows);
+
+
 /* Returns the number of columns returned by a SQL statement
  *
  * Parameters
@@ -18,18 +18,21 @@
 #define STMT_SELECT (1)
 #define STMT_INSERT (2)
 #define STMT_DELETE (3)
+#define STMT_ANALYZE (4)
 
 typedef struct chisql_statement
 {
     bool explain;
     char *text;
     uint8_t type;
+    uint32_t nparams; /* Number of parameters ("?") in the statement */
     union {
         Create_t *create;
         SRA_t    *select;
         Insert_t *insert;
         Delete_t *delete;
     } stmt;
+    RA_t *plan; /* Relational algebra plan of a SELECT (set by the optimizer, or NULL) */
 } chisql_statement_t;
 
 int chisql_parser(const char *sql, chisql_statement_t **stmt);
@@ -12,6 +12,7 @@ enum constraint_type {
    CONS_DEFAULT,
    CONS_AUTO_INCREMENT,
    CONS_CHECK,
+   CONS_DICTIONARY,
    CONS_SIZE
 };
 
@@ -54,6 +55,7 @@ Constraint_t *ForeignKey(ForeignKeyRef_t fkr);
 Constraint_t *Default(Literal_t *val);
 Constraint_t *Unique(void);
 Constraint_t *Check(Condition_t *cond);
+Constraint_t *Dictionary(void);
 Constraint_t *ColumnSize(unsigned size);
 Constraint_t *Constraint_append(Constraint_t *constraints, Constraint_t *constraint);
 Column_t *Column_addConstraint(Column_t *column, Constraint_t *constraints);
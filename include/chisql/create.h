@@ -26,6 +26,7 @@ typedef struct TableReference_s {
 
 typedef struct Index_s {
    char *name, *table_name, *column_name;
+   StrList_t *columns; /* All the indexed columns (column_name is the first one) */
    int unique;
 } Index_t;
 
@@ -52,6 +53,7 @@ TableReference_t *TableReference_make(char *table_name, char *alias);
 void        TableReference_free(TableReference_t *tref);
 
 Index_t *   Index_make(char *name, char *table_name, char *column_name);
+Index_t *   Index_makeColumns(char *name, char *table_name, StrList_t *columns);
 Index_t *   Index_makeUnique(Index_t *idx);
 void        Index_print(Index_t *idx);
 void        Index_free(Index_t *idx);
@@ -5,13 +5,21 @@
 #include "ra.h"
 #include "create.h"
 
+/* A row of a multi-row VALUES, after the first one */
+typedef struct InsertRow_s {
+   Literal_t *values;
+   struct InsertRow_s *next;
+} InsertRow_t;
+
 typedef struct Insert_s {
    char *table_name;
    StrList_t *col_names;
    Literal_t *values;
+   InsertRow_t *more_rows; /* NULL if there is a single row */
 } Insert_t;
 
 Insert_t *Insert_make(const char *table_name, StrList_t *opt_col_names, Literal_t *values);
+Insert_t *Insert_addRow(Insert_t *insert, Literal_t *values);
 void Insert_print(Insert_t *insert);
 void Insert_free(Insert_t *insert);
 
@@ -83,6 +83,7 @@ typedef struct SRA_Project_s {
    int distinct;
    enum OrderBy asc_desc;
    Expression_t *group_by;
+   int limit, offset; /* limit is -1 if there is no LIMIT */
 } SRA_Project_t;
 
 typedef struct SRA_Select_s {
@@ -130,6 +131,7 @@ struct JoinCondition_s {
 typedef struct ProjectOption_s {
    Expression_t *order_by, *group_by;
    enum OrderBy asc_desc; /* not used by group by */
+   int limit, offset; /* limit is -1 if there is no LIMIT */
 } ProjectOption_t;
 
 SRA_t *SRATable(TableReference_t *ref);
@@ -150,6 +152,7 @@ SRA_t *SRA_makeDistinct(SRA_t *sra);
 
 ProjectOption_t *OrderBy_make(Expression_t *expr, enum OrderBy o);
 ProjectOption_t *GroupBy_make(Expression_t *expr);
+ProjectOption_t *Limit_make(int limit, int offset);
 ProjectOption_t *ProjectOption_combine(ProjectOption_t *order_by, 
                                         ProjectOption_t *group_by);
 void ProjectOption_print(ProjectOption_t *sra);
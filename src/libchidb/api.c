@@ -42,11 +42,18 @@
 
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <chidb/chidb.h>
 #include "dbm.h"
 #include "btree.h"
 #include "record.h"
 #include "util.h"
+#include "dict.h"
+#include "stmt-cache.h"
+#include "schema.h"
+#include "stats.h"
+#include "dbm-reg.h"
 
 /* Implemented in codegen.c */
 int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt);
@@ -55,22 +62,88 @@ int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt);
 int chidb_stmt_optimize(chidb *db,
 			chisql_statement_t *sql_stmt, 
 			chisql_statement_t **sql_stmt_opt);
+void chidb_stmt_optimize_free(chisql_statement_t *sql_stmt_opt);
 
   /* your code */
 
 int chidb_open(const char *file, chidb **db)
 {
+    return chidb_open_v2(file, db, 0);
+}
+
+/* Creates an empty file whose pages will be stored compressed (see
+ * pager.c), unless the file already exists */
+static int chidb_create_compressed(const char *file)
+{
+    Pager *pager;
+    int rc;
+
+    rc = chidb_Pager_open(&pager, file);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!pager->compressed)
+    {
+        rc = chidb_Pager_setPageSize(pager, DEFAULT_PAGE_SIZE);
+        if (rc == CHIDB_OK)
+            rc = chidb_Pager_setCompression(pager, true);
+
+        /* The file already has uncompressed pages */
+        if (rc == CHIDB_EMISUSE)
+            rc = CHIDB_OK;
+    }
+
+    chidb_Pager_close(pager);
+
+    return rc;
+}
+
+int chidb_open_v2(const char *file, chidb **db, int flags)
+{
+    int rc;
+
+    if (flags & CHIDB_OPEN_COMPRESSED)
+    {
+        rc = chidb_create_compressed(file);
+        if (rc != CHIDB_OK)
+            return rc;
+    }
+
     *db = malloc(sizeof(chidb));
     if (*db == NULL)
         return CHIDB_ENOMEM;
-    chidb_Btree_open(file, *db, &(*db)->bt);
+    rc = chidb_Btree_open(file, *db, &(*db)->bt);
+    if (rc != CHIDB_OK)
+    {
+        free(*db);
+        *db = NULL;
+        return rc;
+    }
 
     /* Additional initialization code goes here */
-    return CHIDB_OK;
+    (*db)->dicts = NULL;
+    (*db)->nDicts = 0;
+    (*db)->schemaVersion = 0;
+    (*db)->schema = NULL;
+    (*db)->stats = NULL;
+
+    rc = chidb_StmtCache_create(&(*db)->stmtCache, STMT_CACHE_DEFAULT_SIZE);
+    if (rc != CHIDB_OK)
+    {
+        chidb_Btree_close((*db)->bt);
+        free(*db);
+        *db = NULL;
+    }
+
+    return rc;
 }
 
 int chidb_close(chidb *db)
 {
+    chidb_StmtCache_destroy(db->stmtCache);
+    chidb_Schema_free(db->schema);
+    chidb_Stats_free(db->stats);
+    chidb_Dict_freeAll(db);
     chidb_Btree_close(db->bt);
     free(db);
 
@@ -79,44 +152,99 @@ int chidb_close(chidb *db)
     return CHIDB_OK;
 }
 
+/* Does the program modify the schema? (ANALYZE counts as a schema
+ * change, since the new statistics may change the plans of statements) */
+static bool chidb_stmt_modifies_schema(chidb_stmt *stmt)
+{
+    for(int i=0; i < stmt->endOp; i++)
+        if (stmt->ops[i].opcode == Op_CreateTable || stmt->ops[i].opcode == Op_CreateIndex ||
+            stmt->ops[i].opcode == Op_KeyCreate || stmt->ops[i].opcode == Op_Analyze)
+            return true;
+
+    return false;
+}
+
 int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt)
 {
     int rc;
     chisql_statement_t *sql_stmt, *sql_stmt_opt;
+    char *key;
+
+    rc = chidb_StmtCache_normalize(sql, &key);
+    if(rc != CHIDB_OK)
+        return rc;
+
+    /* Reuse a statement compiled from the same SQL, if there is one */
+    if(chidb_StmtCache_get(db->stmtCache, key, db->schemaVersion, stmt) == CHIDB_OK)
+    {
+        free(key);
+        return CHIDB_OK;
+    }
 
     *stmt = malloc(sizeof(chidb_stmt));
+    if(*stmt == NULL)
+    {
+        free(key);
+        return CHIDB_ENOMEM;
+    }
 
     rc = chidb_stmt_init(*stmt, db);
 
     if(rc != CHIDB_OK)
     {
+        free(key);
         free(*stmt);
+        *stmt = NULL;
         return rc;
     }
 
     rc = chisql_parser(sql, &sql_stmt);
 
+    if(rc == CHIDB_OK)
+        rc = chidb_stmt_optimize((*stmt)->db, sql_stmt, &sql_stmt_opt);
+
     if(rc != CHIDB_OK)
     {
+        free(key);
+        chidb_stmt_free(*stmt);
         free(*stmt);
+        *stmt = NULL;
         return rc;
     }
 
-    rc = chidb_stmt_optimize((*stmt)->db, sql_stmt, &sql_stmt_opt);
+    /* The program reads the values bound to parameters with Variable */
+    rc = chidb_stmt_set_params(*stmt, sql_stmt->nparams);
+
+    if(rc == CHIDB_OK)
+        rc = chidb_stmt_codegen(*stmt, sql_stmt_opt);
+
+    chidb_stmt_optimize_free(sql_stmt_opt);
+
+    (*stmt)->explain = sql_stmt->explain;
+
+    /* EXPLAIN shows the program as generated */
+    if(rc == CHIDB_OK && !(*stmt)->explain)
+        rc = chidb_stmt_peephole(*stmt);
 
     if(rc != CHIDB_OK)
     {
+        free(key);
+        chidb_stmt_free(*stmt);
         free(*stmt);
+        *stmt = NULL;
         return rc;
     }
 
-    rc = chidb_stmt_codegen(*stmt, sql_stmt_opt);
-
-    free(sql_stmt_opt);
+    /* Statements that modify the schema are not cached, since
+     * running them again would fail anyway */
+    (*stmt)->schemaVersion = db->schemaVersion;
+    (*stmt)->schemaChange = chidb_stmt_modifies_schema(*stmt);
+    if(!(*stmt)->schemaChange)
+        (*stmt)->cacheKey = key;
+    else
+        free(key);
 
-    (*stmt)->explain = sql_stmt->explain;
-
-    return rc;
+    return CHIDB_OK;
 }
 
 int chidb_step(chidb_stmt *stmt)
@@ -132,12 +260,203 @@ int chidb_step(chidb_stmt *stmt)
 		}
 	}
 	else
-		return chidb_stmt_exec(stmt);
+	{
+		int rc = chidb_stmt_exec(stmt);
+
+		/* Invalidate statements compiled against the old schema, once the
+		 * statement has run to completion (the first time it does) */
+		if(rc == CHIDB_DONE && stmt->schemaChange && stmt->schemaVersion == stmt->db->schemaVersion)
+			stmt->db->schemaVersion++;
+
+		return rc;
+	}
 }
 
 int chidb_finalize(chidb_stmt *stmt)
 {
-    return chidb_stmt_free(stmt);
+    int rc;
+
+    /* Keep the statement around, in case the same SQL is prepared again */
+    if(stmt->cacheKey != NULL && stmt->schemaVersion == stmt->db->schemaVersion)
+        return chidb_StmtCache_put(stmt->db->stmtCache, stmt);
+
+    rc = chidb_stmt_free(stmt);
+    free(stmt);
+
+    return rc;
+}
+
+int chidb_reset(chidb_stmt *stmt)
+{
+    return chidb_stmt_reset(stmt);
+}
+
+int chidb_bind_int(chidb_stmt *stmt, int param, int value)
+{
+    if(param < 1 || param > stmt->nParams)
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_reg_set_int(&stmt->params[param - 1], value);
+}
+
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value)
+{
+    if(param < 1 || param > stmt->nParams)
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_reg_set_text(&stmt->params[param - 1], value, strlen(value));
+}
+
+int chidb_bind_null(chidb_stmt *stmt, int param)
+{
+    if(param < 1 || param > stmt->nParams)
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_reg_set_null(&stmt->params[param - 1]);
+}
+
+/* Number of rows inserted by each of the INSERT statements of a batch */
+#define BATCH_ROWS (64)
+
+/* Is a value of a row of a batch one of the types of chidb_value? */
+static bool batch_value_ok(const chidb_value *v)
+{
+    return v->type == SQL_NULL || v->type == SQL_INTEGER_4BYTE || (v->type == SQL_TEXT && v->s != NULL);
+}
+
+/* A row of a batch, and its key */
+typedef struct batch_row
+{
+    int32_t key;
+    const chidb_value *values;
+} batch_row;
+
+static int batch_row_cmp(const void *a, const void *b)
+{
+    const batch_row *ra = a, *rb = b;
+
+    return (ra->key > rb->key) - (ra->key < rb->key);
+}
+
+/* Returns an INSERT statement of nrows rows, with a parameter for
+ * each of their values (NULL if it can't be allocated) */
+static char *batch_sql(const char *table, uint32_t nCols, int nrows)
+{
+    size_t len = strlen("INSERT INTO  VALUES ;") + strlen(table) + nrows * (3 * nCols + 3);
+    char *sql = malloc(len + 1), *p;
+
+    if (sql == NULL)
+        return NULL;
+
+    p = sql + sprintf(sql, "INSERT INTO %s VALUES ", table);
+    for (int r = 0; r < nrows; r++)
+    {
+        p += sprintf(p, r == 0 ? "(" : ", (");
+        for (uint32_t i = 0; i < nCols; i++)
+            p += sprintf(p, i == 0 ? "?" : ", ?");
+        *p++ = ')';
+    }
+    strcpy(p, ";");
+
+    return sql;
+}
+
+/* Runs a prepared INSERT statement of a batch on nrows of its rows */
+static int batch_insert(chidb_stmt *stmt, batch_row *rows, uint32_t nCols, int nrows)
+{
+    int rc = CHIDB_OK;
+
+    for (int r = 0; r < nrows && rc == CHIDB_OK; r++)
+        for (uint32_t i = 0; i < nCols && rc == CHIDB_OK; i++)
+        {
+            const chidb_value *v = &rows[r].values[i];
+            int param = r * nCols + i + 1;
+
+            if (v->type == SQL_INTEGER_4BYTE)
+                rc = chidb_bind_int(stmt, param, v->i);
+            else if (v->type == SQL_TEXT)
+                rc = chidb_bind_text(stmt, param, v->s);
+            else
+                rc = chidb_bind_null(stmt, param);
+        }
+
+    if (rc == CHIDB_OK)
+        rc = chidb_step(stmt);
+    chidb_reset(stmt);
+
+    return rc == CHIDB_DONE ? CHIDB_OK : rc;
+}
+
+int chidb_insert_batch(chidb *db, const char *table, const chidb_value *values, int nrows)
+{
+    Schema *schema;
+    SchemaTable *t;
+    batch_row *rows;
+    chidb_stmt *stmt;
+    char *sql;
+    int rc, r, n;
+
+    if (nrows <= 0)
+        return CHIDB_OK;
+
+    rc = chidb_Schema_get(db, &schema);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (chidb_Schema_findTable(schema, table, &t) != CHIDB_OK || t->pk < 0)
+        return CHIDB_EINVALIDSQL;
+
+    rows = malloc(nrows * sizeof(batch_row));
+    if (rows == NULL)
+        return CHIDB_ENOMEM;
+
+    /* All the values are checked before any row is inserted */
+    for (r = 0; r < nrows; r++)
+    {
+        rows[r].values = values + (size_t) r * t->nCols;
+        for (uint32_t i = 0; i < t->nCols; i++)
+            if (!batch_value_ok(&rows[r].values[i]) ||
+                (i == (uint32_t) t->pk && rows[r].values[i].type != SQL_INTEGER_4BYTE))
+            {
+                free(rows);
+                return CHIDB_EMISMATCH;
+            }
+        rows[r].key = rows[r].values[t->pk].i;
+    }
+
+    /* Sorting the rows makes each INSERT statement insert keys that come
+     * after those inserted by the previous one */
+    qsort(rows, nrows, sizeof(batch_row), batch_row_cmp);
+
+    /* The rows are inserted BATCH_ROWS at a time, with the same statement,
+     * and then the ones that are left, with a statement of fewer rows */
+    r = 0;
+    while (r < nrows && rc == CHIDB_OK)
+    {
+        n = nrows - r < BATCH_ROWS ? nrows - r : BATCH_ROWS;
+
+        sql = batch_sql(t->name, t->nCols, n);
+        if (sql == NULL)
+        {
+            rc = CHIDB_ENOMEM;
+            break;
+        }
+
+        /* If it fails, chidb_prepare frees the statement itself */
+        rc = chidb_prepare(db, sql, &stmt);
+        free(sql);
+        if (rc != CHIDB_OK)
+            break;
+
+        for (; nrows - r >= n && rc == CHIDB_OK; r += n)
+            rc = batch_insert(stmt, rows + r, t->nCols, n);
+
+        chidb_finalize(stmt);
+    }
+
+    free(rows);
+
+    return rc;
 }
 
 int chidb_column_count(chidb_stmt *stmt)
@@ -194,7 +513,7 @@ int chidb_column_type(chidb_stmt *stmt, int col)
 				return SQL_INTEGER_4BYTE;
 				break;
 			case REG_STRING:
-				return 2 * strlen(r->value.s) + SQL_TEXT;
+				return 2 * r->len + SQL_TEXT;
 				break;
 			default:
 				return SQL_NOTVALID;
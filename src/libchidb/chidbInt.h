@@ -72,6 +72,10 @@ typedef uint32_t chidb_key_t;
 
 /* Forward declaration */
 typedef struct BTree BTree;
+typedef struct Dict Dict;
+typedef struct StmtCache StmtCache;
+typedef struct Schema Schema;
+typedef struct Stats Stats;
 
 
   /* code */
@@ -84,6 +88,22 @@ typedef struct BTree BTree;
 struct chidb
 {
     BTree   *bt;
+
+    /* Dictionaries that have been loaded into memory (see dict.c) */
+    Dict    **dicts;
+    uint32_t nDicts;
+
+    /* Compiled statements that are not in use (see stmt-cache.c) */
+    StmtCache *stmtCache;
+
+    /* Incremented whenever the schema is modified */
+    uint32_t schemaVersion;
+
+    /* In-memory copy of the schema table (see schema.c) */
+    Schema *schema;
+
+    /* In-memory copy of the statistics collected by ANALYZE (see stats.c) */
+    Stats *stats;
 };
 
 #endif /*CHIDBINT_H_*/
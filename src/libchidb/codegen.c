@@ -3,6 +3,84 @@
  *
  *  SQL -> DBM Code Generator
  *
+ * This module compiles a SQL statement (as produced by chisql_parser and
+ * chidb_stmt_optimize) into a DBM program.
+ *
+ * A SELECT statement is compiled from its plan (see optimizer.c) or, if
+ * it has none, from its relational algebra (see SRA_desugar). The tables in the RA tree are scanned with nested loops,
+ * in the order in which they appear in the tree (which, in a plan, is
+ * the join order chosen by the optimizer), and the Sigma
+ * conditions are split into conjuncts, each of which is evaluated in the
+ * outermost loop where all the columns it refers to are available. This
+ * way, a row is discarded as soon as possible, before any more columns
+ * are loaded or any inner loops are run. A conjunct that compares a
+ * table's INTEGER PRIMARY KEY with a value that is known before the
+ * table's loop starts is not evaluated at all: instead, the loop seeks
+ * directly to the matching rows. The same goes for a conjunct on an
+ * indexed column: the loop then scans the matching range of the index,
+ * and seeks each entry's row in the table, unless the index is covering
+ * (the only columns of the table that are used are the indexed column
+ * and the primary key, which are in the index's entries, so the table is
+ * not read at all, see cg_covers). A conjunct col IN (...) on
+ * either kind of column seeks each of the values in the list in turn.
+ * An index on several columns is a key B-Tree (see keytree.c), which is
+ * scanned from the key made from the equalities on its leading columns
+ * and a bound of the next one, to the key made from the same equalities
+ * and the other bound (see cg_prefix and cg_key_range). The conjuncts are
+ * still evaluated on each of its rows.
+ * Any other IN is looked up in a value list, which is filled with the
+ * values once, before the loops (see cg_load_consts). If the database
+ * has been analyzed, the statistics decide which of these access paths is used
+ * (see cg_access_path). A table that would still be scanned in full for
+ * each row of the outer loops, and that is joined to them by an equality,
+ * is read once into a hash table instead, and its loop only visits the
+ * rows with a matching key (see cg_hash_path). Outer joins of two tables,
+ * which have no RA, are compiled from the SRA into hash joins (see
+ * cg_outer_join). With an ORDER BY, the result rows (preceded by their
+ * sort key) are added to a sorter, which produces them once the loops
+ * are done. With a GROUP BY or aggregate functions, the loops instead
+ * feed the grouping column and the arguments of the aggregate functions
+ * into a hash aggregator (see cg_aggregate), and the result rows are
+ * built from the groups it produces once the loops are done. If the rows
+ * are read in order of the GROUP BY column, each group is produced as soon
+ * as its last row has been read instead (see cg_stream), and a COUNT(*)
+ * of a whole table just counts the entries of its B-Tree. With a
+ * DISTINCT, the result rows go through a hash set (an aggregator with no
+ * functions) before they are produced, and the operands of a UNION,
+ * INTERSECT or EXCEPT are compiled one after the other, into a hash set
+ * shared by both of them (see cg_compound). If the rows of a single table
+ * can be read in order of the ORDER BY column, through the primary key or
+ * an index (backwards, for a descending order), they are not sorted at
+ * all (see cg_order). A LIMIT stops the program once the last row has
+ * been produced, and, with an ORDER BY, the sorter only keeps the rows
+ * that can still be among the first ones (a top-n sort).
+ *
+ * Each column is loaded (with Column, or Key for the primary key) into
+ * its own register at most once per row, right before the first conjunct
+ * that needs it or, if it is only needed by an inner loop or by the
+ * result row, once all the conjuncts of its loop have been evaluated.
+ * The registers of the columns in the result row are the result row's
+ * registers, so they do not have to be copied. Constants (literals and
+ * parameters) are loaded once, before the loops. The same goes for the
+ * expressions computed from them (the optimizer has already folded those
+ * that only involve literals), which are computed with the DBM's
+ * arithmetic instructions (and Concat): each distinct expression is
+ * computed into its own register at most once per row, in the loop of
+ * the innermost table that it refers to, so that an expression that is
+ * both in a condition and in the result row is only computed once.
+ *
+ * The dictionary-encoded columns of a table (see dict.c) are stored as
+ * codes. INSERT encodes their values before the record is made. A SELECT
+ * decodes them right after they are loaded, unless all they are used for
+ * is being compared for equality with constants (the constants are then
+ * encoded instead, once, before the loops, and the codes are compared,
+ * see cg_dict_cmp), being the GROUP BY column, or being a column of the
+ * result row of a DISTINCT: the aggregator then groups the codes, and
+ * they are only decoded in the rows that it produces (see cg_agg_row).
+ *
+ * All the registers and cursors used by the program are obtained with
+ * chidb_stmt_alloc_regs and chidb_stmt_alloc_cursor.
+ *
  */
 
 /*
@@ -37,49 +115,3914 @@
  *
  */
 
+#include <ctype.h>
 #include <chidb/chidb.h>
 #include <chisql/chisql.h>
 #include "dbm.h"
+#include "schema.h"
+#include "stats.h"
 #include "util.h"
 
-  /* ...code... */
+/* Maximum number of aggregate functions in a SELECT (the key and the
+ * functions of a group must fit in a record) */
+#define CG_MAX_AGGS (254)
 
-int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
+
+/* A conjunct of a SELECT's conditions */
+typedef struct cg_pred
+{
+    Condition_t *cond;
+    int32_t level;          /* Loop where it is evaluated (-1 if it refers to no table) */
+    bool seek;              /* Is it evaluated by seeking the loop's cursor? */
+    bool build;             /* Is it evaluated when the table's hash table is built? */
+} cg_pred_t;
+
+/* The way a table's rows are accessed in its loop: the conjuncts that
+ * are evaluated by seeking the table's cursor, or the cursor of one of
+ * its indexes (or NULL). col is the primary key or the indexed column.
+ * In a hash join, col is the column that the hash table is keyed by.
+ *
+ * An index on several columns is read with a key scan (cursor is the key
+ * scan's number): col is its first column, prefix has the equalities on
+ * its leading columns, and lower and upper bound the column after them.
+ * None of these conjuncts is marked as a seek (see cg_access_path) */
+typedef struct cg_path
+{
+    SchemaIndex *index;     /* Index that is scanned (NULL to scan the table itself) */
+    int32_t cursor;         /* Cursor of the index */
+    int32_t hash;           /* Hash table with the table's rows (-1 if it is not a hash join) */
+    int32_t col;
+    cg_pred_t *eq;          /* col = v: seek to v (there is no loop, unless it is an index or a hash table) */
+    cg_pred_t *lower;       /* col > v, col >= v: start the loop at v */
+    cg_pred_t *upper;       /* col < v, col <= v: end the loop at v */
+    cg_pred_t *in;          /* col IN (...): seek to each value in the list, in order */
+    bool last;              /* With no bounds: start at the last entry, instead of the first one */
+    bool desc;              /* Visit the entries backwards, from the last one (see cg_order) */
+    bool once;              /* Only visit the first entry (see cg_stream) */
+    bool covering;          /* Does the index have all the columns that are used (see cg_covers)? */
+    cg_pred_t *prefix[SCHEMA_MAX_INDEX_COLS];
+    uint32_t nPrefix;       /* Number of leading columns of an index on several columns with an equality */
+} cg_path_t;
+
+/* A table in the FROM clause of a SELECT */
+typedef struct cg_table
+{
+    const char *name;       /* Name used to refer to the table (its alias, if it has one) */
+    SchemaTable *schema;
+    int32_t cursor;
+    int32_t *colReg;        /* Register of each column (-1 if the column is not used) */
+    bool *loaded;           /* Has the column been loaded, at the current point of the program? */
+    bool *compared;         /* Is the (dictionary-encoded) column compared with a constant? */
+    bool *coded;            /* Does the column's register have its code, instead of its value? */
+    bool *valued;           /* Is the (dictionary-encoded) column's value needed, and not only its code? */
+    int32_t dict;           /* Register with the root page of the table's dictionary (-1 if not needed) */
+    cg_path_t path;
+    int32_t block;          /* In a hash join, the columns are in consecutive registers, from this one */
+    uint32_t nBlock;
+} cg_table_t;
+
+/* A column of the result row */
+typedef struct cg_output
+{
+    Expression_t *src;      /* Expression in the Pi */
+    bool star;              /* Is it one of the columns of a "*"? */
+    Expression_t *expr;     /* Constant or computed expression (NULL if the column is a column of a table) */
+    bool calc;              /* Is it computed (see cg_calc_t)? */
+    uint32_t table;
+    int32_t col;
+    int32_t agg;            /* Aggregate function (-1 if the column is not one) */
+    bool copy;              /* Does the column's value have to be copied to the result row? */
+} cg_output_t;
+
+/* A constant (a literal or a parameter), which is loaded before the loops */
+typedef struct cg_const
+{
+    const void *key;        /* The Expression_t or Literal_t of the constant */
+    Literal_t *lit;         /* NULL for NULL */
+    int32_t reg;
+} cg_const_t;
+
+/* A constant that is compared with a dictionary-encoded column, encoded
+ * with the column's dictionary (see cg_dict_cmp) */
+typedef struct cg_code
+{
+    const void *key;        /* The Expression_t of the constant */
+    uint32_t table;
+    int32_t col;
+    int32_t reg;            /* Register with the code (-1 if the column is decoded, instead) */
+} cg_code_t;
+
+/* The values of an IN condition, which are added to a value list (with
+ * a register to load each of them into) before the loops */
+typedef struct cg_list
+{
+    Condition_t *cond;
+    int32_t list;
+    int32_t reg;
+} cg_list_t;
+
+/* An expression that is computed from the columns of a row (with the
+ * DBM's arithmetic instructions, or with Concat). Identical expressions
+ * share the same register, and they are computed once per row of their
+ * loop, right before the first conjunct that needs them or, if they are
+ * only needed by the inner loops and the result row, once all the
+ * conjuncts of the loop have been evaluated (like the columns) */
+typedef struct cg_calc
+{
+    Expression_t *expr;     /* First occurrence of the expression */
+    int32_t reg;
+    int32_t level;          /* Loop where it is computed (-1, before the loops, if it refers to no table) */
+    bool computed;          /* Has it been computed, at the current point of the program? */
+} cg_calc_t;
+
+/* Code generator */
+typedef struct codegen
+{
+    chidb_stmt *stmt;
+    Schema *schema;
+    Stats *stats;
+    uint32_t nEntries;      /* Number of entries added to the schema table */
+
+    /* Error when emitting an instruction or allocating a register (these
+     * errors are checked once all the program has been generated) */
+    int rc;
+
+    /* Address of the next instruction */
+    uint32_t addr;
+
+    /* Labels. Jumps to a label are emitted with the label number as their
+     * jump address, and they are fixed once all the program has been generated */
+    int32_t *labels;
+    uint32_t nLabels;
+    uint32_t *fixups;
+    uint32_t nFixups;
+
+    cg_table_t *tables;
+    uint32_t nTables;
+    cg_pred_t *preds;
+    uint32_t nPreds;
+    cg_output_t *outputs;
+    uint32_t nOutputs;
+    int32_t rr;             /* First register of the result row */
+    int32_t corrupt;        /* Label of the Halt for index entries with no row (-1 if there are none) */
+    cg_const_t *consts;
+    uint32_t nConsts;
+    cg_code_t *codes;
+    uint32_t nCodes;
+    cg_list_t *lists;
+    uint32_t nLists;
+    uint32_t nValueLists;
+    cg_calc_t *calcs;
+    uint32_t nCalcs;
+    uint32_t nHashes;
+    uint32_t nBatches;
+    uint32_t nKeyScans;
+
+    /* Outer join (see cg_outer_join): are the rows of the first table
+     * (the probe side) and of the second table (the build side) that
+     * have no match kept? matched is set once a row of the first table
+     * has a match, and one is a register with 1 */
+    bool outer;
+    bool keepProbe;
+    bool keepBuild;
+    int32_t matched;
+    int32_t one;
+
+    /* ORDER BY: the result rows are added to a sorter (-1 if there is no
+     * ORDER BY), with the sort key in the register before the result row */
+    int32_t sorter;
+    Expression_t *order;
+    int32_t key;
+
+    /* LIMIT and OFFSET: the result rows that are still to be produced,
+     * and to be skipped, are counted down in registers limit and offset
+     * (-1 if there is no LIMIT, or no OFFSET). Once the last one has been
+     * produced, the program jumps to the label stop, at its Halt */
+    int32_t limit;
+    int32_t offset;
+    int32_t stop;
+
+    /* Aggregation (see cg_aggregate): the rows are added to an aggregator
+     * (-1 if there are no aggregate functions and no GROUP BY), with their
+     * key (the GROUP BY column, if there is one) followed by the argument
+     * of each aggregate function, in consecutive registers from aggReg.
+     * AggRow stores each group in the same registers. If the rows are
+     * read in order of the GROUP BY column, the aggregator is sorted. If
+     * the only function is COUNT(*) of a whole table, there is no
+     * aggregator: the table's entries are counted instead */
+    int32_t agg;
+    Expression_t *group;
+    Expression_t **aggs;
+    uint32_t nAggs;
+    int32_t aggReg;
+    bool sorted;
+    bool count;
+
+    /* DISTINCT (see cg_distinct): the result rows (preceded by their sort
+     * key, with an ORDER BY) are added to a hash set, an aggregator with no
+     * functions (-1 if there is no DISTINCT, or the rows are distinct
+     * already), and each row of the set is copied to the registers from
+     * distinctReg. If the rows are read in order, the set is sorted */
+    int32_t distinct;
+    int32_t distinctReg;
+    bool distinctSorted;
+
+    /* Set operations (see cg_compound): the result rows of an operand are
+     * added to the operation's hash set instead (-1 if the SELECT is not an
+     * operand), with the arguments of its functions from setArgs */
+    int32_t set;
+    int32_t setArgs;
+    uint32_t nAggregators;
+} codegen_t;
+
+
+/* Grows an array by one element. Returns the new element (or NULL) */
+static void *cg_grow(void **array, uint32_t *n, size_t size)
+{
+    void *a = realloc(*array, size * (*n + 1));
+
+    if (a == NULL)
+        return NULL;
+
+    *array = a;
+    return (char *) a + size * (*n)++;
+}
+
+
+/* Emits an instruction */
+static void cg_emit(codegen_t *cg, opcode_t opcode, int32_t p1, int32_t p2, int32_t p3, char *p4)
+{
+    chidb_dbm_op_t op = {opcode, p1, p2, p3, p4};
+    int rc = chidb_stmt_set_op(cg->stmt, &op, cg->addr++);
+
+    if (rc != CHIDB_OK && cg->rc == CHIDB_OK)
+        cg->rc = rc;
+}
+
+/* Creates a new label, which doesn't refer to any address yet */
+static int32_t cg_label(codegen_t *cg)
+{
+    int32_t *label = cg_grow((void **) &cg->labels, &cg->nLabels, sizeof(int32_t));
+
+    if (label == NULL)
+    {
+        cg->rc = CHIDB_ENOMEM;
+        return 0;
+    }
+
+    *label = -1;
+    return cg->nLabels - 1;
+}
+
+/* Makes a label refer to the address of the next instruction */
+static void cg_bind(codegen_t *cg, int32_t label)
+{
+    if (cg->rc == CHIDB_OK)
+        cg->labels[label] = cg->addr;
+}
+
+/* Emits a jump instruction (where p2 is the jump address) to a label */
+static void cg_jump(codegen_t *cg, opcode_t opcode, int32_t p1, int32_t label, int32_t p3)
+{
+    uint32_t *fixup = cg_grow((void **) &cg->fixups, &cg->nFixups, sizeof(uint32_t));
+
+    if (fixup == NULL)
+    {
+        cg->rc = CHIDB_ENOMEM;
+        return;
+    }
+
+    *fixup = cg->addr;
+    cg_emit(cg, opcode, p1, label, p3, NULL);
+}
+
+/* Allocates n consecutive registers */
+static int32_t cg_regs(codegen_t *cg, uint32_t n)
+{
+    int32_t r = 0;
+    int rc = chidb_stmt_alloc_regs(cg->stmt, n, &r);
+
+    if (rc != CHIDB_OK && cg->rc == CHIDB_OK)
+        cg->rc = rc;
+
+    return r;
+}
+
+/* Allocates a cursor */
+static int32_t cg_cursor(codegen_t *cg)
+{
+    int32_t c = 0;
+    int rc = chidb_stmt_alloc_cursor(cg->stmt, &c);
+
+    if (rc != CHIDB_OK && cg->rc == CHIDB_OK)
+        cg->rc = rc;
+
+    return c;
+}
+
+/* Emits an instruction that loads a string into a register */
+static void cg_string(codegen_t *cg, const char *s, int32_t reg)
+{
+    cg_emit(cg, Op_String, strlen(s), reg, 0, (char *) s);
+}
+
+
+/*
+ * CONSTANTS
+ */
+
+/* Returns the constant with the given key (or NULL) */
+static cg_const_t *cg_find_const(codegen_t *cg, const void *key)
+{
+    for (uint32_t i = 0; i < cg->nConsts; i++)
+        if (cg->consts[i].key == key)
+            return &cg->consts[i];
+
+    return NULL;
+}
+
+/* Adds a constant, to be loaded into register reg (if reg is -1, a
+ * register is allocated for it) */
+static int cg_add_const(codegen_t *cg, const void *key, Literal_t *lit, int32_t reg)
+{
+    cg_const_t *c;
+
+    /* The DBM has no floating point registers */
+    if (lit != NULL && lit->t == TYPE_DOUBLE)
+        return CHIDB_EINVALIDSQL;
+
+    c = cg_grow((void **) &cg->consts, &cg->nConsts, sizeof(cg_const_t));
+    if (c == NULL)
+        return CHIDB_ENOMEM;
+
+    c->key = key;
+    c->lit = lit;
+    c->reg = reg >= 0 ? reg : cg_regs(cg, 1);
+
+    return CHIDB_OK;
+}
+
+/* Adds the values of an IN condition, which are loaded into a value
+ * list (unless they already are) */
+static int cg_add_list(codegen_t *cg, Condition_t *cond)
+{
+    cg_list_t *l;
+
+    for (uint32_t i = 0; i < cg->nLists; i++)
+        if (cg->lists[i].cond == cond)
+            return CHIDB_OK;
+
+    for (Literal_t *lit = cond->cond.in.values_list; lit; lit = lit->next)
+        if (lit->t == TYPE_DOUBLE)
+            return CHIDB_EINVALIDSQL;
+
+    if ((l = cg_grow((void **) &cg->lists, &cg->nLists, sizeof(cg_list_t))) == NULL)
+        return CHIDB_ENOMEM;
+
+    l->cond = cond;
+    l->list = cg->nValueLists++;
+    l->reg = cg_regs(cg, 1);
+
+    return CHIDB_OK;
+}
+
+/* Returns the value list of an IN condition */
+static cg_list_t *cg_list(codegen_t *cg, Condition_t *cond)
+{
+    for (uint32_t i = 0; i < cg->nLists; i++)
+        if (cg->lists[i].cond == cond)
+            return &cg->lists[i];
+
+    return NULL;
+}
+
+/* Emits the instruction that loads a literal (or NULL) into a register */
+static void cg_load_lit(codegen_t *cg, Literal_t *lit, int32_t reg)
+{
+    char buf[2];
+
+    if (lit == NULL)
+        cg_emit(cg, Op_Null, 0, reg, 0, NULL);
+    else switch (lit->t)
+    {
+    case TYPE_INT:
+        cg_emit(cg, Op_Integer, lit->val.ival, reg, 0, NULL);
+        break;
+    case TYPE_CHAR:
+        buf[0] = lit->val.cval;
+        buf[1] = '\0';
+        cg_string(cg, buf, reg);
+        break;
+    case TYPE_TEXT:
+        cg_string(cg, lit->val.strval, reg);
+        break;
+    case TYPE_PARAM:
+        cg_emit(cg, Op_Variable, lit->val.ival, reg, 0, NULL);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Emits the instructions that load the constants, and the values of
+ * the value lists */
+static void cg_load_consts(codegen_t *cg)
+{
+    for (uint32_t i = 0; i < cg->nConsts; i++)
+        cg_load_lit(cg, cg->consts[i].lit, cg->consts[i].reg);
+
+    /* The root pages of the dictionaries, and the codes of the constants
+     * that are compared with the columns they encode */
+    for (uint32_t i = 0; i < cg->nTables; i++)
+        if (cg->tables[i].dict >= 0)
+            cg_emit(cg, Op_Integer, cg->tables[i].schema->dict, cg->tables[i].dict, 0, NULL);
+
+    for (uint32_t i = 0; i < cg->nCodes; i++)
+    {
+        cg_code_t *code = &cg->codes[i];
+        cg_table_t *t = &cg->tables[code->table];
+
+        if (code->reg < 0)
+            continue;
+
+        cg_emit(cg, Op_SCopy, cg_find_const(cg, code->key)->reg, code->reg, 0, NULL);
+        cg_emit(cg, Op_DictEncode, t->dict, code->reg, 0, NULL);
+    }
+
+    for (uint32_t i = 0; i < cg->nLists; i++)
+    {
+        cg_list_t *l = &cg->lists[i];
+
+        cg_emit(cg, Op_ListOpen, l->list, 0, 0, NULL);
+        for (Literal_t *lit = l->cond->cond.in.values_list; lit; lit = lit->next)
+        {
+            cg_load_lit(cg, lit, l->reg);
+            cg_emit(cg, Op_ListAdd, l->list, l->reg, 0, NULL);
+        }
+    }
+}
+
+
+/*
+ * SELECT
+ */
+
+/* Finds the table and column that a column reference refers to */
+static int cg_find_column(codegen_t *cg, ColumnReference_t *ref, uint32_t *table, int32_t *col)
+{
+    uint32_t matches = 0;
+
+    for (uint32_t i = 0; i < cg->nTables; i++)
+    {
+        if (ref->tableName != NULL && strcasecmp(ref->tableName, cg->tables[i].name) != 0)
+            continue;
+
+        if (chidb_Schema_findColumn(cg->tables[i].schema, ref->columnName, col) == CHIDB_OK)
+        {
+            *table = i;
+            matches++;
+        }
+    }
+
+    /* Unknown or ambiguous column */
+    if (matches != 1)
+        return CHIDB_EINVALIDSQL;
+
+    /* Find the column again, since col is the last match */
+    return chidb_Schema_findColumn(cg->tables[*table].schema, ref->columnName, col);
+}
+
+/* Are two expressions the same (the same columns and literals, combined
+ * with the same operators)? */
+static bool cg_same_expr(codegen_t *cg, Expression_t *e1, Expression_t *e2)
+{
+    uint32_t t1, t2;
+    int32_t c1, c2;
+    Literal_t *l1, *l2;
+
+    if (e1->t != e2->t)
+        return false;
+
+    switch (e1->t)
+    {
+    case EXPR_TERM:
+        break;
+    case EXPR_NEG:
+        return cg_same_expr(cg, e1->expr.unary.expr, e2->expr.unary.expr);
+    default:
+        return cg_same_expr(cg, e1->expr.binary.expr1, e2->expr.binary.expr1) &&
+               cg_same_expr(cg, e1->expr.binary.expr2, e2->expr.binary.expr2);
+    }
+
+    if (e1->expr.term.t != e2->expr.term.t)
+        return false;
+
+    switch (e1->expr.term.t)
+    {
+    case TERM_NULL:
+        return true;
+    case TERM_COLREF:
+        return cg_find_column(cg, e1->expr.term.ref, &t1, &c1) == CHIDB_OK &&
+               cg_find_column(cg, e2->expr.term.ref, &t2, &c2) == CHIDB_OK &&
+               t1 == t2 && c1 == c2;
+    case TERM_LITERAL:
+        l1 = e1->expr.term.val;
+        l2 = e2->expr.term.val;
+        if (l1->t != l2->t)
+            return false;
+        switch (l1->t)
+        {
+        case TYPE_INT:
+        case TYPE_PARAM:
+            return l1->val.ival == l2->val.ival;
+        case TYPE_CHAR:
+            return l1->val.cval == l2->val.cval;
+        case TYPE_TEXT:
+            return strcmp(l1->val.strval, l2->val.strval) == 0;
+        default:
+            return false;
+        }
+    default:
+        return false;
+    }
+}
+
+/* Returns the number of the innermost table that an expression refers
+ * to (-1 if it refers to no table) in level */
+static int cg_expr_level(codegen_t *cg, Expression_t *expr, int32_t *level)
+{
+    uint32_t table;
+    int32_t col, level1, level2;
+    int rc;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        break;
+    case EXPR_NEG:
+        return cg_expr_level(cg, expr->expr.unary.expr, level);
+    default:
+        if ((rc = cg_expr_level(cg, expr->expr.binary.expr1, &level1)) != CHIDB_OK ||
+            (rc = cg_expr_level(cg, expr->expr.binary.expr2, &level2)) != CHIDB_OK)
+            return rc;
+        *level = level1 > level2 ? level1 : level2;
+        return CHIDB_OK;
+    }
+
+    switch (expr->expr.term.t)
+    {
+    case TERM_LITERAL:
+    case TERM_NULL:
+        *level = -1;
+        return CHIDB_OK;
+    case TERM_COLREF:
+        rc = cg_find_column(cg, expr->expr.term.ref, &table, &col);
+        *level = table;
+        return rc;
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
+}
+
+/* Same as cg_expr_level, but with a condition */
+static int cg_cond_level(codegen_t *cg, Condition_t *cond, int32_t *level)
+{
+    int32_t level1, level2;
+    int rc;
+
+    switch (cond->t)
+    {
+    case RA_COND_EQ:
+    case RA_COND_LT:
+    case RA_COND_GT:
+    case RA_COND_LEQ:
+    case RA_COND_GEQ:
+        if ((rc = cg_expr_level(cg, cond->cond.comp.expr1, &level1)) != CHIDB_OK ||
+            (rc = cg_expr_level(cg, cond->cond.comp.expr2, &level2)) != CHIDB_OK)
+            return rc;
+        break;
+    case RA_COND_AND:
+    case RA_COND_OR:
+        if ((rc = cg_cond_level(cg, cond->cond.binary.cond1, &level1)) != CHIDB_OK ||
+            (rc = cg_cond_level(cg, cond->cond.binary.cond2, &level2)) != CHIDB_OK)
+            return rc;
+        break;
+    case RA_COND_NOT:
+        return cg_cond_level(cg, cond->cond.unary.cond, level);
+    case RA_COND_IN:
+        return cg_expr_level(cg, cond->cond.in.expr, level);
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
+
+    *level = level1 > level2 ? level1 : level2;
+    return CHIDB_OK;
+}
+
+/* Does an expression refer to the given table (if local is false) or to
+ * no table other than the given one (if local is true)? */
+static bool cg_expr_refers(codegen_t *cg, Expression_t *expr, uint32_t table, bool local)
+{
+    uint32_t t;
+    int32_t col;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        if (expr->expr.term.t != TERM_COLREF)
+            return local;
+        return cg_find_column(cg, expr->expr.term.ref, &t, &col) == CHIDB_OK && t == table;
+    case EXPR_NEG:
+        return cg_expr_refers(cg, expr->expr.unary.expr, table, local);
+    default:
+        if (local)
+            return cg_expr_refers(cg, expr->expr.binary.expr1, table, true) &&
+                   cg_expr_refers(cg, expr->expr.binary.expr2, table, true);
+        return cg_expr_refers(cg, expr->expr.binary.expr1, table, false) ||
+               cg_expr_refers(cg, expr->expr.binary.expr2, table, false);
+    }
+}
+
+/* Does a condition refer to no table other than the given one? */
+static bool cg_cond_local(codegen_t *cg, Condition_t *cond, uint32_t table)
+{
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        return cg_cond_local(cg, cond->cond.binary.cond1, table) &&
+               cg_cond_local(cg, cond->cond.binary.cond2, table);
+    case RA_COND_NOT:
+        return cg_cond_local(cg, cond->cond.unary.cond, table);
+    case RA_COND_IN:
+        return cg_expr_refers(cg, cond->cond.in.expr, table, true);
+    default:
+        return cg_expr_refers(cg, cond->cond.comp.expr1, table, true) &&
+               cg_expr_refers(cg, cond->cond.comp.expr2, table, true);
+    }
+}
+
+/* Returns the computed expression that is the same as an expression (or NULL) */
+static cg_calc_t *cg_find_calc(codegen_t *cg, Expression_t *expr)
+{
+    for (uint32_t i = 0; i < cg->nCalcs; i++)
+        if (cg_same_expr(cg, cg->calcs[i].expr, expr))
+            return &cg->calcs[i];
+
+    return NULL;
+}
+
+static int cg_use_expr(codegen_t *cg, Expression_t *expr);
+
+/* Adds an expression that is computed into register reg (if reg is -1, a
+ * register is allocated for it), unless the same expression has been
+ * added already, and allocates the registers used by its operands */
+static int cg_add_calc(codegen_t *cg, Expression_t *expr, int32_t reg)
+{
+    cg_calc_t *c;
+    int32_t level;
+    int rc;
+
+    if (cg_find_calc(cg, expr) != NULL)
+        return CHIDB_OK;
+
+    if (expr->t == EXPR_NEG)
+        rc = cg_use_expr(cg, expr->expr.unary.expr);
+    else if ((rc = cg_use_expr(cg, expr->expr.binary.expr1)) == CHIDB_OK)
+        rc = cg_use_expr(cg, expr->expr.binary.expr2);
+
+    if (rc != CHIDB_OK || (rc = cg_expr_level(cg, expr, &level)) != CHIDB_OK)
+        return rc;
+
+    if ((c = cg_grow((void **) &cg->calcs, &cg->nCalcs, sizeof(cg_calc_t))) == NULL)
+        return CHIDB_ENOMEM;
+
+    c->expr = expr;
+    c->reg = reg >= 0 ? reg : cg_regs(cg, 1);
+    c->level = level;
+    c->computed = false;
+
+    return CHIDB_OK;
+}
+
+/* Is a condition an equality (col = v) of a dictionary-encoded column
+ * and a constant (a string, or a parameter)? If so, returns the column
+ * and the constant */
+static bool cg_dict_cmp(codegen_t *cg, Condition_t *cond, uint32_t *table, int32_t *col, Expression_t **v)
+{
+    Expression_t *e[2];
+
+    if (cond->t != RA_COND_EQ)
+        return false;
+
+    e[0] = cond->cond.comp.expr1;
+    e[1] = cond->cond.comp.expr2;
+
+    for (int i = 0; i < 2; i++)
+    {
+        Expression_t *c = e[i], *k = e[1 - i];
+        SchemaTable *t;
+
+        if (c->t != EXPR_TERM || c->expr.term.t != TERM_COLREF ||
+            k->t != EXPR_TERM || k->expr.term.t != TERM_LITERAL ||
+            (k->expr.term.val->t != TYPE_TEXT && k->expr.term.val->t != TYPE_PARAM) ||
+            cg_find_column(cg, c->expr.term.ref, table, col) != CHIDB_OK)
+            continue;
+
+        t = cg->tables[*table].schema;
+        if (t->dict != 0 && t->encoded[*col])
+        {
+            *v = k;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Adds a constant that is compared with a dictionary-encoded column */
+static int cg_add_code(codegen_t *cg, Expression_t *v, uint32_t table, int32_t col)
+{
+    cg_code_t *code = cg_grow((void **) &cg->codes, &cg->nCodes, sizeof(cg_code_t));
+
+    if (code == NULL)
+        return CHIDB_ENOMEM;
+
+    code->key = v;
+    code->table = table;
+    code->col = col;
+    code->reg = -1;
+
+    return CHIDB_OK;
+}
+
+/* Returns the register with the code of a constant that is compared with
+ * a dictionary-encoded column, if the column's code is compared (or -1) */
+static int32_t cg_code_reg(codegen_t *cg, const void *key, uint32_t table, int32_t col)
+{
+    for (uint32_t i = 0; i < cg->nCodes; i++)
+        if (cg->codes[i].key == key && cg->codes[i].table == table && cg->codes[i].col == col)
+            return cg->codes[i].reg;
+
+    return -1;
+}
+
+/* Allocates the register of a column. Unless the column is only used as
+ * a key of the aggregator (the GROUP BY column), its value is needed */
+static int cg_use_col(codegen_t *cg, Expression_t *expr, bool key)
+{
+    uint32_t table;
+    int32_t col;
+    int rc;
+
+    rc = cg_find_column(cg, expr->expr.term.ref, &table, &col);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (cg->tables[table].colReg[col] < 0)
+        cg->tables[table].colReg[col] = cg_regs(cg, 1);
+    if (!key)
+        cg->tables[table].valued[col] = true;
+
+    return CHIDB_OK;
+}
+
+/* Allocates the registers (and adds the constants) used by an expression */
+static int cg_use_expr(codegen_t *cg, Expression_t *expr)
+{
+    if (expr->t != EXPR_TERM)
+        return cg_add_calc(cg, expr, -1);
+
+    switch (expr->expr.term.t)
+    {
+    case TERM_LITERAL:
+        return cg_add_const(cg, expr, expr->expr.term.val, -1);
+    case TERM_NULL:
+        return cg_add_const(cg, expr, NULL, -1);
+    default:
+        return cg_use_col(cg, expr, false);
+    }
+}
+
+/* Same as cg_use_expr, but with a condition. A dictionary-encoded column
+ * that is compared with a constant doesn't get a register here: it gets
+ * one for its code if that is all it is used for (see cg_select) */
+static int cg_use_cond(codegen_t *cg, Condition_t *cond)
+{
+    Expression_t *v;
+    uint32_t table;
+    int32_t col;
+    int rc;
+
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        if ((rc = cg_use_cond(cg, cond->cond.binary.cond1)) != CHIDB_OK)
+            return rc;
+        return cg_use_cond(cg, cond->cond.binary.cond2);
+    case RA_COND_NOT:
+        return cg_use_cond(cg, cond->cond.unary.cond);
+    case RA_COND_IN:
+        if ((rc = cg_add_list(cg, cond)) != CHIDB_OK)
+            return rc;
+        return cg_use_expr(cg, cond->cond.in.expr);
+    default:
+        if (cg_dict_cmp(cg, cond, &table, &col, &v))
+        {
+            cg->tables[table].compared[col] = true;
+            if ((rc = cg_add_code(cg, v, table, col)) != CHIDB_OK)
+                return rc;
+            return cg_use_expr(cg, v);
+        }
+        if ((rc = cg_use_expr(cg, cond->cond.comp.expr1)) != CHIDB_OK)
+            return rc;
+        return cg_use_expr(cg, cond->cond.comp.expr2);
+    }
+}
+
+/* Emits the instruction that loads a column of the current row of a table */
+static void cg_load_column(codegen_t *cg, uint32_t table, int32_t col)
+{
+    cg_table_t *t = &cg->tables[table];
+
+    if (t->loaded[col])
+        return;
+
+    if (col == t->schema->pk)
+        cg_emit(cg, Op_Key, t->cursor, t->colReg[col], 0, NULL);
+    else
+        cg_emit(cg, Op_Column, t->cursor, col, t->colReg[col], NULL);
+
+    if (t->schema->dict != 0 && t->schema->encoded[col] && !t->coded[col])
+        cg_emit(cg, Op_DictDecode, t->dict, t->colReg[col], 0, NULL);
+
+    t->loaded[col] = true;
+}
+
+/* Opcode of the instruction that computes an expression */
+static opcode_t cg_calc_op(enum ExprType t)
+{
+    switch (t)
+    {
+    case EXPR_PLUS:
+        return Op_Add;
+    case EXPR_MINUS:
+        return Op_Subtract;
+    case EXPR_MULTIPLY:
+        return Op_Multiply;
+    case EXPR_DIVIDE:
+        return Op_Divide;
+    case EXPR_CONCAT:
+        return Op_Concat;
+    default:
+        return Op_Negate;
+    }
+}
+
+/* Returns the register with the value of an expression (emitting the
+ * instructions that load it, if it is a column that hasn't been loaded,
+ * or that compute it, if it is a computed expression that hasn't been
+ * computed) */
+static int32_t cg_value(codegen_t *cg, Expression_t *expr)
+{
+    uint32_t table;
+    int32_t col;
+    cg_calc_t *c;
+
+    if (expr->t != EXPR_TERM)
+    {
+        c = cg_find_calc(cg, expr);
+        if (!c->computed)
+        {
+            /* The operands of the expression that was added, which are the ones with registers */
+            expr = c->expr;
+            if (expr->t == EXPR_NEG)
+                cg_emit(cg, Op_Negate, cg_value(cg, expr->expr.unary.expr), c->reg, 0, NULL);
+            else
+                cg_emit(cg, cg_calc_op(expr->t), cg_value(cg, expr->expr.binary.expr1),
+                        cg_value(cg, expr->expr.binary.expr2), c->reg, NULL);
+            c->computed = true;
+        }
+        return c->reg;
+    }
+
+    if (expr->expr.term.t != TERM_COLREF)
+        return cg_find_const(cg, expr)->reg;
+
+    cg_find_column(cg, expr->expr.term.ref, &table, &col);
+    cg_load_column(cg, table, col);
+
+    return cg->tables[table].colReg[col];
+}
+
+/* Emits the instructions that compute the expressions of a loop (or, if
+ * level is -1, the ones that refer to no table) that haven't been computed */
+static void cg_compute(codegen_t *cg, int32_t level)
+{
+    for (uint32_t i = 0; i < cg->nCalcs; i++)
+        if (cg->calcs[i].level == level)
+            cg_value(cg, cg->calcs[i].expr);
+}
+
+/* Marks the expressions of a loop as not computed, so that they are
+ * computed again for the next row */
+static void cg_uncompute(codegen_t *cg, int32_t level)
+{
+    for (uint32_t i = 0; i < cg->nCalcs; i++)
+        if (cg->calcs[i].level == level)
+            cg->calcs[i].computed = false;
+}
+
+/* Emits the instructions that load the columns (and compute the
+ * expressions) used by a condition */
+static void cg_load_cond(codegen_t *cg, Condition_t *cond)
 {
-    int opnum = 0;
-    int nOps;
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        cg_load_cond(cg, cond->cond.binary.cond1);
+        cg_load_cond(cg, cond->cond.binary.cond2);
+        break;
+    case RA_COND_NOT:
+        cg_load_cond(cg, cond->cond.unary.cond);
+        break;
+    case RA_COND_IN:
+        cg_value(cg, cond->cond.in.expr);
+        break;
+    default:
+        cg_value(cg, cond->cond.comp.expr1);
+        cg_value(cg, cond->cond.comp.expr2);
+    }
+}
+
+/* Comparison instruction that jumps if (a op b) is true */
+static opcode_t cg_cmp_op(enum CondType t, bool negate)
+{
+    switch (t)
+    {
+    case RA_COND_EQ:
+        return negate ? Op_Ne : Op_Eq;
+    case RA_COND_LT:
+        return negate ? Op_Ge : Op_Lt;
+    case RA_COND_GT:
+        return negate ? Op_Le : Op_Gt;
+    case RA_COND_LEQ:
+        return negate ? Op_Gt : Op_Le;
+    default:
+        return negate ? Op_Lt : Op_Ge;
+    }
+}
+
+/* Emits the instruction that jumps to label if an expression is NULL
+ * (none, if it is a literal, which can't be NULL) */
+static void cg_null_jump(codegen_t *cg, Expression_t *expr, int32_t label)
+{
+    if (expr->t == EXPR_TERM && expr->expr.term.t == TERM_LITERAL)
+        return;
+
+    cg_jump(cg, Op_IsNull, cg_value(cg, expr), label, 0);
+}
+
+/* Emits the instructions that evaluate a condition (or its NOT, if negate
+ * is true), and jump to label if it is equal to jumpIf (otherwise, they
+ * continue with the next instruction). The NOTs are pushed down to the
+ * comparisons, as NOT (a AND b) is (NOT a OR NOT b), NOT (a OR b) is
+ * (NOT a AND NOT b) and NOT NOT a is a, even if a or b are NULL */
+static void cg_cond_neg(codegen_t *cg, Condition_t *cond, int32_t label, bool jumpIf, bool negate)
+{
+    Expression_t *v;
+    uint32_t table;
+    int32_t skip = 0, col, r1, r2;
+
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        /* (a AND b) is false if a is false, and (a OR b) is true if a is true.
+         * Otherwise, they are the same as b */
+        skip = cg_label(cg);
+        if (jumpIf == ((cond->t == RA_COND_OR) != negate))
+            cg_cond_neg(cg, cond->cond.binary.cond1, label, jumpIf, negate);
+        else
+            cg_cond_neg(cg, cond->cond.binary.cond1, skip, !jumpIf, negate);
+        cg_cond_neg(cg, cond->cond.binary.cond2, label, jumpIf, negate);
+        cg_bind(cg, skip);
+        return;
+    case RA_COND_NOT:
+        cg_cond_neg(cg, cond->cond.unary.cond, label, jumpIf, !negate);
+        return;
+    default:
+        break;
+    }
+
+    /* A comparison (or an IN) with a NULL operand is NULL, and so is its
+     * NOT: like false, it doesn't jump if jumpIf is true, and it jumps
+     * otherwise. Negating the comparison would turn it into true */
+    if (negate)
+    {
+        skip = cg_label(cg);
+        jumpIf = !jumpIf;
+        if (cond->t == RA_COND_IN)
+            cg_null_jump(cg, cond->cond.in.expr, jumpIf ? label : skip);
+        else
+        {
+            cg_null_jump(cg, cond->cond.comp.expr1, jumpIf ? label : skip);
+            cg_null_jump(cg, cond->cond.comp.expr2, jumpIf ? label : skip);
+        }
+    }
+
+    if (cond->t == RA_COND_IN)
+    {
+        /* The values are in a value list, which is searched for the expression's value */
+        cg_jump(cg, jumpIf ? Op_ListIn : Op_ListNotIn, cg_list(cg, cond)->list, label, cg_value(cg, cond->cond.in.expr));
+    }
+    else
+    {
+        /* The comparison instructions compare p3 with p1. A constant that
+         * is compared with the code of a column is replaced by its code */
+        r1 = cg_value(cg, cond->cond.comp.expr1);
+        r2 = cg_value(cg, cond->cond.comp.expr2);
+        if (cg_dict_cmp(cg, cond, &table, &col, &v) && cg->tables[table].coded[col])
+        {
+            if (v == cond->cond.comp.expr1)
+                r1 = cg_code_reg(cg, v, table, col);
+            else
+                r2 = cg_code_reg(cg, v, table, col);
+        }
+        cg_jump(cg, cg_cmp_op(cond->t, !jumpIf), r2, label, r1);
+    }
+    if (negate)
+        cg_bind(cg, skip);
+}
+
+/* Emits the instructions that evaluate a condition, and jump to label if
+ * the condition is equal to jumpIf (otherwise, they continue with the
+ * next instruction). The columns used by the condition must be loaded. */
+static void cg_cond(codegen_t *cg, Condition_t *cond, int32_t label, bool jumpIf)
+{
+    cg_cond_neg(cg, cond, label, jumpIf, false);
+}
+
+/* Adds the conjuncts of a condition to the SELECT's conjuncts */
+static int cg_add_conjuncts(codegen_t *cg, Condition_t *cond)
+{
+    cg_pred_t *pred;
+    int rc;
+
+    if (cond->t == RA_COND_AND)
+    {
+        if ((rc = cg_add_conjuncts(cg, cond->cond.binary.cond1)) != CHIDB_OK)
+            return rc;
+        return cg_add_conjuncts(cg, cond->cond.binary.cond2);
+    }
+
+    pred = cg_grow((void **) &cg->preds, &cg->nPreds, sizeof(cg_pred_t));
+    if (pred == NULL)
+        return CHIDB_ENOMEM;
+
+    pred->cond = cond;
+    pred->level = -1;
+    pred->seek = false;
+    pred->build = false;
+
+    return CHIDB_OK;
+}
+
+/* Adds a table to the SELECT's tables */
+static int cg_add_table(codegen_t *cg, const char *table_name, const char *name)
+{
+    SchemaTable *schema;
+    cg_table_t *t;
 
-    /* Manually load a program that just produces five result rows, with
-     * three columns: an integer identifier, the SQL query (text), and NULL. */
+    if (chidb_Schema_findTable(cg->schema, table_name, &schema) != CHIDB_OK)
+        return CHIDB_EINVALIDSQL;
 
-    stmt->nCols = 3;
-    stmt->cols = malloc(sizeof(char *) * stmt->nCols);
-    stmt->cols[0] = strdup("id");
-    stmt->cols[1] = strdup("sql");
-    stmt->cols[2] = strdup("null");
+    for (uint32_t i = 0; i < cg->nTables; i++)
+        if (strcasecmp(cg->tables[i].name, name) == 0)
+            return CHIDB_EINVALIDSQL;
 
-    chidb_dbm_op_t ops[] = {
-            {Op_Integer, 1, 0, 0, NULL},
-            {Op_String, strlen(sql_stmt->text), 1, 0, sql_stmt->text},
-            {Op_Null, 0, 2, 0, NULL},
-            {Op_ResultRow, 0, 3, 0, NULL},
-            {Op_Integer, 2, 0, 0, NULL},
-            {Op_ResultRow, 0, 3, 0, NULL},
-            {Op_Integer, 3, 0, 0, NULL},
-            {Op_ResultRow, 0, 3, 0, NULL},
-            {Op_Integer, 4, 0, 0, NULL},
-            {Op_ResultRow, 0, 3, 0, NULL},
-            {Op_Integer, 5, 0, 0, NULL},
-            {Op_ResultRow, 0, 3, 0, NULL},
-            {Op_Halt, 0, 0, 0, NULL},
-    };
+    t = cg_grow((void **) &cg->tables, &cg->nTables, sizeof(cg_table_t));
+    if (t == NULL)
+        return CHIDB_ENOMEM;
 
-    nOps = sizeof(ops) / sizeof(chidb_dbm_op_t);
+    t->name = name;
+    t->schema = schema;
+    t->cursor = cg_cursor(cg);
+    t->path.index = NULL;
+    t->path.hash = -1;
+    t->path.eq = t->path.lower = t->path.upper = t->path.in = NULL;
+    t->path.last = t->path.desc = t->path.once = t->path.covering = false;
+    t->path.nPrefix = 0;
+    t->dict = -1;
+    t->colReg = malloc(sizeof(int32_t) * schema->nCols);
+    t->loaded = calloc(schema->nCols, sizeof(bool));
+    t->compared = calloc(schema->nCols, sizeof(bool));
+    t->coded = calloc(schema->nCols, sizeof(bool));
+    t->valued = calloc(schema->nCols, sizeof(bool));
+    if (t->colReg == NULL || t->loaded == NULL || t->compared == NULL || t->coded == NULL || t->valued == NULL)
+        return CHIDB_ENOMEM;
 
-    for(int i=0; i < nOps; i++)
-        chidb_stmt_set_op(stmt, &ops[i], opnum++);
+    for (uint32_t i = 0; i < schema->nCols; i++)
+        t->colReg[i] = -1;
 
     return CHIDB_OK;
+}
 
+/* Adds the tables and conditions of the RA tree below a SELECT's
+ * top-level Pi to the SELECT's tables and conjuncts */
+static int cg_from(codegen_t *cg, RA_t *ra)
+{
+    int rc;
+
+    if (ra == NULL)
+        return CHIDB_EINVALIDSQL;
+
+    switch (ra->t)
+    {
+    case RA_TABLE:
+        return cg_add_table(cg, ra->table.name, ra->table.name);
+    case RA_RHO_TABLE:
+        if (ra->rho.ra == NULL || ra->rho.ra->t != RA_TABLE)
+            return CHIDB_EINVALIDSQL;
+        return cg_add_table(cg, ra->rho.ra->table.name, ra->rho.new_name);
+    case RA_SIGMA:
+        if ((rc = cg_from(cg, ra->sigma.ra)) != CHIDB_OK)
+            return rc;
+        return cg_add_conjuncts(cg, ra->sigma.cond);
+    case RA_CROSS:
+        if ((rc = cg_from(cg, ra->binary.ra1)) != CHIDB_OK)
+            return rc;
+        return cg_from(cg, ra->binary.ra2);
+    case RA_PI:
+        /* A Pi below the top-level Pi only narrows down the columns that
+         * are used, which the code generator already takes into account */
+        return cg_from(cg, ra->pi.ra);
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
 }
 
+/* Adds the tables and conditions of an outer join of two tables (with
+ * an ON clause) to the SELECT's tables and conjuncts, and assigns each
+ * conjunct to a loop. The join is a hash join (see cg_hash_path): the
+ * second table is added to the hash table, and the first table probes it.
+ * The rows of the first table (in a LEFT or FULL join) that have no
+ * match are produced right after their probe, and the rows of the second
+ * table (in a RIGHT or FULL join) that have no match are produced once
+ * all the rows of the first table have been probed.
+ *
+ * The conditions of the ON clause are evaluated on each match, except
+ * those that only refer to the table whose rows are not all kept, which
+ * filter that table's rows. The WHERE conditions can only refer to the
+ * table whose rows are all kept, since they are evaluated before any
+ * columns are set to NULL */
+static int cg_outer_join(codegen_t *cg, SRA_t *join, Condition_t *where)
+{
+    SRA_t *sra1 = join->join.sra1, *sra2 = join->join.sra2;
+    uint32_t nOn;
+    int rc;
+
+    if (sra1->t != SRA_TABLE || sra2->t != SRA_TABLE ||
+        join->join.opt_cond == NULL || join->join.opt_cond->t != JOIN_COND_ON)
+        return CHIDB_EINVALIDSQL;
+
+    cg->outer = true;
+    cg->keepProbe = join->t != SRA_RIGHT_OUTER_JOIN;
+    cg->keepBuild = join->t != SRA_LEFT_OUTER_JOIN;
+
+    for (int i = 0; i < 2; i++)
+    {
+        TableReference_t *ref = (i == 0 ? sra1 : sra2)->table.ref;
+
+        if ((rc = cg_add_table(cg, ref->table_name, ref->alias ? ref->alias : ref->table_name)) != CHIDB_OK)
+            return rc;
+    }
+
+    if ((rc = cg_add_conjuncts(cg, join->join.opt_cond->on)) != CHIDB_OK)
+        return rc;
+    nOn = cg->nPreds;
+    if (where != NULL && (rc = cg_add_conjuncts(cg, where)) != CHIDB_OK)
+        return rc;
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+    {
+        cg_pred_t *pred = &cg->preds[i];
+
+        if ((rc = cg_cond_level(cg, pred->cond, &pred->level)) != CHIDB_OK)
+            return rc;
+
+        if (i < nOn)
+        {
+            if (!cg->keepBuild && cg_cond_local(cg, pred->cond, 1))
+                pred->build = true;
+            else if (!cg->keepProbe && cg_cond_local(cg, pred->cond, 0))
+            {
+                pred->level = 0;
+                continue;
+            }
+            pred->level = 1;
+        }
+        else if (!cg->keepBuild && pred->level <= 0)
+            continue;
+        else if (!cg->keepProbe && cg_cond_local(cg, pred->cond, 1))
+        {
+            if (pred->level >= 0)
+                pred->build = true;
+        }
+        else if (pred->level >= 0)
+            return CHIDB_EINVALIDSQL;
+    }
+
+    return CHIDB_OK;
+}
+
+/* Adds a column of the result row */
+static int cg_add_output(codegen_t *cg, Expression_t *src, bool star, Expression_t *expr, uint32_t table, int32_t col)
+{
+    cg_output_t *out = cg_grow((void **) &cg->outputs, &cg->nOutputs, sizeof(cg_output_t));
+
+    if (out == NULL)
+        return CHIDB_ENOMEM;
+
+    out->src = src;
+    out->star = star;
+    out->expr = expr;
+    out->table = table;
+    out->col = col;
+    out->agg = -1;
+    out->calc = false;
+    out->copy = false;
+
+    return CHIDB_OK;
+}
+
+/* Is an expression the argument of COUNT(*)? */
+static bool cg_is_star(Expression_t *expr)
+{
+    return expr->t == EXPR_TERM && expr->expr.term.t == TERM_COLREF &&
+           strcmp(expr->expr.term.ref->columnName, "*") == 0;
+}
+
+/* Adds an aggregate function (a TERM_FUNC), which is computed by the
+ * aggregator. Its argument must be a column, a constant, or an expression
+ * computed from them (or "*", for COUNT) */
+static int cg_add_agg(codegen_t *cg, Expression_t *func)
+{
+    Expression_t *arg = func->expr.term.f.expr, **agg;
+    int32_t level;
+    int rc;
+
+    if (cg_is_star(arg))
+    {
+        if (func->expr.term.f.t != FUNC_COUNT)
+            return CHIDB_EINVALIDSQL;
+    }
+    else if ((rc = cg_expr_level(cg, arg, &level)) != CHIDB_OK)
+        return rc;
+
+    if ((agg = cg_grow((void **) &cg->aggs, &cg->nAggs, sizeof(Expression_t *))) == NULL)
+        return CHIDB_ENOMEM;
+    *agg = func;
+
+    return CHIDB_OK;
+}
+
+/* Adds the columns of the result row for the expressions in a Pi */
+static int cg_add_outputs(codegen_t *cg, Expression_t *expr_list)
+{
+    int32_t level, col;
+    uint32_t table;
+    int rc;
+
+    for (Expression_t *expr = expr_list; expr; expr = expr->next)
+    {
+        ColumnReference_t *ref = expr->expr.term.ref;
+
+        if (expr->t == EXPR_TERM && expr->expr.term.t == TERM_COLREF && strcmp(ref->columnName, "*") == 0)
+        {
+            /* All the columns of all the tables (or of one table) */
+            for (uint32_t i = 0; i < cg->nTables; i++)
+            {
+                if (ref->tableName != NULL && strcasecmp(ref->tableName, cg->tables[i].name) != 0)
+                    continue;
+
+                for (uint32_t j = 0; j < cg->tables[i].schema->nCols; j++)
+                    if ((rc = cg_add_output(cg, expr, true, NULL, i, j)) != CHIDB_OK)
+                        return rc;
+            }
+        }
+        else if (expr->t == EXPR_TERM && expr->expr.term.t == TERM_FUNC)
+        {
+            if ((rc = cg_add_agg(cg, expr)) != CHIDB_OK ||
+                (rc = cg_add_output(cg, expr, false, NULL, 0, 0)) != CHIDB_OK)
+                return rc;
+            cg->outputs[cg->nOutputs - 1].agg = cg->nAggs - 1;
+        }
+        else if ((rc = cg_expr_level(cg, expr, &level)) != CHIDB_OK)
+            return rc;
+        else if (expr->t == EXPR_TERM && expr->expr.term.t == TERM_COLREF)
+        {
+            cg_find_column(cg, ref, &table, &col);
+            if ((rc = cg_add_output(cg, expr, false, NULL, table, col)) != CHIDB_OK)
+                return rc;
+        }
+        else if ((rc = cg_add_output(cg, expr, false, expr, 0, 0)) != CHIDB_OK)
+            return rc;
+        else
+            cg->outputs[cg->nOutputs - 1].calc = expr->t != EXPR_TERM;
+    }
+
+    return cg->nOutputs > 0 ? CHIDB_OK : CHIDB_EINVALIDSQL;
+}
+
+/* Appends the text of a computed expression (or of one of its operands)
+ * to a string of the given size */
+static void cg_expr_text(Expression_t *expr, char *buf, size_t size)
+{
+    static const char *ops[] = {[EXPR_PLUS] = " + ", [EXPR_MINUS] = " - ", [EXPR_MULTIPLY] = " * ",
+                                [EXPR_DIVIDE] = " / ", [EXPR_CONCAT] = " || "};
+    size_t len = strlen(buf);
+    Literal_t *lit;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        break;
+    case EXPR_NEG:
+        snprintf(buf + len, size - len, "-");
+        cg_expr_text(expr->expr.unary.expr, buf, size);
+        return;
+    default:
+        /* Operands that are not terms are parenthesized */
+        for (int i = 0; i < 2; i++)
+        {
+            Expression_t *e = i == 0 ? expr->expr.binary.expr1 : expr->expr.binary.expr2;
+
+            if (i == 1)
+                snprintf(buf + strlen(buf), size - strlen(buf), "%s", ops[expr->t]);
+            if (e->t != EXPR_TERM)
+                snprintf(buf + strlen(buf), size - strlen(buf), "(");
+            cg_expr_text(e, buf, size);
+            if (e->t != EXPR_TERM)
+                snprintf(buf + strlen(buf), size - strlen(buf), ")");
+        }
+        return;
+    }
+
+    lit = expr->expr.term.val;
+    if (expr->expr.term.t == TERM_COLREF)
+        snprintf(buf + len, size - len, "%s", expr->expr.term.ref->columnName);
+    else if (expr->expr.term.t != TERM_LITERAL)
+        snprintf(buf + len, size - len, "NULL");
+    else if (lit->t == TYPE_INT)
+        snprintf(buf + len, size - len, "%d", lit->val.ival);
+    else if (lit->t == TYPE_TEXT)
+        snprintf(buf + len, size - len, "'%s'", lit->val.strval);
+    else if (lit->t == TYPE_CHAR)
+        snprintf(buf + len, size - len, "'%c'", lit->val.cval);
+    else
+        snprintf(buf + len, size - len, "?");
+}
+
+/* Returns the name of a column of the result row */
+static char *cg_output_name(codegen_t *cg, cg_output_t *out)
+{
+    char buf[64];
+
+    if (!out->star && out->src->alias != NULL)
+        return strdup(out->src->alias);
+
+    if (out->agg >= 0)
+    {
+        static const char *funcs[] = {[FUNC_MAX] = "MAX", [FUNC_MIN] = "MIN", [FUNC_COUNT] = "COUNT",
+                                      [FUNC_AVG] = "AVG", [FUNC_SUM] = "SUM"};
+        Expression_t *arg = out->src->expr.term.f.expr;
+        const char *name = "?";
+        char num[32] = "";
+
+        if (arg->t != EXPR_TERM)
+        {
+            cg_expr_text(arg, num, sizeof(num));
+            name = num;
+        }
+        else if (arg->expr.term.t == TERM_COLREF)
+            name = arg->expr.term.ref->columnName;
+        else if (arg->expr.term.t == TERM_NULL)
+            name = "NULL";
+        else if (arg->expr.term.val->t == TYPE_INT)
+        {
+            snprintf(num, sizeof(num), "%d", arg->expr.term.val->val.ival);
+            name = num;
+        }
+        snprintf(buf, sizeof(buf), "%s(%.20s)", funcs[out->src->expr.term.f.t], name);
+        return strdup(buf);
+    }
+
+    if (out->expr == NULL)
+        return strdup(cg->tables[out->table].schema->cols[out->col]);
+
+    if (out->calc)
+    {
+        buf[0] = '\0';
+        cg_expr_text(out->expr, buf, sizeof(buf));
+        return strdup(buf);
+    }
+
+    if (out->expr->expr.term.t == TERM_NULL)
+        return strdup("NULL");
+
+    switch (out->expr->expr.term.val->t)
+    {
+    case TYPE_INT:
+        snprintf(buf, sizeof(buf), "%d", out->expr->expr.term.val->val.ival);
+        return strdup(buf);
+    case TYPE_TEXT:
+        return strdup(out->expr->expr.term.val->val.strval);
+    default:
+        return strdup("?");
+    }
+}
+
+/* Sets the number and names of the columns of the result row */
+static int cg_set_cols(codegen_t *cg)
+{
+    chidb_stmt *stmt = cg->stmt;
+
+    stmt->cols = calloc(cg->nOutputs, sizeof(char *));
+    if (stmt->cols == NULL)
+        return CHIDB_ENOMEM;
+    stmt->nCols = cg->nOutputs;
+
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+        if ((stmt->cols[i] = cg_output_name(cg, &cg->outputs[i])) == NULL)
+            return CHIDB_ENOMEM;
+
+    return CHIDB_OK;
+}
+
+/* Is an expression the given column of a table? */
+static bool cg_is_col(codegen_t *cg, Expression_t *expr, uint32_t table, int32_t col)
+{
+    uint32_t t;
+    int32_t c;
+
+    return expr->t == EXPR_TERM && expr->expr.term.t == TERM_COLREF &&
+           cg_find_column(cg, expr->expr.term.ref, &t, &c) == CHIDB_OK &&
+           t == table && c == col;
+}
+
+/* Returns the comparison in a conjunct as (col op v), where col is a
+ * column of the table and v is known before the table's loop (if that
+ * is not possible, returns false) */
+static bool cg_col_cmp(codegen_t *cg, cg_pred_t *pred, uint32_t table, int32_t col, enum CondType *op, Expression_t **v)
+{
+    Condition_t *cond = pred->cond;
+    int32_t level;
+
+    if (pred->level != table || cond->t > RA_COND_GEQ)
+        return false;
+
+    if (cg_is_col(cg, cond->cond.comp.expr1, table, col))
+    {
+        *op = cond->t;
+        *v = cond->cond.comp.expr2;
+    }
+    else if (cg_is_col(cg, cond->cond.comp.expr2, table, col))
+    {
+        /* v op col is col op' v */
+        *op = cond->t == RA_COND_LT ? RA_COND_GT :
+              cond->t == RA_COND_GT ? RA_COND_LT :
+              cond->t == RA_COND_LEQ ? RA_COND_GEQ :
+              cond->t == RA_COND_GEQ ? RA_COND_LEQ : RA_COND_EQ;
+        *v = cond->cond.comp.expr1;
+    }
+    else
+        return false;
+
+    return cg_expr_level(cg, *v, &level) == CHIDB_OK && level < (int32_t) table;
+}
+
+/* Checks whether a conjunct is col IN (...), with a list of integers
+ * (the keys of a table and of its indexes are integers) */
+static bool cg_col_in(codegen_t *cg, cg_pred_t *pred, uint32_t table, int32_t col)
+{
+    if (pred->level != (int32_t) table || pred->cond->t != RA_COND_IN ||
+        !cg_is_col(cg, pred->cond->cond.in.expr, table, col))
+        return false;
+
+    for (Literal_t *lit = pred->cond->cond.in.values_list; lit; lit = lit->next)
+        if (lit->t != TYPE_INT)
+            return false;
+
+    return true;
+}
+
+/* Finds the conjuncts that bound a column of a table (the table's
+ * primary key, or the column of one of its indexes) */
+static void cg_bounds(codegen_t *cg, uint32_t table, int32_t col, cg_path_t *path)
+{
+    enum CondType op;
+    Expression_t *v;
+
+    path->col = col;
+    path->eq = path->lower = path->upper = path->in = NULL;
+    path->last = path->desc = path->once = path->covering = false;
+    path->nPrefix = 0;
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+    {
+        cg_pred_t *pred = &cg->preds[i];
+
+        /* col IN (...) is a seek to each of the values */
+        if (cg_col_in(cg, pred, table, col))
+        {
+            if (path->in == NULL)
+                path->in = pred;
+            continue;
+        }
+
+        if (!cg_col_cmp(cg, pred, table, col, &op, &v))
+            continue;
+
+        if (op == RA_COND_EQ && path->eq == NULL)
+            path->eq = pred;
+        else if ((op == RA_COND_GT || op == RA_COND_GEQ) && path->lower == NULL)
+            path->lower = pred;
+        else if ((op == RA_COND_LT || op == RA_COND_LEQ) && path->upper == NULL)
+            path->upper = pred;
+    }
+
+    /* A seek to a single key (or to each key in a list) makes the other
+     * conjuncts regular conjuncts */
+    if (path->eq != NULL)
+        path->in = NULL;
+    if (path->eq != NULL || path->in != NULL)
+        path->lower = path->upper = NULL;
+}
+
+/* Finds the conjuncts that bound the scan of an index on several
+ * columns: equalities on as many of its leading columns as possible and,
+ * on the column after them, a range (with one or two bounds) */
+static void cg_prefix(codegen_t *cg, uint32_t table, SchemaIndex *index, cg_path_t *path)
+{
+    cg_path_t cpath;
+
+    cg_bounds(cg, table, index->col, path);
+    path->eq = path->in = NULL;
+
+    for (uint32_t i = 0; i < index->nCols; i++)
+    {
+        cg_bounds(cg, table, index->cols[i], &cpath);
+        path->lower = cpath.lower;
+        path->upper = cpath.upper;
+        if (cpath.eq == NULL)
+            break;
+        path->prefix[path->nPrefix++] = cpath.eq;
+    }
+}
+
+/* How selective an access path is: an equality is better than a list of
+ * values (or equalities on the leading columns of an index on several
+ * columns), which is better than a range, and a range with two bounds is
+ * better than a range with one */
+static int cg_path_rank(cg_path_t *path)
+{
+    if (path->eq != NULL)
+        return 4;
+    if (path->in != NULL || path->nPrefix > 0)
+        return 3;
+
+    return (path->lower != NULL) + (path->upper != NULL);
+}
+
+/* Does an expression (or a condition) refer to no column of a table
+ * other than col and the primary key? */
+static bool cg_expr_covered(codegen_t *cg, Expression_t *expr, uint32_t table, int32_t col)
+{
+    uint32_t t;
+    int32_t c;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        if (expr->expr.term.t != TERM_COLREF)
+            return true;
+        return cg_find_column(cg, expr->expr.term.ref, &t, &c) == CHIDB_OK &&
+               (t != table || c == col || c == cg->tables[table].schema->pk);
+    case EXPR_NEG:
+        return cg_expr_covered(cg, expr->expr.unary.expr, table, col);
+    default:
+        return cg_expr_covered(cg, expr->expr.binary.expr1, table, col) &&
+               cg_expr_covered(cg, expr->expr.binary.expr2, table, col);
+    }
+}
+
+static bool cg_cond_covered(codegen_t *cg, Condition_t *cond, uint32_t table, int32_t col)
+{
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        return cg_cond_covered(cg, cond->cond.binary.cond1, table, col) &&
+               cg_cond_covered(cg, cond->cond.binary.cond2, table, col);
+    case RA_COND_NOT:
+        return cg_cond_covered(cg, cond->cond.unary.cond, table, col);
+    case RA_COND_IN:
+        return cg_expr_covered(cg, cond->cond.in.expr, table, col);
+    default:
+        return cg_expr_covered(cg, cond->cond.comp.expr1, table, col) &&
+               cg_expr_covered(cg, cond->cond.comp.expr2, table, col);
+    }
+}
+
+/* Is an index on a column of a table covering? That is, are the only
+ * columns of the table that the SELECT uses (in the result row, the
+ * ORDER BY, the aggregation and the conjuncts) the indexed column and the
+ * primary key, which are both in the index's entries? Then, the rows
+ * don't have to be read from the table */
+static bool cg_covers(codegen_t *cg, uint32_t table, int32_t col)
+{
+    cg_table_t *t = &cg->tables[table];
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        if (t->colReg[i] >= 0 && (int32_t) i != col && (int32_t) i != t->schema->pk)
+            return false;
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (!cg_cond_covered(cg, cg->preds[i].cond, table, col))
+            return false;
+
+    return true;
+}
+
+/* Estimated selectivity of one of the conjuncts of an access path, on
+ * the column col */
+static double cg_pred_sel(codegen_t *cg, uint32_t table, int32_t col, cg_pred_t *pred, TableStats *ts)
+{
+    enum CondType op;
+    Expression_t *v;
+
+    cg_col_cmp(cg, pred, table, col, &op, &v);
+
+    return chidb_Stats_selectivity(ts, col, op,
+                                   v->t == EXPR_TERM && v->expr.term.t == TERM_LITERAL ? v->expr.term.val : NULL);
+}
+
+/* Estimated fraction of a table's rows that are within the bounds of
+ * an access path */
+static double cg_path_sel(codegen_t *cg, uint32_t table, cg_path_t *path, TableStats *ts)
+{
+    double lower = 1, upper = 1, prefix = 1;
+    int32_t col = path->col;
+
+    if (path->eq != NULL)
+        return cg_pred_sel(cg, table, col, path->eq, ts);
+
+    /* Each value of a list is an equality */
+    if (path->in != NULL)
+    {
+        double sel = 0;
+
+        for (Literal_t *lit = path->in->cond->cond.in.values_list; lit; lit = lit->next)
+            sel += chidb_Stats_selectivity(ts, path->col, RA_COND_EQ, lit);
+        return sel < 1 ? sel : 1;
+    }
+
+    /* The equalities on the leading columns of an index on several columns
+     * (assume they are independent), and the range on the next column */
+    if (path->index != NULL && path->index->nCols > 1)
+    {
+        for (uint32_t i = 0; i < path->nPrefix; i++)
+            prefix *= cg_pred_sel(cg, table, path->index->cols[i], path->prefix[i], ts);
+        if (path->nPrefix == path->index->nCols)
+            return prefix;
+        col = path->index->cols[path->nPrefix];
+    }
+
+    if (path->lower != NULL)
+        lower = cg_pred_sel(cg, table, col, path->lower, ts);
+    if (path->upper != NULL)
+        upper = cg_pred_sel(cg, table, col, path->upper, ts);
+
+    /* The rows below the upper bound, except those below the lower bound
+     * (if the estimates are not that precise, assume they are independent) */
+    if (path->lower != NULL && path->upper != NULL && lower + upper - 1 > lower * upper)
+        return prefix * (lower + upper - 1);
+
+    return prefix * lower * upper;
+}
+
+/* Chooses how the rows of a table are accessed: through its primary key
+ * or through one of its indexes (if either is bounded by the conjuncts),
+ * or with a full scan.
+ *
+ * If the table and its indexes have been analyzed, the path with the
+ * lowest estimated cost is chosen (see chidb_Stats_pathCost). Otherwise,
+ * on a tie, the primary key is preferred, since an index scan also has to
+ * seek each row in the table. For the same reason, an index is only used
+ * for an equality, a list of values or a range with both bounds: a range
+ * with one bound may well match most of the table, and then a full scan
+ * is cheaper. With statistics, the cost of a covering index (see
+ * cg_covers) doesn't include the seeks, since only its entries are read.
+ *
+ * The bounds of an index on several columns don't replace any conjunct,
+ * so they are not marked as seeks: its keys order NULL like any other
+ * value, while a comparison with NULL is never true, so the conjuncts are
+ * still evaluated on the rows that its scan visits */
+static void cg_access_path(codegen_t *cg, uint32_t table)
+{
+    cg_table_t *t = &cg->tables[table];
+    cg_path_t *path = &t->path;
+    cg_path_t ipath;
+    TableStats *ts = NULL;
+    IndexStats *is;
+    double cost, best = 0;
+
+    cg_bounds(cg, table, t->schema->pk, path);
+    path->index = NULL;
+    path->hash = -1;
+
+    if (chidb_Stats_findTable(cg->stats, t->schema->name, &ts) == CHIDB_OK)
+        best = chidb_Stats_pathCost(ts, NULL, cg_path_sel(cg, table, path, ts), false);
+    else
+        ts = NULL;
+
+    for (uint32_t i = 0; i < cg->schema->nIndexes; i++)
+    {
+        SchemaIndex *index = &cg->schema->indexes[i];
+
+        if (index->table != t->schema)
+            continue;
+
+        if (index->nCols > 1)
+            cg_prefix(cg, table, index, &ipath);
+        else
+            cg_bounds(cg, table, index->col, &ipath);
+        ipath.index = index;
+        ipath.hash = -1;
+
+        if (cg_path_rank(&ipath) == 0)
+            continue;
+
+        if (ts != NULL && chidb_Stats_findIndex(cg->stats, ipath.index->name, &is) == CHIDB_OK)
+        {
+            cost = chidb_Stats_pathCost(ts, is, cg_path_sel(cg, table, &ipath, ts),
+                                        index->nCols == 1 && cg_covers(cg, table, ipath.col));
+            if (cost < best)
+            {
+                *path = ipath;
+                best = cost;
+            }
+            continue;
+        }
+
+        if (ipath.eq == NULL && ipath.in == NULL && ipath.nPrefix == 0 &&
+            (ipath.lower == NULL || ipath.upper == NULL))
+            continue;
+
+        if (cg_path_rank(&ipath) > cg_path_rank(path))
+            *path = ipath;
+    }
+
+    if (path->index != NULL && path->index->nCols > 1)
+    {
+        path->cursor = cg->nKeyScans++;
+        return;
+    }
+
+    if (path->index != NULL)
+        path->cursor = cg_cursor(cg);
+
+    if (path->eq != NULL)
+        path->eq->seek = true;
+    if (path->in != NULL)
+        path->in->seek = true;
+    if (path->lower != NULL)
+        path->lower->seek = true;
+    if (path->upper != NULL)
+        path->upper->seek = true;
+}
+
+/* Turns the full scan of a table (which is repeated for each row of the
+ * outer loops) into a hash join, if one of the conjuncts is an equijoin
+ * (col = v, where v is a column of an outer table): the table's rows are
+ * added, once, to a hash table keyed by col, and its loop only visits the
+ * rows that the hash table has for v. The conjuncts that only refer to
+ * the table are evaluated when the hash table is built, so the rows that
+ * don't satisfy them are not added to it. Returns false if the table's
+ * rows are still read with its access path */
+static bool cg_hash_path(codegen_t *cg, uint32_t table)
+{
+    cg_table_t *t = &cg->tables[table];
+    cg_path_t *path = &t->path;
+    enum CondType op;
+    Expression_t *v;
+    int32_t level;
+    bool once = true;
+
+    if (table == 0 || path->index != NULL || cg_path_rank(path) > 0)
+        return false;
+
+    /* If the outer loops produce a single row, the table is only scanned once */
+    for (uint32_t i = 0; i < table; i++)
+        if (cg->tables[i].path.index != NULL || cg->tables[i].path.hash >= 0 || cg->tables[i].path.eq == NULL)
+            once = false;
+    if (once && !cg->outer)
+        return false;
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+    {
+        cg_pred_t *pred = &cg->preds[i];
+
+        if (pred->build)
+            continue;
+
+        for (uint32_t col = 0; col < t->schema->nCols; col++)
+        {
+            if (!cg_col_cmp(cg, pred, table, col, &op, &v) || op != RA_COND_EQ ||
+                cg_expr_level(cg, v, &level) != CHIDB_OK || level < 0)
+                continue;
+
+            path->hash = cg->nHashes++;
+            path->col = col;
+            path->eq = pred;
+            pred->seek = true;
+
+            /* In an outer join, cg_outer_join decides which conjuncts filter the rows */
+            for (uint32_t j = 0; j < cg->nPreds && !cg->outer; j++)
+                if (cg->preds[j].level == (int32_t) table && !cg->preds[j].seek &&
+                    cg_cond_local(cg, cg->preds[j].cond, table))
+                    cg->preds[j].build = true;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Emits the loop that adds the rows of a table to its hash table (see
+ * cg_hash_path). This is done before any of the loops */
+static void cg_hash_build(codegen_t *cg, uint32_t table)
+{
+    cg_table_t *t = &cg->tables[table];
+    int32_t top = cg_label(cg), next = cg_label(cg), end = cg_label(cg);
+
+    cg_emit(cg, Op_HashOpen, t->path.hash, t->nBlock, 0, NULL);
+    cg_jump(cg, Op_Rewind, t->cursor, end, 0);
+    cg_bind(cg, top);
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (cg->preds[i].level == (int32_t) table && cg->preds[i].build)
+        {
+            cg_load_cond(cg, cg->preds[i].cond);
+            cg_cond(cg, cg->preds[i].cond, next, false);
+        }
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        if (t->colReg[i] >= 0)
+            cg_load_column(cg, table, i);
+
+    cg_emit(cg, Op_HashInsert, t->path.hash, t->block, t->colReg[t->path.col], NULL);
+    cg_bind(cg, next);
+    cg_jump(cg, Op_Next, t->cursor, top, 0);
+    cg_bind(cg, end);
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        t->loaded[i] = false;
+    cg_uncompute(cg, table);
+}
+
+/* Returns the register with the value of a column, a constant or a
+ * computed expression (which must have been loaded, or computed, already) */
+static int32_t cg_reg(codegen_t *cg, Expression_t *expr)
+{
+    uint32_t table;
+    int32_t col;
+
+    if (expr->t != EXPR_TERM)
+        return cg_find_calc(cg, expr)->reg;
+
+    if (expr->expr.term.t != TERM_COLREF)
+        return cg_find_const(cg, expr)->reg;
+
+    cg_find_column(cg, expr->expr.term.ref, &table, &col);
+
+    return cg->tables[table].colReg[col];
+}
+
+/* Are two aggregate functions the same function of the same expression? */
+static bool cg_same_agg(codegen_t *cg, Expression_t *f1, Expression_t *f2)
+{
+    Expression_t *a1 = f1->expr.term.f.expr, *a2 = f2->expr.term.f.expr;
+
+    if (f1->expr.term.f.t != f2->expr.term.f.t)
+        return false;
+    if (cg_is_star(a1) || cg_is_star(a2))
+        return cg_is_star(a1) && cg_is_star(a2);
+
+    return cg_same_expr(cg, a1, a2);
+}
+
+/* Returns the register where AggRow stores the value of an expression
+ * (the GROUP BY column, or an aggregate function), or -1 if AggRow
+ * doesn't store it */
+static int32_t cg_agg_reg(codegen_t *cg, Expression_t *expr)
+{
+    uint32_t table;
+    int32_t col;
+
+    if (expr->t != EXPR_TERM)
+        return -1;
+
+    if (expr->expr.term.t == TERM_FUNC)
+    {
+        for (uint32_t i = 0; i < cg->nAggs; i++)
+            if (cg_same_agg(cg, cg->aggs[i], expr))
+                return cg->aggReg + (cg->group != NULL) + i;
+        return -1;
+    }
+
+    if (cg->group != NULL && expr->expr.term.t == TERM_COLREF &&
+        cg_find_column(cg, expr->expr.term.ref, &table, &col) == CHIDB_OK &&
+        cg_is_col(cg, cg->group, table, col))
+        return cg->aggReg;
+
+    return -1;
+}
+
+/* Emits the instruction that stores the current row of an aggregator
+ * (cg->agg or cg->distinct) in the registers from reg, and decodes the
+ * dictionary-encoded columns that the aggregator grouped by their codes */
+static void cg_agg_row(codegen_t *cg, int32_t agg, int32_t reg)
+{
+    uint32_t table;
+    int32_t col;
+
+    cg_emit(cg, Op_AggRow, agg, reg, 0, NULL);
+
+    if (agg == cg->agg)
+    {
+        if (cg->group != NULL && cg_find_column(cg, cg->group->expr.term.ref, &table, &col) == CHIDB_OK &&
+            cg->tables[table].coded[col])
+            cg_emit(cg, Op_DictDecode, cg->tables[table].dict, reg, 0, NULL);
+        return;
+    }
+
+    /* In an aggregation, the rows of the DISTINCT have been decoded already */
+    for (uint32_t i = 0; i < cg->nOutputs && cg->agg < 0; i++)
+    {
+        cg_output_t *out = &cg->outputs[i];
+
+        if (out->expr == NULL && cg->tables[out->table].coded[out->col])
+            cg_emit(cg, Op_DictDecode, cg->tables[out->table].dict, reg + (cg->sorter >= 0) + i, 0, NULL);
+    }
+}
+
+/* Emits a row of the statement's result, in n registers from reg. With
+ * an OFFSET, the first rows are skipped, and, with a LIMIT, the program
+ * stops after the last row */
+static void cg_result(codegen_t *cg, int32_t reg, uint32_t n)
+{
+    int32_t skip = cg_label(cg);
+
+    if (cg->offset >= 0)
+        cg_jump(cg, Op_IfPos, cg->offset, skip, 1);
+    cg_emit(cg, Op_ResultRow, reg, n, 0, NULL);
+    if (cg->limit >= 0)
+        cg_jump(cg, Op_DecrJumpZero, cg->limit, cg->stop, 0);
+    cg_bind(cg, skip);
+}
+
+/* Emits the instructions that produce a result row, in n registers from
+ * reg (preceded by the sort key, with an ORDER BY): the row is added to
+ * the sorter or, in an operand of a set operation, to the operation's
+ * hash set. Otherwise, it is a row of the statement's result */
+static void cg_sink(codegen_t *cg, int32_t reg, uint32_t n)
+{
+    if (cg->sorter >= 0)
+        cg_emit(cg, Op_SorterInsert, cg->sorter, reg, 0, NULL);
+    else if (cg->set >= 0)
+        cg_emit(cg, Op_AggStep, cg->set, reg, cg->setArgs, NULL);
+    else
+        cg_result(cg, reg, n);
+}
+
+/* Emits the result row (copying the columns that are not loaded directly
+ * into it, or, in an aggregation, the values of the current group). With
+ * an ORDER BY, the sort key is copied before it. The sort key's column has
+ * already been loaded (or set to NULL, in the rows of an outer join with
+ * no match) along with the others. With a DISTINCT, the row is added to
+ * the hash set, and, in a sorted set, a row that is not the same as the
+ * previous one produces the previous one */
+static void cg_emit_row(codegen_t *cg)
+{
+    int32_t row = cg->sorter >= 0 ? cg->key : cg->rr;
+
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+    {
+        cg_output_t *out = &cg->outputs[i];
+
+        if (out->copy)
+            cg_emit(cg, Op_SCopy, cg->agg >= 0 ? cg_agg_reg(cg, out->src) :
+                                  out->calc ? cg_reg(cg, out->expr) : cg->tables[out->table].colReg[out->col],
+                    cg->rr + i, 0, NULL);
+    }
+
+    if (cg->sorter >= 0)
+    {
+        int32_t reg = cg->agg >= 0 ? cg_agg_reg(cg, cg->order) : -1;
+
+        cg_emit(cg, Op_SCopy, reg >= 0 ? reg : cg_reg(cg, cg->order), cg->key, 0, NULL);
+    }
+
+    if (cg->distinct < 0)
+    {
+        cg_sink(cg, row, cg->nOutputs);
+        return;
+    }
+
+    if (cg->distinctSorted)
+    {
+        int32_t same = cg_label(cg);
+
+        cg_jump(cg, Op_AggBreak, cg->distinct, same, row);
+        cg_agg_row(cg, cg->distinct, cg->distinctReg);
+        cg_sink(cg, cg->distinctReg, cg->nOutputs);
+        cg_bind(cg, same);
+    }
+
+    cg_emit(cg, Op_AggStep, cg->distinct, row, 0, NULL);
+}
+
+/* Emits the result row or, in an aggregation, the instructions that add
+ * the current row to the aggregator */
+static void cg_result_row(codegen_t *cg)
+{
+    int32_t args = cg->aggReg + (cg->group != NULL);
+
+    if (cg->agg < 0)
+    {
+        cg_emit_row(cg);
+        return;
+    }
+
+    /* In a sorted aggregation, a row with a new key finishes the current group */
+    if (cg->sorted)
+    {
+        int32_t same = cg_label(cg);
+
+        cg_jump(cg, Op_AggBreak, cg->agg, same, cg_reg(cg, cg->group));
+        cg_agg_row(cg, cg->agg, cg->aggReg);
+        cg_emit_row(cg);
+        cg_bind(cg, same);
+    }
+
+    if (cg->group != NULL)
+        cg_emit(cg, Op_SCopy, cg_reg(cg, cg->group), cg->aggReg, 0, NULL);
+
+    for (uint32_t i = 0; i < cg->nAggs; i++)
+        if (!cg_is_star(cg->aggs[i]->expr.term.f.expr))
+            cg_emit(cg, Op_SCopy, cg_reg(cg, cg->aggs[i]->expr.term.f.expr), args + i, 0, NULL);
+
+    cg_emit(cg, Op_AggStep, cg->agg, cg->aggReg, args, NULL);
+}
+
+/* Sets up the aggregation of a SELECT with aggregate functions or a
+ * GROUP BY (a column). Each column of the result row, and the ORDER BY
+ * expression, must be the GROUP BY column, an aggregate function, or a
+ * constant. An aggregate function in the ORDER BY that is not in the
+ * result row is computed as well */
+static int cg_aggregate(codegen_t *cg, Expression_t *group)
+{
+    Expression_t *order = cg->order;
+    int32_t level;
+    int rc;
+
+    if (group != NULL)
+    {
+        if (group->t != EXPR_TERM || group->expr.term.t != TERM_COLREF ||
+            cg_expr_level(cg, group, &level) != CHIDB_OK)
+            return CHIDB_EINVALIDSQL;
+        cg->group = group;
+    }
+
+    if (order != NULL && order->t == EXPR_TERM && order->expr.term.t == TERM_FUNC)
+    {
+        bool found = false;
+
+        for (uint32_t i = 0; i < cg->nAggs && !found; i++)
+            found = cg_same_agg(cg, cg->aggs[i], order);
+        if (!found && (rc = cg_add_agg(cg, order)) != CHIDB_OK)
+            return rc;
+    }
+
+    if (cg->nAggs > CG_MAX_AGGS)
+        return CHIDB_EINVALIDSQL;
+
+    cg->agg = cg->nAggregators++;
+    cg->aggReg = cg_regs(cg, (group != NULL) + cg->nAggs);
+
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+        if (cg->outputs[i].calc ||
+            (cg->outputs[i].expr == NULL && (cg->outputs[i].star || cg_agg_reg(cg, cg->outputs[i].src) < 0)))
+            return CHIDB_EINVALIDSQL;
+
+    if (order != NULL && cg_agg_reg(cg, order) < 0)
+    {
+        if (order->t != EXPR_TERM || (order->expr.term.t != TERM_LITERAL && order->expr.term.t != TERM_NULL))
+            return CHIDB_EINVALIDSQL;
+        if ((rc = cg_use_expr(cg, order)) != CHIDB_OK)
+            return rc;
+    }
+
+    /* The columns that the loops load for the aggregator */
+    if (group != NULL && (rc = cg_use_col(cg, group, true)) != CHIDB_OK)
+        return rc;
+
+    for (uint32_t i = 0; i < cg->nAggs; i++)
+        if (!cg_is_star(cg->aggs[i]->expr.term.f.expr) &&
+            (rc = cg_use_expr(cg, cg->aggs[i]->expr.term.f.expr)) != CHIDB_OK)
+            return rc;
+
+    return CHIDB_OK;
+}
+
+/* Is an expression one of the columns of the result row? */
+static bool cg_is_output(codegen_t *cg, Expression_t *expr)
+{
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+    {
+        cg_output_t *out = &cg->outputs[i];
+
+        if (out->agg >= 0 ? expr->t == EXPR_TERM && expr->expr.term.t == TERM_FUNC && cg_same_agg(cg, out->src, expr) :
+            out->calc ? cg_same_expr(cg, out->expr, expr)
+                      : out->expr == NULL && cg_is_col(cg, expr, out->table, out->col))
+            return true;
+    }
+
+    return false;
+}
+
+/* Sets up the duplicate elimination of a SELECT DISTINCT. The ORDER BY
+ * expression must be one of the columns of the result row (or a
+ * constant), so that equal rows have the same sort key. There is nothing
+ * to do if the rows are known to be distinct: the groups of an
+ * aggregation are distinct if the GROUP BY column is in the result row
+ * (and, with no GROUP BY, there is a single group), and the rows of a
+ * single table are distinct if its primary key is */
+static int cg_distinct(codegen_t *cg)
+{
+    Expression_t *order = cg->order;
+
+    if (order != NULL && !cg_is_output(cg, order) &&
+        (order->t != EXPR_TERM || (order->expr.term.t != TERM_LITERAL && order->expr.term.t != TERM_NULL)))
+        return CHIDB_EINVALIDSQL;
+
+    if (cg->agg >= 0 && (cg->group == NULL || cg_is_output(cg, cg->group)))
+        return CHIDB_OK;
+
+    if (cg->agg < 0 && cg->nTables == 1 && !cg->outer)
+        for (uint32_t i = 0; i < cg->nOutputs; i++)
+            if (cg->outputs[i].expr == NULL && cg->outputs[i].col == cg->tables[0].schema->pk)
+                return CHIDB_OK;
+
+    cg->distinct = cg->nAggregators++;
+
+    return CHIDB_OK;
+}
+
+/* Returns an index on a column of a table (or NULL). Indexes on several
+ * columns are not considered */
+static SchemaIndex *cg_find_index(codegen_t *cg, uint32_t table, int32_t col)
+{
+    for (uint32_t i = 0; i < cg->schema->nIndexes; i++)
+        if (cg->schema->indexes[i].table == cg->tables[table].schema && cg->schema->indexes[i].col == col &&
+            cg->schema->indexes[i].nCols == 1)
+            return &cg->schema->indexes[i];
+
+    return NULL;
+}
+
+/* Takes advantage of the order in which the rows of a single table are
+ * read, once its access path has been chosen. If they are read in order
+ * of the GROUP BY column (the table's primary key, or the column of the
+ * index that is scanned), the groups are finished one after another, so
+ * the aggregator is sorted: it only keeps the current group, instead of
+ * a hash table with all of them. A table that would be scanned in full
+ * is scanned through an index on the GROUP BY column, if there is one.
+ * The same goes for the hash set of a SELECT DISTINCT of a single column.
+ *
+ * With no GROUP BY, a single MIN or MAX of the primary key or of an
+ * indexed column, over all the rows of the table, is the value in the
+ * first or the last entry of the table or the index, so the loop only
+ * visits that entry */
+static void cg_stream(codegen_t *cg)
+{
+    cg_table_t *t = &cg->tables[0];
+    cg_path_t *path = &t->path;
+    Expression_t *arg;
+    SchemaIndex *index;
+    uint32_t table;
+    int32_t col;
+    bool scan;
+
+    if (cg->nTables != 1 || cg->outer || path->hash >= 0)
+        return;
+
+    scan = path->index == NULL && cg_path_rank(path) == 0;
+
+    if (cg->group != NULL || (cg->distinct >= 0 && cg->agg < 0 && cg->nOutputs == 1 && cg->outputs[0].expr == NULL))
+    {
+        if (cg->group != NULL)
+            cg_find_column(cg, cg->group->expr.term.ref, &table, &col);
+        else
+            col = cg->outputs[0].col;
+
+        if (scan && col != t->schema->pk && (index = cg_find_index(cg, 0, col)) != NULL)
+        {
+            path->index = index;
+            path->col = col;
+            path->cursor = cg_cursor(cg);
+        }
+
+        if (cg->group != NULL)
+            cg->sorted = path->index != NULL ? path->index->col == col : col == t->schema->pk;
+        else
+            cg->distinctSorted = path->index != NULL && path->index->col == col;
+        return;
+    }
+
+    if (cg->agg < 0 || cg->nAggs != 1 || cg->nPreds > 0 || !scan ||
+        (cg->aggs[0]->expr.term.f.t != FUNC_MIN && cg->aggs[0]->expr.term.f.t != FUNC_MAX))
+        return;
+
+    arg = cg->aggs[0]->expr.term.f.expr;
+    if (arg->t != EXPR_TERM || arg->expr.term.t != TERM_COLREF ||
+        cg_find_column(cg, arg->expr.term.ref, &table, &col) != CHIDB_OK)
+        return;
+
+    if (col != t->schema->pk)
+    {
+        if ((index = cg_find_index(cg, 0, col)) == NULL)
+            return;
+        path->index = index;
+        path->col = col;
+        path->cursor = cg_cursor(cg);
+    }
+
+    path->last = cg->aggs[0]->expr.term.f.t == FUNC_MAX;
+    path->once = true;
+}
+
+/* Reads the rows of a single table in order of the ORDER BY column, if
+ * it is the table's primary key or the column of the index that is
+ * scanned, so that they don't have to be sorted. A table that would be
+ * scanned in full is scanned through an index on the ORDER BY column, if
+ * there is one. With a descending order, the scan goes backwards, from
+ * the last entry (which is only done if the scan has no bounds). Returns
+ * true if the rows are read in order */
+static bool cg_order(codegen_t *cg, enum OrderBy dir)
+{
+    cg_table_t *t = &cg->tables[0];
+    cg_path_t *path = &t->path;
+    SchemaIndex *index;
+    uint32_t table;
+    int32_t col;
+
+    if (cg->nTables != 1 || cg->outer || path->hash >= 0 || cg->agg >= 0 || cg->distinct >= 0 ||
+        path->eq != NULL || path->in != NULL ||
+        cg->order->t != EXPR_TERM || cg->order->expr.term.t != TERM_COLREF ||
+        cg_find_column(cg, cg->order->expr.term.ref, &table, &col) != CHIDB_OK)
+        return false;
+
+    if (path->index == NULL && cg_path_rank(path) == 0 && col != t->schema->pk &&
+        (index = cg_find_index(cg, 0, col)) != NULL)
+    {
+        path->index = index;
+        path->col = col;
+        path->cursor = cg_cursor(cg);
+    }
+
+    if (path->index != NULL ? path->index->col != col : col != t->schema->pk)
+        return false;
+
+    if (dir == ORDER_BY_DESC)
+    {
+        if (cg_path_rank(path) > 0)
+            return false;
+        path->desc = path->last = true;
+    }
+
+    return true;
+}
+
+/* Emits the instructions that set the columns of a table to NULL (for
+ * the rows of an outer join that have no match in the table), and the
+ * expressions computed from them, which are NULL as well */
+static void cg_null_table(codegen_t *cg, uint32_t table)
+{
+    cg_table_t *t = &cg->tables[table];
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        if (t->colReg[i] >= 0)
+            cg_emit(cg, Op_Null, 0, t->colReg[i], 0, NULL);
+
+    for (uint32_t i = 0; i < cg->nCalcs; i++)
+        if (cg_expr_refers(cg, cg->calcs[i].expr, table, false))
+            cg_emit(cg, Op_Null, 0, cg->calcs[i].reg, 0, NULL);
+}
+
+/* Positions a cursor on its first entry or, if last is true, on its last
+ * entry (the last one with a key that is not greater than the largest
+ * key). Jumps to end if there are no entries */
+static void cg_rewind(codegen_t *cg, int32_t cursor, bool last, int32_t end)
+{
+    int32_t r;
+
+    if (!last)
+    {
+        cg_jump(cg, Op_Rewind, cursor, end, 0);
+        return;
+    }
+
+    r = cg_regs(cg, 1);
+    cg_emit(cg, Op_Integer, INT32_MAX, r, 0, NULL);
+    cg_jump(cg, Op_SeekLe, cursor, end, r);
+}
+
+/* Emits the instructions that make a key for the scan of an index on
+ * several columns (see cg_prefix): the key of the values of the
+ * equalities on its leading columns and, if bound is not NULL, of the
+ * value of bound, on the next column. Returns the key's register */
+static int32_t cg_key(codegen_t *cg, uint32_t table, cg_pred_t *bound)
+{
+    cg_path_t *path = &cg->tables[table].path;
+    uint32_t n = path->nPrefix + (bound != NULL);
+    int32_t r = cg_regs(cg, n + 1);
+    enum CondType op;
+    Expression_t *v;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        cg_col_cmp(cg, i < path->nPrefix ? path->prefix[i] : bound, table, path->index->cols[i], &op, &v);
+        cg_emit(cg, Op_SCopy, cg_value(cg, v), r + i, 0, NULL);
+    }
+    cg_emit(cg, Op_MakeKey, r, n, r + n, NULL);
+
+    return r + n;
+}
+
+/* Emits the start of the scan of an index on several columns: the seek
+ * to the first entry within its bounds (after the entries whose values
+ * start with the lower bound, if it is strict) and, at the label top,
+ * the end of the scan once the values of an entry are past the
+ * equalities or the upper bound */
+static void cg_key_range(codegen_t *cg, uint32_t table, int32_t top, int32_t end)
+{
+    cg_path_t *path = &cg->tables[table].path;
+    enum CondType lowerOp = RA_COND_GEQ, upperOp = RA_COND_LEQ;
+    int32_t col = path->index->cols[path->nPrefix < path->index->nCols ? path->nPrefix : 0];
+    int32_t high = -1;
+    Expression_t *v;
+
+    if (path->lower != NULL)
+        cg_col_cmp(cg, path->lower, table, col, &lowerOp, &v);
+    if (path->upper != NULL)
+        cg_col_cmp(cg, path->upper, table, col, &upperOp, &v);
+
+    if (path->nPrefix > 0 || path->upper != NULL)
+        high = cg_key(cg, table, path->upper);
+
+    cg_jump(cg, lowerOp == RA_COND_GT ? Op_KeySeekGt : Op_KeySeekGe, path->cursor, end,
+            cg_key(cg, table, path->lower));
+    cg_bind(cg, top);
+
+    if (high >= 0)
+        cg_jump(cg, upperOp == RA_COND_LT ? Op_KeyGe : Op_KeyGt, path->cursor, end, high);
+}
+
+/* Emits the seek of the row of the current entry of a table's index in
+ * the table, with the instruction that gets the entry's primary key
+ * (IdxPKey, or KeyPKey for an index on several columns) */
+static void cg_index_row(codegen_t *cg, uint32_t table, opcode_t pkey)
+{
+    cg_table_t *t = &cg->tables[table];
+    int32_t pk = t->schema->pk, rkey;
+
+    /* The entry's primary key goes directly into the key's register, if the key is used */
+    if (pk >= 0 && t->colReg[pk] >= 0)
+    {
+        rkey = t->colReg[pk];
+        t->loaded[pk] = true;
+    }
+    else
+        rkey = cg_regs(cg, 1);
+
+    if (cg->corrupt < 0)
+        cg->corrupt = cg_label(cg);
+
+    cg_emit(cg, pkey, t->path.cursor, rkey, 0, NULL);
+    cg_jump(cg, Op_Seek, t->cursor, cg->corrupt, rkey);
+}
+
+/* Emits the start of the loop over the entries of a table's index (which
+ * only visits the entries within the index's bounds), and the seek of
+ * each entry's row in the table (unless the index is covering). With a
+ * list of values, each value v is scanned as the range [v, v], from the
+ * label values, and the label more goes on to the next value */
+static void cg_index_scan(codegen_t *cg, uint32_t table, int32_t top, int32_t end,
+                          int32_t values, int32_t more)
+{
+    cg_table_t *t = &cg->tables[table];
+    cg_path_t *path = &t->path;
+    int32_t pk = t->schema->pk, rv = -1;
+    enum CondType op;
+    Expression_t *v;
+
+    /* An index on several columns is read with a key scan, and it is never covering */
+    if (path->index->nCols > 1)
+    {
+        cg_key_range(cg, table, top, end);
+        cg_index_row(cg, table, Op_KeyPKey);
+        return;
+    }
+
+    if (path->in != NULL)
+    {
+        cg_list_t *l = cg_list(cg, path->in->cond);
+
+        rv = l->reg;
+        cg_jump(cg, Op_ListRewind, l->list, end, 0);
+        cg_bind(cg, values);
+        cg_emit(cg, Op_ListValue, l->list, rv, 0, NULL);
+        cg_jump(cg, Op_SeekGe, path->cursor, end, rv);
+    }
+    /* An equality is scanned as the range [v, v] */
+    else if (path->eq != NULL)
+    {
+        cg_col_cmp(cg, path->eq, table, path->col, &op, &v);
+        cg_jump(cg, Op_SeekGe, path->cursor, end, cg_value(cg, v));
+    }
+    else if (path->lower != NULL)
+    {
+        cg_col_cmp(cg, path->lower, table, path->col, &op, &v);
+        cg_jump(cg, op == RA_COND_GT ? Op_SeekGt : Op_SeekGe, path->cursor, end, cg_value(cg, v));
+    }
+    else
+        cg_rewind(cg, path->cursor, path->last, end);
+
+    cg_bind(cg, top);
+
+    /* Stop once the index key is past the upper bound */
+    if (path->in != NULL)
+        cg_jump(cg, Op_IdxGt, path->cursor, more, rv);
+    else if (path->eq != NULL)
+        cg_jump(cg, Op_IdxGt, path->cursor, end, cg_value(cg, v));
+    else if (path->upper != NULL)
+    {
+        cg_col_cmp(cg, path->upper, table, path->col, &op, &v);
+        cg_jump(cg, op == RA_COND_LT ? Op_IdxGe : Op_IdxGt, path->cursor, end, cg_value(cg, v));
+    }
+
+    /* With a covering index, the row is not read: the indexed column is
+     * the entry's key, and the primary key is in the entry as well */
+    if (path->covering)
+    {
+        if (t->colReg[path->col] >= 0)
+        {
+            cg_emit(cg, Op_Key, path->cursor, t->colReg[path->col], 0, NULL);
+            t->loaded[path->col] = true;
+        }
+        if (pk >= 0 && t->colReg[pk] >= 0)
+        {
+            cg_emit(cg, Op_IdxPKey, path->cursor, t->colReg[pk], 0, NULL);
+            t->loaded[pk] = true;
+        }
+        return;
+    }
+
+    cg_index_row(cg, table, Op_IdxPKey);
+}
+
+/* Emits the loop over the rows of a table (and, inside it, the loops
+ * over the following tables, and the result row) */
+static void cg_loop(codegen_t *cg, uint32_t table)
+{
+    cg_table_t *t = &cg->tables[table];
+    int32_t top = cg_label(cg), next = cg_label(cg), end = cg_label(cg);
+    int32_t pk = t->schema->pk;
+    cg_path_t *path = &t->path;
+    cg_list_t *l = path->in != NULL ? cg_list(cg, path->in->cond) : NULL;
+    int32_t values = -1, more = -1;
+    enum CondType op;
+    Expression_t *v;
+
+    /* With a list of values, the loop seeks each of them in turn */
+    if (l != NULL)
+    {
+        values = cg_label(cg);
+        more = cg_label(cg);
+    }
+
+    if (path->index != NULL)
+        cg_index_scan(cg, table, top, end, values, more);
+    else if (path->hash >= 0)
+    {
+        /* The rows in the hash table with the key v */
+        cg_col_cmp(cg, path->eq, table, path->col, &op, &v);
+        if (cg->keepProbe)
+            cg_emit(cg, Op_Integer, 0, cg->matched, 0, NULL);
+        cg_jump(cg, Op_HashProbe, path->hash, end, cg_value(cg, v));
+        cg_bind(cg, top);
+        cg_emit(cg, Op_HashRow, path->hash, t->block, 0, NULL);
+        for (uint32_t i = 0; i < t->schema->nCols; i++)
+            t->loaded[i] = t->colReg[i] >= 0;
+    }
+    else
+    {
+        if (l != NULL)
+        {
+            /* The value goes directly into the key's register, if the key is used */
+            int32_t rv = l->reg;
+
+            if (t->colReg[pk] >= 0)
+            {
+                rv = t->colReg[pk];
+                t->loaded[pk] = true;
+            }
+
+            cg_jump(cg, Op_ListRewind, l->list, end, 0);
+            cg_bind(cg, values);
+            cg_emit(cg, Op_ListValue, l->list, rv, 0, NULL);
+            cg_jump(cg, Op_Seek, t->cursor, more, rv);
+        }
+        else if (path->eq != NULL)
+        {
+            cg_col_cmp(cg, path->eq, table, pk, &op, &v);
+            cg_jump(cg, Op_Seek, t->cursor, end, cg_value(cg, v));
+        }
+        else if (path->lower != NULL)
+        {
+            cg_col_cmp(cg, path->lower, table, pk, &op, &v);
+            cg_jump(cg, op == RA_COND_GT ? Op_SeekGt : Op_SeekGe, t->cursor, end, cg_value(cg, v));
+        }
+        else
+            cg_rewind(cg, t->cursor, path->last, end);
+
+        cg_bind(cg, top);
+
+        if (path->upper != NULL)
+        {
+            /* Stop once the key is past the upper bound */
+            cg_col_cmp(cg, path->upper, table, pk, &op, &v);
+            cg_load_column(cg, table, pk);
+            cg_jump(cg, op == RA_COND_LT ? Op_Ge : Op_Gt, cg_value(cg, v), end, t->colReg[pk]);
+        }
+    }
+
+    /* The conjuncts, each right after the columns it needs are loaded */
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (cg->preds[i].level == table && !cg->preds[i].seek && !cg->preds[i].build)
+        {
+            cg_load_cond(cg, cg->preds[i].cond);
+            cg_cond(cg, cg->preds[i].cond, next, false);
+        }
+
+    /* The columns (and the computed expressions) needed by the inner
+     * loops and the result row */
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        if (t->colReg[i] >= 0)
+            cg_load_column(cg, table, i);
+    cg_compute(cg, table);
+
+    if (table + 1 < cg->nTables)
+        cg_loop(cg, table + 1);
+    else
+    {
+        /* In an outer join, the row of each table has a match */
+        if (cg->keepProbe)
+            cg_emit(cg, Op_Integer, 1, cg->matched, 0, NULL);
+        if (cg->keepBuild)
+            cg_emit(cg, Op_HashMark, path->hash, 0, 0, NULL);
+
+        cg_result_row(cg);
+    }
+
+    cg_bind(cg, next);
+    if (path->index != NULL && path->index->nCols > 1)
+        cg_jump(cg, Op_KeyNext, path->cursor, top, 0);
+    else if (path->index != NULL && !path->once)
+        cg_jump(cg, path->desc ? Op_Prev : Op_Next, path->cursor, top, 0);
+    else if (path->hash >= 0)
+        cg_jump(cg, Op_HashNext, path->hash, top, 0);
+    else if (path->index == NULL && path->eq == NULL && l == NULL && !path->once)
+        cg_jump(cg, path->desc ? Op_Prev : Op_Next, t->cursor, top, 0);
+    if (l != NULL)
+    {
+        cg_bind(cg, more);
+        cg_jump(cg, Op_ListNext, l->list, values, 0);
+    }
+    cg_bind(cg, end);
+
+    /* In a LEFT or FULL outer join, a row of the first table with no match
+     * is produced with NULL in the columns of the second table */
+    if (path->hash >= 0 && cg->keepProbe)
+    {
+        int32_t skip = cg_label(cg);
+
+        cg_jump(cg, Op_Eq, cg->one, skip, cg->matched);
+        cg_null_table(cg, table);
+        cg_result_row(cg);
+        cg_bind(cg, skip);
+    }
+
+    /* The columns are loaded (and the expressions computed) again in the
+     * next iteration of the outer loop */
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        t->loaded[i] = false;
+    cg_uncompute(cg, table);
+}
+
+/* Emits the loops over the rows of the tables (see cg_loop), from opening
+ * their cursors to closing them */
+static void cg_scan(codegen_t *cg)
+{
+    int32_t rroot = cg_regs(cg, 1);
+
+    /* The table of a covering index is not read */
+    for (uint32_t i = 0; i < cg->nTables; i++)
+    {
+        if (!cg->tables[i].path.covering)
+        {
+            cg_emit(cg, Op_Integer, cg->tables[i].schema->nroot, rroot, 0, NULL);
+            cg_emit(cg, Op_OpenRead, cg->tables[i].cursor, rroot, cg->tables[i].schema->nCols, NULL);
+        }
+
+        if (cg->tables[i].path.index != NULL)
+        {
+            cg_emit(cg, Op_Integer, cg->tables[i].path.index->nroot, rroot, 0, NULL);
+            if (cg->tables[i].path.index->nCols > 1)
+                cg_emit(cg, Op_KeyOpen, cg->tables[i].path.cursor, rroot, 0, NULL);
+            else
+                cg_emit(cg, Op_OpenRead, cg->tables[i].path.cursor, rroot, 0, NULL);
+        }
+    }
+
+    if (cg->outer)
+        cg_emit(cg, Op_Integer, 1, cg->one, 0, NULL);
+
+    for (uint32_t i = 0; i < cg->nTables; i++)
+        if (cg->tables[i].path.hash >= 0)
+            cg_hash_build(cg, i);
+
+    cg_loop(cg, 0);
+
+    /* In a RIGHT or FULL outer join, the rows of the second table with
+     * no match, with NULL in the columns of the first table */
+    if (cg->keepBuild)
+    {
+        cg_table_t *t = &cg->tables[1];
+        int32_t top = cg_label(cg), done = cg_label(cg), h = t->path.hash;
+
+        cg_jump(cg, Op_HashUnmatched, h, done, 0);
+        cg_bind(cg, top);
+        cg_emit(cg, Op_HashRow, h, t->block, 0, NULL);
+        cg_null_table(cg, 0);
+
+        /* The expressions computed from the columns of the second table */
+        for (uint32_t i = 0; i < t->schema->nCols; i++)
+            t->loaded[i] = t->colReg[i] >= 0;
+        cg_compute(cg, 1);
+        for (uint32_t i = 0; i < t->schema->nCols; i++)
+            t->loaded[i] = false;
+        cg_uncompute(cg, 1);
+
+        cg_result_row(cg);
+        cg_jump(cg, Op_HashNext, h, top, 0);
+        cg_bind(cg, done);
+    }
+
+    for (uint32_t i = 0; i < cg->nTables; i++)
+    {
+        if (cg->tables[i].path.hash >= 0)
+            cg_emit(cg, Op_HashClose, cg->tables[i].path.hash, 0, 0, NULL);
+        if (!cg->tables[i].path.covering)
+            cg_emit(cg, Op_Close, cg->tables[i].cursor, 0, 0, NULL);
+        if (cg->tables[i].path.index != NULL)
+            cg_emit(cg, cg->tables[i].path.index->nCols > 1 ? Op_KeyClose : Op_Close,
+                    cg->tables[i].path.cursor, 0, 0, NULL);
+    }
+}
+
+/* Returns a conjunct of the first table's loop as (col op v), where v
+ * is known before the loop (see cg_col_cmp). Returns false if the
+ * conjunct is not a comparison of a column with such a value */
+static bool cg_batch_cmp(codegen_t *cg, cg_pred_t *pred, int32_t *col, enum CondType *op, Expression_t **v)
+{
+    for (*col = 0; *col < (int32_t) cg->tables[0].schema->nCols; (*col)++)
+        if (cg_col_cmp(cg, pred, 0, *col, op, v))
+            return true;
+
+    return false;
+}
+
+/* Can the rows of a SELECT be read in batches (see the vectorized
+ * instructions in dbm-ops.c)? They can in a full scan of a single table,
+ * whose conjuncts all compare a column with a constant, and whose result
+ * row only has columns of the table (each of them loaded directly into
+ * it, since VResultRow produces the row from the vector registers with
+ * the same numbers), with no aggregation, DISTINCT, ORDER BY or LIMIT, and
+ * no dictionary-encoded columns */
+static bool cg_batch(codegen_t *cg)
+{
+    cg_table_t *t = &cg->tables[0];
+    cg_path_t *path = &t->path;
+    enum CondType op;
+    Expression_t *v;
+    int32_t col;
+
+    if (cg->nTables != 1 || cg->outer || cg->agg >= 0 || cg->distinct >= 0 || cg->sorter >= 0 ||
+        cg->set >= 0 || cg->limit >= 0 || t->dict >= 0)
+        return false;
+
+    if (path->index != NULL || path->hash >= 0 || path->eq != NULL || path->lower != NULL ||
+        path->upper != NULL || path->in != NULL || path->last || path->desc || path->once)
+        return false;
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (cg->preds[i].level == 0 && !cg_batch_cmp(cg, &cg->preds[i], &col, &op, &v))
+            return false;
+
+    for (uint32_t i = 0; i < cg->nCalcs; i++)
+        if (cg->calcs[i].level == 0)
+            return false;
+
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+    {
+        cg_output_t *out = &cg->outputs[i];
+
+        if (out->expr != NULL || out->copy || t->colReg[out->col] != cg->rr + (int32_t) i)
+            return false;
+    }
+
+    return true;
+}
+
+/* Vectorized comparison that removes the rows where (col op v) is false */
+static opcode_t cg_vcmp_op(enum CondType t)
+{
+    switch (t)
+    {
+    case RA_COND_EQ:
+        return Op_VNe;
+    case RA_COND_LT:
+        return Op_VGe;
+    case RA_COND_GT:
+        return Op_VLe;
+    case RA_COND_LEQ:
+        return Op_VGt;
+    default:
+        return Op_VLt;
+    }
+}
+
+/* Emits the instruction that loads a column of the current batch into
+ * the vector register with the same number as the column's register */
+static void cg_batch_column(codegen_t *cg, int32_t batch, int32_t col)
+{
+    cg_table_t *t = &cg->tables[0];
+
+    if (t->loaded[col])
+        return;
+
+    if (col == t->schema->pk)
+        cg_emit(cg, Op_VKey, batch, t->colReg[col], 0, NULL);
+    else
+        cg_emit(cg, Op_VColumn, batch, col, t->colReg[col], NULL);
+
+    t->loaded[col] = true;
+}
+
+/* Emits the loop over the batches of rows of a table (see cg_batch).
+ * Each conjunct removes rows from the batch, right after the column it
+ * needs is loaded, so the other columns are only loaded for the rows
+ * that are left */
+static void cg_batch_scan(codegen_t *cg)
+{
+    cg_table_t *t = &cg->tables[0];
+    int32_t rroot = cg_regs(cg, 1), batch = cg->nBatches++;
+    int32_t top = cg_label(cg), end = cg_label(cg);
+    enum CondType op;
+    Expression_t *v;
+    int32_t col;
+
+    cg_emit(cg, Op_Integer, t->schema->nroot, rroot, 0, NULL);
+    cg_emit(cg, Op_BatchOpen, batch, rroot, 0, NULL);
+    cg_jump(cg, Op_BatchRewind, batch, end, 0);
+    cg_bind(cg, top);
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (cg->preds[i].level == 0)
+        {
+            cg_batch_cmp(cg, &cg->preds[i], &col, &op, &v);
+            cg_batch_column(cg, batch, col);
+            cg_emit(cg, cg_vcmp_op(op), cg_value(cg, v), batch, t->colReg[col], NULL);
+        }
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        if (t->colReg[i] >= 0)
+            cg_batch_column(cg, batch, i);
+
+    cg_emit(cg, Op_VResultRow, cg->rr, cg->nOutputs, batch, NULL);
+    cg_jump(cg, Op_BatchNext, batch, top, 0);
+    cg_bind(cg, end);
+    cg_emit(cg, Op_BatchClose, batch, 0, 0, NULL);
+
+    for (uint32_t i = 0; i < t->schema->nCols; i++)
+        t->loaded[i] = false;
+}
+
+/* Generates the code for a SELECT statement */
+static int cg_select(codegen_t *cg, SRA_t *sra, RA_t *ra)
+{
+    SRA_t *join;
+    Condition_t *where = NULL;
+    Expression_t *order;
+    int32_t end, rroot, level;
+    bool aggregate;
+    int rc;
+
+    if (sra->t != SRA_PROJECT)
+        return CHIDB_EINVALIDSQL;
+
+    /* Outer joins have no RA, so they are compiled from the SRA */
+    join = sra->project.sra;
+    if (join->t == SRA_SELECT)
+    {
+        where = join->select.cond;
+        join = join->select.sra;
+    }
+
+    if (join->t == SRA_LEFT_OUTER_JOIN || join->t == SRA_RIGHT_OUTER_JOIN || join->t == SRA_FULL_OUTER_JOIN)
+    {
+        if ((rc = cg_outer_join(cg, join, where)) != CHIDB_OK ||
+            (rc = cg_add_outputs(cg, sra->project.expr_list)) != CHIDB_OK)
+            return rc;
+    }
+    else
+    {
+        if (ra == NULL || ra->t != RA_PI)
+            return CHIDB_EINVALIDSQL;
+
+        if ((rc = cg_from(cg, ra->pi.ra)) != CHIDB_OK ||
+            (rc = cg_add_outputs(cg, ra->pi.expr_list)) != CHIDB_OK)
+            return rc;
+
+        /* Assign each conjunct to a loop */
+        for (uint32_t i = 0; i < cg->nPreds && rc == CHIDB_OK; i++)
+            rc = cg_cond_level(cg, cg->preds[i].cond, &cg->preds[i].level);
+    }
+
+    order = sra->project.order_by;
+    aggregate = cg->nAggs > 0 || sra->project.group_by != NULL ||
+                (order != NULL && order->t == EXPR_TERM && order->expr.term.t == TERM_FUNC);
+
+    /* The result row. Columns of the tables (and computed expressions) are
+     * loaded directly into it, unless they appear in it more than once (or
+     * the rows are aggregated, in which case they are copied from the groups). With an ORDER BY, it
+     * is preceded by the sort key, so that both are a row of the sorter */
+    if (order != NULL)
+    {
+        cg->sorter = 0;
+        cg->order = order;
+        cg->key = cg_regs(cg, 1 + cg->nOutputs);
+        cg->rr = cg->key + 1;
+    }
+    else
+        cg->rr = cg_regs(cg, cg->nOutputs);
+    for (uint32_t i = 0; i < cg->nOutputs && rc == CHIDB_OK; i++)
+    {
+        cg_output_t *out = &cg->outputs[i];
+
+        if (out->calc && cg_find_calc(cg, out->expr) == NULL)
+            rc = cg_add_calc(cg, out->expr, cg->rr + i);
+        else if (out->calc)
+            out->copy = true;
+        else if (out->expr != NULL)
+            rc = cg_add_const(cg, out->expr, out->expr->expr.term.t == TERM_NULL ? NULL : out->expr->expr.term.val, cg->rr + i);
+        else if (!aggregate && cg->tables[out->table].colReg[out->col] < 0)
+            cg->tables[out->table].colReg[out->col] = cg->rr + i;
+        else
+            out->copy = true;
+    }
+
+    if (rc == CHIDB_OK && aggregate)
+        rc = cg_aggregate(cg, sra->project.group_by);
+    else if (rc == CHIDB_OK && order != NULL)
+        rc = cg_expr_level(cg, order, &level) == CHIDB_OK ? cg_use_expr(cg, order) : CHIDB_EINVALIDSQL;
+
+    if (rc == CHIDB_OK && sra->project.distinct)
+        rc = cg_distinct(cg);
+
+    /* Choose how each table is accessed (the second table of an outer
+     * join is always hashed) */
+    for (uint32_t i = 0; i < cg->nTables && rc == CHIDB_OK; i++)
+    {
+        if (!cg->outer || i == 0)
+            cg_access_path(cg, i);
+        if (!cg_hash_path(cg, i) && cg->outer && i == 1)
+            rc = CHIDB_EINVALIDSQL;
+    }
+
+    /* COUNT(*) of a whole table doesn't have to read the table's rows. In
+     * a sorted aggregation (or a sorted DISTINCT), the rows are produced in
+     * order of the GROUP BY (or the DISTINCT) column, so they don't have to
+     * be sorted again */
+    if (rc == CHIDB_OK && cg->agg >= 0)
+    {
+        cg->count = cg->group == NULL && cg->nTables == 1 && !cg->outer && cg->nPreds == 0;
+        for (uint32_t i = 0; i < cg->nAggs; i++)
+            if (!cg_is_star(cg->aggs[i]->expr.term.f.expr))
+                cg->count = false;
+    }
+
+    if (rc == CHIDB_OK)
+    {
+        cg_stream(cg);
+        if (cg->sorter >= 0 && sra->project.asc_desc != ORDER_BY_DESC &&
+            ((cg->sorted && cg_agg_reg(cg, order) == cg->aggReg) ||
+             (cg->distinctSorted && cg_is_col(cg, order, 0, cg->outputs[0].col))))
+            cg->sorter = -1;
+        if (cg->sorter >= 0 && cg_order(cg, sra->project.asc_desc))
+            cg->sorter = -1;
+    }
+
+    /* LIMIT and OFFSET (the operands of a set operation have neither) */
+    if (sra->project.limit >= 0)
+    {
+        cg->limit = cg_regs(cg, 1);
+        if (sra->project.offset > 0)
+            cg->offset = cg_regs(cg, 1);
+        if (cg->stop < 0)
+            cg->stop = cg_label(cg);
+    }
+
+    /* The rows of the hash set of a DISTINCT */
+    if (cg->distinct >= 0)
+        cg->distinctReg = cg_regs(cg, (cg->sorter >= 0) + cg->nOutputs);
+
+    /* Allocate the registers that the conjuncts and seeks need */
+    for (uint32_t i = 0; i < cg->nPreds && rc == CHIDB_OK; i++)
+    {
+        cg_pred_t *pred = &cg->preds[i];
+        enum CondType op;
+        Expression_t *v;
+
+        if (!pred->seek)
+            rc = cg_use_cond(cg, pred->cond);
+        else if (pred->cond->t == RA_COND_IN)
+            rc = cg_add_list(cg, pred->cond);
+        else
+        {
+            cg_table_t *t = &cg->tables[pred->level];
+
+            cg_col_cmp(cg, pred, pred->level, t->path.col, &op, &v);
+            rc = cg_use_expr(cg, v);
+
+            /* The upper bound of a table scan is compared with the key */
+            if (pred == t->path.upper && t->path.index == NULL && t->colReg[t->schema->pk] < 0)
+                t->colReg[t->schema->pk] = cg_regs(cg, 1);
+        }
+    }
+
+    /* A dictionary-encoded column that is only compared with constants is
+     * loaded as its code, and never decoded. So is one that is (also) the
+     * GROUP BY column, or a column of the result row of a DISTINCT, and is
+     * not used otherwise: its codes are decoded in the rows of the
+     * aggregator (outer joins and hashed tables always decode them). Any
+     * other one is decoded */
+    for (uint32_t i = 0; i < cg->nTables && rc == CHIDB_OK; i++)
+    {
+        cg_table_t *t = &cg->tables[i];
+
+        if (t->schema->dict == 0)
+            continue;
+
+        for (uint32_t j = 0; j < t->schema->nCols; j++)
+        {
+            if (t->compared[j] && t->colReg[j] < 0 && !(t->path.hash >= 0 && (int32_t) j == t->path.col))
+            {
+                t->colReg[j] = cg_regs(cg, 1);
+                t->coded[j] = true;
+            }
+            else if (t->schema->encoded[j] && t->colReg[j] >= 0 && !t->valued[j] &&
+                     (cg->agg >= 0 || cg->distinct >= 0) && !cg->outer && t->path.hash < 0)
+                t->coded[j] = true;
+            if (t->schema->encoded[j] && t->colReg[j] >= 0 && t->dict < 0)
+                t->dict = cg_regs(cg, 1);
+        }
+    }
+
+    for (uint32_t i = 0; i < cg->nCodes; i++)
+        if (cg->tables[cg->codes[i].table].coded[cg->codes[i].col])
+            cg->codes[i].reg = cg_regs(cg, 1);
+
+    /* The columns of a hashed table (including the column that it is keyed
+     * by) go in a block of registers, and they are copied to the result
+     * row, since HashRow overwrites the block */
+    for (uint32_t i = 0; i < cg->nTables && rc == CHIDB_OK; i++)
+    {
+        cg_table_t *t = &cg->tables[i];
+
+        if (t->path.hash < 0)
+            continue;
+
+        if (t->colReg[t->path.col] < 0)
+            t->colReg[t->path.col] = 0;
+
+        t->nBlock = 0;
+        for (uint32_t j = 0; j < t->schema->nCols; j++)
+            t->nBlock += t->colReg[j] >= 0;
+
+        t->block = cg_regs(cg, t->nBlock);
+        for (uint32_t j = 0, n = 0; j < t->schema->nCols; j++)
+            if (t->colReg[j] >= 0)
+                t->colReg[j] = t->block + n++;
+    }
+
+    for (uint32_t i = 0; i < cg->nOutputs; i++)
+        if (cg->outputs[i].expr == NULL && cg->tables[cg->outputs[i].table].path.hash >= 0)
+            cg->outputs[i].copy = true;
+
+    /* The index that each table is read through (which may have been
+     * chosen after its access path, see cg_stream and cg_order) */
+    for (uint32_t i = 0; i < cg->nTables; i++)
+        if (cg->tables[i].path.index != NULL && cg->tables[i].path.index->nCols == 1)
+            cg->tables[i].path.covering = cg_covers(cg, i, cg->tables[i].path.col);
+
+    if (cg->outer)
+    {
+        cg->matched = cg_regs(cg, 1);
+        cg->one = cg_regs(cg, 1);
+    }
+
+    /* The columns of a set operation are those of its first operand */
+    if (rc != CHIDB_OK || (cg->stmt->cols == NULL && (rc = cg_set_cols(cg)) != CHIDB_OK))
+        return rc;
+
+    /* Constants (and the expressions computed from them), and conjuncts
+     * that don't depend on any table (if they are false, there are no rows,
+     * but an aggregation still produces its groups). The aggregator and
+     * the sorter are opened before them */
+    end = cg_label(cg);
+    cg_load_consts(cg);
+    cg_compute(cg, -1);
+
+    /* With LIMIT 0, there are no rows */
+    if (cg->limit >= 0)
+    {
+        cg_emit(cg, Op_Integer, sra->project.limit > 0 ? sra->project.limit : 1, cg->limit, 0, NULL);
+        if (sra->project.limit == 0)
+            cg_jump(cg, Op_DecrJumpZero, cg->limit, cg->stop, 0);
+    }
+    if (cg->offset >= 0)
+        cg_emit(cg, Op_Integer, sra->project.offset, cg->offset, 0, NULL);
+
+    if (cg->agg >= 0 && !cg->count)
+    {
+        /* A character for each function (see AggOpen), in the order of enum FuncType */
+        char funcs[CG_MAX_AGGS + 1];
+
+        for (uint32_t i = 0; i < cg->nAggs; i++)
+            funcs[i] = cg_is_star(cg->aggs[i]->expr.term.f.expr) ? 'C' : "xncas"[cg->aggs[i]->expr.term.f.t];
+        funcs[cg->nAggs] = '\0';
+
+        cg_emit(cg, Op_AggOpen, cg->agg, cg->group != NULL, cg->sorted ? -1 : 0, funcs);
+    }
+
+    if (cg->distinct >= 0)
+        cg_emit(cg, Op_AggOpen, cg->distinct, (cg->sorter >= 0) + cg->nOutputs, cg->distinctSorted ? -1 : 0, "");
+
+    if (cg->sorter >= 0)
+        cg_emit(cg, Op_SorterOpen, cg->sorter, 1 + cg->nOutputs, 0,
+                sra->project.asc_desc == ORDER_BY_DESC ? "-" : "+");
+
+    /* A top-n sort only keeps the rows that can still be produced */
+    if (cg->sorter >= 0 && sra->project.limit > 0 &&
+        (int64_t) sra->project.limit + sra->project.offset <= INT32_MAX)
+        cg_emit(cg, Op_SorterLimit, cg->sorter, sra->project.limit + sra->project.offset, 0, NULL);
+
+    for (uint32_t i = 0; i < cg->nPreds; i++)
+        if (cg->preds[i].level < 0)
+            cg_cond(cg, cg->preds[i].cond, end, false);
+
+    if (cg->count)
+    {
+        /* COUNT(*) of a whole table is the number of entries in its B-Tree */
+        rroot = cg_regs(cg, 1);
+        cg_emit(cg, Op_Integer, cg->tables[0].schema->nroot, rroot, 0, NULL);
+        cg_emit(cg, Op_Count, rroot, cg->aggReg, 0, NULL);
+        cg_emit_row(cg);
+    }
+    else if (cg_batch(cg))
+        cg_batch_scan(cg);
+    else
+        cg_scan(cg);
+    cg_bind(cg, end);
+
+    for (uint32_t i = 0; i < cg->nLists; i++)
+        cg_emit(cg, Op_ListClose, cg->lists[i].list, 0, 0, NULL);
+
+    /* In an aggregation, the result rows are the groups */
+    if (cg->agg >= 0 && !cg->count)
+    {
+        int32_t top = cg_label(cg), done = cg_label(cg);
+
+        cg_jump(cg, Op_AggRewind, cg->agg, done, 0);
+        cg_bind(cg, top);
+        cg_agg_row(cg, cg->agg, cg->aggReg);
+        cg_emit_row(cg);
+        cg_jump(cg, Op_AggNext, cg->agg, top, 0);
+        cg_bind(cg, done);
+        cg_emit(cg, Op_AggClose, cg->agg, 0, 0, NULL);
+    }
+
+    /* With a DISTINCT, the result rows are the rows of the hash set (in a
+     * sorted set, all but the last one have been produced already) */
+    if (cg->distinct >= 0)
+    {
+        int32_t top = cg_label(cg), done = cg_label(cg);
+
+        cg_jump(cg, Op_AggRewind, cg->distinct, done, 0);
+        cg_bind(cg, top);
+        cg_agg_row(cg, cg->distinct, cg->distinctReg);
+        cg_sink(cg, cg->distinctReg, cg->nOutputs);
+        cg_jump(cg, Op_AggNext, cg->distinct, top, 0);
+        cg_bind(cg, done);
+        cg_emit(cg, Op_AggClose, cg->distinct, 0, 0, NULL);
+    }
+
+    /* With an ORDER BY, the result rows come out of the sorter */
+    if (cg->sorter >= 0)
+    {
+        int32_t top = cg_label(cg), done = cg_label(cg);
+
+        cg_jump(cg, Op_SorterSort, cg->sorter, done, 0);
+        cg_bind(cg, top);
+        cg_emit(cg, Op_SorterRow, cg->sorter, cg->key, 0, NULL);
+        cg_result(cg, cg->rr, cg->nOutputs);
+        cg_jump(cg, Op_SorterNext, cg->sorter, top, 0);
+        cg_bind(cg, done);
+        cg_emit(cg, Op_SorterClose, cg->sorter, 0, 0, NULL);
+    }
+
+    return CHIDB_OK;
+}
+
+
+/*
+ * SET OPERATIONS
+ */
+
+/* Frees the nodes of an RA tree produced by SRA_desugar (but not its
+ * conditions and expressions, which belong to the SRA tree) */
+static void cg_free_ra(RA_t *ra)
+{
+    if (ra == NULL)
+        return;
+
+    switch (ra->t)
+    {
+    case RA_TABLE:
+        free(ra->table.name);
+        break;
+    case RA_SIGMA:
+        cg_free_ra(ra->sigma.ra);
+        break;
+    case RA_PI:
+        cg_free_ra(ra->pi.ra);
+        break;
+    case RA_RHO_TABLE:
+    case RA_RHO_EXPR:
+        cg_free_ra(ra->rho.ra);
+        free(ra->rho.new_name);
+        break;
+    default:
+        cg_free_ra(ra->binary.ra1);
+        cg_free_ra(ra->binary.ra2);
+    }
+
+    free(ra);
+}
+
+/* Frees the state of a SELECT, once its code has been generated, so that
+ * the next operand of a set operation can be compiled */
+static void cg_reset(codegen_t *cg)
+{
+    for (uint32_t i = 0; i < cg->nTables; i++)
+    {
+        free(cg->tables[i].colReg);
+        free(cg->tables[i].loaded);
+        free(cg->tables[i].compared);
+        free(cg->tables[i].coded);
+        free(cg->tables[i].valued);
+    }
+    free(cg->tables);
+    free(cg->preds);
+    free(cg->aggs);
+    free(cg->outputs);
+    free(cg->consts);
+    free(cg->codes);
+    free(cg->lists);
+    free(cg->calcs);
+
+    cg->tables = NULL;
+    cg->nTables = 0;
+    cg->preds = NULL;
+    cg->nPreds = 0;
+    cg->outputs = NULL;
+    cg->nOutputs = 0;
+    cg->consts = NULL;
+    cg->nConsts = 0;
+    cg->codes = NULL;
+    cg->nCodes = 0;
+    cg->lists = NULL;
+    cg->nLists = 0;
+    cg->calcs = NULL;
+    cg->nCalcs = 0;
+    cg->outer = cg->keepProbe = cg->keepBuild = false;
+    cg->sorter = -1;
+    cg->limit = cg->offset = -1;
+    cg->order = NULL;
+    cg->agg = -1;
+    cg->group = NULL;
+    cg->aggs = NULL;
+    cg->nAggs = 0;
+    cg->sorted = cg->count = false;
+    cg->distinct = -1;
+    cg->distinctSorted = false;
+}
+
+static int cg_compound(codegen_t *cg, SRA_t *sra, RA_t *ra, uint32_t *ncols);
+
+/* Generates the code for a SELECT or a set operation, with its plan (or
+ * NULL, if it has none, in which case the SELECT's RA is used), and
+ * returns its number of columns */
+static int cg_query(codegen_t *cg, SRA_t *sra, RA_t *ra, uint32_t *ncols)
+{
+    RA_t *desugared = NULL;
+    int rc;
+
+    if (sra->t == SRA_UNION || sra->t == SRA_INTERSECT || sra->t == SRA_EXCEPT)
+        return cg_compound(cg, sra, ra, ncols);
+
+    if (ra == NULL && sra->t == SRA_PROJECT)
+        ra = desugared = SRA_desugar(sra);
+
+    rc = cg_select(cg, sra, ra);
+    *ncols = cg->nOutputs;
+
+    cg_reset(cg);
+    cg_free_ra(desugared);
+
+    return rc;
+}
+
+/* Generates the code for a set operation of two SELECTs (or of a set
+ * operation and a SELECT), with its plan (a Union of the plans of its
+ * operands, or NULL). The operands are compiled one after the other, and
+ * their result rows are added, as keys, to a hash set (an aggregator,
+ * which spills to disk if the keys don't fit in memory). With a UNION,
+ * the rows of the set are the result. With an INTERSECT or an EXCEPT, the
+ * set counts the rows from each operand (COUNT of 1 for the rows of one
+ * operand, and of NULL for the rows of the other one), and only the rows
+ * that are in both operands, or only in the first one, are produced. The
+ * operands can't have an ORDER BY or a LIMIT, and they must have the same
+ * number of columns */
+static int cg_compound(codegen_t *cg, SRA_t *sra, RA_t *ra, uint32_t *ncols)
+{
+    int32_t set = cg->nAggregators++, parent = cg->set, parentArgs = cg->setArgs;
+    int32_t args = 0, row, zero = 0, top, done, skip;
+    bool counts = sra->t != SRA_UNION;
+    uint32_t open, n1 = 0, n2 = 0;
+    int rc;
+
+    if ((sra->binary.sra1->t == SRA_PROJECT &&
+         (sra->binary.sra1->project.order_by != NULL || sra->binary.sra1->project.limit >= 0)) ||
+        (sra->binary.sra2->t == SRA_PROJECT &&
+         (sra->binary.sra2->project.order_by != NULL || sra->binary.sra2->project.limit >= 0)))
+        return CHIDB_EINVALIDSQL;
+
+    /* The arguments of the counts: 1 and NULL for the rows of the first
+     * operand, NULL and 1 for the rows of the second one */
+    if (counts)
+    {
+        args = cg_regs(cg, 3);
+        cg_emit(cg, Op_Integer, 1, args, 0, NULL);
+        cg_emit(cg, Op_Null, 0, args + 1, 0, NULL);
+        cg_emit(cg, Op_Integer, 1, args + 2, 0, NULL);
+    }
+
+    /* The number of columns in the key is set once the first operand has
+     * been compiled */
+    open = cg->addr;
+    cg_emit(cg, Op_AggOpen, set, 0, 0, counts ? "cc" : "");
+
+    cg->set = set;
+    cg->setArgs = args;
+    rc = cg_query(cg, sra->binary.sra1, ra != NULL ? ra->binary.ra1 : NULL, &n1);
+
+    cg->setArgs = args + counts;
+    if (rc == CHIDB_OK)
+        rc = cg_query(cg, sra->binary.sra2, ra != NULL ? ra->binary.ra2 : NULL, &n2);
+
+    cg->set = parent;
+    cg->setArgs = parentArgs;
+
+    if (rc != CHIDB_OK)
+        return rc;
+    if (n1 != n2)
+        return CHIDB_EINVALIDSQL;
+    if (cg->rc == CHIDB_OK)
+        cg->stmt->ops[open].p2 = n1;
+
+    /* The rows of the set, followed by their counts */
+    row = cg_regs(cg, n1 + 2 * counts);
+    if (counts)
+    {
+        zero = cg_regs(cg, 1);
+        cg_emit(cg, Op_Integer, 0, zero, 0, NULL);
+    }
+
+    top = cg_label(cg);
+    done = cg_label(cg);
+    skip = cg_label(cg);
+
+    cg_jump(cg, Op_AggRewind, set, done, 0);
+    cg_bind(cg, top);
+    cg_emit(cg, Op_AggRow, set, row, 0, NULL);
+    if (counts)
+    {
+        cg_jump(cg, Op_Eq, zero, skip, row + n1);
+        cg_jump(cg, sra->t == SRA_INTERSECT ? Op_Eq : Op_Gt, zero, skip, row + n1 + 1);
+    }
+    cg_sink(cg, row, n1);
+    cg_bind(cg, skip);
+    cg_jump(cg, Op_AggNext, set, top, 0);
+    cg_bind(cg, done);
+    cg_emit(cg, Op_AggClose, set, 0, 0, NULL);
+
+    *ncols = n1;
+
+    return CHIDB_OK;
+}
+
+/* Emits the end of the program of a SELECT (where a LIMIT stops it, any
+ * cursors, sorters and so on that are still open are closed when the
+ * statement is reset) */
+static void cg_halt(codegen_t *cg)
+{
+    if (cg->stop >= 0)
+        cg_bind(cg, cg->stop);
+    cg_emit(cg, Op_Halt, 0, 0, 0, NULL);
+
+    if (cg->corrupt >= 0)
+    {
+        cg_bind(cg, cg->corrupt);
+        cg_emit(cg, Op_Halt, CHIDB_ECORRUPT, 0, 0, "Index entry refers to a row that is not in the table");
+    }
+}
+
+/*
+ * INSERT
+ */
+
+/* Adds the values of a row of an INSERT as constants: the value of each
+ * column goes into its register of the record, from rec (NULL if it isn't
+ * given a value), except for the primary key, which goes into rkey and is
+ * stored as NULL in the record */
+static int cg_insert_row(codegen_t *cg, SchemaTable *t, Insert_t *insert, Literal_t *row,
+                         Literal_t **values, int32_t rec, int32_t rkey)
+{
+    StrList_t *name;
+    Literal_t *lit;
+    int32_t col;
+    uint32_t i;
+    int rc = CHIDB_OK;
+
+    for (lit = row, name = insert->col_names, i = 0; lit && rc == CHIDB_OK; lit = lit->next, i++)
+    {
+        if (name != NULL)
+        {
+            if (chidb_Schema_findColumn(t, name->str, &col) != CHIDB_OK || values[col] != NULL)
+                rc = CHIDB_EINVALIDSQL;
+            name = name->next;
+        }
+        else if (i < t->nCols)
+            col = i;
+        else
+            rc = CHIDB_EINVALIDSQL;
+
+        if (rc == CHIDB_OK)
+            values[col] = lit;
+    }
+
+    if (rc == CHIDB_OK && (name != NULL || (insert->col_names == NULL && i != t->nCols)))
+        rc = CHIDB_EINVALIDSQL;
+
+    if (rc == CHIDB_OK && (values[t->pk] == NULL ||
+                           (values[t->pk]->t != TYPE_INT && values[t->pk]->t != TYPE_PARAM)))
+        rc = CHIDB_EINVALIDSQL;
+
+    for (i = 0; i < t->nCols && rc == CHIDB_OK; i++)
+        rc = cg_add_const(cg, &values[i], i == t->pk ? NULL : values[i], rec + i);
+    if (rc == CHIDB_OK)
+        rc = cg_add_const(cg, values[t->pk], values[t->pk], rkey);
+
+    return rc;
+}
+
+/* Emits the instructions that replace the values of the dictionary-encoded
+ * columns of a row (its record, from rec) with their codes, adding them to
+ * the table's dictionary if they aren't there. rdict is a register for the
+ * root page of the dictionary, loaded if load is true */
+static void cg_insert_codes(codegen_t *cg, SchemaTable *t, int32_t rec, int32_t rdict, bool load)
+{
+    if (t->dict == 0)
+        return;
+
+    if (load)
+        cg_emit(cg, Op_Integer, t->dict, rdict, 0, NULL);
+    for (uint32_t i = 0; i < t->nCols; i++)
+        if (t->encoded[i] && (int32_t) i != t->pk)
+            cg_emit(cg, Op_DictEncode, rdict, rec + i, 1, NULL);
+}
+
+/* Emits the instructions that make the key of a row's entry in an index
+ * on several columns, from the registers of its record (from rec) and of
+ * its primary key (rkey). MakeKey fails if the entry doesn't fit in the
+ * index, so the keys are made before the row is inserted. Returns the
+ * key's register */
+static int32_t cg_index_key(codegen_t *cg, SchemaIndex *idx, int32_t rec, int32_t rkey)
+{
+    int32_t r = cg_regs(cg, idx->nCols + 1);
+
+    for (uint32_t i = 0; i < idx->nCols; i++)
+        cg_emit(cg, Op_SCopy, idx->cols[i] == idx->table->pk ? rkey : rec + idx->cols[i], r + i, 0, NULL);
+    cg_emit(cg, Op_MakeKey, r, idx->nCols, r + idx->nCols, "entry");
+
+    return r + idx->nCols;
+}
+
+/* Generates the code for an INSERT of several rows (a VALUES with more
+ * than one row). Each B-Tree is only opened once, and the rows (each of
+ * them preceded by its primary key) are added to a sorter, so they are
+ * inserted in order of their keys. The entries of a row in the table's
+ * indexes are inserted right after the row, so if an insertion fails,
+ * the rows inserted before it are in the indexes, and the rest are not */
+static int cg_insert_rows(codegen_t *cg, SchemaTable *t, Insert_t *insert, uint32_t nrows)
+{
+    Literal_t **values;
+    InsertRow_t *row = NULL;
+    int32_t rows, rrec, rroot, c, top, end, scans, *keys;
+    uint32_t n = t->nCols + 1;
+    int rc = CHIDB_OK;
+
+    /* The values of all the rows, one row (its key, then its record) after the other */
+    values = calloc(nrows * t->nCols, sizeof(Literal_t *));
+    if (values == NULL)
+        return CHIDB_ENOMEM;
+
+    rows = cg_regs(cg, nrows * n);
+    for (uint32_t r = 0; r < nrows && rc == CHIDB_OK; r++)
+    {
+        rc = cg_insert_row(cg, t, insert, r == 0 ? insert->values : row->values,
+                           values + r * t->nCols, rows + r * n + 1, rows + r * n);
+        row = r == 0 ? insert->more_rows : row->next;
+    }
+
+    free(values);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    /* The register with the key of each index on several columns */
+    keys = calloc(cg->schema->nIndexes, sizeof(int32_t));
+    if (keys == NULL)
+        return CHIDB_ENOMEM;
+
+    rrec = cg_regs(cg, 1);
+    rroot = cg_regs(cg, 1);
+    top = cg_label(cg);
+    end = cg_label(cg);
+
+    cg_load_consts(cg);
+    for (uint32_t r = 0; r < nrows; r++)
+        cg_insert_codes(cg, t, rows + r * n + 1, rroot, r == 0);
+
+    cg_emit(cg, Op_SorterOpen, 0, n, 0, "+");
+    for (uint32_t r = 0; r < nrows; r++)
+        cg_emit(cg, Op_SorterInsert, 0, rows + r * n, 0, NULL);
+
+    /* The table's cursor, followed by the cursor of each of its indexes
+     * on one column. Its indexes on several columns get key scans */
+    c = cg_cursor(cg);
+    scans = cg->nKeyScans;
+    cg_emit(cg, Op_Integer, t->nroot, rroot, 0, NULL);
+    cg_emit(cg, Op_OpenWrite, c, rroot, t->nCols, NULL);
+    for (uint32_t i = 0; i < cg->schema->nIndexes; i++)
+        if (cg->schema->indexes[i].table == t)
+        {
+            cg_emit(cg, Op_Integer, cg->schema->indexes[i].nroot, rroot, 0, NULL);
+            if (cg->schema->indexes[i].nCols > 1)
+                cg_emit(cg, Op_KeyOpen, cg->nKeyScans++, rroot, 0, NULL);
+            else
+                cg_emit(cg, Op_OpenWrite, cg_cursor(cg), rroot, 0, NULL);
+        }
+
+    /* Each row, in order of its key, and then its index entries */
+    cg_jump(cg, Op_SorterSort, 0, end, 0);
+    cg_bind(cg, top);
+    cg_emit(cg, Op_SorterRow, 0, rows, 0, NULL);
+    for (uint32_t i = 0; i < cg->schema->nIndexes; i++)
+        if (cg->schema->indexes[i].table == t && cg->schema->indexes[i].nCols > 1)
+            keys[i] = cg_index_key(cg, &cg->schema->indexes[i], rows + 1, rows);
+    cg_emit(cg, Op_MakeRecord, rows + 1, t->nCols, rrec, NULL);
+    cg_emit(cg, Op_Insert, c, rrec, rows, NULL);
+    for (uint32_t i = 0, ci = c + 1, ks = scans; i < cg->schema->nIndexes; i++)
+    {
+        SchemaIndex *idx = &cg->schema->indexes[i];
+
+        if (idx->table != t)
+            continue;
+        if (idx->nCols > 1)
+            cg_emit(cg, Op_KeyInsert, ks++, keys[i], rows, NULL);
+        else
+            cg_emit(cg, Op_IdxInsert, ci++, idx->col == t->pk ? rows : rows + 1 + idx->col, rows, NULL);
+    }
+    cg_jump(cg, Op_SorterNext, 0, top, 0);
+    cg_bind(cg, end);
+
+    for (int32_t ci = c; ci < (int32_t) cg->stmt->nCurAlloc; ci++)
+        cg_emit(cg, Op_Close, ci, 0, 0, NULL);
+    for (uint32_t ks = scans; ks < cg->nKeyScans; ks++)
+        cg_emit(cg, Op_KeyClose, ks, 0, 0, NULL);
+    cg_emit(cg, Op_SorterClose, 0, 0, 0, NULL);
+    cg_emit(cg, Op_Halt, 0, 0, 0, NULL);
+
+    free(keys);
+
+    return CHIDB_OK;
+}
+
+/* Generates the code for an INSERT statement */
+static int cg_insert(codegen_t *cg, Insert_t *insert)
+{
+    SchemaTable *t;
+    Literal_t **values;
+    int32_t rec, rkey, rrec, rroot, c, *keys;
+    uint32_t i, nrows = 1;
+    int rc;
+
+    if (chidb_Schema_findTable(cg->schema, insert->table_name, &t) != CHIDB_OK)
+        return CHIDB_EINVALIDSQL;
+
+    /* The key of the new entry is the value of the INTEGER PRIMARY KEY
+     * (generating keys for tables without one is not supported) */
+    if (t->pk < 0)
+        return CHIDB_EINVALIDSQL;
+
+    for (InsertRow_t *row = insert->more_rows; row; row = row->next)
+        nrows++;
+    if (nrows > 1)
+        return cg_insert_rows(cg, t, insert, nrows);
+
+    /* The value of each column */
+    values = calloc(t->nCols, sizeof(Literal_t *));
+    if (values == NULL)
+        return CHIDB_ENOMEM;
+
+    rec = cg_regs(cg, t->nCols);
+    rkey = cg_regs(cg, 1);
+    rc = cg_insert_row(cg, t, insert, insert->values, values, rec, rkey);
+
+    free(values);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    /* The register with the key of each index on several columns */
+    keys = calloc(cg->schema->nIndexes, sizeof(int32_t));
+    if (keys == NULL)
+        return CHIDB_ENOMEM;
+
+    rrec = cg_regs(cg, 1);
+    rroot = cg_regs(cg, 1);
+    c = cg_cursor(cg);
+
+    cg_load_consts(cg);
+    cg_insert_codes(cg, t, rec, rroot, true);
+
+    for (i = 0; i < cg->schema->nIndexes; i++)
+        if (cg->schema->indexes[i].table == t && cg->schema->indexes[i].nCols > 1)
+            keys[i] = cg_index_key(cg, &cg->schema->indexes[i], rec, rkey);
+
+    cg_emit(cg, Op_Integer, t->nroot, rroot, 0, NULL);
+    cg_emit(cg, Op_OpenWrite, c, rroot, t->nCols, NULL);
+    cg_emit(cg, Op_MakeRecord, rec, t->nCols, rrec, NULL);
+    cg_emit(cg, Op_Insert, c, rrec, rkey, NULL);
+    cg_emit(cg, Op_Close, c, 0, 0, NULL);
+
+    /* Add the new entry to the table's indexes */
+    for (i = 0; i < cg->schema->nIndexes; i++)
+    {
+        SchemaIndex *idx = &cg->schema->indexes[i];
+
+        if (idx->table != t)
+            continue;
+
+        cg_emit(cg, Op_Integer, idx->nroot, rroot, 0, NULL);
+        if (idx->nCols > 1)
+        {
+            cg_emit(cg, Op_KeyOpen, cg->nKeyScans, rroot, 0, NULL);
+            cg_emit(cg, Op_KeyInsert, cg->nKeyScans, keys[i], rkey, NULL);
+            cg_emit(cg, Op_KeyClose, cg->nKeyScans++, 0, 0, NULL);
+            continue;
+        }
+        cg_emit(cg, Op_OpenWrite, c, rroot, 0, NULL);
+        cg_emit(cg, Op_IdxInsert, c, idx->col == t->pk ? rkey : rec + idx->col, rkey, NULL);
+        cg_emit(cg, Op_Close, c, 0, 0, NULL);
+    }
+
+    free(keys);
+
+    cg_emit(cg, Op_Halt, 0, 0, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/*
+ * CREATE TABLE, CREATE INDEX
+ */
+
+/* Emits the instruction that creates a new B-Tree (CreateTable,
+ * CreateIndex, or KeyCreate). Returns the register with its root page */
+static int32_t cg_new_btree(codegen_t *cg, opcode_t create)
+{
+    int32_t rnew = cg_regs(cg, 1);
+
+    cg_emit(cg, create, rnew, 0, 0, NULL);
+
+    return rnew;
+}
+
+/* Emits the code that adds an entry to the schema table, for the B-Tree
+ * whose root page is in register rnew */
+static void cg_schema_entry(codegen_t *cg, int32_t rnew, const char *type,
+                            const char *name, const char *tbl_name, const char *sql)
+{
+    int32_t rec, rrec, rkey, rroot, c;
+
+    rec = cg_regs(cg, 5);
+    rrec = cg_regs(cg, 1);
+    rkey = cg_regs(cg, 1);
+    rroot = cg_regs(cg, 1);
+    c = cg_cursor(cg);
+
+    cg_emit(cg, Op_Integer, 1, rroot, 0, NULL);
+    cg_emit(cg, Op_OpenWrite, c, rroot, 5, NULL);
+    cg_emit(cg, Op_SCopy, rnew, rec + 3, 0, NULL);
+    cg_string(cg, type, rec);
+    cg_string(cg, name, rec + 1);
+    cg_string(cg, tbl_name, rec + 2);
+    cg_string(cg, sql, rec + 4);
+    cg_emit(cg, Op_MakeRecord, rec, 5, rrec, NULL);
+    cg_emit(cg, Op_Integer, cg->schema->maxKey + 1 + cg->nEntries++, rkey, 0, NULL);
+    cg_emit(cg, Op_Insert, c, rrec, rkey, NULL);
+    cg_emit(cg, Op_Close, c, 0, 0, NULL);
+}
+
+/* Generates the code for a CREATE TABLE or CREATE INDEX statement,
+ * which adds an entry to the schema table. An index is filled with the
+ * table's rows before its entry is added, so if that fails (e.g., the
+ * values of a row don't fit in the key of an index on several columns),
+ * the schema is left unchanged. A table with dictionary-encoded columns
+ * also gets a second entry, for its dictionary */
+static int cg_create(codegen_t *cg, Create_t *create, const char *text)
+{
+    SchemaTable *t = NULL, *tt;
+    SchemaIndex *idx;
+    const char *type, *name, *tbl_name;
+    int32_t cols[SCHEMA_MAX_INDEX_COLS], rnew, rkey, rroot, rval, c, ct;
+    uint32_t nCols = 0;
+    bool dict = false;
+    char *sql;
+    size_t len;
+
+    if (create->t == CREATE_TABLE)
+    {
+        type = "table";
+        name = tbl_name = create->table->name;
+
+        if (chidb_Schema_findTable(cg->schema, name, &tt) == CHIDB_OK)
+            return CHIDB_EINVALIDSQL;
+
+        /* Only TEXT columns can be dictionary-encoded */
+        for (Column_t *column = create->table->columns; column; column = column->next)
+            for (Constraint_t *cons = column->constraints; cons; cons = cons->next)
+                if (cons->t == CONS_DICTIONARY)
+                {
+                    if (column->type != TYPE_TEXT)
+                        return CHIDB_EINVALIDSQL;
+                    dict = true;
+                }
+    }
+    else
+    {
+        type = "index";
+        name = create->index->name;
+        tbl_name = create->index->table_name;
+
+        if (chidb_Schema_findIndex(cg->schema, name, &idx) == CHIDB_OK ||
+            chidb_Schema_findTable(cg->schema, tbl_name, &t) != CHIDB_OK)
+            return CHIDB_EINVALIDSQL;
+
+        /* The entries of an index are ordered by value, not by code,
+         * so dictionary-encoded columns can't be indexed */
+        for (StrList_t *column = create->index->columns; column; column = column->next)
+            if (nCols == SCHEMA_MAX_INDEX_COLS ||
+                chidb_Schema_findColumn(t, column->str, &cols[nCols]) != CHIDB_OK ||
+                t->encoded[cols[nCols++]])
+                return CHIDB_EINVALIDSQL;
+    }
+
+    /* The SQL stored in the schema table doesn't include the final semicolon */
+    len = strlen(text);
+    while (len > 0 && (text[len - 1] == ';' || isspace(text[len - 1])))
+        len--;
+    sql = strndup(text, len);
+    if (sql == NULL)
+        return CHIDB_ENOMEM;
+
+    /* An index on several columns is a key B-Tree (see keytree.c) */
+    if (create->t == CREATE_TABLE)
+        rnew = cg_new_btree(cg, Op_CreateTable);
+    else
+        rnew = cg_new_btree(cg, nCols > 1 ? Op_KeyCreate : Op_CreateIndex);
+
+    if (create->t == CREATE_INDEX)
+    {
+        int32_t top = cg_label(cg), end = cg_label(cg);
+
+        /* The value of each column, followed by their key */
+        rkey = cg_regs(cg, 1);
+        rroot = cg_regs(cg, 1);
+        rval = cg_regs(cg, nCols + 1);
+        c = nCols > 1 ? (int32_t) cg->nKeyScans++ : cg_cursor(cg);
+        ct = cg_cursor(cg);
+
+        cg_emit(cg, nCols > 1 ? Op_KeyOpen : Op_OpenWrite, c, rnew, 0, NULL);
+        cg_emit(cg, Op_Integer, t->nroot, rroot, 0, NULL);
+        cg_emit(cg, Op_OpenRead, ct, rroot, t->nCols, NULL);
+        cg_jump(cg, Op_Rewind, ct, end, 0);
+        cg_bind(cg, top);
+        for (uint32_t i = 0; i < nCols; i++)
+            if (cols[i] == t->pk)
+                cg_emit(cg, Op_Key, ct, rval + i, 0, NULL);
+            else
+                cg_emit(cg, Op_Column, ct, cols[i], rval + i, NULL);
+        cg_emit(cg, Op_Key, ct, rkey, 0, NULL);
+        if (nCols > 1)
+        {
+            cg_emit(cg, Op_MakeKey, rval, nCols, rval + nCols, "entry");
+            cg_emit(cg, Op_KeyInsert, c, rval + nCols, rkey, NULL);
+        }
+        else
+            cg_emit(cg, Op_IdxInsert, c, rval, rkey, NULL);
+        cg_jump(cg, Op_Next, ct, top, 0);
+        cg_bind(cg, end);
+        cg_emit(cg, Op_Close, ct, 0, 0, NULL);
+        cg_emit(cg, nCols > 1 ? Op_KeyClose : Op_Close, c, 0, 0, NULL);
+    }
+
+    cg_schema_entry(cg, rnew, type, name, tbl_name, sql);
+    free(sql);
+
+    if (dict)
+        cg_schema_entry(cg, cg_new_btree(cg, Op_CreateTable), "dictionary", name, tbl_name, "");
+
+    cg_emit(cg, Op_Halt, 0, 0, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/*
+ * ANALYZE
+ */
+
+/* Generates the code for an ANALYZE statement, which appends the
+ * statistics of the database to its statistics table (creating the
+ * table first, if the database has never been analyzed) */
+static int cg_analyze(codegen_t *cg)
+{
+    SchemaTable *t;
+    int32_t rroot;
+
+    if (chidb_Schema_findTable(cg->schema, STATS_TABLE, &t) == CHIDB_OK)
+    {
+        rroot = cg_regs(cg, 1);
+        cg_emit(cg, Op_Integer, t->nroot, rroot, 0, NULL);
+    }
+    else
+    {
+        rroot = cg_new_btree(cg, Op_CreateTable);
+        cg_schema_entry(cg, rroot, "table", STATS_TABLE, STATS_TABLE,
+                        "CREATE TABLE " STATS_TABLE "(id INTEGER PRIMARY KEY, type TEXT, "
+                        "tbl TEXT, name TEXT, stat TEXT)");
+    }
+
+    cg_emit(cg, Op_Analyze, rroot, 0, 0, NULL);
+    cg_emit(cg, Op_Halt, 0, 0, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/* Generate a DBM program from a SQL statement
+ *
+ * Parameters
+ * - stmt: DBM (with no instructions)
+ * - sql_stmt: SQL statement
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EINVALIDSQL: The statement refers to tables or columns that
+ *                      do not exist, or it is not supported
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when reading the schema
+ */
+int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
+{
+    codegen_t cg;
+    uint32_t ncols;
+    int rc;
+
+    memset(&cg, 0, sizeof(codegen_t));
+    cg.stmt = stmt;
+    cg.rc = CHIDB_OK;
+    cg.corrupt = -1;
+    cg.sorter = -1;
+    cg.limit = cg.offset = cg.stop = -1;
+    cg.agg = -1;
+    cg.distinct = -1;
+    cg.set = -1;
+
+    rc = chidb_Schema_get(stmt->db, &cg.schema);
+    if (rc == CHIDB_OK)
+        rc = chidb_Stats_get(stmt->db, &cg.stats);
+
+    if (rc == CHIDB_OK)
+    {
+        switch (sql_stmt->type)
+        {
+        case STMT_SELECT:
+            /* The plan chosen by the optimizer or, if the statement was
+             * not optimized, its RA (the RA of a set operation shares
+             * subtrees, so each operand is desugared on its own) */
+            if ((rc = cg_query(&cg, sql_stmt->stmt.select, sql_stmt->plan, &ncols)) == CHIDB_OK)
+                cg_halt(&cg);
+            break;
+        case STMT_INSERT:
+            rc = cg_insert(&cg, sql_stmt->stmt.insert);
+            break;
+        case STMT_CREATE:
+            rc = cg_create(&cg, sql_stmt->stmt.create, sql_stmt->text);
+            break;
+        case STMT_ANALYZE:
+            rc = cg_analyze(&cg);
+            break;
+        default:
+            rc = CHIDB_EINVALIDSQL;
+        }
+    }
+
+    if (rc == CHIDB_OK)
+        rc = cg.rc;
+
+    /* Replace the labels in jumps with their addresses */
+    for (uint32_t i = 0; i < cg.nFixups && rc == CHIDB_OK; i++)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[cg.fixups[i]];
+
+        op->p2 = cg.labels[op->p2];
+    }
+
+    cg_reset(&cg);
+    free(cg.labels);
+    free(cg.fixups);
+
+    return rc;
+}
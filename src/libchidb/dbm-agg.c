@@ -0,0 +1,883 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine aggregators
+ *
+ */
+
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The aggregation instructions (see dbm-ops.c) divide rows into groups
+ * by their key, and compute aggregate functions (COUNT, SUM, AVG, MIN
+ * and MAX) over the values of each group, in a single pass over the rows,
+ * without sorting them:
+ *
+ *  - AggStep adds a row: a key (a set of registers) and an argument for
+ *    each aggregate function. The state of the functions in the row's
+ *    group is updated with the arguments.
+ *  - AggRewind positions the aggregator on the first group, once all
+ *    the rows have been added, and AggNext on each of the following
+ *    ones. AggRow stores the key and the result of each function of the
+ *    current group in a set of registers.
+ *
+ * NULL keys are equal to each other (so, they form a single group), and
+ * NULL arguments are ignored (except by COUNT(*), which counts the rows).
+ * SUM, AVG, MIN and MAX are NULL in a group with no values. Since
+ * registers only hold 32-bit integers, AVG is the integer average
+ * (rounded toward zero), and a SUM that doesn't fit in a register is an
+ * error. If the key has no values, there is exactly one group, even if
+ * no rows were added (so that, for example, COUNT(*) is 0).
+ *
+ * The groups are kept in an open addressing hash table, with linear
+ * probing, and they are produced in the order in which they were
+ * created. Once the groups in memory take up more than the aggregator's
+ * budget, no more groups are created: the rows of the groups that are
+ * in memory are still aggregated, but the rows of any other group are
+ * written to one of DBM_AGG_NPART partitions, chosen by the high bits of
+ * the hash value of their key. Each partition is a temporary file, with
+ * the rows stored as their length (4 bytes) followed by a record with
+ * their key and arguments. Once the groups in memory have been produced,
+ * the partitions are read back, one at a time, and their rows are
+ * aggregated in the same way (a partition that doesn't fit in memory
+ * either is partitioned again, by the following bits of the hash value).
+ * So, every row is read from the input once, and written to a partition
+ * at most once per level of partitioning.
+ *
+ * If the rows are known to be in order of their key (for example, when
+ * they are read from an index on the GROUP BY column), the aggregator
+ * can be opened as a sorted aggregator instead. Then, all the rows of a
+ * group are added one after another, so only the current group is kept,
+ * and there is no hash table and no partitions. Before each row is
+ * added, AggBreak checks whether its key is the key of the current group:
+ * if it isn't, the current group is finished, and AggRow stores it
+ * (the next row that is added then starts a new group). The last group
+ * is produced, as usual, by AggRewind.
+ *
+ * An aggregator with no functions is a hash set of its keys (which is
+ * how the code generator removes duplicate rows, for DISTINCT and set
+ * operations).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbm-agg.h"
+#include "dbm-reg.h"
+#include "record.h"
+
+/* Bits of the hash value used to choose a partition at each level */
+#define AGG_PART_BITS (3)
+#define AGG_MAX_DEPTH (32 / AGG_PART_BITS)
+#define AGG_PART(hash, depth) (((hash) >> (32 - AGG_PART_BITS * ((depth) + 1))) & (DBM_AGG_NPART - 1))
+
+
+/* Get an aggregator
+ *
+ * Returns aggregator number nagg of a DBM program, allocating
+ * it if necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nagg: Aggregator number
+ * - a: Out parameter. Used to return a pointer to the aggregator.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid aggregator number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_agg_get(chidb_stmt *stmt, int32_t nagg, chidb_dbm_agg_t **a)
+{
+    if (nagg < 0)
+        return CHIDB_EMISUSE;
+
+    if (nagg >= stmt->nAggs)
+    {
+        chidb_dbm_agg_t *aggs = realloc(stmt->aggs, (nagg + 1) * sizeof(chidb_dbm_agg_t));
+        if (aggs == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&aggs[stmt->nAggs], 0, (nagg + 1 - stmt->nAggs) * sizeof(chidb_dbm_agg_t));
+        stmt->aggs = aggs;
+        stmt->nAggs = nagg + 1;
+    }
+
+    *a = &stmt->aggs[nagg];
+
+    return CHIDB_OK;
+}
+
+
+/* Hash value of a key (FNV-1a, over the type and the bytes of each value) */
+static uint32_t chidb_dbm_agg_hash(chidb_dbm_agg_t *a, chidb_dbm_register_t *key)
+{
+    uint32_t hash = 2166136261u;
+
+    for(uint32_t i = 0; i < a->nkeys; i++)
+    {
+        const uint8_t *p = NULL;
+        uint32_t len = 0;
+
+        if (key[i].type == REG_INT32)
+        {
+            p = (const uint8_t *) &key[i].value.i;
+            len = sizeof(int32_t);
+        }
+        else if (key[i].type == REG_STRING)
+        {
+            p = (const uint8_t *) key[i].value.s;
+            len = key[i].len;
+        }
+        else if (key[i].type == REG_BINARY)
+        {
+            p = key[i].value.bin.bytes;
+            len = key[i].value.bin.nbytes;
+        }
+
+        hash = (hash ^ (key[i].type == REG_UNSPECIFIED ? REG_NULL : key[i].type)) * 16777619u;
+        for(uint32_t j = 0; j < len; j++)
+            hash = (hash ^ p[j]) * 16777619u;
+    }
+
+    return hash;
+}
+
+
+/* Are two keys equal? (NULLs are equal to each other) */
+static bool chidb_dbm_agg_keyEq(chidb_dbm_agg_t *a, chidb_dbm_register_t *k1, chidb_dbm_register_t *k2)
+{
+    for(uint32_t i = 0; i < a->nkeys; i++)
+        if (chidb_dbm_reg_cmp(&k1[i], &k2[i]) != 0)
+            return false;
+
+    return true;
+}
+
+
+/* Bytes of memory used by the values of a register */
+static uint32_t chidb_dbm_agg_regSize(chidb_dbm_register_t *r)
+{
+    return r->buf != NULL ? r->buf->size : 0;
+}
+
+
+/* Frees a group */
+static void chidb_dbm_agg_freeGroup(chidb_dbm_agg_t *a, chidb_dbm_agg_group_t *g)
+{
+    for(uint32_t i = 0; i < a->nkeys; i++)
+        chidb_dbm_reg_free(&g->key[i]);
+    for(uint32_t i = 0; i < a->naggs; i++)
+        chidb_dbm_reg_free(&g->acc[i].ext);
+    free(g);
+}
+
+
+/* Frees the groups in memory, and empties the hash table */
+static void chidb_dbm_agg_clear(chidb_dbm_agg_t *a)
+{
+    for(uint32_t i = 0; i < a->ngroups; i++)
+        chidb_dbm_agg_freeGroup(a, a->groups[i]);
+    a->ngroups = 0;
+    a->mem = 0;
+    a->full = false;
+
+    if (a->slots != NULL)
+        memset(a->slots, 0, a->nslots * sizeof(uint32_t));
+}
+
+
+/* Open an aggregator
+ *
+ * Parameters
+ * - a: Aggregator
+ * - nkeys: Number of values in the key of each row
+ * - budget: Memory budget, in bytes (0 for DBM_AGG_BUDGET)
+ * - sorted: Are the rows added in order of their key? (see
+ *           chidb_dbm_agg_break)
+ * - funcs: The aggregate functions, with a character for each of them
+ *          (see chidb_dbm_agg_func_t). There is an argument for each
+ *          function in each row.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator is already open, the rows have too
+ *                  many values to be stored in a record, or funcs is
+ *                  invalid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_agg_open(chidb_dbm_agg_t *a, uint32_t nkeys, uint32_t budget, bool sorted, const char *funcs)
+{
+    static const char *names = "Ccsanx";
+    uint32_t naggs = funcs != NULL ? strlen(funcs) : 0;
+
+    if (a->open || nkeys + naggs > 0xFF)
+        return CHIDB_EMISUSE;
+
+    for(uint32_t i = 0; i < naggs; i++)
+        if (strchr(names, funcs[i]) == NULL)
+            return CHIDB_EMISUSE;
+
+    memset(a, 0, sizeof(chidb_dbm_agg_t));
+
+    a->funcs = calloc(naggs > 0 ? naggs : 1, sizeof(chidb_dbm_agg_func_t));
+    a->slots = calloc(DBM_AGG_MIN_SLOTS, sizeof(uint32_t));
+    a->row = calloc(nkeys + naggs > 0 ? nkeys + naggs : 1, sizeof(chidb_dbm_register_t));
+    if (a->funcs == NULL || a->slots == NULL || a->row == NULL)
+    {
+        free(a->funcs);
+        free(a->slots);
+        free(a->row);
+        return CHIDB_ENOMEM;
+    }
+
+    for(uint32_t i = 0; i < naggs; i++)
+        a->funcs[i] = strchr(names, funcs[i]) - names;
+
+    a->open = true;
+    a->sorted = sorted;
+    a->nkeys = nkeys;
+    a->naggs = naggs;
+    a->nslots = DBM_AGG_MIN_SLOTS;
+    a->budget = budget > 0 ? budget : DBM_AGG_BUDGET;
+
+    return CHIDB_OK;
+}
+
+
+/* Doubles the number of slots of the hash table (once it is half full) */
+static int chidb_dbm_agg_grow(chidb_dbm_agg_t *a)
+{
+    uint32_t nslots = a->nslots * 2;
+    uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+
+    if (slots == NULL)
+        return CHIDB_ENOMEM;
+
+    for(uint32_t i = 0; i < a->ngroups; i++)
+    {
+        uint32_t slot = a->groups[i]->hash & (nslots - 1);
+
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (nslots - 1);
+        slots[slot] = i + 1;
+    }
+
+    free(a->slots);
+    a->slots = slots;
+    a->nslots = nslots;
+
+    return CHIDB_OK;
+}
+
+
+/* Creates a group with a key, and adds it to the hash table at a slot */
+static int chidb_dbm_agg_newGroup(chidb_dbm_agg_t *a, uint32_t hash, chidb_dbm_register_t *key,
+                                  uint32_t slot, chidb_dbm_agg_group_t **group)
+{
+    chidb_dbm_agg_group_t *g;
+    uint32_t size = sizeof(chidb_dbm_agg_group_t) + a->naggs * sizeof(chidb_dbm_agg_acc_t)
+                  + a->nkeys * sizeof(chidb_dbm_register_t);
+    int rc = CHIDB_OK;
+
+    if (a->ngroups == a->maxgroups)
+    {
+        uint32_t maxgroups = a->maxgroups > 0 ? 2 * a->maxgroups : 64;
+        chidb_dbm_agg_group_t **groups = realloc(a->groups, maxgroups * sizeof(chidb_dbm_agg_group_t *));
+
+        if (groups == NULL)
+            return CHIDB_ENOMEM;
+        a->groups = groups;
+        a->maxgroups = maxgroups;
+    }
+
+    if ((g = calloc(1, size)) == NULL)
+        return CHIDB_ENOMEM;
+
+    g->hash = hash;
+    g->key = (chidb_dbm_register_t *) &g->acc[a->naggs];
+    for(uint32_t i = 0; i < a->nkeys && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_keep(&g->key[i], &key[i]);
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_dbm_agg_freeGroup(a, g);
+        return rc;
+    }
+
+    for(uint32_t i = 0; i < a->nkeys; i++)
+        size += chidb_dbm_agg_regSize(&g->key[i]);
+
+    a->groups[a->ngroups++] = g;
+    a->slots[slot] = a->ngroups;
+    a->mem += size + sizeof(uint32_t) * 2;
+    *group = g;
+
+    if (2 * a->ngroups > a->nslots)
+        return chidb_dbm_agg_grow(a);
+
+    return CHIDB_OK;
+}
+
+
+/* Updates the state of the aggregate functions of a group with the
+ * arguments of a row */
+static int chidb_dbm_agg_accumulate(chidb_dbm_agg_t *a, chidb_dbm_agg_group_t *g, chidb_dbm_register_t *args)
+{
+    for(uint32_t i = 0; i < a->naggs; i++)
+    {
+        chidb_dbm_agg_acc_t *acc = &g->acc[i];
+        chidb_dbm_register_t *v = &args[i];
+        uint32_t size;
+        int c, rc;
+
+        if (a->funcs[i] == DBM_AGG_COUNT_ALL)
+        {
+            acc->count++;
+            continue;
+        }
+
+        if (v->type == REG_UNSPECIFIED || v->type == REG_NULL)
+            continue;
+
+        switch (a->funcs[i])
+        {
+        case DBM_AGG_SUM:
+        case DBM_AGG_AVG:
+            if (v->type != REG_INT32)
+                return CHIDB_EMISMATCH;
+            acc->sum += v->value.i;
+            break;
+        case DBM_AGG_MIN:
+        case DBM_AGG_MAX:
+            c = acc->count == 0 ? 0 : chidb_dbm_reg_cmp(v, &acc->ext);
+            if (acc->count == 0 || (a->funcs[i] == DBM_AGG_MIN ? c < 0 : c > 0))
+            {
+                size = chidb_dbm_agg_regSize(&acc->ext);
+                if ((rc = chidb_dbm_reg_keep(&acc->ext, v)) != CHIDB_OK)
+                    return rc;
+                a->mem += chidb_dbm_agg_regSize(&acc->ext) - size;
+            }
+            break;
+        default:
+            break;
+        }
+
+        acc->count++;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Writes a row (its key and its arguments) to a partition */
+static int chidb_dbm_agg_spillRow(chidb_dbm_agg_t *a, uint32_t hash, chidb_dbm_register_t *key,
+                                  chidb_dbm_register_t *args)
+{
+    uint32_t part = AGG_PART(hash, a->depth), len;
+    DBRecordBuffer dbrb;
+    DBRecord *dbr;
+    uint8_t *data;
+    int rc = CHIDB_OK;
+
+    if (a->spill[part] == NULL && (a->spill[part] = tmpfile()) == NULL)
+        return CHIDB_EIO;
+
+    chidb_DBRecord_create_empty(&dbrb, a->nkeys + a->naggs);
+    for(uint32_t i = 0; i < a->nkeys && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_append(&dbrb, &key[i]);
+    for(uint32_t i = 0; i < a->naggs && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_append(&dbrb, &args[i]);
+    chidb_DBRecord_finalize(&dbrb, &dbr);
+
+    if (rc == CHIDB_OK)
+        rc = chidb_DBRecord_pack(dbr, &data);
+
+    if (rc == CHIDB_OK)
+    {
+        len = dbr->packed_len;
+        if (fwrite(&len, sizeof(uint32_t), 1, a->spill[part]) != 1 ||
+            fwrite(data, len, 1, a->spill[part]) != 1)
+            rc = CHIDB_EIO;
+        free(data);
+    }
+    chidb_DBRecord_destroy(dbr);
+
+    return rc;
+}
+
+
+/* Adds a row, once its hash value is known */
+static int chidb_dbm_agg_add(chidb_dbm_agg_t *a, uint32_t hash, chidb_dbm_register_t *key,
+                             chidb_dbm_register_t *args)
+{
+    chidb_dbm_agg_group_t *g = NULL;
+    uint32_t slot = hash & (a->nslots - 1);
+    int rc;
+
+    while (a->slots[slot] != 0)
+    {
+        chidb_dbm_agg_group_t *other = a->groups[a->slots[slot] - 1];
+
+        if (other->hash == hash && chidb_dbm_agg_keyEq(a, other->key, key))
+        {
+            g = other;
+            break;
+        }
+        slot = (slot + 1) & (a->nslots - 1);
+    }
+
+    if (g == NULL)
+    {
+        if (a->full)
+            return chidb_dbm_agg_spillRow(a, hash, key, args);
+
+        if ((rc = chidb_dbm_agg_newGroup(a, hash, key, slot, &g)) != CHIDB_OK)
+            return rc;
+    }
+
+    if ((rc = chidb_dbm_agg_accumulate(a, g, args)) != CHIDB_OK)
+        return rc;
+
+    /* Once the hash bits run out, the groups can't be partitioned any more */
+    if (a->mem > a->budget && a->depth < AGG_MAX_DEPTH)
+        a->full = true;
+
+    return CHIDB_OK;
+}
+
+
+/* Adds a row to a sorted aggregator, whose groups are only kept until
+ * they are finished */
+static int chidb_dbm_agg_addSorted(chidb_dbm_agg_t *a, chidb_dbm_register_t *key,
+                                   chidb_dbm_register_t *args)
+{
+    chidb_dbm_agg_group_t *g;
+    int rc;
+
+    if (a->finished)
+    {
+        chidb_dbm_agg_clear(a);
+        a->finished = false;
+    }
+
+    if (a->ngroups == 0)
+    {
+        if ((rc = chidb_dbm_agg_newGroup(a, 0, key, 0, &g)) != CHIDB_OK)
+            return rc;
+    }
+    else
+    {
+        g = a->groups[0];
+        if (!chidb_dbm_agg_keyEq(a, g->key, key))
+            return CHIDB_EMISUSE;
+    }
+
+    return chidb_dbm_agg_accumulate(a, g, args);
+}
+
+
+/* Add a row to an aggregator
+ *
+ * Parameters
+ * - a: Aggregator
+ * - key: Key of the row (a->nkeys registers)
+ * - args: Argument of each aggregate function (a->naggs registers).
+ *         The arguments of COUNT(*) are ignored.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator has already been rewound or, in a
+ *                  sorted aggregator, the row's key is not the key of
+ *                  the current group (which has not been finished by
+ *                  chidb_dbm_agg_break)
+ * - CHIDB_EMISMATCH: An argument of SUM or AVG is not an integer, or a
+ *                    value that has to be written to a partition is a
+ *                    binary value
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when writing a partition
+ */
+int chidb_dbm_agg_step(chidb_dbm_agg_t *a, chidb_dbm_register_t *key, chidb_dbm_register_t *args)
+{
+    if (a->done)
+        return CHIDB_EMISUSE;
+
+    if (a->sorted)
+        return chidb_dbm_agg_addSorted(a, key, args);
+
+    return chidb_dbm_agg_add(a, chidb_dbm_agg_hash(a, key), key, args);
+}
+
+
+/* Check whether a row is in the current group of a sorted aggregator
+ *
+ * If the aggregator has a current group, and the row's key is not its
+ * key, the group is finished (since all its rows have been added), and
+ * the aggregator is positioned on it (see chidb_dbm_agg_row). The next
+ * row that is added starts a new group.
+ *
+ * Parameters
+ * - a: Aggregator
+ * - key: Key of the row (a->nkeys registers)
+ * - finished: Out parameter. Set to true if the current group has been
+ *             finished.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator is not sorted, or it has already been
+ *                  rewound
+ */
+int chidb_dbm_agg_break(chidb_dbm_agg_t *a, chidb_dbm_register_t *key, bool *finished)
+{
+    if (!a->sorted || a->done)
+        return CHIDB_EMISUSE;
+
+    *finished = false;
+
+    if (a->ngroups > 0 && !a->finished && !chidb_dbm_agg_keyEq(a, a->groups[0]->key, key))
+    {
+        a->finished = true;
+        a->next = 0;
+        *finished = true;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Adds the partitions that have been written to the pending partitions */
+static int chidb_dbm_agg_pushSpills(chidb_dbm_agg_t *a)
+{
+    for(uint32_t i = 0; i < DBM_AGG_NPART; i++)
+    {
+        chidb_dbm_agg_part_t *pending;
+
+        if (a->spill[i] == NULL)
+            continue;
+
+        pending = realloc(a->pending, (a->npending + 1) * sizeof(chidb_dbm_agg_part_t));
+        if (pending == NULL)
+            return CHIDB_ENOMEM;
+        a->pending = pending;
+
+        a->pending[a->npending].f = a->spill[i];
+        a->pending[a->npending].depth = a->depth + 1;
+        a->npending++;
+        a->spill[i] = NULL;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Reads a row from a partition into a->row. Sets found to false if
+ * there are no rows left */
+static int chidb_dbm_agg_readRow(chidb_dbm_agg_t *a, FILE *f, bool *found)
+{
+    DBRecord *dbr;
+    uint32_t len;
+    int rc = CHIDB_OK;
+
+    *found = false;
+
+    if (fread(&len, sizeof(uint32_t), 1, f) != 1)
+        return feof(f) ? CHIDB_OK : CHIDB_EIO;
+
+    if (len > a->recSize)
+    {
+        uint8_t *rec = realloc(a->rec, len);
+
+        if (rec == NULL)
+            return CHIDB_ENOMEM;
+        a->rec = rec;
+        a->recSize = len;
+    }
+
+    if (fread(a->rec, len, 1, f) != 1)
+        return CHIDB_EIO;
+
+    if ((rc = chidb_DBRecord_unpack(&dbr, a->rec)) != CHIDB_OK)
+        return rc;
+
+    for(uint32_t i = 0; i < a->nkeys + a->naggs && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_set_field(&a->row[i], dbr, i);
+    chidb_DBRecord_destroy(dbr);
+
+    *found = true;
+
+    return rc;
+}
+
+
+/* Replaces the groups in memory with the groups of the pending
+ * partitions, until there is a partition with at least one group */
+static int chidb_dbm_agg_nextPart(chidb_dbm_agg_t *a)
+{
+    int rc;
+
+    chidb_dbm_agg_clear(a);
+
+    while (a->ngroups == 0 && a->npending > 0)
+    {
+        chidb_dbm_agg_part_t part = a->pending[--a->npending];
+        bool found = true;
+
+        a->depth = part.depth;
+        rc = fseek(part.f, 0, SEEK_SET) == 0 ? CHIDB_OK : CHIDB_EIO;
+
+        while (rc == CHIDB_OK && (rc = chidb_dbm_agg_readRow(a, part.f, &found)) == CHIDB_OK && found)
+        {
+            chidb_dbm_register_t *key = a->row;
+
+            rc = chidb_dbm_agg_add(a, chidb_dbm_agg_hash(a, key), key, &a->row[a->nkeys]);
+        }
+
+        fclose(part.f);
+
+        if (rc != CHIDB_OK || (rc = chidb_dbm_agg_pushSpills(a)) != CHIDB_OK)
+            return rc;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Position an aggregator on its first group
+ *
+ * No more rows can be added to the aggregator after this.
+ *
+ * Parameters
+ * - a: Aggregator
+ * - found: Out parameter. Set to false if there are no groups.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator has already been rewound
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when reading a partition
+ */
+int chidb_dbm_agg_rewind(chidb_dbm_agg_t *a, bool *found)
+{
+    chidb_dbm_agg_group_t *g;
+    int rc;
+
+    if (a->done)
+        return CHIDB_EMISUSE;
+
+    a->done = true;
+    a->next = 0;
+    *found = false;
+
+    /* A finished group has already been produced */
+    if (a->finished)
+    {
+        chidb_dbm_agg_clear(a);
+        a->finished = false;
+    }
+
+    /* With no key, there is a group even if there are no rows */
+    if (a->nkeys == 0 && a->ngroups == 0 &&
+        (rc = chidb_dbm_agg_newGroup(a, chidb_dbm_agg_hash(a, NULL), NULL, 0, &g)) != CHIDB_OK)
+        return rc;
+
+    if ((rc = chidb_dbm_agg_pushSpills(a)) != CHIDB_OK)
+        return rc;
+
+    if (a->ngroups == 0 && (rc = chidb_dbm_agg_nextPart(a)) != CHIDB_OK)
+        return rc;
+
+    *found = a->ngroups > 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Move an aggregator to its next group
+ *
+ * Parameters
+ * - a: Aggregator
+ * - found: Out parameter. Set to false if there are no more groups.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator has not been rewound
+ * - CHIDB_EMISMATCH: An argument of SUM or AVG in a partition is not
+ *                    an integer
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing a partition
+ */
+int chidb_dbm_agg_next(chidb_dbm_agg_t *a, bool *found)
+{
+    int rc;
+
+    if (!a->done)
+        return CHIDB_EMISUSE;
+
+    *found = false;
+
+    if (a->next >= a->ngroups)
+        return CHIDB_OK;
+
+    if (++a->next == a->ngroups)
+    {
+        if ((rc = chidb_dbm_agg_nextPart(a)) != CHIDB_OK)
+            return rc;
+        a->next = 0;
+    }
+
+    *found = a->next < a->ngroups;
+
+    return CHIDB_OK;
+}
+
+
+/* Get the key and the results of the current group of an aggregator
+ *
+ * Parameters
+ * - a: Aggregator
+ * - row: Registers where the key (a->nkeys values) and the result of
+ *        each aggregate function (a->naggs values) are stored
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The aggregator is not positioned on a group (or on
+ *                  a group finished by chidb_dbm_agg_break)
+ * - CHIDB_EMISMATCH: A result doesn't fit in a register
+ */
+int chidb_dbm_agg_row(chidb_dbm_agg_t *a, chidb_dbm_register_t *row)
+{
+    chidb_dbm_agg_group_t *g;
+    int rc = CHIDB_OK;
+
+    if ((!a->done && !a->finished) || a->next >= a->ngroups)
+        return CHIDB_EMISUSE;
+
+    g = a->groups[a->next];
+
+    for(uint32_t i = 0; i < a->nkeys && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_copy(&row[i], &g->key[i]);
+
+    for(uint32_t i = 0; i < a->naggs && rc == CHIDB_OK; i++)
+    {
+        chidb_dbm_agg_acc_t *acc = &g->acc[i];
+        chidb_dbm_register_t *r = &row[a->nkeys + i];
+        int64_t v = acc->count;
+
+        if (acc->count == 0 && a->funcs[i] != DBM_AGG_COUNT_ALL && a->funcs[i] != DBM_AGG_COUNT)
+        {
+            rc = chidb_dbm_reg_set_null(r);
+            continue;
+        }
+
+        switch (a->funcs[i])
+        {
+        case DBM_AGG_MIN:
+        case DBM_AGG_MAX:
+            rc = chidb_dbm_reg_copy(r, &acc->ext);
+            continue;
+        case DBM_AGG_SUM:
+            v = acc->sum;
+            break;
+        case DBM_AGG_AVG:
+            v = acc->sum / acc->count;
+            break;
+        default:
+            break;
+        }
+
+        if (v < INT32_MIN || v > INT32_MAX)
+            return CHIDB_EMISMATCH;
+        rc = chidb_dbm_reg_set_int(r, (int32_t) v);
+    }
+
+    return rc;
+}
+
+
+/* Close an aggregator
+ *
+ * Frees its groups, and closes (and removes) its partitions.
+ *
+ * Parameters
+ * - a: Aggregator
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_agg_close(chidb_dbm_agg_t *a)
+{
+    if (!a->open)
+        return CHIDB_OK;
+
+    chidb_dbm_agg_clear(a);
+    free(a->groups);
+    free(a->slots);
+
+    for(uint32_t i = 0; i < DBM_AGG_NPART; i++)
+        if (a->spill[i] != NULL)
+            fclose(a->spill[i]);
+    for(uint32_t i = 0; i < a->npending; i++)
+        fclose(a->pending[i].f);
+    free(a->pending);
+
+    for(uint32_t i = 0; i < a->nkeys + a->naggs; i++)
+        chidb_dbm_reg_free(&a->row[i]);
+    free(a->row);
+    free(a->rec);
+    free(a->funcs);
+
+    memset(a, 0, sizeof(chidb_dbm_agg_t));
+
+    return CHIDB_OK;
+}
+
+
+/* Free the aggregators of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_agg_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nAggs; i++)
+        chidb_dbm_agg_close(&stmt->aggs[i]);
+    free(stmt->aggs);
+    stmt->aggs = NULL;
+    stmt->nAggs = 0;
+
+    return CHIDB_OK;
+}
@@ -0,0 +1,577 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine vectorized (batch-at-a-time) execution
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The vectorized instructions (see dbm-ops.c) scan a table and operate
+ * on batches of up to DBM_BATCH_SIZE rows at a time, instead of a single
+ * row at a time:
+ *
+ *  - A batch scan (chidb_dbm_batch_t) reads the rows of a table B-Tree
+ *    directly from its leaf nodes, one batch at a time.
+ *  - Columns are decoded into vector registers (chidb_dbm_vector_t),
+ *    which hold one value for each row in the batch.
+ *  - Comparisons remove rows from the batch's selection vector, instead
+ *    of jumping. They run as a loop over the entire vector, followed by
+ *    a (branch-free) loop that compacts the selection vector.
+ *
+ * Only the rows in the selection vector are decoded, and only those rows
+ * are returned as result rows.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dbm-batch.h"
+#include "record.h"
+#include "util.h"
+
+
+/* Get a batch scan
+ *
+ * Returns batch scan number nbatch of a DBM program, allocating
+ * it if necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nbatch: Batch scan number
+ * - batch: Out parameter. Used to return a pointer to the batch scan.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid batch scan number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_batch_get(chidb_stmt *stmt, int32_t nbatch, chidb_dbm_batch_t **batch)
+{
+    if (nbatch < 0)
+        return CHIDB_EMISUSE;
+
+    if (nbatch >= stmt->nBatches)
+    {
+        chidb_dbm_batch_t *batches = realloc(stmt->batches, (nbatch + 1) * sizeof(chidb_dbm_batch_t));
+        if (batches == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&batches[stmt->nBatches], 0, (nbatch + 1 - stmt->nBatches) * sizeof(chidb_dbm_batch_t));
+        stmt->batches = batches;
+        stmt->nBatches = nbatch + 1;
+    }
+
+    *batch = &stmt->batches[nbatch];
+
+    return CHIDB_OK;
+}
+
+
+/* Get a vector register
+ *
+ * Returns vector register number nvreg of a DBM program, allocating
+ * it if necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nvreg: Vector register number
+ * - v: Out parameter. Used to return a pointer to the vector register.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid vector register number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_vector_get(chidb_stmt *stmt, int32_t nvreg, chidb_dbm_vector_t **v)
+{
+    if (nvreg < 0)
+        return CHIDB_EMISUSE;
+
+    if (nvreg >= stmt->nVReg)
+    {
+        chidb_dbm_vector_t *vreg = realloc(stmt->vreg, (nvreg + 1) * sizeof(chidb_dbm_vector_t));
+        if (vreg == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&vreg[stmt->nVReg], 0, (nvreg + 1 - stmt->nVReg) * sizeof(chidb_dbm_vector_t));
+        stmt->vreg = vreg;
+        stmt->nVReg = nvreg + 1;
+    }
+
+    *v = &stmt->vreg[nvreg];
+
+    return CHIDB_OK;
+}
+
+
+/* Open a batch scan on a table
+ *
+ * Parameters
+ * - batch: Batch scan
+ * - nroot: Root page of the table B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_batch_open(chidb_dbm_batch_t *batch, npage_t nroot)
+{
+    batch->open = true;
+    batch->nroot = nroot;
+    batch->depth = 0;
+    batch->n = 0;
+    batch->nsel = 0;
+    batch->emit = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Position a batch scan at the start of the table, and load the first batch
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - batch: Batch scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The B-Tree is not a table B-Tree
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_dbm_batch_rewind(BTree *bt, chidb_dbm_batch_t *batch)
+{
+    batch->depth = 1;
+    batch->path_page[0] = batch->nroot;
+    batch->path_cell[0] = 0;
+
+    return chidb_dbm_batch_load(bt, batch);
+}
+
+
+/* Adds a row to the current batch */
+static int chidb_dbm_batch_addRow(chidb_dbm_batch_t *batch, BTreeCell *cell)
+{
+    uint32_t size = cell->fields.tableLeaf.data_size;
+
+    if (batch->data_len + size > batch->data_size)
+    {
+        uint32_t data_size = batch->data_size ? batch->data_size : 4096;
+        while (batch->data_len + size > data_size)
+            data_size *= 2;
+
+        uint8_t *data = realloc(batch->data, data_size);
+        if (data == NULL)
+            return CHIDB_ENOMEM;
+
+        batch->data = data;
+        batch->data_size = data_size;
+    }
+
+    batch->key[batch->n] = cell->key;
+    batch->row[batch->n] = batch->data_len;
+    memcpy(&batch->data[batch->data_len], cell->fields.tableLeaf.data, size);
+    batch->data_len += size;
+    batch->n++;
+
+    return CHIDB_OK;
+}
+
+
+/* Load the next batch of rows
+ *
+ * Continues the scan, loading up to DBM_BATCH_SIZE rows. If there are
+ * no more rows in the table, the batch is left empty. All the rows in
+ * the batch are selected.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - batch: Batch scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The B-Tree is not a table B-Tree
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_dbm_batch_load(BTree *bt, chidb_dbm_batch_t *batch)
+{
+    BTreeNode *btn;
+    BTreeCell cell;
+    int rc = CHIDB_OK;
+
+    batch->n = 0;
+    batch->data_len = 0;
+    batch->emit = 0;
+
+    while (batch->depth > 0 && batch->n < DBM_BATCH_SIZE && rc == CHIDB_OK)
+    {
+        uint32_t top = batch->depth - 1;
+        ncell_t ncell = batch->path_cell[top];
+
+        rc = chidb_Btree_getNodeByPage(bt, batch->path_page[top], &btn);
+        if (rc != CHIDB_OK)
+            break;
+
+        if (btn->type == PGTYPE_TABLE_LEAF)
+        {
+            for(; ncell < btn->n_cells && batch->n < DBM_BATCH_SIZE && rc == CHIDB_OK; ncell++)
+            {
+                chidb_Btree_getCell(btn, ncell, &cell);
+                rc = chidb_dbm_batch_addRow(batch, &cell);
+            }
+
+            batch->path_cell[top] = ncell;
+            if (ncell == btn->n_cells)
+                batch->depth--;
+        }
+        else if (btn->type == PGTYPE_TABLE_INTERNAL)
+        {
+            /* Visit the children in order: the child of each cell, and then
+             * the right page */
+            if (ncell > btn->n_cells)
+                batch->depth--;
+            else if (batch->depth == DBM_BATCH_MAX_DEPTH)
+                rc = CHIDB_ECORRUPT;
+            else
+            {
+                npage_t child;
+
+                if (ncell < btn->n_cells)
+                {
+                    chidb_Btree_getCell(btn, ncell, &cell);
+                    child = cell.fields.tableInternal.child_page;
+                }
+                else
+                    child = btn->right_page;
+
+                batch->path_cell[top]++;
+                batch->path_page[batch->depth] = child;
+                batch->path_cell[batch->depth] = 0;
+                batch->depth++;
+            }
+        }
+        else
+            rc = CHIDB_EMISMATCH;
+
+        chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    for(uint32_t i = 0; i < batch->n; i++)
+        batch->sel[i] = i;
+    batch->nsel = batch->n;
+
+    return rc;
+}
+
+
+/* Close a batch scan
+ *
+ * Parameters
+ * - batch: Batch scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_batch_close(chidb_dbm_batch_t *batch)
+{
+    batch->open = false;
+    batch->depth = 0;
+    batch->n = 0;
+    batch->nsel = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Finds the type and position of a field in a record (see record.c
+ * for the format of a record). */
+static uint32_t chidb_dbm_batch_findField(const uint8_t *rec, uint32_t field, uint32_t *offset)
+{
+    uint8_t header_size = rec[0];
+    uint32_t pos = 1, type;
+
+    *offset = header_size;
+
+    for(uint32_t f = 0; pos < header_size; f++)
+    {
+        if (rec[pos] & 0x80)
+        {
+            getVarint32(&rec[pos], &type);
+            pos += 4;
+        }
+        else
+            type = rec[pos++];
+
+        if (f == field)
+            return type;
+
+        if (type == SQL_INTEGER_1BYTE || type == SQL_INTEGER_2BYTE || type == SQL_INTEGER_4BYTE)
+            *offset += type;
+        else if (type >= SQL_TEXT)
+            *offset += (type - SQL_TEXT) / 2;
+    }
+
+    /* Fields past the end of the record are NULL */
+    return SQL_NULL;
+}
+
+
+/* Decode a column of the current batch
+ *
+ * Stores the value of a column, in each selected row of the current
+ * batch, in a vector register.
+ *
+ * Parameters
+ * - batch: Batch scan
+ * - col: Column number
+ * - v: Vector register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_batch_column(chidb_dbm_batch_t *batch, uint32_t col, chidb_dbm_vector_t *v)
+{
+    uint32_t strbuf_len = 0;
+
+    /* The strings can't be longer than the records (plus the NULs) */
+    if (batch->data_len + batch->n > v->strbuf_size)
+    {
+        char *strbuf = realloc(v->strbuf, batch->data_len + batch->n);
+        if (strbuf == NULL)
+            return CHIDB_ENOMEM;
+        v->strbuf = strbuf;
+        v->strbuf_size = batch->data_len + batch->n;
+    }
+
+    for(uint32_t i = 0; i < batch->nsel; i++)
+    {
+        uint16_t row = batch->sel[i];
+        const uint8_t *rec = &batch->data[batch->row[row]];
+        uint32_t offset, type = chidb_dbm_batch_findField(rec, col, &offset);
+
+        switch(type)
+        {
+        case SQL_NULL:
+            v->type[row] = REG_NULL;
+            break;
+        case SQL_INTEGER_1BYTE:
+            v->type[row] = REG_INT32;
+            v->i[row] = (int8_t) rec[offset];
+            break;
+        case SQL_INTEGER_2BYTE:
+            v->type[row] = REG_INT32;
+            v->i[row] = (int16_t) get2byte(&rec[offset]);
+            break;
+        case SQL_INTEGER_4BYTE:
+            v->type[row] = REG_INT32;
+            v->i[row] = (int32_t) get4byte(&rec[offset]);
+            break;
+        default:
+        {
+            uint32_t len = (type - SQL_TEXT) / 2;
+
+            v->type[row] = REG_STRING;
+            v->s[row] = &v->strbuf[strbuf_len];
+            memcpy(v->s[row], &rec[offset], len);
+            v->s[row][len] = '\0';
+            strbuf_len += len + 1;
+            break;
+        }
+        }
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Store the keys of the current batch
+ *
+ * Stores the key of each row of the current batch in a vector register.
+ *
+ * Parameters
+ * - batch: Batch scan
+ * - v: Vector register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_batch_key(chidb_dbm_batch_t *batch, chidb_dbm_vector_t *v)
+{
+    for(uint32_t row = 0; row < batch->n; row++)
+    {
+        v->type[row] = REG_INT32;
+        v->i[row] = batch->key[row];
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Order of the types of values, as in chidb_dbm_reg_cmp: NULL, integer,
+ * string, binary */
+static inline int chidb_dbm_batch_rank(uint8_t type)
+{
+    return type == REG_INT32 ? 1 : type == REG_STRING ? 2 : type == REG_BINARY ? 3 : 0;
+}
+
+/* Computes, for every row in the batch, whether "v[row] OP c" holds.
+ * Values are ordered as in chidb_dbm_reg_cmp, so a NULL (or a string)
+ * comes before (or after) every integer. The loop runs over the entire
+ * vector (not just the rows in the batch) so its trip count is a
+ * constant, which lets the compiler vectorize it without a scalar
+ * epilogue. */
+#define MATCH_INT(OP)                                                       \
+    for(uint32_t row = 0; row < DBM_BATCH_SIZE; row++)                      \
+    {                                                                       \
+        int32_t x = v->i[row];                                              \
+        int d = v->type[row] == REG_INT32 ? (x > c) - (x < c) :             \
+                v->type[row] == REG_STRING ? 1 : -1;                        \
+        match[row] = d OP 0;                                                \
+    }
+
+#define MATCH_STR(OP)                                                       \
+    for(uint32_t i = 0; i < batch->nsel; i++)                               \
+    {                                                                       \
+        uint16_t row = batch->sel[i];                                       \
+        int d = v->type[row] == REG_STRING ? strcmp(v->s[row], r->value.s) : -1; \
+        match[row] = d OP 0;                                                \
+    }
+
+/* Values of the other types (NULL, or binary) are only compared by type */
+#define MATCH_RANK(OP)                                                      \
+    for(uint32_t i = 0; i < batch->nsel; i++)                               \
+    {                                                                       \
+        uint16_t row = batch->sel[i];                                       \
+        int d = chidb_dbm_batch_rank(v->type[row]) - chidb_dbm_batch_rank(r->type); \
+        match[row] = d OP 0;                                                \
+    }
+
+/* Filter the current batch
+ *
+ * Removes from the selection vector the rows where the comparison
+ * "v[row] cmp r" holds (i.e., the rows where the equivalent row-at-a-time
+ * comparison instruction would jump). Values of different types
+ * (including NULLs) are ordered by type, as in chidb_dbm_reg_cmp.
+ *
+ * Parameters
+ * - batch: Batch scan
+ * - v: Vector register
+ * - cmp: Comparison (Op_VEq, Op_VNe, Op_VLt, Op_VLe, Op_VGt, Op_VGe)
+ * - r: Register with the value to compare with
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_batch_filter(chidb_dbm_batch_t *batch, chidb_dbm_vector_t *v, opcode_t cmp, chidb_dbm_register_t *r)
+{
+    uint8_t match[DBM_BATCH_SIZE];
+    uint32_t nsel = 0;
+
+    if (r->type == REG_INT32)
+    {
+        int32_t c = r->value.i;
+
+        switch(cmp)
+        {
+        case Op_VEq: MATCH_INT(==); break;
+        case Op_VNe: MATCH_INT(!=); break;
+        case Op_VLt: MATCH_INT(<);  break;
+        case Op_VLe: MATCH_INT(<=); break;
+        case Op_VGt: MATCH_INT(>);  break;
+        default:     MATCH_INT(>=); break;
+        }
+    }
+    else if (r->type == REG_STRING)
+    {
+        switch(cmp)
+        {
+        case Op_VEq: MATCH_STR(==); break;
+        case Op_VNe: MATCH_STR(!=); break;
+        case Op_VLt: MATCH_STR(<);  break;
+        case Op_VLe: MATCH_STR(<=); break;
+        case Op_VGt: MATCH_STR(>);  break;
+        default:     MATCH_STR(>=); break;
+        }
+    }
+    else
+    {
+        switch(cmp)
+        {
+        case Op_VEq: MATCH_RANK(==); break;
+        case Op_VNe: MATCH_RANK(!=); break;
+        case Op_VLt: MATCH_RANK(<);  break;
+        case Op_VLe: MATCH_RANK(<=); break;
+        case Op_VGt: MATCH_RANK(>);  break;
+        default:     MATCH_RANK(>=); break;
+        }
+    }
+
+    /* Compact the selection vector */
+    for(uint32_t i = 0; i < batch->nsel; i++)
+    {
+        uint16_t row = batch->sel[i];
+        batch->sel[nsel] = row;
+        nsel += !match[row];
+    }
+    batch->nsel = nsel;
+
+    return CHIDB_OK;
+}
+
+
+/* Free the vector registers and batch scans of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_batch_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nVReg; i++)
+        free(stmt->vreg[i].strbuf);
+    free(stmt->vreg);
+    stmt->vreg = NULL;
+    stmt->nVReg = 0;
+
+    for(uint32_t i = 0; i < stmt->nBatches; i++)
+        free(stmt->batches[i].data);
+    free(stmt->batches);
+    stmt->batches = NULL;
+    stmt->nBatches = 0;
+
+    return CHIDB_OK;
+}
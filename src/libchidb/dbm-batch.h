@@ -0,0 +1,59 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine vectorized (batch-at-a-time) execution -- header
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef DBM_BATCH_H_
+#define DBM_BATCH_H_
+
+#include "chidbInt.h"
+#include "btree.h"
+#include "dbm-types.h"
+
+int chidb_dbm_batch_get(chidb_stmt *stmt, int32_t nbatch, chidb_dbm_batch_t **batch);
+int chidb_dbm_vector_get(chidb_stmt *stmt, int32_t nvreg, chidb_dbm_vector_t **v);
+int chidb_dbm_batch_open(chidb_dbm_batch_t *batch, npage_t nroot);
+int chidb_dbm_batch_rewind(BTree *bt, chidb_dbm_batch_t *batch);
+int chidb_dbm_batch_load(BTree *bt, chidb_dbm_batch_t *batch);
+int chidb_dbm_batch_close(chidb_dbm_batch_t *batch);
+int chidb_dbm_batch_column(chidb_dbm_batch_t *batch, uint32_t col, chidb_dbm_vector_t *v);
+int chidb_dbm_batch_key(chidb_dbm_batch_t *batch, chidb_dbm_vector_t *v);
+int chidb_dbm_batch_filter(chidb_dbm_batch_t *batch, chidb_dbm_vector_t *v, opcode_t cmp, chidb_dbm_register_t *r);
+int chidb_dbm_batch_freeAll(chidb_stmt *stmt);
+
+#endif /* DBM_BATCH_H_ */
@@ -75,7 +75,8 @@ typedef enum dbm_file_program_type
 int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt);
 
 /* Implemented in optimizer.c */
-int chidb_stmt_optimize(chidb_stmt *stmt, chisql_statement_t *sql_stmt, chisql_statement_t **sql_stmt_opt);
+int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statement_t **sql_stmt_opt);
+void chidb_stmt_optimize_free(chisql_statement_t *sql_stmt_opt);
 
 
 int __chidb_dbm_file_read_line(FILE *f, char* line)
@@ -445,7 +446,7 @@ int __chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **_dbmf, chidb
         	        return rc;
         	    }
 
-        	    rc = chidb_stmt_optimize(&dbmf->stmt, sql_stmt, &sql_stmt_opt);
+        	    rc = chidb_stmt_optimize(dbmf->db, sql_stmt, &sql_stmt_opt);
 
         	    if(rc != CHIDB_OK)
         	    {
@@ -453,6 +454,7 @@ int __chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **_dbmf, chidb
         	    }
 
         	    rc = chidb_stmt_codegen(&dbmf->stmt, sql_stmt_opt);
+        	    chidb_stmt_optimize_free(sql_stmt_opt);
 
         	    if(rc != CHIDB_OK)
         	    {
@@ -485,7 +487,10 @@ int __chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **_dbmf, chidb
         }
     }
 
-    return CHIDB_OK;
+    if (section == CHIDB_FILE)
+        return CHIDB_OK;
+
+    return chidb_stmt_peephole(&dbmf->stmt);
 }
 
 int chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **dbmf, chidb *db)
@@ -0,0 +1,899 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine hash tables (for hash joins)
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The hash join instructions (see dbm-ops.c) join two inputs by building
+ * a hash table with the rows of one of them (the build side), keyed by
+ * the join column, and then looking up (probing) the key of each row of
+ * the other input:
+ *
+ *  - HashInsert adds a row (a set of registers) to the hash table.
+ *  - HashProbe positions the hash table on the first row with a key, and
+ *    HashNext on each of the following ones. HashRow copies the values of
+ *    the current row to a set of registers.
+ *  - For outer joins, HashMark marks the current row as matched, and
+ *    HashUnmatched (followed by HashNext) visits the rows that were
+ *    never marked.
+ *
+ * NULL keys never match any key (not even NULL), but the rows with a
+ * NULL key are still visited by HashUnmatched.
+ *
+ * The entries are divided into DBM_HASH_NPART partitions by the low bits
+ * of their hash value, and chained into buckets by the following bits.
+ * The memory used by the entries is bounded by the hash table's budget:
+ * once the entries in memory take up more than that, the largest
+ * partition that is still in memory is spilled, that is, its entries are
+ * moved to a temporary file (and any entry that is later added to it is
+ * also stored there). Each entry of a spilled partition gets the next
+ * number of the partition, and is stored in a table B-Tree, keyed by its
+ * number, as a record with its key and its values. A key B-Tree (see
+ * keytree.c) orders the entries by hash value: its keys are the hash
+ * value of an entry followed by the entry's number (4 bytes each,
+ * big-endian), so a probe is a seek to the first entry with the probe's
+ * hash value, followed by a scan of the entries with that same hash value,
+ * whose rows are found by their numbers. Entry numbers are B-Tree keys,
+ * which are varints of 28 bits, and that bounds the number of entries of
+ * a spilled partition. Whether a spilled entry has been matched is kept
+ * in memory, in a bitmap indexed by its number.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dbm-hash.h"
+#include "dbm-reg.h"
+#include "btree.h"
+#include "keytree.h"
+#include "record.h"
+#include "util.h"
+
+/* Initial number of buckets (always a power of two) */
+#define DBM_HASH_MIN_BUCKETS (256)
+
+#define HASH_PART(hash) ((hash) & (DBM_HASH_NPART - 1))
+#define HASH_BUCKET(h, hash) (((hash) / DBM_HASH_NPART) & ((h)->nbuckets - 1))
+
+/* Maximum number of entries of a spilled partition (their numbers are B-Tree keys) */
+#define SPILL_MAX_ENTRIES (1 << 28)
+
+/* Size of a key of the B-Tree of a spilled partition's hash values */
+#define SPILL_HASH_KEY_SIZE (8)
+
+
+/* Get a hash table
+ *
+ * Returns hash table number nhash of a DBM program, allocating
+ * it if necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nhash: Hash table number
+ * - h: Out parameter. Used to return a pointer to the hash table.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid hash table number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_hash_get(chidb_stmt *stmt, int32_t nhash, chidb_dbm_hash_t **h)
+{
+    if (nhash < 0)
+        return CHIDB_EMISUSE;
+
+    if (nhash >= stmt->nHashes)
+    {
+        chidb_dbm_hash_t *hashes = realloc(stmt->hashes, (nhash + 1) * sizeof(chidb_dbm_hash_t));
+        if (hashes == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&hashes[stmt->nHashes], 0, (nhash + 1 - stmt->nHashes) * sizeof(chidb_dbm_hash_t));
+        stmt->hashes = hashes;
+        stmt->nHashes = nhash + 1;
+    }
+
+    *h = &stmt->hashes[nhash];
+
+    return CHIDB_OK;
+}
+
+
+/* Hash value of a key (FNV-1a, over the bytes of a string or an integer) */
+static uint32_t chidb_dbm_hash_value(chidb_dbm_register_t *key)
+{
+    const uint8_t *p;
+    uint32_t len, hash = 2166136261u;
+
+    if (key->type == REG_INT32)
+    {
+        p = (const uint8_t *) &key->value.i;
+        len = sizeof(int32_t);
+    }
+    else if (key->type == REG_STRING)
+    {
+        p = (const uint8_t *) key->value.s;
+        len = key->len;
+    }
+    else
+        return 0;
+
+    for(uint32_t i = 0; i < len; i++)
+        hash = (hash ^ p[i]) * 16777619u;
+
+    return hash;
+}
+
+
+/* Do two keys match? (NULLs, and keys of different types, never match) */
+static bool chidb_dbm_hash_keyEq(chidb_dbm_register_t *a, chidb_dbm_register_t *b)
+{
+    if (a->type != b->type)
+        return false;
+
+    if (a->type == REG_INT32)
+        return a->value.i == b->value.i;
+    if (a->type == REG_STRING)
+        return a->len == b->len && memcmp(a->value.s, b->value.s, a->len) == 0;
+
+    return false;
+}
+
+
+/* Bytes of memory used by an entry */
+static uint32_t chidb_dbm_hash_entrySize(chidb_dbm_hash_t *h, chidb_dbm_hash_entry_t *e)
+{
+    uint32_t size = sizeof(chidb_dbm_hash_entry_t) + h->ncols * sizeof(chidb_dbm_register_t);
+
+    if (e->key.buf != NULL)
+        size += e->key.buf->size;
+    for(uint32_t i = 0; i < h->ncols; i++)
+        if (e->row[i].buf != NULL)
+            size += e->row[i].buf->size;
+
+    return size;
+}
+
+
+/* Frees an entry */
+static void chidb_dbm_hash_freeEntry(chidb_dbm_hash_t *h, chidb_dbm_hash_entry_t *e)
+{
+    chidb_dbm_reg_free(&e->key);
+    for(uint32_t i = 0; i < h->ncols; i++)
+        chidb_dbm_reg_free(&e->row[i]);
+    free(e);
+}
+
+
+/* Open a hash table
+ *
+ * Parameters
+ * - h: Hash table
+ * - ncols: Number of values in each row
+ * - budget: Memory budget, in bytes (0 for DBM_HASH_BUDGET)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The hash table is already open, or the rows have
+ *                  too many values to be stored in a record
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_hash_open(chidb_dbm_hash_t *h, uint32_t ncols, uint32_t budget)
+{
+    if (h->open || ncols > 0xFF - 2)
+        return CHIDB_EMISUSE;
+
+    memset(h, 0, sizeof(chidb_dbm_hash_t));
+
+    h->buckets = calloc(DBM_HASH_MIN_BUCKETS, sizeof(chidb_dbm_hash_entry_t *));
+    h->spillRow = calloc(ncols, sizeof(chidb_dbm_register_t));
+    if (h->buckets == NULL || h->spillRow == NULL)
+    {
+        free(h->buckets);
+        free(h->spillRow);
+        return CHIDB_ENOMEM;
+    }
+
+    h->open = true;
+    h->ncols = ncols;
+    h->budget = budget > 0 ? budget : DBM_HASH_BUDGET;
+    h->nbuckets = DBM_HASH_MIN_BUCKETS;
+    h->mode = DBM_HASH_NONE;
+
+    return CHIDB_OK;
+}
+
+
+/* Doubles the number of buckets of a hash table */
+static int chidb_dbm_hash_grow(chidb_dbm_hash_t *h)
+{
+    chidb_dbm_hash_entry_t **buckets, *e, *next;
+    uint32_t nbuckets = h->nbuckets;
+
+    buckets = calloc(nbuckets * 2, sizeof(chidb_dbm_hash_entry_t *));
+    if (buckets == NULL)
+        return CHIDB_ENOMEM;
+
+    h->nbuckets = nbuckets * 2;
+    for(uint32_t i = 0; i < nbuckets; i++)
+        for(e = h->buckets[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            e->next = buckets[HASH_BUCKET(h, e->hash)];
+            buckets[HASH_BUCKET(h, e->hash)] = e;
+        }
+
+    free(h->buckets);
+    h->buckets = buckets;
+
+    return CHIDB_OK;
+}
+
+
+/* Opens the temporary file where the partitions are spilled. The file
+ * is removed right away, so it disappears once it is closed */
+static int chidb_dbm_hash_openTmp(chidb_dbm_hash_t *h)
+{
+    char filename[] = P_tmpdir "/chidb-hash-XXXXXX";
+    BTree *bt;
+    int fd, rc;
+
+    fd = mkstemp(filename);
+    if (fd < 0)
+        return CHIDB_EIO;
+    close(fd);
+
+    h->tmp = calloc(1, sizeof(chidb));
+    if (h->tmp == NULL)
+        rc = CHIDB_ENOMEM;
+    else
+        rc = chidb_Btree_open(filename, h->tmp, &bt);
+
+    unlink(filename);
+
+    if (rc == CHIDB_OK)
+        h->tmp->bt = bt;
+
+    return rc;
+}
+
+
+/* Adds an entry to a spilled partition: its row to the table B-Tree,
+ * and its hash value to the key B-Tree */
+static int chidb_dbm_hash_spillEntry(chidb_dbm_hash_t *h, uint32_t hash, bool matched,
+                                     chidb_dbm_register_t *key, chidb_dbm_register_t *row)
+{
+    chidb_dbm_hash_spill_t *spill = &h->spill[HASH_PART(hash)];
+    uint8_t hkey[SPILL_HASH_KEY_SIZE];
+    DBRecordBuffer dbrb;
+    DBRecord *dbr;
+    uint8_t *data;
+    int rc = CHIDB_OK;
+
+    if (spill->n == SPILL_MAX_ENTRIES)
+        return CHIDB_ECONSTRAINT;
+
+    chidb_DBRecord_create_empty(&dbrb, h->ncols + 1);
+    for(int32_t i = -1; i < (int32_t) h->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_append(&dbrb, i < 0 ? key : &row[i]);
+    chidb_DBRecord_finalize(&dbrb, &dbr);
+
+    if (rc == CHIDB_OK && spill->n % 8 == 0)
+    {
+        uint8_t *bits = realloc(spill->matched, spill->n / 8 + 1);
+
+        if (bits == NULL)
+            rc = CHIDB_ENOMEM;
+        else
+        {
+            bits[spill->n / 8] = 0;
+            spill->matched = bits;
+        }
+    }
+
+    if (rc == CHIDB_OK)
+        rc = chidb_DBRecord_pack(dbr, &data);
+
+    if (rc == CHIDB_OK)
+    {
+        rc = chidb_Btree_insertInTable(h->tmp->bt, spill->nroot, spill->n, data, dbr->packed_len);
+        free(data);
+    }
+    chidb_DBRecord_destroy(dbr);
+
+    if (rc == CHIDB_OK)
+    {
+        put4byte(hkey, hash);
+        put4byte(hkey + 4, spill->n);
+        rc = chidb_KeyTree_insert(h->tmp->bt, spill->nhashes, hkey, sizeof(hkey));
+    }
+
+    if (rc == CHIDB_OK)
+    {
+        if (matched)
+            spill->matched[spill->n / 8] |= 1 << (spill->n % 8);
+        spill->n++;
+    }
+
+    return rc;
+}
+
+
+/* Spills a partition: moves its entries from memory to a new table
+ * B-Tree (and their hash values to a new key B-Tree) in the temporary file */
+static int chidb_dbm_hash_spill(chidb_dbm_hash_t *h, uint32_t part)
+{
+    chidb_dbm_hash_entry_t **p, *e;
+    int rc;
+
+    if (h->tmp == NULL && (rc = chidb_dbm_hash_openTmp(h)) != CHIDB_OK)
+        return rc;
+
+    if ((rc = chidb_Btree_newNode(h->tmp->bt, &h->spill[part].nroot, PGTYPE_TABLE_LEAF)) != CHIDB_OK ||
+        (rc = chidb_KeyTree_create(h->tmp->bt, &h->spill[part].nhashes)) != CHIDB_OK)
+        return rc;
+
+    for(uint32_t i = 0; i < h->nbuckets; i++)
+        for(p = &h->buckets[i]; *p != NULL; )
+        {
+            e = *p;
+            if (HASH_PART(e->hash) != part)
+            {
+                p = &e->next;
+                continue;
+            }
+
+            if ((rc = chidb_dbm_hash_spillEntry(h, e->hash, e->matched, &e->key, e->row)) != CHIDB_OK)
+                return rc;
+
+            *p = e->next;
+            h->mem -= chidb_dbm_hash_entrySize(h, e);
+            h->nentries--;
+            chidb_dbm_hash_freeEntry(h, e);
+        }
+
+    h->partMem[part] = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Add a row to a hash table
+ *
+ * The hash table is no longer positioned on an entry.
+ *
+ * Parameters
+ * - h: Hash table
+ * - key: Key
+ * - row: Values of the row (h->ncols registers)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: A value that has to be spilled is a binary value
+ * - CHIDB_ECONSTRAINT: The row's partition has been spilled, and it
+ *                      already has SPILL_MAX_ENTRIES entries
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the temporary file
+ */
+int chidb_dbm_hash_insert(chidb_dbm_hash_t *h, chidb_dbm_register_t *key, chidb_dbm_register_t *row)
+{
+    uint32_t hash = chidb_dbm_hash_value(key), part = HASH_PART(hash), size;
+    chidb_dbm_hash_entry_t *e;
+    int rc = CHIDB_OK;
+
+    h->mode = DBM_HASH_NONE;
+    chidb_KeyTree_close(&h->kc);
+
+    if (h->spill[part].nroot != 0)
+        return chidb_dbm_hash_spillEntry(h, hash, false, key, row);
+
+    e = calloc(1, sizeof(chidb_dbm_hash_entry_t) + h->ncols * sizeof(chidb_dbm_register_t));
+    if (e == NULL)
+        return CHIDB_ENOMEM;
+
+    e->hash = hash;
+    rc = chidb_dbm_reg_keep(&e->key, key);
+    for(uint32_t i = 0; i < h->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_keep(&e->row[i], &row[i]);
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_dbm_hash_freeEntry(h, e);
+        return rc;
+    }
+
+    e->next = h->buckets[HASH_BUCKET(h, hash)];
+    h->buckets[HASH_BUCKET(h, hash)] = e;
+    h->nentries++;
+
+    size = chidb_dbm_hash_entrySize(h, e);
+    h->mem += size;
+    h->partMem[part] += size;
+
+    if (h->nentries > h->nbuckets && (rc = chidb_dbm_hash_grow(h)) != CHIDB_OK)
+        return rc;
+
+    /* Spill the largest partitions until the entries fit in the budget */
+    while (h->mem > h->budget && rc == CHIDB_OK)
+    {
+        uint32_t largest = 0;
+
+        for(uint32_t i = 1; i < DBM_HASH_NPART; i++)
+            if (h->partMem[i] > h->partMem[largest])
+                largest = i;
+
+        rc = chidb_dbm_hash_spill(h, largest);
+    }
+
+    return rc;
+}
+
+
+/* Decodes spilled entry number n (its record) into spillKey and spillRow */
+static int chidb_dbm_hash_spillDecode(chidb_dbm_hash_t *h, uint8_t *data, uint32_t n)
+{
+    DBRecord *dbr;
+    int rc;
+
+    if ((rc = chidb_DBRecord_unpack(&dbr, data)) != CHIDB_OK)
+        return rc;
+
+    h->spillEntry = n;
+    rc = chidb_dbm_reg_set_field(&h->spillKey, dbr, 0);
+    for(uint32_t i = 0; i < h->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_set_field(&h->spillRow[i], dbr, i + 1);
+    chidb_DBRecord_destroy(dbr);
+
+    return rc;
+}
+
+
+/* Positions the scan of a spilled partition's table B-Tree on the first
+ * cell that is not before the current cell, and decodes its entry. The
+ * current cell is given by the path from the root to it, which may point
+ * past the last cell of a node (then, the scan continues with the next
+ * child of the parent node). If there are no more cells, found is set to
+ * false. */
+static int chidb_dbm_hash_spillLoad(chidb_dbm_hash_t *h, bool *found)
+{
+    BTree *bt = h->tmp->bt;
+    BTreeNode *btn;
+    BTreeCell cell;
+    int rc = CHIDB_OK;
+
+    *found = false;
+
+    while (h->depth > 0 && rc == CHIDB_OK && !*found)
+    {
+        uint32_t top = h->depth - 1;
+        ncell_t ncell = h->path_cell[top];
+
+        if ((rc = chidb_Btree_getNodeByPage(bt, h->path_page[top], &btn)) != CHIDB_OK)
+            break;
+
+        if (btn->type == PGTYPE_TABLE_LEAF && ncell < btn->n_cells)
+        {
+            chidb_Btree_getCell(btn, ncell, &cell);
+            *found = true;
+            rc = chidb_dbm_hash_spillDecode(h, cell.fields.tableLeaf.data, cell.key);
+        }
+        else if (btn->type == PGTYPE_TABLE_LEAF || ncell > btn->n_cells)
+        {
+            /* Done with this node */
+            h->depth--;
+            if (h->depth > 0)
+                h->path_cell[h->depth - 1]++;
+        }
+        else if (h->depth == DBM_HASH_MAX_DEPTH)
+            rc = CHIDB_ECORRUPT;
+        else
+        {
+            /* The child of the cell (or the right page, after the last cell) */
+            if (ncell < btn->n_cells)
+            {
+                chidb_Btree_getCell(btn, ncell, &cell);
+                h->path_page[h->depth] = cell.fields.tableInternal.child_page;
+            }
+            else
+                h->path_page[h->depth] = btn->right_page;
+            h->path_cell[h->depth] = 0;
+            h->depth++;
+        }
+
+        chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    return rc;
+}
+
+
+/* Positions the scan of a spilled partition's table B-Tree on its first
+ * entry (the entries are in order of their numbers) */
+static int chidb_dbm_hash_spillRewind(chidb_dbm_hash_t *h, uint32_t part, bool *found)
+{
+    h->part = part;
+    h->path_page[0] = h->spill[part].nroot;
+    h->path_cell[0] = 0;
+    h->depth = 1;
+
+    return chidb_dbm_hash_spillLoad(h, found);
+}
+
+
+/* Moves to the next cell of the scan of a spilled partition's table B-Tree */
+static int chidb_dbm_hash_spillNext(chidb_dbm_hash_t *h, bool *found)
+{
+    h->path_cell[h->depth - 1]++;
+
+    return chidb_dbm_hash_spillLoad(h, found);
+}
+
+
+/* Has a spilled entry been matched? */
+static bool chidb_dbm_hash_spillMatched(chidb_dbm_hash_t *h, uint32_t part, uint32_t n)
+{
+    return n < h->spill[part].n && (h->spill[part].matched[n / 8] & (1 << (n % 8)));
+}
+
+
+/* Moves to the next entry with the probe key. If first is true, this is
+ * the first entry with the key (otherwise, the one after the current entry) */
+static int chidb_dbm_hash_nextProbe(chidb_dbm_hash_t *h, bool first, bool *found)
+{
+    uint32_t part = HASH_PART(h->probeHash);
+    uint8_t hkey[SPILL_HASH_KEY_SIZE];
+    int rc;
+
+    *found = false;
+
+    if (h->probe.type != REG_INT32 && h->probe.type != REG_STRING)
+        return CHIDB_OK;
+
+    if (h->spill[part].nroot == 0)
+    {
+        h->entry = first ? h->buckets[HASH_BUCKET(h, h->probeHash)] : h->entry->next;
+        while (h->entry != NULL &&
+               (h->entry->hash != h->probeHash || !chidb_dbm_hash_keyEq(&h->entry->key, &h->probe)))
+            h->entry = h->entry->next;
+
+        *found = h->entry != NULL;
+        return CHIDB_OK;
+    }
+
+    /* The entries with the same hash value, from the partition's key
+     * B-Tree, each of them read from the table B-Tree by its number */
+    h->entry = NULL;
+    h->part = part;
+    if (first)
+    {
+        put4byte(hkey, h->probeHash);
+        put4byte(hkey + 4, 0);
+        rc = chidb_KeyTree_seek(h->tmp->bt, h->spill[part].nhashes, &h->kc, hkey, sizeof(hkey));
+    }
+    else
+        rc = chidb_KeyTree_next(&h->kc);
+
+    while (rc == CHIDB_OK && h->kc.key != NULL && get4byte(h->kc.key) == h->probeHash)
+    {
+        uint32_t n = get4byte(h->kc.key + 4);
+        uint8_t *data;
+        uint16_t size;
+
+        rc = chidb_Btree_find(h->tmp->bt, h->spill[part].nroot, n, &data, &size);
+        if (rc == CHIDB_ENOTFOUND)
+            rc = CHIDB_ECORRUPT;
+        if (rc != CHIDB_OK)
+            break;
+
+        rc = chidb_dbm_hash_spillDecode(h, data, n);
+        free(data);
+
+        if (rc == CHIDB_OK && chidb_dbm_hash_keyEq(&h->spillKey, &h->probe))
+        {
+            *found = true;
+            break;
+        }
+        if (rc == CHIDB_OK)
+            rc = chidb_KeyTree_next(&h->kc);
+    }
+
+    return rc;
+}
+
+
+/* Moves to the next entry that hasn't been matched. The entries in
+ * memory (bucket by bucket) come first, followed by the entries of each
+ * spilled partition. If first is true, this is the first such entry */
+static int chidb_dbm_hash_nextUnmatched(chidb_dbm_hash_t *h, bool first, bool *found)
+{
+    int rc = CHIDB_OK;
+
+    *found = false;
+
+    if (first)
+    {
+        h->bucket = 0;
+        h->entry = NULL;
+        h->part = DBM_HASH_NPART;
+    }
+    else if (h->entry != NULL && (h->entry = h->entry->next) == NULL)
+        h->bucket++;
+
+    /* Entries in memory */
+    for(; h->bucket < h->nbuckets; h->bucket++)
+    {
+        if (h->entry == NULL)
+            h->entry = h->buckets[h->bucket];
+        while (h->entry != NULL && h->entry->matched)
+            h->entry = h->entry->next;
+
+        if (h->entry != NULL)
+        {
+            *found = true;
+            return CHIDB_OK;
+        }
+    }
+
+    /* Spilled entries */
+    if (h->part < DBM_HASH_NPART)
+        rc = chidb_dbm_hash_spillNext(h, found);
+
+    while (rc == CHIDB_OK)
+    {
+        if (!*found)
+        {
+            uint32_t part = h->part == DBM_HASH_NPART ? 0 : h->part + 1;
+
+            while (part < DBM_HASH_NPART && h->spill[part].nroot == 0)
+                part++;
+            if (part == DBM_HASH_NPART)
+                break;
+
+            rc = chidb_dbm_hash_spillRewind(h, part, found);
+        }
+        else if (chidb_dbm_hash_spillMatched(h, h->part, h->spillEntry))
+            rc = chidb_dbm_hash_spillNext(h, found);
+        else
+            break;
+    }
+
+    return rc;
+}
+
+
+/* Position a hash table on the first entry with a key
+ *
+ * Parameters
+ * - h: Hash table
+ * - key: Key
+ * - found: Out parameter. Set to false if no entry has the key.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the temporary file
+ */
+int chidb_dbm_hash_probe(chidb_dbm_hash_t *h, chidb_dbm_register_t *key, bool *found)
+{
+    int rc;
+
+    if ((rc = chidb_dbm_reg_keep(&h->probe, key)) != CHIDB_OK)
+        return rc;
+
+    h->probeHash = chidb_dbm_hash_value(key);
+    h->mode = DBM_HASH_PROBE;
+
+    rc = chidb_dbm_hash_nextProbe(h, true, found);
+    if (!*found)
+        h->mode = DBM_HASH_NONE;
+
+    return rc;
+}
+
+
+/* Position a hash table on the first entry that hasn't been matched
+ *
+ * Parameters
+ * - h: Hash table
+ * - found: Out parameter. Set to false if all the entries have been matched.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the temporary file
+ */
+int chidb_dbm_hash_unmatched(chidb_dbm_hash_t *h, bool *found)
+{
+    int rc;
+
+    h->mode = DBM_HASH_UNMATCHED;
+
+    rc = chidb_dbm_hash_nextUnmatched(h, true, found);
+    if (!*found)
+        h->mode = DBM_HASH_NONE;
+
+    return rc;
+}
+
+
+/* Move a hash table to the next entry
+ *
+ * The next entry is the next entry with the key of the last probe
+ * (after chidb_dbm_hash_probe) or the next entry that hasn't been
+ * matched (after chidb_dbm_hash_unmatched).
+ *
+ * Parameters
+ * - h: Hash table
+ * - found: Out parameter. Set to false if there are no more entries.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the temporary file
+ */
+int chidb_dbm_hash_next(chidb_dbm_hash_t *h, bool *found)
+{
+    int rc;
+
+    if (h->mode == DBM_HASH_PROBE)
+        rc = chidb_dbm_hash_nextProbe(h, false, found);
+    else if (h->mode == DBM_HASH_UNMATCHED)
+        rc = chidb_dbm_hash_nextUnmatched(h, false, found);
+    else
+    {
+        *found = false;
+        return CHIDB_OK;
+    }
+
+    if (!*found)
+        h->mode = DBM_HASH_NONE;
+
+    return rc;
+}
+
+
+/* Get the values of the current entry of a hash table
+ *
+ * Parameters
+ * - h: Hash table
+ * - row: Out parameter. Used to return the h->ncols registers with
+ *        the entry's values.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The hash table is not positioned on an entry
+ */
+int chidb_dbm_hash_row(chidb_dbm_hash_t *h, chidb_dbm_register_t **row)
+{
+    if (h->mode == DBM_HASH_NONE)
+        return CHIDB_EMISUSE;
+
+    *row = h->entry != NULL ? h->entry->row : h->spillRow;
+
+    return CHIDB_OK;
+}
+
+
+/* Mark the current entry of a hash table as matched
+ *
+ * Parameters
+ * - h: Hash table
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The hash table is not positioned on an entry
+ */
+int chidb_dbm_hash_mark(chidb_dbm_hash_t *h)
+{
+    if (h->mode == DBM_HASH_NONE)
+        return CHIDB_EMISUSE;
+
+    if (h->entry != NULL)
+        h->entry->matched = true;
+    else
+        h->spill[h->part].matched[h->spillEntry / 8] |= 1 << (h->spillEntry % 8);
+
+    return CHIDB_OK;
+}
+
+
+/* Close a hash table
+ *
+ * Frees its entries, and closes (and removes) its temporary file.
+ *
+ * Parameters
+ * - h: Hash table
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_hash_close(chidb_dbm_hash_t *h)
+{
+    chidb_dbm_hash_entry_t *e, *next;
+
+    if (!h->open)
+        return CHIDB_OK;
+
+    for(uint32_t i = 0; i < h->nbuckets; i++)
+        for(e = h->buckets[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            chidb_dbm_hash_freeEntry(h, e);
+        }
+    free(h->buckets);
+
+    for(uint32_t i = 0; i < DBM_HASH_NPART; i++)
+        free(h->spill[i].matched);
+
+    chidb_KeyTree_close(&h->kc);
+    if (h->tmp != NULL)
+    {
+        chidb_Btree_close(h->tmp->bt);
+        free(h->tmp);
+    }
+
+    chidb_dbm_reg_free(&h->probe);
+    chidb_dbm_reg_free(&h->spillKey);
+    for(uint32_t i = 0; i < h->ncols; i++)
+        chidb_dbm_reg_free(&h->spillRow[i]);
+    free(h->spillRow);
+
+    memset(h, 0, sizeof(chidb_dbm_hash_t));
+
+    return CHIDB_OK;
+}
+
+
+/* Free the hash tables of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_hash_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nHashes; i++)
+        chidb_dbm_hash_close(&stmt->hashes[i]);
+    free(stmt->hashes);
+    stmt->hashes = NULL;
+    stmt->nHashes = 0;
+
+    return CHIDB_OK;
+}
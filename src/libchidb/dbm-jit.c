@@ -0,0 +1,427 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine JIT compiler
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#ifdef CHIDB_JIT
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
+#endif
+#include <chidb/log.h>
+#include "dbm.h"
+#include "dbm-jit.h"
+
+/* The JIT compiler translates a DBM program into C code, compiles it with
+ * the system's C compiler into a shared object, and loads it with dlopen.
+ *
+ * Each instruction becomes a labelled block of code in a single function.
+ * Instructions that only manipulate registers (Integer, Null, Noop) and
+ * integer comparisons (Eq, Ne, Lt, Le, Gt, Ge) are translated into
+ * straight-line code, where jumps are gotos to the label of the target
+ * instruction. All other instructions (cursor and B-Tree operations,
+ * result rows, etc.) are translated into calls to their instruction
+ * handlers in dbm-ops.c, which remain the reference implementation of
+ * each instruction.
+ *
+ * The generated function has the following signature:
+ *
+ *   int f(chidb_stmt *stmt, chidb_dbm_register_t **reg, uint32_t *pc)
+ *
+ * It starts running at instruction *pc, and returns in the same
+ * circumstances as chidb_stmt_exec (with *pc pointing to the next
+ * instruction to run), so a statement can switch from the interpreter
+ * to the compiled code between calls to chidb_stmt_exec. Registers are
+ * always accessed through *reg, since an instruction handler may
+ * reallocate the registers.
+ */
+
+/* Get the JIT threshold
+ *
+ * Returns the number of instructions a statement has to run before
+ * it is compiled to native code, as specified in the CHIDB_JIT_THRESHOLD
+ * environment variable. If the variable is not set, the JIT compiler
+ * is disabled.
+ *
+ * Return
+ * - The JIT threshold, or 0 if the JIT compiler is disabled.
+ */
+uint64_t chidb_dbm_jit_threshold()
+{
+    char *s = getenv(JIT_THRESHOLD_ENV);
+
+    if (s == NULL || *s == '\0')
+        return 0;
+
+    return strtoull(s, NULL, 10);
+}
+
+
+/* The JIT compiler needs dlopen (see configure.ac). Without it, programs
+ * are always interpreted: chidb_dbm_jit_compile always fails, and
+ * chidb_stmt_exec falls back to the interpreter */
+#ifdef CHIDB_JIT
+
+#define JIT_ENTRY "chidb_jit_main"
+
+/* The generated code accesses registers as raw memory, so it
+ * needs to know the size of the register type */
+_Static_assert(sizeof(register_type_t) == sizeof(int), "register_type_t must be an int");
+
+/* Addresses of the instruction handlers, which are embedded
+ * as constants in the generated code */
+#define JIT_HANDLER(OP) [Op_ ## OP] = chidb_dbm_op_ ## OP,
+static int (*const jit_handlers[])(chidb_stmt *stmt, chidb_dbm_op_t *op) =
+{
+    FOREACH_OP(JIT_HANDLER)
+};
+
+/* C operators of the comparison instructions. Note that the
+ * comparison instructions jump if R[p3] <op> R[p1] */
+static const char *jit_cmp[] =
+{
+    [Op_Eq] = "==",
+    [Op_Ne] = "!=",
+    [Op_Lt] = "<",
+    [Op_Le] = "<=",
+    [Op_Gt] = ">",
+    [Op_Ge] = ">=",
+};
+
+
+/* Emits a call to the handler of instruction i. If the handler
+ * jumps, the generated code jumps to the new value of *pc */
+static void jit_emit_call(FILE *f, chidb_stmt *stmt, uint32_t i)
+{
+    fprintf(f, "    CALL(%" PRIu32 ", %#" PRIxPTR ", %#" PRIxPTR ");\n", i + 1,
+            (uintptr_t) jit_handlers[stmt->ops[i].opcode], (uintptr_t) &stmt->ops[i]);
+}
+
+/* Emits the code for instruction i */
+static void jit_emit_op(FILE *f, chidb_stmt *stmt, uint32_t i)
+{
+    chidb_dbm_op_t *op = &stmt->ops[i];
+
+    fprintf(f, "L%" PRIu32 ": /* %s %i %i %i */\n", i, opcode_to_str(op->opcode), op->p1, op->p2, op->p3);
+
+    switch(op->opcode)
+    {
+    case Op_Noop:
+        break;
+
+    case Op_Integer:
+    case Op_Null:
+        if (!EXISTS_REGISTER(stmt, op->p2))
+        {
+            jit_emit_call(f, stmt, i);
+            break;
+        }
+        if (op->opcode == Op_Integer)
+        {
+            fprintf(f, "    TYPE(%i) = %i;\n", op->p2, REG_INT32);
+            fprintf(f, "    INT(%i) = %i;\n", op->p2, op->p1);
+        }
+        else
+            fprintf(f, "    TYPE(%i) = %i;\n", op->p2, REG_NULL);
+        break;
+
+    case Op_Eq:
+    case Op_Ne:
+    case Op_Lt:
+    case Op_Le:
+    case Op_Gt:
+    case Op_Ge:
+        /* Integer comparisons are done inline. Anything else (including
+         * errors, like comparing registers of different types) is left
+         * to the instruction handler */
+        if (!EXISTS_REGISTER(stmt, op->p1) || !EXISTS_REGISTER(stmt, op->p3) ||
+            !IS_VALID_ADDRESS(stmt, op->p2))
+        {
+            jit_emit_call(f, stmt, i);
+            break;
+        }
+        fprintf(f, "    if (TYPE(%i) == %i && TYPE(%i) == %i)\n", op->p3, REG_INT32, op->p1, REG_INT32);
+        fprintf(f, "    {\n");
+        fprintf(f, "        if (INT(%i) %s INT(%i))\n", op->p3, jit_cmp[op->opcode], op->p1);
+        fprintf(f, "            goto L%i;\n", op->p2);
+        fprintf(f, "    }\n");
+        fprintf(f, "    else\n");
+        fprintf(f, "    {\n");
+        fprintf(f, "    ");
+        jit_emit_call(f, stmt, i);
+        fprintf(f, "    }\n");
+        break;
+
+    default:
+        jit_emit_call(f, stmt, i);
+        break;
+    }
+}
+
+/* Emits the C code for the entire program */
+static void jit_emit(FILE *f, chidb_stmt *stmt)
+{
+    fprintf(f, "/* Generated by the chidb JIT compiler */\n\n");
+    fprintf(f, "#include <stdint.h>\n\n");
+    fprintf(f, "typedef int (*handler_t)(void *stmt, void *op);\n\n");
+    fprintf(f, "#define REG(r) ((char *) *reg + (r) * %zu)\n", sizeof(chidb_dbm_register_t));
+    fprintf(f, "#define TYPE(r) (*(int *) (REG(r) + %zu))\n", offsetof(chidb_dbm_register_t, type));
+    fprintf(f, "#define INT(r) (*(int32_t *) (REG(r) + %zu))\n", offsetof(chidb_dbm_register_t, value.i));
+    fprintf(f, "#define CALL(next, h, op)                        \\\n");
+    fprintf(f, "    do                                           \\\n");
+    fprintf(f, "    {                                            \\\n");
+    fprintf(f, "        *pc = (next);                            \\\n");
+    fprintf(f, "        rc = ((handler_t) (h))(stmt, (void *) (op)); \\\n");
+    fprintf(f, "        if (rc != %i)                            \\\n", CHIDB_OK);
+    fprintf(f, "            return rc;                           \\\n");
+    fprintf(f, "        if (*pc != (next))                       \\\n");
+    fprintf(f, "            goto dispatch;                       \\\n");
+    fprintf(f, "    } while(0)\n\n");
+
+    fprintf(f, "int %s(void *stmt, void **reg, uint32_t *pc)\n", JIT_ENTRY);
+    fprintf(f, "{\n");
+    fprintf(f, "    int rc;\n\n");
+    fprintf(f, "dispatch:\n");
+    fprintf(f, "    switch(*pc)\n");
+    fprintf(f, "    {\n");
+    for(uint32_t i=0; i < stmt->endOp; i++)
+        fprintf(f, "    case %" PRIu32 ": goto L%" PRIu32 ";\n", i, i);
+    fprintf(f, "    default: return %i;\n", CHIDB_OK);
+    fprintf(f, "    }\n\n");
+
+    for(uint32_t i=0; i < stmt->endOp; i++)
+        jit_emit_op(f, stmt, i);
+
+    /* Falling off the end of the program */
+    fprintf(f, "L%" PRIu32 ":\n", stmt->endOp);
+    fprintf(f, "    *pc = %" PRIu32 ";\n", stmt->endOp);
+    fprintf(f, "    return %i;\n", CHIDB_OK);
+    fprintf(f, "}\n");
+}
+
+
+/* Runs the C compiler, with its output discarded, to compile the
+ * generated code in src into the shared object so. The compiler is run
+ * directly (not through the shell), so the paths and the compiler's
+ * name are never interpreted as shell syntax. Returns true if it
+ * succeeded */
+static bool jit_run_cc(const char *cc, const char *so, const char *src)
+{
+    char *const argv[] = {(char *) cc, "-O2", "-shared", "-fPIC", "-o", (char *) so, (char *) src, NULL};
+    int status, fd;
+    pid_t pid;
+
+    if ((pid = fork()) < 0)
+        return false;
+
+    if (pid == 0)
+    {
+        if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execvp(cc, argv);
+        _exit(127);
+    }
+
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return false;
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+/* Compile a DBM program to native code
+ *
+ * Generates C code for the program, compiles it with the C compiler
+ * specified in the CHIDB_JIT_CC environment variable (or "cc" if it is
+ * not set), and loads the resulting shared object. CHIDB_JIT_CC is the
+ * name (or path) of the compiler itself, with no arguments: it is run
+ * directly, not through the shell. The compiled program
+ * is discarded whenever an instruction is modified.
+ *
+ * Since the addresses of the instructions and the size of the register
+ * file are embedded in the generated code, the program must not be
+ * modified while the compiled code is in use.
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: The program could not be written, compiled, or loaded
+ */
+int chidb_dbm_jit_compile(chidb_stmt *stmt)
+{
+    char dir[PATH_MAX], src[PATH_MAX + 8], so[PATH_MAX + 8], *cc, *tmp;
+    void *handle;
+    void *fn;
+    FILE *f;
+    int rc = CHIDB_OK;
+
+    chidb_dbm_jit_free(stmt);
+
+    if ((tmp = getenv("TMPDIR")) == NULL || *tmp == '\0')
+        tmp = "/tmp";
+    if ((cc = getenv(JIT_CC_ENV)) == NULL || *cc == '\0')
+        cc = JIT_DEFAULT_CC;
+
+    snprintf(dir, sizeof(dir), "%s/chidb-jit-XXXXXX", tmp);
+    if (mkdtemp(dir) == NULL)
+        return CHIDB_EIO;
+    snprintf(src, sizeof(src), "%s/jit.c", dir);
+    snprintf(so, sizeof(so), "%s/jit.so", dir);
+
+    if ((f = fopen(src, "w")) == NULL)
+    {
+        rmdir(dir);
+        return CHIDB_EIO;
+    }
+    jit_emit(f, stmt);
+    if (fclose(f) != 0)
+    {
+        rc = CHIDB_EIO;
+        goto cleanup;
+    }
+
+    if (!jit_run_cc(cc, so, src))
+    {
+        chilog(WARNING, "JIT: could not compile program with '%s'", cc);
+        rc = CHIDB_EIO;
+        goto cleanup;
+    }
+
+    if ((handle = dlopen(so, RTLD_NOW | RTLD_LOCAL)) == NULL)
+    {
+        chilog(WARNING, "JIT: could not load compiled program: %s", dlerror());
+        rc = CHIDB_EIO;
+        goto cleanup;
+    }
+
+    if ((fn = dlsym(handle, JIT_ENTRY)) == NULL)
+    {
+        dlclose(handle);
+        rc = CHIDB_EIO;
+        goto cleanup;
+    }
+
+    stmt->jitHandle = handle;
+    *(void **) &stmt->jit = fn;
+
+cleanup:
+    /* Once loaded, the shared object is no longer needed on disk */
+    unlink(so);
+    unlink(src);
+    rmdir(dir);
+
+    return rc;
+}
+
+
+/* Run a compiled DBM program
+ *
+ * Runs the compiled program from the current value of the
+ * program counter. Note that instructions run by the compiled
+ * code are not counted in stmt->nSteps.
+ *
+ * Parameters
+ * - stmt: DBM program (must have been compiled)
+ *
+ * Return
+ * - Same as chidb_stmt_exec
+ */
+int chidb_dbm_jit_run(chidb_stmt *stmt)
+{
+    assert(stmt->jit != NULL);
+
+    return stmt->jit(stmt, &stmt->reg, &stmt->pc);
+}
+
+
+/* Discard a compiled DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_jit_free(chidb_stmt *stmt)
+{
+    if (stmt->jitHandle != NULL)
+        dlclose(stmt->jitHandle);
+
+    stmt->jitHandle = NULL;
+    stmt->jit = NULL;
+
+    return CHIDB_OK;
+}
+
+#else
+
+int chidb_dbm_jit_compile(chidb_stmt *stmt)
+{
+    return CHIDB_EIO;
+}
+
+int chidb_dbm_jit_run(chidb_stmt *stmt)
+{
+    assert(stmt->jit != NULL);
+
+    return CHIDB_EMISUSE;
+}
+
+int chidb_dbm_jit_free(chidb_stmt *stmt)
+{
+    stmt->jitHandle = NULL;
+    stmt->jit = NULL;
+
+    return CHIDB_OK;
+}
+
+#endif /* CHIDB_JIT */
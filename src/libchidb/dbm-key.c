@@ -0,0 +1,495 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine key scans
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The key instructions (see dbm-ops.c) read and update key B-Trees (see
+ * keytree.c), which are the B-Trees of the indexes on several columns.
+ *
+ * MakeKey encodes the values of some registers as a string of bytes (a
+ * binary value), the key, whose order (as compared by memcmp) is that of
+ * the values: by the first value, then by the second one, and so on. Each
+ * value is ordered like chidb_dbm_reg_cmp orders them, and its encoding
+ * starts with a tag for its type:
+ *
+ *  - NULL: KEY_TAG_NULL
+ *  - Integer: KEY_TAG_INT, followed by its 4 bytes (big-endian, with the
+ *    sign bit flipped, so that negative integers come first)
+ *  - String or binary value: KEY_TAG_TEXT or KEY_TAG_BINARY, followed by
+ *    its bytes (with each 0x00 written as 0x00 0xFF) and by 0x00 0x00
+ *
+ * No encoded value is a prefix of another one, so two keys are ordered
+ * by the first value in which they differ. Each entry of an index on
+ * several columns has the key of its values followed by the primary key
+ * of its row (4 bytes, big-endian), so the keys of the entries are unique
+ * even if their values are not, and an index's entries are in order of
+ * their values.
+ *
+ * A key scan visits the entries in order, from a seek to the first entry
+ * whose key is not lower than a key (KeySeekGe) or, for a strict bound,
+ * greater than all the keys that start with a key (KeySeekGt), until
+ * the first bytes of an entry's key are past the key of the other bound
+ * (KeyGt and KeyGe).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dbm-key.h"
+#include "dbm-reg.h"
+#include "util.h"
+
+#define KEY_TAG_NULL (0x01)
+#define KEY_TAG_INT (0x02)
+#define KEY_TAG_TEXT (0x03)
+#define KEY_TAG_BINARY (0x04)
+
+/* Size of the primary key at the end of an entry's key */
+#define KEY_PK_SIZE (4)
+
+
+/* Size of the encoding of a string of bytes */
+static uint32_t chidb_dbm_key_bytesSize(const uint8_t *s, uint32_t len)
+{
+    uint32_t size = 1 + len + 2;
+
+    for(uint32_t i = 0; i < len; i++)
+        size += s[i] == 0x00;
+
+    return size;
+}
+
+
+/* Encodes a string of bytes. Returns the end of its encoding */
+static uint8_t *chidb_dbm_key_putBytes(uint8_t *p, uint8_t tag, const uint8_t *s, uint32_t len)
+{
+    *p++ = tag;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        *p++ = s[i];
+        if (s[i] == 0x00)
+            *p++ = 0xFF;
+    }
+    *p++ = 0x00;
+    *p++ = 0x00;
+
+    return p;
+}
+
+
+/* Make the key of some values
+ *
+ * Parameters
+ * - values: Registers with the values
+ * - n: Number of values
+ * - bt: If not NULL, the key is the key of an entry of a key B-Tree of
+ *       this file, which must have room for it and a primary key
+ * - key: Register where the key is stored (as a binary value)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: A register has no value
+ * - CHIDB_ECONSTRAINT: The key of an entry is too long
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_key_make(chidb_dbm_register_t *values, uint32_t n, BTree *bt, chidb_dbm_register_t *key)
+{
+    uint8_t small[256], *buf = small, *p;
+    uint32_t size = 0;
+    int rc;
+
+    for(uint32_t i = 0; i < n; i++)
+    {
+        chidb_dbm_register_t *r = &values[i];
+
+        switch (r->type)
+        {
+        case REG_NULL:
+            size += 1;
+            break;
+        case REG_INT32:
+            size += 1 + 4;
+            break;
+        case REG_STRING:
+            size += chidb_dbm_key_bytesSize((uint8_t *) r->value.s, r->len);
+            break;
+        case REG_BINARY:
+            size += chidb_dbm_key_bytesSize(r->value.bin.bytes, r->value.bin.nbytes);
+            break;
+        default:
+            return CHIDB_EMISMATCH;
+        }
+    }
+
+    if (bt != NULL && size + KEY_PK_SIZE > chidb_KeyTree_maxKey(bt))
+        return CHIDB_ECONSTRAINT;
+
+    /* The key of no values is empty, so no key is lower than it */
+    if (size == 0)
+        return chidb_dbm_reg_set_binary(key, (const uint8_t *) "", 0);
+
+    if (size > sizeof(small) && (buf = malloc(size)) == NULL)
+        return CHIDB_ENOMEM;
+
+    p = buf;
+    for(uint32_t i = 0; i < n; i++)
+    {
+        chidb_dbm_register_t *r = &values[i];
+
+        switch (r->type)
+        {
+        case REG_NULL:
+            *p++ = KEY_TAG_NULL;
+            break;
+        case REG_INT32:
+            *p++ = KEY_TAG_INT;
+            put4byte(p, (uint32_t) r->value.i ^ 0x80000000);
+            p += 4;
+            break;
+        case REG_STRING:
+            p = chidb_dbm_key_putBytes(p, KEY_TAG_TEXT, (uint8_t *) r->value.s, r->len);
+            break;
+        default:
+            p = chidb_dbm_key_putBytes(p, KEY_TAG_BINARY, r->value.bin.bytes, r->value.bin.nbytes);
+            break;
+        }
+    }
+
+    rc = chidb_dbm_reg_set_binary(key, buf, size);
+
+    if (buf != small)
+        free(buf);
+
+    return rc;
+}
+
+
+/* Get a key scan
+ *
+ * Returns key scan number nscan of a DBM program, allocating it if
+ * necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nscan: Key scan number
+ * - ks: Out parameter. Used to return a pointer to the key scan.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid key scan number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_key_get(chidb_stmt *stmt, int32_t nscan, chidb_dbm_keyscan_t **ks)
+{
+    if (nscan < 0)
+        return CHIDB_EMISUSE;
+
+    if (nscan >= stmt->nKeyScans)
+    {
+        chidb_dbm_keyscan_t *scans = realloc(stmt->keyScans, (nscan + 1) * sizeof(chidb_dbm_keyscan_t));
+        if (scans == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&scans[stmt->nKeyScans], 0, (nscan + 1 - stmt->nKeyScans) * sizeof(chidb_dbm_keyscan_t));
+        stmt->keyScans = scans;
+        stmt->nKeyScans = nscan + 1;
+    }
+
+    *ks = &stmt->keyScans[nscan];
+
+    return CHIDB_OK;
+}
+
+
+/* Open a key scan of a key B-Tree
+ *
+ * The scan is not positioned on any entry until it is first seeked.
+ *
+ * Parameters
+ * - ks: Key scan (which must not be open)
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the key B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The key scan is already open
+ */
+int chidb_dbm_key_open(chidb_dbm_keyscan_t *ks, BTree *bt, npage_t nroot)
+{
+    if (ks->open)
+        return CHIDB_EMISUSE;
+
+    memset(ks, 0, sizeof(chidb_dbm_keyscan_t));
+    ks->open = true;
+    ks->bt = bt;
+    ks->nroot = nroot;
+    ks->kc.bt = bt;
+
+    return CHIDB_OK;
+}
+
+
+/* Makes sure that the buffer of a key scan has room for size bytes */
+static int chidb_dbm_key_reserve(chidb_dbm_keyscan_t *ks, uint32_t size)
+{
+    uint8_t *buf;
+
+    if (size <= ks->bufSize)
+        return CHIDB_OK;
+
+    if ((buf = realloc(ks->buf, size)) == NULL)
+        return CHIDB_ENOMEM;
+
+    ks->buf = buf;
+    ks->bufSize = size;
+
+    return CHIDB_OK;
+}
+
+
+/* Add an entry to the key B-Tree of a key scan
+ *
+ * Parameters
+ * - ks: Key scan
+ * - key: Register with the key of the entry's values (see chidb_dbm_key_make)
+ * - pk: Primary key of the entry's row
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The register doesn't have a key
+ * - CHIDB_ECONSTRAINT: The key (with the primary key) is longer than
+ *                      the longest key of a key B-Tree
+ * - CHIDB_EDUPLICATE: The B-Tree already has the entry
+ * - Any other error code returned by chidb_KeyTree_insert
+ */
+int chidb_dbm_key_insert(chidb_dbm_keyscan_t *ks, chidb_dbm_register_t *key, chidb_key_t pk)
+{
+    uint32_t len;
+    int rc;
+
+    if (key->type != REG_BINARY)
+        return CHIDB_EMISMATCH;
+
+    len = key->value.bin.nbytes + KEY_PK_SIZE;
+    if (len > chidb_KeyTree_maxKey(ks->bt))
+        return CHIDB_ECONSTRAINT;
+
+    if ((rc = chidb_dbm_key_reserve(ks, len)) != CHIDB_OK)
+        return rc;
+
+    memcpy(ks->buf, key->value.bin.bytes, key->value.bin.nbytes);
+    put4byte(&ks->buf[key->value.bin.nbytes], pk);
+
+    return chidb_KeyTree_insert(ks->bt, ks->nroot, ks->buf, len);
+}
+
+
+/* Position a key scan on the first entry not lower than a key
+ *
+ * Parameters
+ * - ks: Key scan
+ * - key: Register with a key
+ * - past: If true, skip the entries whose keys start with key (and
+ *         position the scan on the first entry greater than all of them)
+ * - found: Out parameter. Is there such an entry?
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The register doesn't have a key
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - Any other error code returned by chidb_KeyTree_seek
+ */
+int chidb_dbm_key_seek(chidb_dbm_keyscan_t *ks, chidb_dbm_register_t *key, bool past, bool *found)
+{
+    const uint8_t *k;
+    uint32_t len, maxKey = chidb_KeyTree_maxKey(ks->bt);
+    int rc;
+
+    if (key->type != REG_BINARY)
+        return CHIDB_EMISMATCH;
+
+    k = key->value.bin.bytes;
+    len = key->value.bin.nbytes;
+    *found = false;
+
+    /* The lowest key greater than all the keys that start with key is key
+     * with its trailing 0xFFs removed, and its last byte incremented (if
+     * all its bytes are 0xFF, there is no such key) */
+    if (past)
+    {
+        while (len > 0 && k[len - 1] == 0xFF)
+            len--;
+        if (len == 0)
+            return chidb_KeyTree_close(&ks->kc);
+
+        if ((rc = chidb_dbm_key_reserve(ks, len)) != CHIDB_OK)
+            return rc;
+        memcpy(ks->buf, k, len);
+        ks->buf[len - 1]++;
+        k = ks->buf;
+    }
+
+    /* No key in the B-Tree is longer than maxKey, so a longer key is
+     * compared with them like its first maxKey + 1 bytes */
+    if (len > maxKey + 1)
+        len = maxKey + 1;
+
+    rc = chidb_KeyTree_seek(ks->bt, ks->nroot, &ks->kc, k, len);
+    *found = ks->kc.key != NULL;
+
+    return rc;
+}
+
+
+/* Move a key scan to the next entry
+ *
+ * Parameters
+ * - ks: Key scan
+ * - found: Out parameter. Is there a next entry?
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - Any other error code returned by chidb_KeyTree_next
+ */
+int chidb_dbm_key_next(chidb_dbm_keyscan_t *ks, bool *found)
+{
+    int rc = chidb_KeyTree_next(&ks->kc);
+
+    *found = ks->kc.key != NULL;
+
+    return rc;
+}
+
+
+/* Compare the key of the current entry of a key scan with a key
+ *
+ * Only the first bytes of the entry's key (as many as the key has) are
+ * compared, so an entry whose key starts with key is equal to it.
+ *
+ * Parameters
+ * - ks: Key scan
+ * - key: Register with a key
+ * - c: Out parameter. A negative number, 0 or a positive number if the
+ *      entry's key is lower than, equal to, or greater than key.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The scan is not positioned on an entry
+ * - CHIDB_EMISMATCH: The register doesn't have a key
+ */
+int chidb_dbm_key_cmp(chidb_dbm_keyscan_t *ks, chidb_dbm_register_t *key, int *c)
+{
+    uint32_t len;
+
+    if (ks->kc.key == NULL)
+        return CHIDB_EMISUSE;
+    if (key->type != REG_BINARY)
+        return CHIDB_EMISMATCH;
+
+    len = key->value.bin.nbytes;
+    *c = memcmp(ks->kc.key, key->value.bin.bytes, ks->kc.len < len ? ks->kc.len : len);
+    if (*c == 0 && ks->kc.len < len)
+        *c = -1;
+
+    return CHIDB_OK;
+}
+
+
+/* Get the primary key of the current entry of a key scan
+ *
+ * Parameters
+ * - ks: Key scan
+ * - pk: Out parameter. Primary key of the entry's row.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The scan is not positioned on an entry
+ * - CHIDB_ECORRUPT: The entry's key has no primary key
+ */
+int chidb_dbm_key_pkey(chidb_dbm_keyscan_t *ks, chidb_key_t *pk)
+{
+    if (ks->kc.key == NULL)
+        return CHIDB_EMISUSE;
+    if (ks->kc.len < KEY_PK_SIZE)
+        return CHIDB_ECORRUPT;
+
+    *pk = get4byte(&ks->kc.key[ks->kc.len - KEY_PK_SIZE]);
+
+    return CHIDB_OK;
+}
+
+
+/* Close a key scan
+ *
+ * Parameters
+ * - ks: Key scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_key_close(chidb_dbm_keyscan_t *ks)
+{
+    if (!ks->open)
+        return CHIDB_OK;
+
+    chidb_KeyTree_close(&ks->kc);
+    free(ks->buf);
+
+    memset(ks, 0, sizeof(chidb_dbm_keyscan_t));
+
+    return CHIDB_OK;
+}
+
+
+/* Free the key scans of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_key_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nKeyScans; i++)
+        chidb_dbm_key_close(&stmt->keyScans[i]);
+    free(stmt->keyScans);
+    stmt->keyScans = NULL;
+    stmt->nKeyScans = 0;
+
+    return CHIDB_OK;
+}
@@ -0,0 +1,333 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine value lists
+ *
+ */
+
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The list instructions (see dbm-ops.c) keep a list of values, such as
+ * the literals of an IN condition, which is built once and then looked up
+ * many times:
+ *
+ *  - ListAdd adds a value. NULL values are not added, since they are not
+ *    equal to any value.
+ *  - ListIn and ListNotIn look up a value. The first lookup sorts the
+ *    values (removing duplicates), and each lookup is then a binary search.
+ *  - ListRewind and ListNext visit the values in order (without
+ *    duplicates), and ListValue stores the current value in a register.
+ *
+ * Values are compared with chidb_dbm_reg_cmp (so, as in the rest of the
+ * DBM, an integer is never equal to a string).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dbm-list.h"
+#include "dbm-reg.h"
+
+
+/* Get a value list
+ *
+ * Returns value list number nlist of a DBM program, allocating it if
+ * necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nlist: List number
+ * - l: Out parameter. Used to return a pointer to the list.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid list number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_list_get(chidb_stmt *stmt, int32_t nlist, chidb_dbm_list_t **l)
+{
+    if (nlist < 0)
+        return CHIDB_EMISUSE;
+
+    if (nlist >= stmt->nLists)
+    {
+        chidb_dbm_list_t *lists = realloc(stmt->lists, (nlist + 1) * sizeof(chidb_dbm_list_t));
+        if (lists == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&lists[stmt->nLists], 0, (nlist + 1 - stmt->nLists) * sizeof(chidb_dbm_list_t));
+        stmt->lists = lists;
+        stmt->nLists = nlist + 1;
+    }
+
+    *l = &stmt->lists[nlist];
+
+    return CHIDB_OK;
+}
+
+
+/* Open a value list, with no values
+ *
+ * Parameters
+ * - l: List (which must not be open)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The list is already open
+ */
+int chidb_dbm_list_open(chidb_dbm_list_t *l)
+{
+    if (l->open)
+        return CHIDB_EMISUSE;
+
+    memset(l, 0, sizeof(chidb_dbm_list_t));
+    l->open = true;
+    l->sorted = true;
+
+    return CHIDB_OK;
+}
+
+
+/* Add a value to a list
+ *
+ * Parameters
+ * - l: List
+ * - r: Register with the value (if it is NULL, nothing is added)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_list_add(chidb_dbm_list_t *l, chidb_dbm_register_t *r)
+{
+    if (r->type == REG_NULL || r->type == REG_UNSPECIFIED)
+        return CHIDB_OK;
+
+    if (l->nvalues == l->maxvalues)
+    {
+        uint32_t maxvalues = l->maxvalues > 0 ? l->maxvalues * 2 : 16;
+        chidb_dbm_register_t *values = realloc(l->values, maxvalues * sizeof(chidb_dbm_register_t));
+
+        if (values == NULL)
+            return CHIDB_ENOMEM;
+
+        for(uint32_t i = 0; i < l->nvalues; i++)
+            chidb_dbm_reg_relocate(&values[i]);
+        l->values = values;
+        l->maxvalues = maxvalues;
+    }
+
+    chidb_dbm_reg_init(&l->values[l->nvalues]);
+    l->nvalues++;
+    l->sorted = false;
+
+    return chidb_dbm_reg_keep(&l->values[l->nvalues - 1], r);
+}
+
+
+static int chidb_dbm_list_cmp(const void *a, const void *b)
+{
+    return chidb_dbm_reg_cmp((chidb_dbm_register_t *) a, (chidb_dbm_register_t *) b);
+}
+
+/* Sorts the values of a list, and removes the duplicates */
+static void chidb_dbm_list_sort(chidb_dbm_list_t *l)
+{
+    uint32_t n = 0;
+
+    if (l->sorted)
+        return;
+
+    qsort(l->values, l->nvalues, sizeof(chidb_dbm_register_t), chidb_dbm_list_cmp);
+
+    for(uint32_t i = 0; i < l->nvalues; i++)
+    {
+        chidb_dbm_reg_relocate(&l->values[i]);
+
+        if (n > 0 && chidb_dbm_reg_cmp(&l->values[n - 1], &l->values[i]) == 0)
+            chidb_dbm_reg_free(&l->values[i]);
+        else if (n++ < i)
+        {
+            l->values[n - 1] = l->values[i];
+            chidb_dbm_reg_relocate(&l->values[n - 1]);
+        }
+    }
+
+    l->nvalues = n;
+    l->sorted = true;
+}
+
+
+/* Look up a value in a list
+ *
+ * Parameters
+ * - l: List
+ * - r: Register with the value
+ * - found: Out parameter. Is the value in the list? (a NULL value never is)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_list_find(chidb_dbm_list_t *l, chidb_dbm_register_t *r, bool *found)
+{
+    uint32_t lo = 0, hi;
+
+    *found = false;
+    if (r->type == REG_NULL || r->type == REG_UNSPECIFIED)
+        return CHIDB_OK;
+
+    chidb_dbm_list_sort(l);
+
+    hi = l->nvalues;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = chidb_dbm_reg_cmp(&l->values[mid], r);
+
+        if (cmp == 0)
+        {
+            *found = true;
+            break;
+        }
+        else if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Position a list on its first value (in order)
+ *
+ * Parameters
+ * - l: List
+ * - found: Out parameter. Does the list have any values?
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_list_rewind(chidb_dbm_list_t *l, bool *found)
+{
+    chidb_dbm_list_sort(l);
+    l->next = 0;
+    *found = l->nvalues > 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Move a list to its next value
+ *
+ * Parameters
+ * - l: List
+ * - found: Out parameter. Is there a next value?
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The list has not been positioned with ListRewind
+ */
+int chidb_dbm_list_next(chidb_dbm_list_t *l, bool *found)
+{
+    if (!l->sorted || l->next >= l->nvalues)
+        return CHIDB_EMISUSE;
+
+    *found = ++l->next < l->nvalues;
+
+    return CHIDB_OK;
+}
+
+
+/* Store the current value of a list in a register
+ *
+ * Parameters
+ * - l: List
+ * - r: Register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The list is not positioned on a value
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_list_value(chidb_dbm_list_t *l, chidb_dbm_register_t *r)
+{
+    if (!l->sorted || l->next >= l->nvalues)
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_reg_copy(r, &l->values[l->next]);
+}
+
+
+/* Close a value list, freeing its values
+ *
+ * Parameters
+ * - l: List
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_list_close(chidb_dbm_list_t *l)
+{
+    if (!l->open)
+        return CHIDB_OK;
+
+    for(uint32_t i = 0; i < l->nvalues; i++)
+        chidb_dbm_reg_free(&l->values[i]);
+    free(l->values);
+
+    memset(l, 0, sizeof(chidb_dbm_list_t));
+
+    return CHIDB_OK;
+}
+
+
+/* Free the value lists of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_list_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nLists; i++)
+        chidb_dbm_list_close(&stmt->lists[i]);
+    free(stmt->lists);
+    stmt->lists = NULL;
+    stmt->nLists = 0;
+
+    return CHIDB_OK;
+}
@@ -41,6 +41,15 @@
 #include "dbm.h"
 #include "btree.h"
 #include "record.h"
+#include "dict.h"
+#include "stats.h"
+#include "dbm-batch.h"
+#include "dbm-hash.h"
+#include "dbm-sorter.h"
+#include "dbm-agg.h"
+#include "dbm-list.h"
+#include "dbm-key.h"
+#include "dbm-reg.h"
 
 
 /* Function pointer for dispatch table */
@@ -77,6 +86,22 @@ int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op)
     return dbm_handlers[op->opcode].func(stmt, op);
 }
 
+/* Defined in dbm.c */
+int realloc_reg(chidb_stmt *stmt, uint32_t size);
+
+/* Makes sure that register r exists, growing the register file if needed.
+ * Programs loaded from a file do not declare how many registers they use. */
+static int dbm_reg_grow(chidb_stmt *stmt, int32_t r)
+{
+    if (r < 0)
+        return CHIDB_EMISUSE;
+
+    if (r >= stmt->nReg)
+        return realloc_reg(stmt, r + 1);
+
+    return CHIDB_OK;
+}
+
 
 /*** INSTRUCTION HANDLER IMPLEMENTATIONS ***/
 
@@ -199,9 +224,16 @@ int chidb_dbm_op_Integer (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_String (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    /* Your code goes here */
+    int rc;
 
-    return CHIDB_OK;
+    if (op->p4 == NULL)
+        return CHIDB_EMISUSE;
+
+    if ((rc = dbm_reg_grow(stmt, op->p2)) != CHIDB_OK)
+        return rc;
+
+    /* p4 lives as long as the statement, so it can be borrowed */
+    return chidb_dbm_reg_set_text_ref(&stmt->reg[op->p2], op->p4, strlen(op->p4));
 }
 
 
@@ -223,9 +255,34 @@ int chidb_dbm_op_ResultRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_MakeRecord (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    /* Your code goes here */
-
-    return CHIDB_OK;
+    DBRecordBuffer dbrb;
+    DBRecord *dbr;
+    uint8_t *data;
+    int rc = CHIDB_OK;
+
+    if (op->p2 < 0 || (op->p2 > 0 && (op->p1 < 0 || !EXISTS_REGISTER(stmt, op->p1 + op->p2 - 1))))
+        return CHIDB_EMISUSE;
+
+    if ((rc = dbm_reg_grow(stmt, op->p3)) != CHIDB_OK)
+        return rc;
+
+    chidb_DBRecord_create_empty(&dbrb, op->p2);
+    for(int32_t i = op->p1; i < op->p1 + op->p2 && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_append(&dbrb, &stmt->reg[i]);
+    chidb_DBRecord_finalize(&dbrb, &dbr);
+
+    if (rc == CHIDB_OK)
+        rc = chidb_DBRecord_pack(dbr, &data);
+
+    if (rc == CHIDB_OK)
+    {
+        /* The record goes in the register's reusable buffer */
+        rc = chidb_dbm_reg_set_binary(&stmt->reg[op->p3], data, dbr->packed_len);
+        free(data);
+    }
+    chidb_DBRecord_destroy(dbr);
+
+    return rc;
 }
 
 
@@ -386,22 +443,1946 @@ int chidb_dbm_op_CreateIndex (chidb_stmt *stmt, chidb_dbm_op_t *op)
 }
 
 
+/* DictEncode p1 p2 p3 *
+ *
+ * p1: register containing the root page of a dictionary
+ * p2: register containing a string
+ * p3: if non-zero, add the string to the dictionary if it isn't there
+ *
+ * replace the string in (register p2) with its code in the dictionary.
+ * If the string is not in the dictionary (and is not added to it) the
+ * code is 0, which is not equal to any code stored in a record. So is
+ * the code of a value that isn't a string, if it is not added.
+ * NULL values are left untouched.
+ */
+int chidb_dbm_op_DictEncode (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *r;
+    Dict *dict;
+    uint32_t code;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !IS_VALID_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    r = &stmt->reg[op->p2];
+
+    if (r->type == REG_NULL)
+        return CHIDB_OK;
+
+    if (stmt->reg[op->p1].type != REG_INT32 || (r->type != REG_STRING && op->p3 != 0))
+        return CHIDB_EMISMATCH;
+
+    if (r->type != REG_STRING)
+        return chidb_dbm_reg_set_int(r, 0);
+
+    rc = chidb_Dict_get(stmt->db, stmt->reg[op->p1].value.i, &dict);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_Dict_encode(stmt->db->bt, dict, r->value.s, op->p3 != 0, &code);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_reg_set_int(r, code);
+}
+
+
+/* DictDecode p1 p2 * *
+ *
+ * p1: register containing the root page of a dictionary
+ * p2: register containing a code
+ *
+ * replace the code in (register p2) with its string in the dictionary.
+ * NULL values are left untouched.
+ */
+int chidb_dbm_op_DictDecode (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *r;
+    Dict *dict;
+    const char *s;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !IS_VALID_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    r = &stmt->reg[op->p2];
+
+    if (r->type == REG_NULL)
+        return CHIDB_OK;
+
+    if (stmt->reg[op->p1].type != REG_INT32 || r->type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    rc = chidb_Dict_get(stmt->db, stmt->reg[op->p1].value.i, &dict);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (chidb_Dict_decode(dict, r->value.i, &s) != CHIDB_OK)
+        return CHIDB_ECORRUPT;
+
+    /* The dictionary outlives the statement, so its strings can be borrowed */
+    return chidb_dbm_reg_set_text_ref(r, s, strlen(s));
+}
+
+
 int chidb_dbm_op_Copy (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    /* Your code goes here */
+    int rc;
 
-    return CHIDB_OK;
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    if ((rc = dbm_reg_grow(stmt, op->p2)) != CHIDB_OK)
+        return rc;
+
+    if (op->p1 == op->p2)
+        return CHIDB_OK;
+
+    /* Strings and records share the source's buffer (copy-on-write) */
+    return chidb_dbm_reg_copy(&stmt->reg[op->p2], &stmt->reg[op->p1]);
 }
 
 
 int chidb_dbm_op_SCopy (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    /* Your code goes here */
+    /* Since Copy shares buffers, a shallow copy is the same operation */
+    return chidb_dbm_op_Copy(stmt, op);
+}
+
+
+/*** SUPERINSTRUCTIONS ***/
+
+/* These instructions are not generated directly. Instead, they are
+ * introduced by chidb_stmt_peephole (see dbm.c), which replaces the
+ * first instruction of a common sequence of instructions with a
+ * superinstruction that runs the whole sequence. The other instructions
+ * in the sequence are left in place (so they can still be the target
+ * of a jump) and the superinstruction skips over them. */
+
+
+/* ColumnCmpJump p1 p2 p3 *
+ *
+ * p1, p2, p3: same as Column
+ *
+ * Column instruction immediately followed by a comparison instruction
+ * (Eq, Ne, Lt, Le, Gt, Ge) on the column's register. Stores the column,
+ * and then runs the comparison.
+ */
+int chidb_dbm_op_ColumnCmpJump (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int rc;
+
+    rc = chidb_dbm_op_Column(stmt, op);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    stmt->pc++;
+    return chidb_dbm_op_handle(stmt, op + 1);
+}
+
+
+/* NextColumn p1 p2 * *
+ *
+ * p1, p2: same as Next
+ *
+ * Next instruction where the jump address (p2) is a Column instruction.
+ * If the cursor advances, runs the Column instruction too.
+ */
+int chidb_dbm_op_NextColumn (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int rc;
+
+    rc = chidb_dbm_op_Next(stmt, op);
+    if (rc != CHIDB_OK || stmt->pc != op->p2)
+        return rc;
+
+    stmt->pc++;
+    return chidb_dbm_op_Column(stmt, &stmt->ops[op->p2]);
+}
+
+
+/*** VECTORIZED INSTRUCTIONS ***/
+
+/* These instructions scan a table and process its rows in batches of up
+ * to DBM_BATCH_SIZE rows (see dbm-batch.c). They use batch scans and vector
+ * registers, which are separate from the cursors and registers used by
+ * the other instructions. Instead of jumping, comparisons remove rows from
+ * the batch's selection vector. */
+
+
+/* Returns batch scan number nbatch, which must be open */
+static int get_open_batch(chidb_stmt *stmt, int32_t nbatch, chidb_dbm_batch_t **batch)
+{
+    if (nbatch < 0 || nbatch >= stmt->nBatches || !stmt->batches[nbatch].open)
+        return CHIDB_EMISUSE;
+
+    *batch = &stmt->batches[nbatch];
+
+    return CHIDB_OK;
+}
+
+
+/* BatchOpen p1 p2 * *
+ *
+ * p1: batch scan
+ * p2: register containing the root page of a table B-Tree
+ *
+ * open batch scan p1 on the table
+ */
+int chidb_dbm_op_BatchOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p2) || stmt->reg[op->p2].type != REG_INT32)
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_batch_get(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_batch_open(batch, stmt->reg[op->p2].value.i);
+}
+
+
+/* BatchRewind p1 p2 * *
+ *
+ * p1: batch scan
+ * p2: jump addr
+ *
+ * load the first batch of rows. If the table is empty, jump to p2
+ */
+int chidb_dbm_op_BatchRewind (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_batch_rewind(stmt->db->bt, batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (batch->n == 0)
+        stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+
+/* BatchNext p1 p2 * *
+ *
+ * p1: batch scan
+ * p2: jump addr
+ *
+ * load the next batch of rows. If there is one, jump to p2
+ */
+int chidb_dbm_op_BatchNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_batch_load(stmt->db->bt, batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (batch->n > 0)
+        stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+
+/* BatchClose p1 * * *
+ *
+ * p1: batch scan
+ *
+ * close batch scan p1
+ */
+int chidb_dbm_op_BatchClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_batch_close(batch);
+}
+
+
+/* VColumn p1 p2 p3 *
+ *
+ * p1: batch scan
+ * p2: column number
+ * p3: vector register
+ *
+ * store the value of column p2 of each selected row of the current
+ * batch in (vector register p3)
+ */
+int chidb_dbm_op_VColumn (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    chidb_dbm_vector_t *v;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (op->p2 < 0)
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_vector_get(stmt, op->p3, &v);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_batch_column(batch, op->p2, v);
+}
+
+
+/* VKey p1 p2 * *
+ *
+ * p1: batch scan
+ * p2: vector register
+ *
+ * store the key of each row of the current batch in (vector register p2)
+ */
+int chidb_dbm_op_VKey (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    chidb_dbm_vector_t *v;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p1, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_vector_get(stmt, op->p2, &v);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_batch_key(batch, v);
+}
+
+
+/* VEq, VNe, VLt, VLe, VGt, VGe p1 p2 p3 *
+ *
+ * p1: register containing value k
+ * p2: batch scan
+ * p3: vector register
+ *
+ * remove from the selection vector of batch p2 the rows where
+ * (vector register p3) == k (or !=, <, <=, >, >=). These are the rows
+ * where Eq (or Ne, Lt, Le, Gt, Ge) with the same p1 and p3 would jump.
+ */
+static int chidb_dbm_op_VCmp (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    chidb_dbm_vector_t *v;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    rc = get_open_batch(stmt, op->p2, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_vector_get(stmt, op->p3, &v);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_batch_filter(batch, v, op->opcode, &stmt->reg[op->p1]);
+}
+
+int chidb_dbm_op_VEq (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+int chidb_dbm_op_VNe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+int chidb_dbm_op_VLt (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+int chidb_dbm_op_VLe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+int chidb_dbm_op_VGt (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+int chidb_dbm_op_VGe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return chidb_dbm_op_VCmp(stmt, op);
+}
+
+
+/* VResultRow p1 p2 p3 *
+ *
+ * p1: first vector register
+ * p2: number of vector registers
+ * p3: batch scan
+ *
+ * for each selected row of the current batch of p3, store the row's values
+ * in (vector registers p1...p1+p2-1) in (registers p1...p1+p2-1), and
+ * produce a result row with those registers (as ResultRow does). Once
+ * all the selected rows have been produced, continue with the next
+ * instruction.
+ */
+int chidb_dbm_op_VResultRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_batch_t *batch;
+    chidb_dbm_vector_t *v;
+    uint16_t row;
+    int rc;
+
+    rc = get_open_batch(stmt, op->p3, &batch);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (batch->emit == batch->nsel)
+        return CHIDB_OK;
+
+    if (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p1 + op->p2 - 1))
+        return CHIDB_EMISUSE;
+
+    row = batch->sel[batch->emit++];
+
+    for(int i = op->p1; i < op->p1 + op->p2; i++)
+    {
+        chidb_dbm_register_t *r = &stmt->reg[i];
+
+        rc = chidb_dbm_vector_get(stmt, i, &v);
+        if (rc != CHIDB_OK)
+            return rc;
+
+        if (v->type[row] == REG_INT32)
+            rc = chidb_dbm_reg_set_int(r, v->i[row]);
+        else if (v->type[row] == REG_STRING)
+            rc = chidb_dbm_reg_set_text(r, v->s[row], strlen(v->s[row]));
+        else
+            rc = chidb_dbm_reg_set_null(r);
+
+        if (rc != CHIDB_OK)
+            return rc;
+    }
+
+    stmt->startRR = op->p1;
+    stmt->nRR = op->p2;
+
+    /* Run this instruction again, to produce the next row */
+    stmt->pc--;
+
+    return CHIDB_ROW;
+}
+
+
+/* Variable p1 p2 * *
+ *
+ * p1: parameter number (the first parameter is 1)
+ * p2: register
+ *
+ * store the value bound to parameter p1 (see chidb_bind_*) in (register p2).
+ * If no value has been bound to the parameter, (register p2) is NULL.
+ */
+int chidb_dbm_op_Variable (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *param;
+
+    if (op->p1 < 1 || op->p1 > stmt->nParams || !EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    param = &stmt->params[op->p1 - 1];
+
+    if (param->type == REG_UNSPECIFIED)
+        return chidb_dbm_reg_set_null(&stmt->reg[op->p2]);
+
+    /* Strings bound to the parameter are shared, not copied */
+    return chidb_dbm_reg_copy(&stmt->reg[op->p2], param);
+}
+
+
+/* Analyze p1 * * *
+ *
+ * p1: register containing the root page of the statistics table
+ *
+ * collect the statistics of all the tables and indexes in the database,
+ * and append them to the statistics table (see stats.c).
+ */
+int chidb_dbm_op_Analyze (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    if (stmt->reg[op->p1].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    return chidb_Stats_analyze(stmt->db, stmt->reg[op->p1].value.i);
+}
+
+
+/* Adds the number of entries in the B-Tree node in page npage (and its
+ * subtrees) to count. Only the cells of internal nodes are read: a leaf
+ * just adds its number of cells, without reading them */
+static int count_entries(BTree *bt, npage_t npage, uint32_t *count)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (btn->type == PGTYPE_TABLE_LEAF || btn->type == PGTYPE_INDEX_LEAF)
+    {
+        *count += btn->n_cells;
+        return chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    /* The cells of an index's internal nodes are also entries */
+    if (btn->type == PGTYPE_INDEX_INTERNAL)
+        *count += btn->n_cells;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+        rc = count_entries(bt, btn->type == PGTYPE_TABLE_INTERNAL ? btc.fields.tableInternal.child_page
+                                                                  : btc.fields.indexInternal.child_page, count);
+    }
+
+    if (rc == CHIDB_OK)
+        rc = count_entries(bt, btn->right_page, count);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
+
+
+/* Count p1 p2 * *
+ *
+ * p1: register containing the root page of a B-Tree
+ * p2: register
+ *
+ * store the number of entries in the B-Tree (the rows of a table, or the
+ * entries of an index) in register p2. This doesn't need a cursor, and
+ * it doesn't read the records of the table's rows.
+ */
+int chidb_dbm_op_Count (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    uint32_t count = 0;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    if (stmt->reg[op->p1].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    rc = count_entries(stmt->db->bt, stmt->reg[op->p1].value.i, &count);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (count > INT32_MAX)
+        return CHIDB_EMISMATCH;
+
+    return chidb_dbm_reg_set_int(&stmt->reg[op->p2], (int32_t) count);
+}
+
+
+/* IfPos p1 p2 p3 *
+ *
+ * p1: register
+ * p2: jump addr
+ * p3: integer
+ *
+ * if the integer in register p1 is positive, subtract p3 from it and
+ * jump to p2. Used to skip the first rows of a result (OFFSET).
+ */
+int chidb_dbm_op_IfPos (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    if (stmt->reg[op->p1].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    if (stmt->reg[op->p1].value.i > 0)
+    {
+        stmt->reg[op->p1].value.i -= op->p3;
+        stmt->pc = op->p2;
+    }
 
     return CHIDB_OK;
 }
 
 
+/* DecrJumpZero p1 p2 * *
+ *
+ * p1: register
+ * p2: jump addr
+ *
+ * subtract 1 from the integer in register p1 and, if it becomes 0, jump
+ * to p2. Used to stop once the last row of a result has been produced
+ * (LIMIT).
+ */
+int chidb_dbm_op_DecrJumpZero (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    if (stmt->reg[op->p1].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    if (--stmt->reg[op->p1].value.i == 0)
+        stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+
+/* IsNull p1 p2 * *
+ *
+ * p1: register
+ * p2: jump addr
+ *
+ * if register p1 is NULL, jump to p2. Used where a NULL operand makes a
+ * condition NULL, which the comparison instructions don't tell apart
+ * from false (see cg_cond in codegen.c).
+ */
+int chidb_dbm_op_IsNull (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (!IS_VALID_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    if (stmt->reg[op->p1].type == REG_NULL)
+        stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+
+/* These instructions compute the expressions of a SELECT (see codegen.c).
+ * Their operands are integers (or, for Concat, strings), and NULL if any
+ * of them is NULL. The integers are 32-bit: a result that doesn't fit in
+ * one, or a division by zero, is an error (CHIDB_EMISMATCH). */
+
+/* Add, Subtract, Multiply and Divide */
+static int arith(chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *a, *b;
+    int64_t v;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !IS_VALID_REGISTER(stmt, op->p2) || !EXISTS_REGISTER(stmt, op->p3))
+        return CHIDB_EMISUSE;
+
+    a = &stmt->reg[op->p1];
+    b = &stmt->reg[op->p2];
+
+    if (a->type == REG_NULL || b->type == REG_NULL)
+        return chidb_dbm_reg_set_null(&stmt->reg[op->p3]);
+
+    if (a->type != REG_INT32 || b->type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    switch (op->opcode)
+    {
+    case Op_Add:
+        v = (int64_t) a->value.i + b->value.i;
+        break;
+    case Op_Subtract:
+        v = (int64_t) a->value.i - b->value.i;
+        break;
+    case Op_Multiply:
+        v = (int64_t) a->value.i * b->value.i;
+        break;
+    default:
+        if (b->value.i == 0)
+            return CHIDB_EMISMATCH;
+        v = (int64_t) a->value.i / b->value.i;
+    }
+
+    if (v < INT32_MIN || v > INT32_MAX)
+        return CHIDB_EMISMATCH;
+
+    return chidb_dbm_reg_set_int(&stmt->reg[op->p3], (int32_t) v);
+}
+
+
+/* Add p1 p2 p3 *
+ *
+ * p1, p2, p3: registers
+ *
+ * store the integer in register p1 plus the integer in register p2 in
+ * register p3.
+ */
+int chidb_dbm_op_Add (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return arith(stmt, op);
+}
+
+
+/* Subtract p1 p2 p3 *
+ *
+ * p1, p2, p3: registers
+ *
+ * store the integer in register p1 minus the integer in register p2 in
+ * register p3.
+ */
+int chidb_dbm_op_Subtract (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return arith(stmt, op);
+}
+
+
+/* Multiply p1 p2 p3 *
+ *
+ * p1, p2, p3: registers
+ *
+ * store the integer in register p1 times the integer in register p2 in
+ * register p3.
+ */
+int chidb_dbm_op_Multiply (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return arith(stmt, op);
+}
+
+
+/* Divide p1 p2 p3 *
+ *
+ * p1, p2, p3: registers
+ *
+ * store the integer in register p1 divided by the integer in register p2
+ * (rounded towards zero) in register p3.
+ */
+int chidb_dbm_op_Divide (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return arith(stmt, op);
+}
+
+
+/* Negate p1 p2 * *
+ *
+ * p1, p2: registers
+ *
+ * store the integer in register p1, with its sign changed, in register p2.
+ */
+int chidb_dbm_op_Negate (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *a;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    a = &stmt->reg[op->p1];
+
+    if (a->type == REG_NULL)
+        return chidb_dbm_reg_set_null(&stmt->reg[op->p2]);
+
+    if (a->type != REG_INT32 || a->value.i == INT32_MIN)
+        return CHIDB_EMISMATCH;
+
+    return chidb_dbm_reg_set_int(&stmt->reg[op->p2], -a->value.i);
+}
+
+
+/* Concat p1 p2 p3 *
+ *
+ * p1, p2, p3: registers
+ *
+ * store the string in register p1 followed by the string in register p2
+ * in register p3. An integer is converted to its decimal digits first.
+ */
+int chidb_dbm_op_Concat (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    char digits[2][12], *s;
+    const char *part[2];
+    uint32_t len[2];
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p1) || !IS_VALID_REGISTER(stmt, op->p2) || !EXISTS_REGISTER(stmt, op->p3))
+        return CHIDB_EMISUSE;
+
+    for (int i = 0; i < 2; i++)
+    {
+        chidb_dbm_register_t *r = &stmt->reg[i == 0 ? op->p1 : op->p2];
+
+        switch (r->type)
+        {
+        case REG_NULL:
+            return chidb_dbm_reg_set_null(&stmt->reg[op->p3]);
+        case REG_INT32:
+            len[i] = snprintf(digits[i], sizeof(digits[i]), "%d", r->value.i);
+            part[i] = digits[i];
+            break;
+        case REG_STRING:
+            len[i] = r->len;
+            part[i] = r->value.s;
+            break;
+        default:
+            return CHIDB_EMISMATCH;
+        }
+    }
+
+    /* Register p3 may be one of the operands, so the string is built apart */
+    if ((s = malloc(len[0] + len[1] + 1)) == NULL)
+        return CHIDB_ENOMEM;
+    memcpy(s, part[0], len[0]);
+    memcpy(s + len[0], part[1], len[1]);
+
+    rc = chidb_dbm_reg_set_text(&stmt->reg[op->p3], s, len[0] + len[1]);
+    free(s);
+
+    return rc;
+}
+
+
+
+/* These instructions implement hash joins, with hash tables that map a
+ * key to rows of values (see dbm-hash.c). Like batch scans, hash tables
+ * are numbered separately from cursors and registers. */
+
+
+/* Returns hash table number nhash, which must be open */
+static int get_open_hash(chidb_stmt *stmt, int32_t nhash, chidb_dbm_hash_t **h)
+{
+    if (nhash < 0 || nhash >= stmt->nHashes || !stmt->hashes[nhash].open)
+        return CHIDB_EMISUSE;
+
+    *h = &stmt->hashes[nhash];
+
+    return CHIDB_OK;
+}
+
+
+/* HashOpen p1 p2 p3 *
+ *
+ * p1: hash table
+ * p2: number of values in each row
+ * p3: memory budget, in bytes (0 for the default budget)
+ *
+ * open hash table p1, which is empty
+ */
+int chidb_dbm_op_HashOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    int rc;
+
+    if (op->p2 < 0 || op->p3 < 0)
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_hash_get(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_hash_open(h, op->p2, op->p3);
+}
+
+
+/* HashInsert p1 p2 p3 *
+ *
+ * p1: hash table
+ * p2: first register of the row
+ * p3: register containing the key
+ *
+ * add the row (registers p2...p2+n-1, where n is the number of values
+ * in each row) to hash table p1, with key (register p3)
+ */
+int chidb_dbm_op_HashInsert (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p3) ||
+        (h->ncols > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + h->ncols - 1))))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_hash_insert(h, &stmt->reg[op->p3], &stmt->reg[op->p2]);
+}
+
+
+/* HashProbe p1 p2 p3 *
+ *
+ * p1: hash table
+ * p2: jump addr
+ * p3: register containing the key
+ *
+ * position hash table p1 on the first row with key (register p3). If
+ * there is none (or the key is NULL), jump to p2
+ */
+int chidb_dbm_op_HashProbe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    bool found;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p3))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_hash_probe(h, &stmt->reg[op->p3], &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* HashUnmatched p1 p2 * *
+ *
+ * p1: hash table
+ * p2: jump addr
+ *
+ * position hash table p1 on the first row that has not been marked
+ * with HashMark. If there is none, jump to p2
+ */
+int chidb_dbm_op_HashUnmatched (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    bool found;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_hash_unmatched(h, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* HashNext p1 p2 * *
+ *
+ * p1: hash table
+ * p2: jump addr
+ *
+ * move hash table p1 to the next row with the key of the last HashProbe
+ * (or, after HashUnmatched, to the next row that has not been marked).
+ * If there is one, jump to p2
+ */
+int chidb_dbm_op_HashNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    bool found;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_hash_next(h, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* HashRow p1 p2 * *
+ *
+ * p1: hash table
+ * p2: first register
+ *
+ * store the values of the current row of hash table p1 in
+ * (registers p2...p2+n-1), where n is the number of values in each row
+ */
+int chidb_dbm_op_HashRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    chidb_dbm_register_t *row;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (h->ncols > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + h->ncols - 1)))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_hash_row(h, &row);
+
+    for(uint32_t i = 0; i < h->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_copy(&stmt->reg[op->p2 + i], &row[i]);
+
+    return rc;
+}
+
+
+/* HashMark p1 * * *
+ *
+ * p1: hash table
+ *
+ * mark the current row of hash table p1 as matched (so that
+ * HashUnmatched skips it)
+ */
+int chidb_dbm_op_HashMark (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_hash_mark(h);
+}
+
+
+/* HashClose p1 * * *
+ *
+ * p1: hash table
+ *
+ * close hash table p1, freeing its rows
+ */
+int chidb_dbm_op_HashClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_hash_t *h;
+    int rc;
+
+    rc = get_open_hash(stmt, op->p1, &h);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_hash_close(h);
+}
+
+
+/* These instructions sort rows, with sorters that spill runs of sorted
+ * rows to a temporary file when they go over their memory budget (see
+ * dbm-sorter.c). Sorters are numbered separately from hash tables. */
+
+
+/* Returns sorter number nsorter, which must be open */
+static int get_open_sorter(chidb_stmt *stmt, int32_t nsorter, chidb_dbm_sorter_t **s)
+{
+    if (nsorter < 0 || nsorter >= stmt->nSorters || !stmt->sorters[nsorter].open)
+        return CHIDB_EMISUSE;
+
+    *s = &stmt->sorters[nsorter];
+
+    return CHIDB_OK;
+}
+
+
+/* SorterOpen p1 p2 p3 p4
+ *
+ * p1: sorter
+ * p2: number of values in each row
+ * p3: memory budget, in bytes (0 for the default budget)
+ * p4: direction of each value of the sort key ('+' for ascending,
+ *     '-' for descending). If NULL, the whole row is the key, in
+ *     ascending order.
+ *
+ * open sorter p1, which is empty
+ */
+int chidb_dbm_op_SorterOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    int rc;
+
+    if (op->p2 < 0 || op->p3 < 0)
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_sorter_get(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_sorter_open(s, op->p2, op->p3, op->p4);
+}
+
+
+/* SorterLimit p1 p2 * *
+ *
+ * p1: sorter
+ * p2: number of rows
+ *
+ * only produce the first p2 rows of sorter p1, which is open and empty.
+ * The sorter then only keeps the rows that can still be among them.
+ */
+int chidb_dbm_op_SorterLimit (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    int rc;
+
+    if (op->p2 <= 0)
+        return CHIDB_EMISUSE;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_sorter_limit(s, op->p2);
+}
+
+
+/* SorterInsert p1 p2 * *
+ *
+ * p1: sorter
+ * p2: first register of the row
+ *
+ * add the row (registers p2...p2+n-1, where n is the number of values
+ * in each row) to sorter p1
+ */
+int chidb_dbm_op_SorterInsert (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    int rc;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (s->ncols > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + s->ncols - 1)))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_sorter_insert(s, &stmt->reg[op->p2]);
+}
+
+
+/* SorterSort p1 p2 * *
+ *
+ * p1: sorter
+ * p2: jump addr
+ *
+ * sort the rows of sorter p1, and position it on the first row. If
+ * the sorter has no rows, jump to p2
+ */
+int chidb_dbm_op_SorterSort (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    bool found;
+    int rc;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_sorter_sort(s, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* SorterNext p1 p2 * *
+ *
+ * p1: sorter
+ * p2: jump addr
+ *
+ * move sorter p1 to its next row. If there is one, jump to p2
+ */
+int chidb_dbm_op_SorterNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    bool found;
+    int rc;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_sorter_next(s, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* SorterRow p1 p2 * *
+ *
+ * p1: sorter
+ * p2: first register
+ *
+ * store the values of the current row of sorter p1 in
+ * (registers p2...p2+n-1), where n is the number of values in each row
+ */
+int chidb_dbm_op_SorterRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    chidb_dbm_register_t *row;
+    int rc;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (s->ncols > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + s->ncols - 1)))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_sorter_row(s, &row);
+
+    for(uint32_t i = 0; i < s->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_copy(&stmt->reg[op->p2 + i], &row[i]);
+
+    return rc;
+}
+
+
+/* SorterClose p1 * * *
+ *
+ * p1: sorter
+ *
+ * close sorter p1, freeing its rows and removing its temporary file
+ */
+int chidb_dbm_op_SorterClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_sorter_t *s;
+    int rc;
+
+    rc = get_open_sorter(stmt, op->p1, &s);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_sorter_close(s);
+}
+
+
+/* These instructions compute aggregate functions over groups of rows,
+ * with aggregators that keep the groups in a hash table, or only the
+ * current group if the rows are sorted by their key (see dbm-agg.c).
+ * Aggregators are numbered separately from sorters. */
+
+
+/* Returns aggregator number nagg, which must be open */
+static int get_open_agg(chidb_stmt *stmt, int32_t nagg, chidb_dbm_agg_t **a)
+{
+    if (nagg < 0 || nagg >= stmt->nAggs || !stmt->aggs[nagg].open)
+        return CHIDB_EMISUSE;
+
+    *a = &stmt->aggs[nagg];
+
+    return CHIDB_OK;
+}
+
+
+/* AggOpen p1 p2 p3 p4
+ *
+ * p1: aggregator
+ * p2: number of values in the key of each row
+ * p3: memory budget, in bytes (0 for the default budget), or -1 if the
+ *     rows are added in order of their key (see AggBreak)
+ * p4: aggregate functions, a character for each of them: C (COUNT(*)),
+ *     c (COUNT), s (SUM), a (AVG), n (MIN), x (MAX)
+ *
+ * open aggregator p1, which has no groups
+ */
+int chidb_dbm_op_AggOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    int rc;
+
+    if (op->p2 < 0 || op->p3 < -1)
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_agg_get(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_agg_open(a, op->p2, op->p3 > 0 ? op->p3 : 0, op->p3 < 0, op->p4);
+}
+
+
+/* AggStep p1 p2 p3 *
+ *
+ * p1: aggregator
+ * p2: first register of the key
+ * p3: first register of the arguments
+ *
+ * add a row to aggregator p1, with key (registers p2...p2+k-1, where
+ * k is the number of values in the key), and an argument for each
+ * aggregate function (registers p3...p3+n-1, where n is the number of
+ * functions)
+ */
+int chidb_dbm_op_AggStep (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if ((a->nkeys > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + a->nkeys - 1))) ||
+        (a->naggs > 0 && (op->p3 < 0 || !EXISTS_REGISTER(stmt, op->p3 + a->naggs - 1))))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_agg_step(a, &stmt->reg[op->p2], &stmt->reg[op->p3]);
+}
+
+
+/* AggBreak p1 p2 p3 *
+ *
+ * p1: aggregator
+ * p2: jump addr
+ * p3: first register of the key
+ *
+ * if the row with key (registers p3...p3+k-1) is in the current group
+ * of aggregator p1 (which must have been opened to add the rows in
+ * order of their key), or there is no current group, jump to p2.
+ * Otherwise, the current group is finished, and AggRow stores it
+ */
+int chidb_dbm_op_AggBreak (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    bool finished;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (a->nkeys > 0 && (op->p3 < 0 || !EXISTS_REGISTER(stmt, op->p3 + a->nkeys - 1)))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_agg_break(a, &stmt->reg[op->p3], &finished);
+    if (rc == CHIDB_OK && !finished)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* AggRewind p1 p2 * *
+ *
+ * p1: aggregator
+ * p2: jump addr
+ *
+ * position aggregator p1 on its first group (once all the rows have
+ * been added). If it has no groups, jump to p2
+ */
+int chidb_dbm_op_AggRewind (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    bool found;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_agg_rewind(a, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* AggNext p1 p2 * *
+ *
+ * p1: aggregator
+ * p2: jump addr
+ *
+ * move aggregator p1 to its next group. If there is one, jump to p2
+ */
+int chidb_dbm_op_AggNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    bool found;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_agg_next(a, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* AggRow p1 p2 * *
+ *
+ * p1: aggregator
+ * p2: first register
+ *
+ * store the key of the current group of aggregator p1 (or of the group
+ * finished by AggBreak), followed by the result of each aggregate
+ * function, in (registers p2...p2+k+n-1)
+ */
+int chidb_dbm_op_AggRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (a->nkeys + a->naggs > 0 && (op->p2 < 0 || !EXISTS_REGISTER(stmt, op->p2 + a->nkeys + a->naggs - 1)))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_agg_row(a, &stmt->reg[op->p2]);
+}
+
+
+/* AggClose p1 * * *
+ *
+ * p1: aggregator
+ *
+ * close aggregator p1, freeing its groups and removing its partitions
+ */
+int chidb_dbm_op_AggClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_agg_t *a;
+    int rc;
+
+    rc = get_open_agg(stmt, op->p1, &a);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_agg_close(a);
+}
+
+
+/* These instructions keep lists of values, such as the literals of an
+ * IN condition, which are built once and then looked up with a binary
+ * search, or visited in order (see dbm-list.c). Lists are numbered
+ * separately from aggregators. */
+
+/* Returns value list number nlist, which must be open */
+static int get_open_list(chidb_stmt *stmt, int32_t nlist, chidb_dbm_list_t **l)
+{
+    if (nlist < 0 || nlist >= stmt->nLists || !stmt->lists[nlist].open)
+        return CHIDB_EMISUSE;
+
+    *l = &stmt->lists[nlist];
+
+    return CHIDB_OK;
+}
+
+
+/* ListOpen p1 * * *
+ *
+ * p1: value list
+ *
+ * open value list p1, which has no values
+ */
+int chidb_dbm_op_ListOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    int rc;
+
+    rc = chidb_dbm_list_get(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_list_open(l);
+}
+
+
+/* ListAdd p1 p2 * *
+ *
+ * p1: value list
+ * p2: register
+ *
+ * add the value in register p2 to value list p1 (a NULL value is not added)
+ */
+int chidb_dbm_op_ListAdd (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    int rc;
+
+    rc = get_open_list(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_list_add(l, &stmt->reg[op->p2]);
+}
+
+
+/* Looks up register r in value list nlist */
+static int list_find(chidb_stmt *stmt, int32_t nlist, int32_t r, bool *found)
+{
+    chidb_dbm_list_t *l;
+    int rc;
+
+    rc = get_open_list(stmt, nlist, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!EXISTS_REGISTER(stmt, r))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_list_find(l, &stmt->reg[r], found);
+}
+
+
+/* ListIn p1 p2 p3 *
+ *
+ * p1: value list
+ * p2: jump addr
+ * p3: register
+ *
+ * if the value in register p3 is in value list p1, jump to p2
+ */
+int chidb_dbm_op_ListIn (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    bool found;
+    int rc;
+
+    rc = list_find(stmt, op->p1, op->p3, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* ListNotIn p1 p2 p3 *
+ *
+ * p1: value list
+ * p2: jump addr
+ * p3: register
+ *
+ * if the value in register p3 is not in value list p1 (or it is NULL),
+ * jump to p2
+ */
+int chidb_dbm_op_ListNotIn (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    bool found;
+    int rc;
+
+    rc = list_find(stmt, op->p1, op->p3, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* ListRewind p1 p2 * *
+ *
+ * p1: value list
+ * p2: jump addr
+ *
+ * position value list p1 on its smallest value. If it has no values,
+ * jump to p2
+ */
+int chidb_dbm_op_ListRewind (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    bool found;
+    int rc;
+
+    rc = get_open_list(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_list_rewind(l, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* ListNext p1 p2 * *
+ *
+ * p1: value list
+ * p2: jump addr
+ *
+ * move value list p1 to its next value (skipping duplicates). If there
+ * is one, jump to p2
+ */
+int chidb_dbm_op_ListNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    bool found;
+    int rc;
+
+    rc = get_open_list(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_list_next(l, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* ListValue p1 p2 * *
+ *
+ * p1: value list
+ * p2: register
+ *
+ * store the current value of value list p1 in register p2
+ */
+int chidb_dbm_op_ListValue (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    int rc;
+
+    rc = get_open_list(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_list_value(l, &stmt->reg[op->p2]);
+}
+
+
+/* ListClose p1 * * *
+ *
+ * p1: value list
+ *
+ * close value list p1, freeing its values
+ */
+int chidb_dbm_op_ListClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_list_t *l;
+    int rc;
+
+    rc = get_open_list(stmt, op->p1, &l);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_list_close(l);
+}
+
+
+/* These instructions scan and update the key B-Trees of the indexes on
+ * several columns (see keytree.c). The key of an entry is made from its
+ * values with MakeKey, and it is followed by the primary key of its row
+ * (see dbm-key.c). Like value lists, key scans are numbered separately
+ * from cursors. */
+
+/* Returns key scan number nscan, which must be open */
+static int get_open_keyscan(chidb_stmt *stmt, int32_t nscan, chidb_dbm_keyscan_t **ks)
+{
+    if (nscan < 0 || nscan >= stmt->nKeyScans || !stmt->keyScans[nscan].open)
+        return CHIDB_EMISUSE;
+
+    *ks = &stmt->keyScans[nscan];
+
+    return CHIDB_OK;
+}
+
+
+/* MakeKey p1 p2 p3 p4
+ *
+ * p1: register
+ * p2: number of registers
+ * p3: register
+ * p4: NULL, or any string if the key is for a new index entry
+ *
+ * store the key of the values in the p2 registers starting at p1 (a
+ * binary value, see dbm-key.c) in register p3. The key of a new entry
+ * must fit in a key B-Tree, or MakeKey fails with CHIDB_ECONSTRAINT,
+ * so that the key can be checked before anything is written
+ */
+int chidb_dbm_op_MakeKey (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (op->p2 < 0 || (op->p2 > 0 && (op->p1 < 0 || !EXISTS_REGISTER(stmt, op->p1 + op->p2 - 1))) ||
+        !EXISTS_REGISTER(stmt, op->p3))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_key_make(&stmt->reg[op->p1], op->p2, op->p4 != NULL ? stmt->db->bt : NULL,
+                              &stmt->reg[op->p3]);
+}
+
+
+/* KeyCreate p1 * * *
+ *
+ * p1: register
+ *
+ * create a new, empty key B-Tree, and store the page number of its root
+ * node in register p1
+ */
+int chidb_dbm_op_KeyCreate (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    npage_t nroot;
+    int rc;
+
+    if (!EXISTS_REGISTER(stmt, op->p1))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_KeyTree_create(stmt->db->bt, &nroot);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_reg_set_int(&stmt->reg[op->p1], nroot);
+}
+
+
+/* KeyOpen p1 p2 * *
+ *
+ * p1: key scan
+ * p2: register containing the root page of a key B-Tree
+ *
+ * open key scan p1 on the key B-Tree whose root page is in register p2
+ */
+int chidb_dbm_op_KeyOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_keyscan_t *ks;
+    int rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+    if (stmt->reg[op->p2].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    rc = chidb_dbm_key_get(stmt, op->p1, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_key_open(ks, stmt->db->bt, stmt->reg[op->p2].value.i);
+}
+
+
+/* KeyInsert p1 p2 p3 *
+ *
+ * p1: key scan
+ * p2: register containing a key
+ * p3: register containing a primary key
+ *
+ * add the entry with the key in register p2, followed by the primary key
+ * in register p3, to the key B-Tree of key scan p1
+ */
+int chidb_dbm_op_KeyInsert (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_keyscan_t *ks;
+    int rc;
+
+    rc = get_open_keyscan(stmt, op->p1, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!IS_VALID_REGISTER(stmt, op->p2) || !IS_VALID_REGISTER(stmt, op->p3))
+        return CHIDB_EMISUSE;
+    if (stmt->reg[op->p3].type != REG_INT32)
+        return CHIDB_EMISMATCH;
+
+    return chidb_dbm_key_insert(ks, &stmt->reg[op->p2], stmt->reg[op->p3].value.i);
+}
+
+
+/* Positions key scan nscan on the first entry not lower than the key in
+ * register r (or past the entries whose keys start with it) and, if
+ * there is none, jumps to addr */
+static int key_seek(chidb_stmt *stmt, int32_t nscan, int32_t addr, int32_t r, bool past)
+{
+    chidb_dbm_keyscan_t *ks;
+    bool found;
+    int rc;
+
+    rc = get_open_keyscan(stmt, nscan, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!IS_VALID_REGISTER(stmt, r))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_key_seek(ks, &stmt->reg[r], past, &found);
+    if (rc == CHIDB_OK && !found)
+        stmt->pc = addr;
+
+    return rc;
+}
+
+
+/* KeySeekGe p1 p2 p3 *
+ *
+ * p1: key scan
+ * p2: jump addr
+ * p3: register containing a key
+ *
+ * position key scan p1 on the first entry whose key is not lower than
+ * the key in register p3. If there is none, jump to p2
+ */
+int chidb_dbm_op_KeySeekGe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return key_seek(stmt, op->p1, op->p2, op->p3, false);
+}
+
+
+/* KeySeekGt p1 p2 p3 *
+ *
+ * p1: key scan
+ * p2: jump addr
+ * p3: register containing a key
+ *
+ * position key scan p1 on the first entry whose key is greater than the
+ * key in register p3 and does not start with it. If there is none, jump
+ * to p2
+ */
+int chidb_dbm_op_KeySeekGt (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    return key_seek(stmt, op->p1, op->p2, op->p3, true);
+}
+
+
+/* Compares the key of the current entry of key scan nscan (only as many
+ * of its first bytes as the key in register r has) with that key */
+static int key_cmp(chidb_stmt *stmt, int32_t nscan, int32_t r, int *c)
+{
+    chidb_dbm_keyscan_t *ks;
+    int rc;
+
+    rc = get_open_keyscan(stmt, nscan, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!IS_VALID_REGISTER(stmt, r))
+        return CHIDB_EMISUSE;
+
+    return chidb_dbm_key_cmp(ks, &stmt->reg[r], c);
+}
+
+
+/* KeyGt p1 p2 p3 *
+ *
+ * p1: key scan
+ * p2: jump addr
+ * p3: register containing a key
+ *
+ * if the key of the current entry of key scan p1, cut to the length of
+ * the key in register p3, is greater than that key, jump to p2
+ */
+int chidb_dbm_op_KeyGt (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int c, rc;
+
+    rc = key_cmp(stmt, op->p1, op->p3, &c);
+    if (rc == CHIDB_OK && c > 0)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* KeyGe p1 p2 p3 *
+ *
+ * p1: key scan
+ * p2: jump addr
+ * p3: register containing a key
+ *
+ * if the key of the current entry of key scan p1, cut to the length of
+ * the key in register p3, is greater than or equal to that key, jump to p2
+ */
+int chidb_dbm_op_KeyGe (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int c, rc;
+
+    rc = key_cmp(stmt, op->p1, op->p3, &c);
+    if (rc == CHIDB_OK && c >= 0)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* KeyPKey p1 p2 * *
+ *
+ * p1: key scan
+ * p2: register
+ *
+ * store the primary key of the current entry of key scan p1 in register p2
+ */
+int chidb_dbm_op_KeyPKey (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_keyscan_t *ks;
+    chidb_key_t pk;
+    int rc;
+
+    rc = get_open_keyscan(stmt, op->p1, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (!EXISTS_REGISTER(stmt, op->p2))
+        return CHIDB_EMISUSE;
+
+    rc = chidb_dbm_key_pkey(ks, &pk);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_reg_set_int(&stmt->reg[op->p2], pk);
+}
+
+
+/* KeyNext p1 p2 * *
+ *
+ * p1: key scan
+ * p2: jump addr
+ *
+ * move key scan p1 to the next entry. If there is one, jump to p2
+ */
+int chidb_dbm_op_KeyNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_keyscan_t *ks;
+    bool found;
+    int rc;
+
+    rc = get_open_keyscan(stmt, op->p1, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    rc = chidb_dbm_key_next(ks, &found);
+    if (rc == CHIDB_OK && found)
+        stmt->pc = op->p2;
+
+    return rc;
+}
+
+
+/* KeyClose p1 * * *
+ *
+ * p1: key scan
+ *
+ * close key scan p1
+ */
+int chidb_dbm_op_KeyClose (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_keyscan_t *ks;
+    int rc;
+
+    rc = get_open_keyscan(stmt, op->p1, &ks);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_key_close(ks);
+}
+
 int chidb_dbm_op_Halt (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
     /* Your code goes here */
@@ -0,0 +1,513 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine registers
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include "dbm-reg.h"
+
+/* The values of string and binary registers are stored in one of three
+ * ways (see register_storage_t in dbm-types.h):
+ *
+ * - Small values are stored inline, in the register itself.
+ *
+ * - Larger values are stored in a heap buffer. A register keeps its
+ *   buffer even after it is assigned a value that doesn't need it
+ *   (e.g., an integer), so, once a register has grown a buffer large
+ *   enough for the values it holds, assigning values to it (e.g., reading
+ *   a TEXT column in every iteration of a loop) doesn't allocate memory.
+ *
+ *   Buffers are reference-counted, and copying a register just shares
+ *   its buffer with the destination register. Since a shared buffer is
+ *   never written to (a register whose buffer is shared allocates a new
+ *   one when it is assigned a new value), a buffer is effectively
+ *   copied on write.
+ *
+ * - Values that are already stored somewhere that will outlive the
+ *   register's value, such as the p4 of an instruction (the program's
+ *   constant pool) or a dictionary, can be borrowed instead of copied.
+ *   Borrowed strings must be NUL-terminated.
+ *
+ * Regardless of where the value is stored, value.s (or value.bin.bytes)
+ * points to it, and len contains its length. Strings are always
+ * NUL-terminated. Since inline values are stored in the register itself,
+ * chidb_dbm_reg_relocate must be called on registers that are moved
+ * to a different location in memory.
+ */
+
+/* Minimum size of a heap buffer */
+#define DBM_REG_MIN_BUF (64)
+
+/* Is the register's value stored in its own storage (inline or a buffer)? */
+static inline bool has_storage(chidb_dbm_register_t *r)
+{
+    return r->type == REG_STRING || r->type == REG_BINARY;
+}
+
+/* Drops a reference to a buffer, and frees it if it is no longer used */
+static void regbuf_release(chidb_dbm_regbuf_t *buf)
+{
+    if (buf != NULL && --buf->refs == 0)
+        free(buf);
+}
+
+/* Reserves "size" bytes of storage for a new value in register r. If
+ * the register's current buffer can't be used (because it is too small,
+ * or shared with other registers), it is detached from the register and
+ * returned in "old", so that the caller can release it once it is done
+ * with the register's old value. */
+static int reg_reserve(chidb_dbm_register_t *r, uint32_t size, uint8_t **data, chidb_dbm_regbuf_t **old)
+{
+    *old = NULL;
+
+    if (size <= DBM_REG_INLINE_SIZE)
+    {
+        r->storage = REG_STORE_INLINE;
+        *data = (uint8_t *) r->inl;
+        return CHIDB_OK;
+    }
+
+    if (r->buf == NULL || r->buf->refs > 1 || r->buf->size < size)
+    {
+        uint32_t bufsize = DBM_REG_MIN_BUF;
+        chidb_dbm_regbuf_t *buf;
+
+        while (bufsize < size)
+            bufsize *= 2;
+
+        buf = malloc(sizeof(chidb_dbm_regbuf_t) + bufsize);
+        if (buf == NULL)
+            return CHIDB_ENOMEM;
+
+        buf->refs = 1;
+        buf->size = bufsize;
+
+        *old = r->buf;
+        r->buf = buf;
+    }
+
+    r->storage = REG_STORE_BUFFER;
+    *data = r->buf->data;
+
+    return CHIDB_OK;
+}
+
+
+/* Initialize a register
+ *
+ * Parameters
+ * - r: Register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_init(chidb_dbm_register_t *r)
+{
+    r->type = REG_UNSPECIFIED;
+    r->storage = REG_STORE_INLINE;
+    r->len = 0;
+    r->buf = NULL;
+
+    return CHIDB_OK;
+}
+
+
+/* Free a register's resources
+ *
+ * Parameters
+ * - r: Register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_free(chidb_dbm_register_t *r)
+{
+    regbuf_release(r->buf);
+
+    return chidb_dbm_reg_init(r);
+}
+
+
+/* Update a register after it has been moved in memory
+ *
+ * Parameters
+ * - r: Register (in its new location)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_relocate(chidb_dbm_register_t *r)
+{
+    if (has_storage(r) && r->storage == REG_STORE_INLINE)
+    {
+        if (r->type == REG_STRING)
+            r->value.s = r->inl;
+        else
+            r->value.bin.bytes = (uint8_t *) r->inl;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Store an integer in a register
+ *
+ * Parameters
+ * - r: Register
+ * - i: Integer
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_set_int(chidb_dbm_register_t *r, int32_t i)
+{
+    r->type = REG_INT32;
+    r->value.i = i;
+
+    return CHIDB_OK;
+}
+
+
+/* Store a NULL in a register
+ *
+ * Parameters
+ * - r: Register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_set_null(chidb_dbm_register_t *r)
+{
+    r->type = REG_NULL;
+
+    return CHIDB_OK;
+}
+
+
+/* Store a copy of a string in a register
+ *
+ * The string is stored inline or in the register's buffer, which
+ * is only (re)allocated if it is not large enough.
+ *
+ * Parameters
+ * - r: Register
+ * - s: String (does not need to be NUL-terminated)
+ * - len: Length of the string
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_reg_set_text(chidb_dbm_register_t *r, const char *s, uint32_t len)
+{
+    chidb_dbm_regbuf_t *old;
+    uint8_t *data;
+    int rc;
+
+    rc = reg_reserve(r, len + 1, &data, &old);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    /* The string may be the register's current value */
+    memmove(data, s, len);
+    data[len] = '\0';
+    regbuf_release(old);
+
+    r->type = REG_STRING;
+    r->value.s = (char *) data;
+    r->len = len;
+
+    return CHIDB_OK;
+}
+
+
+/* Store a reference to a string in a register
+ *
+ * The string is not copied, so it must remain valid (and unmodified)
+ * for as long as the register holds it.
+ *
+ * Parameters
+ * - r: Register
+ * - s: NUL-terminated string
+ * - len: Length of the string
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_set_text_ref(chidb_dbm_register_t *r, const char *s, uint32_t len)
+{
+    assert(s[len] == '\0');
+
+    r->type = REG_STRING;
+    r->storage = REG_STORE_BORROWED;
+    r->value.s = (char *) s;
+    r->len = len;
+
+    return CHIDB_OK;
+}
+
+
+/* Store a copy of a binary value in a register
+ *
+ * Parameters
+ * - r: Register
+ * - bytes: Binary value
+ * - nbytes: Length of the binary value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_reg_set_binary(chidb_dbm_register_t *r, const uint8_t *bytes, uint32_t nbytes)
+{
+    chidb_dbm_regbuf_t *old;
+    uint8_t *data;
+    int rc;
+
+    rc = reg_reserve(r, nbytes, &data, &old);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    memmove(data, bytes, nbytes);
+    regbuf_release(old);
+
+    r->type = REG_BINARY;
+    r->value.bin.bytes = data;
+    r->value.bin.nbytes = nbytes;
+    r->len = nbytes;
+
+    return CHIDB_OK;
+}
+
+
+/* Copy the value of a register into another register
+ *
+ * Values stored in a buffer are not copied. Instead, the buffer is
+ * shared by both registers. Borrowed values remain borrowed.
+ *
+ * Parameters
+ * - dst: Destination register
+ * - src: Source register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_reg_copy(chidb_dbm_register_t *dst, chidb_dbm_register_t *src)
+{
+    if (dst == src)
+        return CHIDB_OK;
+
+    if (has_storage(src) && src->storage == REG_STORE_BUFFER)
+    {
+        if (dst->buf != src->buf)
+        {
+            regbuf_release(dst->buf);
+            dst->buf = src->buf;
+            dst->buf->refs++;
+        }
+    }
+    else if (has_storage(src) && src->storage == REG_STORE_INLINE)
+        memcpy(dst->inl, src->inl, DBM_REG_INLINE_SIZE);
+
+    dst->type = src->type;
+    dst->value = src->value;
+    dst->storage = src->storage;
+    dst->len = src->len;
+
+    return chidb_dbm_reg_relocate(dst);
+}
+
+
+/* Store a copy of a register that does not depend on the memory
+ * that borrowed values point to
+ *
+ * Borrowed strings are copied, since the copy may outlive the page
+ * they point to (for instance, in a hash table or a sorter). An
+ * unspecified value is stored as a NULL.
+ *
+ * Parameters
+ * - dst: Destination register
+ * - src: Source register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_reg_keep(chidb_dbm_register_t *dst, chidb_dbm_register_t *src)
+{
+    if (src->type == REG_STRING && src->storage == REG_STORE_BORROWED)
+        return chidb_dbm_reg_set_text(dst, src->value.s, src->len);
+    if (src->type == REG_UNSPECIFIED)
+        return chidb_dbm_reg_set_null(dst);
+
+    return chidb_dbm_reg_copy(dst, src);
+}
+
+
+/* Append the value of a register to a record
+ *
+ * Parameters
+ * - dbrb: Record buffer
+ * - r: Register
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The register has a binary value, which can't
+ *                    be stored in a record
+ */
+int chidb_dbm_reg_append(DBRecordBuffer *dbrb, chidb_dbm_register_t *r)
+{
+    switch (r->type)
+    {
+    case REG_INT32:
+        return chidb_DBRecord_appendInt32(dbrb, r->value.i);
+    case REG_STRING:
+        return chidb_DBRecord_appendString(dbrb, r->value.s);
+    case REG_BINARY:
+        return CHIDB_EMISMATCH;
+    default:
+        return chidb_DBRecord_appendNull(dbrb);
+    }
+}
+
+
+/* Store a field of a record in a register
+ *
+ * Parameters
+ * - r: Register
+ * - dbr: Record
+ * - field: Field number
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_reg_set_field(chidb_dbm_register_t *r, DBRecord *dbr, uint8_t field)
+{
+    int8_t v8;
+    int16_t v16;
+    int32_t v32;
+    const char *s;
+    int len;
+
+    switch (chidb_DBRecord_getType(dbr, field))
+    {
+    case SQL_NULL:
+        return chidb_dbm_reg_set_null(r);
+    case SQL_INTEGER_1BYTE:
+        chidb_DBRecord_getInt8(dbr, field, &v8);
+        return chidb_dbm_reg_set_int(r, v8);
+    case SQL_INTEGER_2BYTE:
+        chidb_DBRecord_getInt16(dbr, field, &v16);
+        return chidb_dbm_reg_set_int(r, v16);
+    case SQL_INTEGER_4BYTE:
+        chidb_DBRecord_getInt32(dbr, field, &v32);
+        return chidb_dbm_reg_set_int(r, v32);
+    default:
+        /* The string is copied straight from the record into the
+         * register's storage, so this only allocates memory if the
+         * register's buffer is too small for it */
+        chidb_DBRecord_getStringRef(dbr, field, &s, &len);
+        return chidb_dbm_reg_set_text(r, s, len);
+    }
+}
+
+
+/* Compares two byte strings (a shorter string comes before the longer
+ * strings that start with it) */
+static int chidb_dbm_reg_cmpBytes(const void *a, uint32_t alen, const void *b, uint32_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+
+    if (c != 0)
+        return c;
+
+    return (alen > blen) - (alen < blen);
+}
+
+
+/* Order of the types of values: NULL, integer, string, binary */
+static int chidb_dbm_reg_rank(chidb_dbm_register_t *r)
+{
+    switch (r->type)
+    {
+    case REG_INT32:
+        return 1;
+    case REG_STRING:
+        return 2;
+    case REG_BINARY:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+
+/* Compare the values of two registers
+ *
+ * Values are ordered by type first (NULL, which includes unspecified
+ * registers, then integers, strings, and binary values), and then by
+ * value. Strings and binary values are compared byte by byte.
+ *
+ * Parameters
+ * - a, b: Registers
+ *
+ * Return
+ * - A negative number if a comes before b, 0 if they are equal, and a
+ *   positive number if a comes after b
+ */
+int chidb_dbm_reg_cmp(chidb_dbm_register_t *a, chidb_dbm_register_t *b)
+{
+    int ra = chidb_dbm_reg_rank(a), rb = chidb_dbm_reg_rank(b);
+
+    if (ra != rb)
+        return ra - rb;
+
+    switch (a->type)
+    {
+    case REG_INT32:
+        return (a->value.i > b->value.i) - (a->value.i < b->value.i);
+    case REG_STRING:
+        return chidb_dbm_reg_cmpBytes(a->value.s, a->len, b->value.s, b->len);
+    case REG_BINARY:
+        return chidb_dbm_reg_cmpBytes(a->value.bin.bytes, a->value.bin.nbytes,
+                                      b->value.bin.bytes, b->value.bin.nbytes);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine registers header
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DBM_REG_H_
+#define DBM_REG_H_
+
+#include "chidbInt.h"
+#include "dbm-types.h"
+#include "record.h"
+
+int chidb_dbm_reg_init(chidb_dbm_register_t *r);
+int chidb_dbm_reg_free(chidb_dbm_register_t *r);
+int chidb_dbm_reg_relocate(chidb_dbm_register_t *r);
+int chidb_dbm_reg_set_int(chidb_dbm_register_t *r, int32_t i);
+int chidb_dbm_reg_set_null(chidb_dbm_register_t *r);
+int chidb_dbm_reg_set_text(chidb_dbm_register_t *r, const char *s, uint32_t len);
+int chidb_dbm_reg_set_text_ref(chidb_dbm_register_t *r, const char *s, uint32_t len);
+int chidb_dbm_reg_set_binary(chidb_dbm_register_t *r, const uint8_t *bytes, uint32_t nbytes);
+int chidb_dbm_reg_copy(chidb_dbm_register_t *dst, chidb_dbm_register_t *src);
+int chidb_dbm_reg_keep(chidb_dbm_register_t *dst, chidb_dbm_register_t *src);
+int chidb_dbm_reg_append(DBRecordBuffer *dbrb, chidb_dbm_register_t *r);
+int chidb_dbm_reg_set_field(chidb_dbm_register_t *r, DBRecord *dbr, uint8_t field);
+int chidb_dbm_reg_cmp(chidb_dbm_register_t *a, chidb_dbm_register_t *b);
+
+#endif /* DBM_REG_H_ */
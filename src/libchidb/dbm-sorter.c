@@ -0,0 +1,742 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Database Machine sorters
+ *
+ */
+
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* The sorting instructions (see dbm-ops.c) produce the rows added to a
+ * sorter in the order of their sort key, which is made of the first
+ * values of each row:
+ *
+ *   SorterOpen    Open a sorter (and set the direction of each key value)
+ *   SorterLimit   Only produce the first rows
+ *   SorterInsert  Add a row
+ *   SorterSort    Sort the rows, and position the sorter on the first one
+ *   SorterNext    Move to the next row
+ *   SorterRow     Get the values of the current row
+ *   SorterClose   Close the sorter
+ *
+ * Values are compared with chidb_dbm_reg_cmp (NULLs come before
+ * integers, and integers before strings, which are compared byte by
+ * byte). Rows with the same key are produced in the order in which
+ * they were added.
+ *
+ * This is an external merge sort. The rows are kept in memory until
+ * they take up more than the sorter's budget; then, they are sorted
+ * (with a merge sort, which is stable) and appended to a temporary file
+ * as a run, and their memory is freed. Once all the rows have been added,
+ * if any run has been written, the rows that are still in memory are
+ * written as the last run, and all the runs are merged in a single pass:
+ * each run is read sequentially, through a buffer of DBM_SORTER_READ_SIZE
+ * bytes, and a loser tree finds the run with the next row with one
+ * comparison per level of the tree. So, while the rows are produced, the
+ * memory used is a buffer (and a row) per run, and the temporary file is
+ * only ever written and read sequentially.
+ *
+ * Each row in a run is stored as its length (4 bytes), followed by a
+ * record with its values.
+ *
+ * A sorter with a limit of n rows (a top-n sort, for an ORDER BY with a
+ * LIMIT) can discard any row that is not among the first n rows of the
+ * ones added so far. Once 2n rows are in memory, they are sorted, and
+ * only the first n are kept, so each row is compared O(log n) times, and
+ * the sorter doesn't spill unless n rows go over its budget. Since the
+ * rows that are kept were added before the ones that come after them, a
+ * stable sort still produces rows with the same key in the order in which
+ * they were added.
+ */
+
+#include <unistd.h>
+#include "dbm-sorter.h"
+#include "dbm-reg.h"
+#include "record.h"
+
+
+/* Get a sorter
+ *
+ * Returns sorter number nsorter of a DBM program, allocating
+ * it if necessary.
+ *
+ * Parameters
+ * - stmt: DBM program
+ * - nsorter: Sorter number
+ * - s: Out parameter. Used to return a pointer to the sorter.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid sorter number
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_sorter_get(chidb_stmt *stmt, int32_t nsorter, chidb_dbm_sorter_t **s)
+{
+    if (nsorter < 0)
+        return CHIDB_EMISUSE;
+
+    if (nsorter >= stmt->nSorters)
+    {
+        chidb_dbm_sorter_t *sorters = realloc(stmt->sorters, (nsorter + 1) * sizeof(chidb_dbm_sorter_t));
+        if (sorters == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&sorters[stmt->nSorters], 0, (nsorter + 1 - stmt->nSorters) * sizeof(chidb_dbm_sorter_t));
+        stmt->sorters = sorters;
+        stmt->nSorters = nsorter + 1;
+    }
+
+    *s = &stmt->sorters[nsorter];
+
+    return CHIDB_OK;
+}
+
+
+/* Compares the keys of two rows (same return value as chidb_dbm_reg_cmp) */
+static int chidb_dbm_sorter_cmp(chidb_dbm_sorter_t *s, chidb_dbm_register_t *a, chidb_dbm_register_t *b)
+{
+    for(uint32_t i = 0; i < s->nkeys; i++)
+    {
+        int c = chidb_dbm_reg_cmp(&a[i], &b[i]);
+
+        if (c != 0)
+            return s->desc[i] ? -c : c;
+    }
+
+    return 0;
+}
+
+
+/* Allocates the registers of a row */
+static chidb_dbm_register_t *chidb_dbm_sorter_newRow(chidb_dbm_sorter_t *s)
+{
+    return calloc(s->ncols > 0 ? s->ncols : 1, sizeof(chidb_dbm_register_t));
+}
+
+
+/* Frees a row */
+static void chidb_dbm_sorter_freeRow(chidb_dbm_sorter_t *s, chidb_dbm_register_t *row)
+{
+    if (row == NULL)
+        return;
+
+    for(uint32_t i = 0; i < s->ncols; i++)
+        chidb_dbm_reg_free(&row[i]);
+    free(row);
+}
+
+
+/* Bytes of memory used by a row in memory */
+static uint32_t chidb_dbm_sorter_rowSize(chidb_dbm_sorter_t *s, chidb_dbm_register_t *row)
+{
+    uint32_t size = sizeof(chidb_dbm_register_t *) + s->ncols * sizeof(chidb_dbm_register_t);
+
+    for(uint32_t i = 0; i < s->ncols; i++)
+        if (row[i].buf != NULL)
+            size += row[i].buf->size;
+
+    return size;
+}
+
+
+/* Open a sorter
+ *
+ * Parameters
+ * - s: Sorter
+ * - ncols: Number of values in each row
+ * - budget: Memory budget, in bytes (0 for DBM_SORTER_BUDGET)
+ * - order: Direction of each value of the sort key: a string with a
+ *          '+' (ascending) or a '-' (descending) for each value. The key
+ *          has as many values as the string has characters. If order is
+ *          NULL, all the values are part of the key, in ascending order.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The sorter is already open, the rows have too many
+ *                  values to be stored in a record, or order is invalid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_sorter_open(chidb_dbm_sorter_t *s, uint32_t ncols, uint32_t budget, const char *order)
+{
+    uint32_t nkeys = order != NULL ? strlen(order) : ncols;
+
+    if (s->open || ncols > 0xFF || nkeys > ncols)
+        return CHIDB_EMISUSE;
+
+    for(uint32_t i = 0; order != NULL && i < nkeys; i++)
+        if (order[i] != '+' && order[i] != '-')
+            return CHIDB_EMISUSE;
+
+    memset(s, 0, sizeof(chidb_dbm_sorter_t));
+
+    s->desc = calloc(nkeys > 0 ? nkeys : 1, sizeof(bool));
+    if (s->desc == NULL)
+        return CHIDB_ENOMEM;
+
+    for(uint32_t i = 0; order != NULL && i < nkeys; i++)
+        s->desc[i] = order[i] == '-';
+
+    s->open = true;
+    s->ncols = ncols;
+    s->nkeys = nkeys;
+    s->budget = budget > 0 ? budget : DBM_SORTER_BUDGET;
+
+    return CHIDB_OK;
+}
+
+
+/* Sorts the rows in memory (with a bottom-up merge sort) */
+static int chidb_dbm_sorter_sortRows(chidb_dbm_sorter_t *s)
+{
+    chidb_dbm_register_t **src = s->rows, **dst, **aux;
+    uint32_t n = s->nrows;
+
+    if (n < 2)
+        return CHIDB_OK;
+
+    aux = dst = malloc(n * sizeof(chidb_dbm_register_t *));
+    if (aux == NULL)
+        return CHIDB_ENOMEM;
+
+    for(uint32_t width = 1; width < n; width *= 2)
+    {
+        for(uint32_t lo = 0; lo < n; lo += 2 * width)
+        {
+            uint32_t mid = lo + width < n ? lo + width : n;
+            uint32_t hi = mid + width < n ? mid + width : n;
+            uint32_t i = lo, j = mid, k = lo;
+
+            /* On a tie, the row from the first half (added earlier) goes first */
+            while (i < mid && j < hi)
+                dst[k++] = chidb_dbm_sorter_cmp(s, src[j], src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+
+        chidb_dbm_register_t **t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != s->rows)
+        memcpy(s->rows, src, n * sizeof(chidb_dbm_register_t *));
+    free(aux);
+
+    return CHIDB_OK;
+}
+
+
+/* Sorts the rows in memory, and appends them to the temporary file as
+ * a new run. The rows are then freed */
+static int chidb_dbm_sorter_spill(chidb_dbm_sorter_t *s)
+{
+    chidb_dbm_sorter_run_t *runs, *run;
+    int rc;
+
+    if (s->tmp == NULL && (s->tmp = tmpfile()) == NULL)
+        return CHIDB_EIO;
+
+    runs = realloc(s->runs, (s->nruns + 1) * sizeof(chidb_dbm_sorter_run_t));
+    if (runs == NULL)
+        return CHIDB_ENOMEM;
+    s->runs = runs;
+
+    if ((rc = chidb_dbm_sorter_sortRows(s)) != CHIDB_OK)
+        return rc;
+
+    run = &s->runs[s->nruns];
+    memset(run, 0, sizeof(chidb_dbm_sorter_run_t));
+    run->start = ftell(s->tmp);
+    run->nrows = s->nrows;
+
+    for(uint32_t i = 0; i < s->nrows && rc == CHIDB_OK; i++)
+    {
+        DBRecordBuffer dbrb;
+        DBRecord *dbr;
+        uint8_t *data;
+        uint32_t len;
+
+        chidb_DBRecord_create_empty(&dbrb, s->ncols);
+        for(uint32_t j = 0; j < s->ncols && rc == CHIDB_OK; j++)
+            rc = chidb_dbm_reg_append(&dbrb, &s->rows[i][j]);
+        chidb_DBRecord_finalize(&dbrb, &dbr);
+
+        if (rc == CHIDB_OK)
+            rc = chidb_DBRecord_pack(dbr, &data);
+
+        if (rc == CHIDB_OK)
+        {
+            len = dbr->packed_len;
+            if (fwrite(&len, sizeof(uint32_t), 1, s->tmp) != 1 || fwrite(data, len, 1, s->tmp) != 1)
+                rc = CHIDB_EIO;
+            free(data);
+        }
+        chidb_DBRecord_destroy(dbr);
+    }
+
+    if (rc != CHIDB_OK)
+        return rc;
+
+    for(uint32_t i = 0; i < s->nrows; i++)
+        chidb_dbm_sorter_freeRow(s, s->rows[i]);
+    s->nrows = 0;
+    s->mem = 0;
+    s->nruns++;
+
+    return CHIDB_OK;
+}
+
+
+/* Set the number of rows that a sorter produces
+ *
+ * Parameters
+ * - s: Sorter
+ * - limit: Number of rows (0 for all of them)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Rows have already been added to the sorter
+ */
+int chidb_dbm_sorter_limit(chidb_dbm_sorter_t *s, uint32_t limit)
+{
+    if (s->sorted || s->nrows > 0 || s->nruns > 0)
+        return CHIDB_EMISUSE;
+
+    s->limit = limit;
+
+    return CHIDB_OK;
+}
+
+
+/* Sorts the rows in memory, and frees the ones past the sorter's limit */
+static int chidb_dbm_sorter_prune(chidb_dbm_sorter_t *s)
+{
+    int rc;
+
+    if ((rc = chidb_dbm_sorter_sortRows(s)) != CHIDB_OK)
+        return rc;
+
+    while (s->nrows > s->limit)
+    {
+        chidb_dbm_register_t *row = s->rows[--s->nrows];
+
+        s->mem -= chidb_dbm_sorter_rowSize(s, row);
+        chidb_dbm_sorter_freeRow(s, row);
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Add a row to a sorter
+ *
+ * Parameters
+ * - s: Sorter
+ * - row: Values of the row (s->ncols registers)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The rows have already been sorted
+ * - CHIDB_EMISMATCH: A value that has to be written to the temporary
+ *                    file is a binary value
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when writing the temporary file
+ */
+int chidb_dbm_sorter_insert(chidb_dbm_sorter_t *s, chidb_dbm_register_t *row)
+{
+    chidb_dbm_register_t *r;
+    int rc = CHIDB_OK;
+
+    if (s->sorted)
+        return CHIDB_EMISUSE;
+
+    if (s->nrows == s->maxrows)
+    {
+        uint32_t maxrows = s->maxrows > 0 ? 2 * s->maxrows : 64;
+        chidb_dbm_register_t **rows = realloc(s->rows, maxrows * sizeof(chidb_dbm_register_t *));
+
+        if (rows == NULL)
+            return CHIDB_ENOMEM;
+        s->rows = rows;
+        s->maxrows = maxrows;
+    }
+
+    if ((r = chidb_dbm_sorter_newRow(s)) == NULL)
+        return CHIDB_ENOMEM;
+
+    for(uint32_t i = 0; i < s->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_keep(&r[i], &row[i]);
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_dbm_sorter_freeRow(s, r);
+        return rc;
+    }
+
+    s->rows[s->nrows++] = r;
+    s->mem += chidb_dbm_sorter_rowSize(s, r);
+
+    /* With a limit, the rows that can't be among the first ones are
+     * discarded before any are spilled */
+    if (s->limit > 0 && (s->nrows >= 2 * s->limit ||
+                         (s->mem > s->budget && s->nrows > s->limit)))
+        rc = chidb_dbm_sorter_prune(s);
+
+    if (rc == CHIDB_OK && s->mem > s->budget)
+        rc = chidb_dbm_sorter_spill(s);
+
+    return rc;
+}
+
+
+/* Reads bytes from a run, refilling its buffer when it runs out */
+static int chidb_dbm_sorter_read(chidb_dbm_sorter_t *s, chidb_dbm_sorter_run_t *run, uint8_t *dst, uint32_t n)
+{
+    while (n > 0)
+    {
+        uint32_t chunk;
+
+        if (run->pos == run->len)
+        {
+            ssize_t nread = pread(fileno(s->tmp), run->buf, DBM_SORTER_READ_SIZE, run->offset);
+
+            if (nread <= 0)
+                return CHIDB_EIO;
+            run->offset += nread;
+            run->pos = 0;
+            run->len = nread;
+        }
+
+        chunk = run->len - run->pos < n ? run->len - run->pos : n;
+        memcpy(dst, run->buf + run->pos, chunk);
+        run->pos += chunk;
+        dst += chunk;
+        n -= chunk;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Reads the next row of a run into run->row (if there are no rows
+ * left, the run is done) */
+static int chidb_dbm_sorter_readRow(chidb_dbm_sorter_t *s, chidb_dbm_sorter_run_t *run)
+{
+    DBRecord *dbr;
+    uint32_t len;
+    int rc;
+
+    if (run->left == 0)
+    {
+        run->done = true;
+        return CHIDB_OK;
+    }
+
+    if ((rc = chidb_dbm_sorter_read(s, run, (uint8_t *) &len, sizeof(uint32_t))) != CHIDB_OK)
+        return rc;
+
+    if (len > s->recSize)
+    {
+        uint8_t *rec = realloc(s->rec, len);
+
+        if (rec == NULL)
+            return CHIDB_ENOMEM;
+        s->rec = rec;
+        s->recSize = len;
+    }
+
+    if ((rc = chidb_dbm_sorter_read(s, run, s->rec, len)) != CHIDB_OK ||
+        (rc = chidb_DBRecord_unpack(&dbr, s->rec)) != CHIDB_OK)
+        return rc;
+
+    for(uint32_t i = 0; i < s->ncols && rc == CHIDB_OK; i++)
+        rc = chidb_dbm_reg_set_field(&run->row[i], dbr, i);
+    chidb_DBRecord_destroy(dbr);
+
+    run->left--;
+
+    return rc;
+}
+
+
+/* Does the current row of run a come before the current row of run b?
+ * Runs that are done come after all the others and, on a tie, the run
+ * that was written first wins (so that the sort is stable). Run number
+ * s->nruns stands for a run that wins against every run, which fills
+ * the loser tree before it is built */
+static bool chidb_dbm_sorter_before(chidb_dbm_sorter_t *s, uint32_t a, uint32_t b)
+{
+    int c;
+
+    if (a == s->nruns)
+        return true;
+    if (b == s->nruns || s->runs[a].done)
+        return false;
+    if (s->runs[b].done)
+        return true;
+
+    c = chidb_dbm_sorter_cmp(s, s->runs[a].row, s->runs[b].row);
+
+    return c < 0 || (c == 0 && a < b);
+}
+
+
+/* Replays the matches of run r, from its leaf of the loser tree to the
+ * root, once its current row has changed. Each node keeps the loser of
+ * its match, and the winner moves up to the next node */
+static void chidb_dbm_sorter_adjust(chidb_dbm_sorter_t *s, uint32_t r)
+{
+    for(uint32_t t = (r + s->nruns) / 2; t > 0; t /= 2)
+        if (chidb_dbm_sorter_before(s, s->tree[t], r))
+        {
+            uint32_t winner = s->tree[t];
+
+            s->tree[t] = r;
+            r = winner;
+        }
+
+    s->tree[0] = r;
+}
+
+
+/* Sort the rows of a sorter, and position it on the first row
+ *
+ * No more rows can be added to the sorter after this.
+ *
+ * Parameters
+ * - s: Sorter
+ * - found: Out parameter. Set to false if the sorter has no rows.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The rows have already been sorted
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the temporary file
+ */
+int chidb_dbm_sorter_sort(chidb_dbm_sorter_t *s, bool *found)
+{
+    int rc;
+
+    if (s->sorted)
+        return CHIDB_EMISUSE;
+
+    s->sorted = true;
+    *found = false;
+
+    s->next = 0;
+
+    if (s->nruns == 0)
+    {
+        *found = s->nrows > 0;
+        return s->limit > 0 ? chidb_dbm_sorter_prune(s) : chidb_dbm_sorter_sortRows(s);
+    }
+
+    if (s->nrows > 0 && (rc = chidb_dbm_sorter_spill(s)) != CHIDB_OK)
+        return rc;
+
+    if (fflush(s->tmp) != 0)
+        return CHIDB_EIO;
+
+    s->tree = malloc(s->nruns * sizeof(uint32_t));
+    if (s->tree == NULL)
+        return CHIDB_ENOMEM;
+
+    for(uint32_t i = 0; i < s->nruns; i++)
+    {
+        chidb_dbm_sorter_run_t *run = &s->runs[i];
+
+        run->buf = malloc(DBM_SORTER_READ_SIZE);
+        run->row = chidb_dbm_sorter_newRow(s);
+        if (run->buf == NULL || run->row == NULL)
+            return CHIDB_ENOMEM;
+
+        run->offset = run->start;
+        run->left = run->nrows;
+        if ((rc = chidb_dbm_sorter_readRow(s, run)) != CHIDB_OK)
+            return rc;
+    }
+
+    for(uint32_t i = 1; i < s->nruns; i++)
+        s->tree[i] = s->nruns;
+    for(uint32_t r = s->nruns; r-- > 0; )
+        chidb_dbm_sorter_adjust(s, r);
+
+    *found = !s->runs[s->tree[0]].done;
+
+    return CHIDB_OK;
+}
+
+
+/* Move a sorter to its next row
+ *
+ * Parameters
+ * - s: Sorter
+ * - found: Out parameter. Set to false if there are no more rows.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The rows have not been sorted
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when reading the temporary file
+ */
+int chidb_dbm_sorter_next(chidb_dbm_sorter_t *s, bool *found)
+{
+    uint32_t winner;
+    int rc;
+
+    if (!s->sorted)
+        return CHIDB_EMISUSE;
+
+    if (s->nruns == 0)
+    {
+        if (s->next < s->nrows)
+            s->next++;
+        *found = s->next < s->nrows;
+        return CHIDB_OK;
+    }
+
+    /* The runs have all the rows, so the limit is checked here */
+    if (s->limit > 0 && ++s->next >= s->limit)
+    {
+        *found = false;
+        return CHIDB_OK;
+    }
+
+    winner = s->tree[0];
+    if (!s->runs[winner].done)
+    {
+        if ((rc = chidb_dbm_sorter_readRow(s, &s->runs[winner])) != CHIDB_OK)
+            return rc;
+        chidb_dbm_sorter_adjust(s, winner);
+    }
+
+    *found = !s->runs[s->tree[0]].done;
+
+    return CHIDB_OK;
+}
+
+
+/* Get the values of the current row of a sorter
+ *
+ * Parameters
+ * - s: Sorter
+ * - row: Out parameter. Used to return the s->ncols registers with
+ *        the row's values.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The sorter is not positioned on a row
+ */
+int chidb_dbm_sorter_row(chidb_dbm_sorter_t *s, chidb_dbm_register_t **row)
+{
+    if (!s->sorted)
+        return CHIDB_EMISUSE;
+
+    if (s->nruns == 0)
+    {
+        if (s->next >= s->nrows)
+            return CHIDB_EMISUSE;
+        *row = s->rows[s->next];
+    }
+    else
+    {
+        if (s->runs[s->tree[0]].done)
+            return CHIDB_EMISUSE;
+        *row = s->runs[s->tree[0]].row;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Close a sorter
+ *
+ * Frees its rows, and closes (and removes) its temporary file.
+ *
+ * Parameters
+ * - s: Sorter
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_sorter_close(chidb_dbm_sorter_t *s)
+{
+    if (!s->open)
+        return CHIDB_OK;
+
+    for(uint32_t i = 0; i < s->nrows; i++)
+        chidb_dbm_sorter_freeRow(s, s->rows[i]);
+    free(s->rows);
+
+    for(uint32_t i = 0; i < s->nruns; i++)
+    {
+        free(s->runs[i].buf);
+        chidb_dbm_sorter_freeRow(s, s->runs[i].row);
+    }
+    free(s->runs);
+
+    if (s->tmp != NULL)
+        fclose(s->tmp);
+
+    free(s->tree);
+    free(s->rec);
+    free(s->desc);
+
+    memset(s, 0, sizeof(chidb_dbm_sorter_t));
+
+    return CHIDB_OK;
+}
+
+
+/* Free the sorters of a DBM program
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_dbm_sorter_freeAll(chidb_stmt *stmt)
+{
+    for(uint32_t i = 0; i < stmt->nSorters; i++)
+        chidb_dbm_sorter_close(&stmt->sorters[i]);
+    free(stmt->sorters);
+    stmt->sorters = NULL;
+    stmt->nSorters = 0;
+
+    return CHIDB_OK;
+}
@@ -45,6 +45,7 @@
 #include <chidb/chisql.h>
 #include "chidbInt.h"
 #include "dbm-cursor.h"
+#include "keytree.h"
 
 #define DEFAULT_OPS_SIZE (50)
 #define DEFAULT_REG_SIZE (10)
@@ -90,8 +91,78 @@
         OP(IdxInsert)   \
         OP(CreateTable) \
         OP(CreateIndex) \
+        OP(DictEncode)  \
+        OP(DictDecode)  \
         OP(Copy)        \
         OP(SCopy)       \
+        OP(ColumnCmpJump) \
+        OP(NextColumn)  \
+        OP(BatchOpen)   \
+        OP(BatchRewind) \
+        OP(BatchNext)   \
+        OP(BatchClose)  \
+        OP(VColumn)     \
+        OP(VKey)        \
+        OP(VEq)         \
+        OP(VNe)         \
+        OP(VLt)         \
+        OP(VLe)         \
+        OP(VGt)         \
+        OP(VGe)         \
+        OP(VResultRow)  \
+        OP(Variable)    \
+        OP(Analyze)     \
+        OP(Count)       \
+        OP(IfPos)       \
+        OP(DecrJumpZero) \
+        OP(IsNull)      \
+        OP(Add)         \
+        OP(Subtract)    \
+        OP(Multiply)    \
+        OP(Divide)      \
+        OP(Negate)      \
+        OP(Concat)      \
+        OP(HashOpen)    \
+        OP(HashInsert)  \
+        OP(HashProbe)   \
+        OP(HashUnmatched) \
+        OP(HashNext)    \
+        OP(HashRow)     \
+        OP(HashMark)    \
+        OP(HashClose)   \
+        OP(SorterOpen)  \
+        OP(SorterLimit) \
+        OP(SorterInsert) \
+        OP(SorterSort)  \
+        OP(SorterNext)  \
+        OP(SorterRow)   \
+        OP(SorterClose) \
+        OP(AggOpen)     \
+        OP(AggStep)     \
+        OP(AggBreak)    \
+        OP(AggRewind)   \
+        OP(AggNext)     \
+        OP(AggRow)      \
+        OP(AggClose)    \
+        OP(ListOpen)    \
+        OP(ListAdd)     \
+        OP(ListIn)      \
+        OP(ListNotIn)   \
+        OP(ListRewind)  \
+        OP(ListNext)    \
+        OP(ListValue)   \
+        OP(ListClose)   \
+        OP(MakeKey)     \
+        OP(KeyCreate)   \
+        OP(KeyOpen)     \
+        OP(KeyInsert)   \
+        OP(KeySeekGe)   \
+        OP(KeySeekGt)   \
+        OP(KeyGt)       \
+        OP(KeyGe)       \
+        OP(KeyPKey)     \
+        OP(KeyNext)     \
+        OP(KeyClose)    \
         OP(Halt)
 
 /* The following generates an enum type for the opcode. It expands to:
@@ -189,7 +260,40 @@ static inline const char* regtype_to_str(register_type_t regtype)
     }
 }
 
-/* A type representing a single register */
+/* How the value of a string or binary register is stored.
+ *
+ * - REG_STORE_INLINE: in the register itself (only for small values)
+ * - REG_STORE_BUFFER: in a heap buffer, which may be shared (copy-on-write)
+ *                     with other registers
+ * - REG_STORE_BORROWED: in memory that is owned by someone else, and that
+ *                       will outlive the register's value (e.g., the p4
+ *                       of an instruction)
+ *
+ * See dbm-reg.c for details. */
+typedef enum register_storage
+{
+    REG_STORE_INLINE   = 0,
+    REG_STORE_BUFFER   = 1,
+    REG_STORE_BORROWED = 2
+} register_storage_t;
+
+/* Size of the inline storage of a register (including the NUL terminator) */
+#define DBM_REG_INLINE_SIZE (16)
+
+/* A reference-counted heap buffer, used to store values that are
+ * too large to be stored inline. */
+typedef struct chidb_dbm_regbuf
+{
+    uint32_t refs;
+    uint32_t size;
+    uint8_t data[];
+} chidb_dbm_regbuf_t;
+
+/* A type representing a single register
+ *
+ * For string and binary registers, value.s (or value.bin.bytes) always
+ * points to the value, regardless of where it is stored, and len is
+ * the length of the value (not including the NUL terminator of strings). */
 typedef struct chidb_dbm_register
 {
     register_type_t type;
@@ -205,8 +309,324 @@ typedef struct chidb_dbm_register
         } bin;
     } value;
 
+    register_storage_t storage;
+    uint32_t len;
+
+    /* Heap buffer. It is kept when the register is assigned a value
+     * that doesn't need it, so it can be reused by later values. */
+    chidb_dbm_regbuf_t *buf;
+
+    char inl[DBM_REG_INLINE_SIZE];
+
 } chidb_dbm_register_t;
 
+/* Maximum number of rows in a batch (in vectorized instructions) */
+#define DBM_BATCH_SIZE (1024)
+
+/* A vector register, used by the vectorized instructions. It holds
+ * one value for each row in a batch (the value for row i of the batch
+ * is in position i). Strings are stored, NUL-terminated, in the vector's
+ * own buffer. */
+typedef struct chidb_dbm_vector
+{
+    uint8_t type[DBM_BATCH_SIZE];  /* register_type_t of each value */
+    int32_t i[DBM_BATCH_SIZE];
+    char *s[DBM_BATCH_SIZE];
+    char *strbuf;
+    uint32_t strbuf_size;
+} chidb_dbm_vector_t;
+
+/* A batch scan, used by the vectorized instructions. It scans a table
+ * B-Tree, DBM_BATCH_SIZE rows at a time. The rows in the current batch
+ * that have not been filtered out are listed in the selection vector. */
+#define DBM_BATCH_MAX_DEPTH (16)
+typedef struct chidb_dbm_batch
+{
+    bool open;
+    npage_t nroot;
+
+    /* Position of the scan: the path from the root to the current
+     * node, and the next cell (or child) to visit in each node */
+    uint32_t depth;
+    npage_t path_page[DBM_BATCH_MAX_DEPTH];
+    ncell_t path_cell[DBM_BATCH_MAX_DEPTH];
+
+    /* Rows in the current batch. The records are copied to data,
+     * starting at the offsets in row */
+    uint32_t n;
+    chidb_key_t key[DBM_BATCH_SIZE];
+    uint32_t row[DBM_BATCH_SIZE];
+    uint8_t *data;
+    uint32_t data_len;   /* Bytes used in data */
+    uint32_t data_size;  /* Size of data */
+
+    /* Selection vector */
+    uint16_t sel[DBM_BATCH_SIZE];
+    uint32_t nsel;
+
+    /* Next entry of the selection vector to be returned by VResultRow */
+    uint32_t emit;
+} chidb_dbm_batch_t;
+
+/* Hash tables, used by the hash join instructions (see dbm-hash.c).
+ * The entries of a hash table are divided into DBM_HASH_NPART partitions
+ * (by their hash value). Once the entries in memory take up more than
+ * the table's memory budget, the largest partition in memory is spilled
+ * to a B-Tree in a temporary file. */
+#define DBM_HASH_NPART (8)
+#define DBM_HASH_BUDGET (4 * 1024 * 1024)
+#define DBM_HASH_MAX_DEPTH (16)
+
+/* An entry of a hash table (in memory): a key, and a row of values */
+typedef struct chidb_dbm_hash_entry
+{
+    struct chidb_dbm_hash_entry *next;  /* Next entry in the same bucket */
+    uint32_t hash;
+    bool matched;
+    chidb_dbm_register_t key;
+    chidb_dbm_register_t row[];
+} chidb_dbm_hash_entry_t;
+
+/* A partition of a hash table that has been spilled to a table B-Tree
+ * (keyed by entry number), with a key B-Tree of its hash values */
+typedef struct chidb_dbm_hash_spill
+{
+    npage_t nroot;          /* Root page of the table B-Tree (0 if the partition is in memory) */
+    npage_t nhashes;        /* Root page of the key B-Tree */
+    uint32_t n;             /* Number of entries in the B-Tree */
+    uint8_t *matched;       /* Bitmap: has entry i been matched? */
+} chidb_dbm_hash_spill_t;
+
+/* What the entries visited by HashNext are */
+typedef enum chidb_dbm_hash_mode
+{
+    DBM_HASH_NONE,          /* None (the hash table is not positioned on an entry) */
+    DBM_HASH_PROBE,         /* The entries with the key passed to HashProbe */
+    DBM_HASH_UNMATCHED      /* The entries that have not been matched */
+} chidb_dbm_hash_mode_t;
+
+typedef struct chidb_dbm_hash
+{
+    bool open;
+    uint32_t ncols;         /* Number of values in each row */
+    uint32_t budget;        /* Memory budget, in bytes */
+
+    /* Entries in memory */
+    chidb_dbm_hash_entry_t **buckets;
+    uint32_t nbuckets;
+    uint32_t nentries;
+    uint32_t mem;                       /* Bytes used by the entries in memory */
+    uint32_t partMem[DBM_HASH_NPART];   /* Bytes used by each partition */
+
+    /* Spilled partitions, and the temporary file they are stored in
+     * (which is opened as a database of its own) */
+    chidb_dbm_hash_spill_t spill[DBM_HASH_NPART];
+    chidb *tmp;
+
+    /* Current entry. If it is a spilled entry, its key and values are
+     * decoded into spillKey and spillRow. A probe's position is the scan
+     * kc of the key B-Tree, and HashUnmatched's position is the path from
+     * the root of the table B-Tree to the entry's cell */
+    chidb_dbm_hash_mode_t mode;
+    chidb_dbm_register_t probe;
+    uint32_t probeHash;
+    uint32_t part;
+    uint32_t bucket;
+    chidb_dbm_hash_entry_t *entry;
+    uint32_t spillEntry;
+    chidb_dbm_register_t spillKey;
+    chidb_dbm_register_t *spillRow;
+    uint32_t depth;
+    npage_t path_page[DBM_HASH_MAX_DEPTH];
+    ncell_t path_cell[DBM_HASH_MAX_DEPTH];
+    KeyTreeCursor kc;
+} chidb_dbm_hash_t;
+
+/* Sorters, used by the sorting instructions (see dbm-sorter.c). The rows
+ * are kept in memory until they take up more than the sorter's memory
+ * budget. Then, they are sorted and written to a temporary file as a
+ * run, and the runs are merged once all the rows have been added. A
+ * sorter with a limit only keeps the rows that can still be among the
+ * first ones. */
+#define DBM_SORTER_BUDGET (4 * 1024 * 1024)
+#define DBM_SORTER_READ_SIZE (4096)
+
+/* A run in the temporary file, which is read sequentially, through a buffer */
+typedef struct chidb_dbm_sorter_run
+{
+    long start;             /* Offset of the run in the file */
+    uint32_t nrows;         /* Number of rows in the run */
+    long offset;            /* Offset of the next byte to read into the buffer */
+    uint32_t left;          /* Rows that haven't been read */
+    uint8_t *buf;
+    uint32_t pos;           /* Next byte of the buffer */
+    uint32_t len;           /* Bytes in the buffer */
+    bool done;              /* Have all the rows been read? */
+    chidb_dbm_register_t *row;  /* Last row read */
+} chidb_dbm_sorter_run_t;
+
+typedef struct chidb_dbm_sorter
+{
+    bool open;
+    bool sorted;            /* Have the rows been sorted (by SorterSort)? */
+    uint32_t ncols;         /* Number of values in each row */
+    uint32_t nkeys;         /* The first nkeys values are the sort key */
+    bool *desc;             /* Is key value i sorted in descending order? */
+    uint32_t budget;        /* Memory budget, in bytes */
+    uint32_t limit;         /* Number of rows produced (0 for all of them) */
+
+    /* Rows in memory */
+    chidb_dbm_register_t **rows;
+    uint32_t nrows;
+    uint32_t maxrows;
+    uint32_t mem;           /* Bytes used by the rows in memory */
+    uint32_t next;          /* Rows produced before the current one (which,
+                             * if there are no runs, is rows[next]) */
+
+    /* Runs in the temporary file, and the loser tree that merges them:
+     * tree[0] is the run with the current row, and each internal node
+     * tree[i] is the run that lost the comparison at that node */
+    FILE *tmp;
+    chidb_dbm_sorter_run_t *runs;
+    uint32_t nruns;
+    uint32_t *tree;
+    uint8_t *rec;           /* Buffer for a record read from a run */
+    uint32_t recSize;
+} chidb_dbm_sorter_t;
+
+/* Aggregators, used by the aggregation instructions (see dbm-agg.c).
+ * The groups are kept in an open addressing hash table, keyed by their
+ * key. Once the groups take up more than the aggregator's memory budget,
+ * the rows of any new group are written to one of DBM_AGG_NPART
+ * partitions (by their hash value), each in a temporary file, and the
+ * partitions are aggregated in the same way, one at a time, after the
+ * groups in memory. A sorted aggregator, whose rows are added in order
+ * of their key, only keeps the current group. */
+#define DBM_AGG_NPART (8)
+#define DBM_AGG_BUDGET (4 * 1024 * 1024)
+#define DBM_AGG_MIN_SLOTS (256)
+
+/* Aggregate functions (and the character that stands for each of them
+ * in AggOpen) */
+typedef enum chidb_dbm_agg_func
+{
+    DBM_AGG_COUNT_ALL,      /* C: COUNT(*) */
+    DBM_AGG_COUNT,          /* c: COUNT(x) */
+    DBM_AGG_SUM,            /* s: SUM(x) */
+    DBM_AGG_AVG,            /* a: AVG(x) */
+    DBM_AGG_MIN,            /* n: MIN(x) */
+    DBM_AGG_MAX             /* x: MAX(x) */
+} chidb_dbm_agg_func_t;
+
+/* The state of an aggregate function in a group */
+typedef struct chidb_dbm_agg_acc
+{
+    int64_t count;          /* Values that are not NULL (rows, for COUNT(*)) */
+    int64_t sum;
+    chidb_dbm_register_t ext;   /* Minimum or maximum value */
+} chidb_dbm_agg_acc_t;
+
+/* A group: its key, and the state of each aggregate function */
+typedef struct chidb_dbm_agg_group
+{
+    uint32_t hash;
+    chidb_dbm_register_t *key;  /* Points right after acc */
+    chidb_dbm_agg_acc_t acc[];
+} chidb_dbm_agg_group_t;
+
+/* A partition that has not been aggregated yet */
+typedef struct chidb_dbm_agg_part
+{
+    FILE *f;
+    uint32_t depth;         /* Number of times its rows have been partitioned */
+} chidb_dbm_agg_part_t;
+
+typedef struct chidb_dbm_agg
+{
+    bool open;
+    bool done;              /* Have all the rows been added (by AggRewind)? */
+    bool sorted;            /* Are the rows added in order of their key (see AggBreak)? */
+    bool finished;          /* In a sorted aggregator, has AggBreak finished the current group? */
+    uint32_t nkeys;         /* Number of values in the key */
+    uint32_t naggs;
+    chidb_dbm_agg_func_t *funcs;
+    uint32_t budget;        /* Memory budget, in bytes */
+
+    /* Groups in memory, in the order in which they were created. Each
+     * slot of the hash table is the number of a group plus one (or 0,
+     * if the slot is empty), and collisions are resolved with linear
+     * probing */
+    chidb_dbm_agg_group_t **groups;
+    uint32_t ngroups;
+    uint32_t maxgroups;
+    uint32_t *slots;
+    uint32_t nslots;
+    uint32_t mem;           /* Bytes used by the groups in memory */
+    bool full;              /* Do the rows of new groups go to the partitions? */
+    uint32_t depth;         /* Number of times the rows in memory have been partitioned */
+
+    /* Partitions that the rows of new groups are written to, and the
+     * partitions that have been written but not aggregated yet */
+    FILE *spill[DBM_AGG_NPART];
+    chidb_dbm_agg_part_t *pending;
+    uint32_t npending;
+
+    uint32_t next;          /* Current group */
+    chidb_dbm_register_t *row;  /* A row read from a partition */
+    uint8_t *rec;           /* Buffer for a record read from a partition */
+    uint32_t recSize;
+} chidb_dbm_agg_t;
+
+/* Value lists, used by the list instructions (see dbm-list.c). The
+ * values are sorted, and their duplicates removed, when they are first
+ * looked up (or visited) */
+typedef struct chidb_dbm_list
+{
+    bool open;
+    bool sorted;
+    chidb_dbm_register_t *values;
+    uint32_t nvalues;
+    uint32_t maxvalues;
+    uint32_t next;          /* Current value (see ListRewind) */
+} chidb_dbm_list_t;
+
+/* Key scans, used by the key instructions (see dbm-key.c), which read
+ * and update key B-Trees (see keytree.c). buf holds the keys that are
+ * made from the key in a register: the key followed by a primary key,
+ * for a new entry, or the key that follows all the keys that start with
+ * it, for a seek past them */
+typedef struct chidb_dbm_keyscan
+{
+    bool open;
+    BTree *bt;
+    npage_t nroot;
+    KeyTreeCursor kc;
+    uint8_t *buf;
+    uint32_t bufSize;
+} chidb_dbm_keyscan_t;
+
+/* A predecoded DBM instruction.
+ *
+ * The threaded interpreter (see chidb_stmt_exec) does not run the
+ * chidb_dbm_op_t's directly. Instead, the program is first translated
+ * into an array of chidb_dbm_insn_t's, where each instruction has
+ * the address of the interpreter code for its opcode, and where register
+ * and jump operands have been resolved to pointers (operands that are
+ * not registers or addresses, or that refer to registers or addresses
+ * that do not exist, are NULL) */
+typedef struct chidb_dbm_insn
+{
+    const void *label;
+    chidb_dbm_op_t *op;
+    chidb_dbm_register_t *r1;
+    chidb_dbm_register_t *r2;
+    chidb_dbm_register_t *r3;
+    struct chidb_dbm_insn *target;
+} chidb_dbm_insn_t;
+
+/* Entry point of a DBM program compiled to native code */
+typedef int (*chidb_dbm_jit_fn)(chidb_stmt *stmt, chidb_dbm_register_t **reg, uint32_t *pc);
+
 /*  This is the struct that represents a single DBM program.
  *
  *  Notice how a single DBM program has its own registers and cursors;
@@ -259,6 +679,77 @@ struct chidb_stmt
      * per operation */
     bool explain;
 
+    /* Predecoded program, used by the threaded interpreter. It is created
+     * the first time the program is run, and discarded whenever an
+     * instruction is modified. */
+    chidb_dbm_insn_t *code;
+
+    /* Should the threaded interpreter be used (if the compiler supports it)? */
+    bool threaded;
+
+    /* Number of instructions executed so far */
+    uint64_t nSteps;
+
+    /* Vector registers and batch scans (used by the vectorized instructions).
+     * These are allocated when an instruction first refers to them. */
+    chidb_dbm_vector_t *vreg;
+    uint32_t nVReg;
+    chidb_dbm_batch_t *batches;
+    uint32_t nBatches;
+
+    /* Hash tables (used by the hash join instructions). These are
+     * allocated when an instruction first refers to them. */
+    chidb_dbm_hash_t *hashes;
+    uint32_t nHashes;
+
+    /* Sorters (used by the sorting instructions). These are allocated
+     * when an instruction first refers to them. */
+    chidb_dbm_sorter_t *sorters;
+    uint32_t nSorters;
+
+    /* Aggregators (used by the aggregation instructions). These are
+     * allocated when an instruction first refers to them. */
+    chidb_dbm_agg_t *aggs;
+    uint32_t nAggs;
+
+    /* Value lists (used by the list instructions). These are allocated
+     * when an instruction first refers to them. */
+    chidb_dbm_list_t *lists;
+    uint32_t nLists;
+
+    /* Key scans (used by the key instructions). These are allocated
+     * when an instruction first refers to them. */
+    chidb_dbm_keyscan_t *keyScans;
+    uint32_t nKeyScans;
+
+    /* Native code for this program (see dbm-jit.c). The program is
+     * compiled once it has run more than jitThreshold instructions
+     * (if jitThreshold is 0, the program is never compiled). */
+    uint64_t jitThreshold;
+    bool jitFailed;
+    void *jitHandle;
+    chidb_dbm_jit_fn jit;
+
+    /* Statement cache (see stmt-cache.c). cacheKey is the normalized SQL
+     * text of the statement (or NULL if the statement can't be cached),
+     * and schemaVersion is the database's schema version when the
+     * statement was compiled. */
+    char *cacheKey;
+    uint32_t schemaVersion;
+
+    /* Does this statement modify the schema? */
+    bool schemaChange;
+
+    /* Values bound to the statement's parameters (see chidb_bind_*).
+     * Parameter i is stored in params[i-1] */
+    chidb_dbm_register_t *params;
+    uint32_t nParams;
+
+    /* Number of registers and cursors allocated with chidb_stmt_alloc_regs
+     * and chidb_stmt_alloc_cursor */
+    uint32_t nRegAlloc;
+    uint32_t nCurAlloc;
+
     /* Additional fields go here */
 };
 
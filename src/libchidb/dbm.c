@@ -40,11 +40,27 @@
 #include <assert.h>
 #include <stdbool.h>
 #include "dbm.h"
+#include "dbm-batch.h"
+#include "dbm-hash.h"
+#include "dbm-sorter.h"
+#include "dbm-agg.h"
+#include "dbm-list.h"
+#include "dbm-key.h"
+#include "dbm-jit.h"
+#include "dbm-reg.h"
 
 /* Forward declaration of auxiliary functions. */
 int realloc_ops(chidb_stmt *stmt, uint32_t size);
 int realloc_reg(chidb_stmt *stmt, uint32_t size);
 int realloc_cur(chidb_stmt *stmt, uint32_t size);
+static int chidb_stmt_predecode(chidb_stmt *stmt, const void **labels, const void **fast);
+static void chidb_stmt_resolve(chidb_stmt *stmt);
+
+/* The threaded interpreter uses the "labels as values" extension
+ * (supported by GCC and Clang) */
+#ifdef __GNUC__
+#define HAVE_COMPUTED_GOTO
+#endif
 
 
 
@@ -78,6 +94,44 @@ int chidb_stmt_init(chidb_stmt *stmt, chidb *db)
     /* The program starts running in instruction 0 */
     stmt->pc = 0;
 
+    /* The program is predecoded the first time it is run */
+    stmt->code = NULL;
+    stmt->threaded = true;
+    stmt->nSteps = 0;
+
+    /* Vector registers, batch scans, hash tables, sorters, aggregators,
+     * value lists and key scans are allocated when they are used */
+    stmt->vreg = NULL;
+    stmt->nVReg = 0;
+    stmt->batches = NULL;
+    stmt->nBatches = 0;
+    stmt->hashes = NULL;
+    stmt->nHashes = 0;
+    stmt->sorters = NULL;
+    stmt->nSorters = 0;
+    stmt->aggs = NULL;
+    stmt->nAggs = 0;
+    stmt->lists = NULL;
+    stmt->nLists = 0;
+    stmt->keyScans = NULL;
+    stmt->nKeyScans = 0;
+
+    /* The program is compiled to native code only if the JIT
+     * compiler has been enabled */
+    stmt->jitThreshold = chidb_dbm_jit_threshold();
+    stmt->jitFailed = false;
+    stmt->jitHandle = NULL;
+    stmt->jit = NULL;
+
+    /* Statements are only cached if they are prepared from SQL */
+    stmt->cacheKey = NULL;
+    stmt->schemaVersion = 0;
+    stmt->schemaChange = false;
+
+    /* The statement has no parameters until chidb_stmt_set_params is called */
+    stmt->params = NULL;
+    stmt->nParams = 0;
+
     /* We allocate an array of chidb_dbm_op_t's with enough room for
      * DEFAULT_OPS_SIZE instructions. This is done with realloc_ops,
      * which initializes the instructions to Noop's. Note that realloc_ops
@@ -104,6 +158,10 @@ int chidb_stmt_init(chidb_stmt *stmt, chidb *db)
     if(rc != CHIDB_OK)
         return rc;
 
+    /* No registers or cursors have been allocated (see chidb_stmt_alloc_regs) */
+    stmt->nRegAlloc = 0;
+    stmt->nCurAlloc = 0;
+
     /* Initially, there is no Result Row */
     stmt->startRR = 0;
     stmt->nRR = 0;
@@ -126,8 +184,143 @@ int chidb_stmt_init(chidb_stmt *stmt, chidb *db)
 int chidb_stmt_free(chidb_stmt *stmt)
 {
 	free(stmt->ops);
+	for(int i=0; i < stmt->nReg; i++)
+		chidb_dbm_reg_free(&stmt->reg[i]);
 	free(stmt->reg);
 	free(stmt->cursors);
+	free(stmt->code);
+	chidb_dbm_batch_freeAll(stmt);
+	chidb_dbm_hash_freeAll(stmt);
+	chidb_dbm_sorter_freeAll(stmt);
+	chidb_dbm_agg_freeAll(stmt);
+	chidb_dbm_list_freeAll(stmt);
+	chidb_dbm_key_freeAll(stmt);
+	chidb_dbm_jit_free(stmt);
+	free(stmt->cacheKey);
+	for(int i=0; i < stmt->nParams; i++)
+		chidb_dbm_reg_free(&stmt->params[i]);
+	free(stmt->params);
+	if(stmt->cols != NULL)
+	{
+		for(int i=0; i < stmt->nCols; i++)
+			free(stmt->cols[i]);
+		free(stmt->cols);
+	}
+    return CHIDB_OK;
+}
+
+
+/* Allocate registers
+ *
+ * Allocates n consecutive registers that have not been allocated before,
+ * growing the DBM's registers if necessary. This is how the code
+ * generator obtains the registers used by a program.
+ *
+ * Parameters
+ * - stmt: DBM
+ * - n: Number of registers
+ * - first: Out parameter. Used to return the first allocated register.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_alloc_regs(chidb_stmt *stmt, uint32_t n, int32_t *first)
+{
+    if(stmt->nRegAlloc + n > stmt->nReg)
+    {
+        uint32_t size = stmt->nReg * 2;
+
+        if(size < stmt->nRegAlloc + n)
+            size = stmt->nRegAlloc + n;
+
+        int rc = realloc_reg(stmt, size);
+        if(rc != CHIDB_OK)
+            return rc;
+    }
+
+    *first = stmt->nRegAlloc;
+    stmt->nRegAlloc += n;
+
+    return CHIDB_OK;
+}
+
+
+/* Allocate a cursor
+ *
+ * Same as chidb_stmt_alloc_regs, but with a single cursor.
+ *
+ * Parameters
+ * - stmt: DBM
+ * - cursor: Out parameter. Used to return the allocated cursor.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_alloc_cursor(chidb_stmt *stmt, int32_t *cursor)
+{
+    if(stmt->nCurAlloc + 1 > stmt->nCursors)
+    {
+        int rc = realloc_cur(stmt, stmt->nCursors * 2 + 1);
+        if(rc != CHIDB_OK)
+            return rc;
+    }
+
+    *cursor = stmt->nCurAlloc++;
+
+    return CHIDB_OK;
+}
+
+
+/* Set the number of parameters of a DBM
+ *
+ * Allocates the registers that hold the values bound to the statement's
+ * parameters (which the Variable instruction reads). Initially, no value
+ * is bound to any parameter.
+ *
+ * Parameters
+ * - stmt: DBM
+ * - nParams: Number of parameters
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_set_params(chidb_stmt *stmt, uint32_t nParams)
+{
+    chidb_dbm_register_t *params;
+
+    for(int i=0; i < stmt->nParams; i++)
+        chidb_dbm_reg_free(&stmt->params[i]);
+
+    params = realloc(stmt->params, sizeof(chidb_dbm_register_t) * nParams);
+    if(nParams > 0 && params == NULL)
+        return CHIDB_ENOMEM;
+
+    for(int i=0; i < nParams; i++)
+        chidb_dbm_reg_init(&params[i]);
+
+    stmt->params = params;
+    stmt->nParams = nParams;
+
+    return CHIDB_OK;
+}
+
+/* Clear the values bound to a DBM's parameters
+ *
+ * Parameters
+ * - stmt: DBM
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_stmt_clear_params(chidb_stmt *stmt)
+{
+    /* Parameters keep their buffers, so they can be reused */
+    for(int i=0; i < stmt->nParams; i++)
+        stmt->params[i].type = REG_UNSPECIFIED;
+
     return CHIDB_OK;
 }
 
@@ -167,11 +360,342 @@ int chidb_stmt_set_op(chidb_stmt *stmt, chidb_dbm_op_t *op, uint32_t pos)
     if(pos >= stmt->endOp)
         stmt->endOp = pos + 1;
 
+    /* The predecoded and compiled programs are no longer valid */
+    free(stmt->code);
+    stmt->code = NULL;
+    chidb_dbm_jit_free(stmt);
+    stmt->jitFailed = false;
+
+    return CHIDB_OK;
+}
+
+/* Is this a comparison instruction (Eq, Ne, Lt, Le, Gt, Ge)? */
+static inline bool is_cmp_op(opcode_t opcode)
+{
+    return opcode >= Op_Eq && opcode <= Op_Ge;
+}
+
+/* Replace common sequences of instructions with superinstructions
+ *
+ * This is a peephole pass over the program that replaces the first
+ * instruction of the following sequences with a superinstruction
+ * (see dbm-ops.c) that runs the entire sequence, to reduce the number
+ * of instructions that have to be dispatched:
+ *
+ *  - Column followed by a comparison on the column's register is
+ *    replaced with ColumnCmpJump.
+ *  - Next that jumps to a Column instruction (the top of a typical
+ *    scanning loop) is replaced with NextColumn.
+ *
+ * The remaining instructions in each sequence are left in place,
+ * so jump addresses do not change.
+ *
+ * Parameters
+ * - stmt: DBM program
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_stmt_peephole(chidb_stmt *stmt)
+{
+    chidb_dbm_op_t *ops = stmt->ops;
+
+    for(int i=0; i + 1 < stmt->endOp; i++)
+    {
+        if (ops[i].opcode == Op_Column && is_cmp_op(ops[i+1].opcode) &&
+            (ops[i+1].p1 == ops[i].p3 || ops[i+1].p3 == ops[i].p3))
+            ops[i].opcode = Op_ColumnCmpJump;
+    }
+
+    for(int i=0; i < stmt->endOp; i++)
+    {
+        if (ops[i].opcode == Op_Next && IS_VALID_ADDRESS(stmt, ops[i].p2) &&
+            (ops[ops[i].p2].opcode == Op_Column || ops[ops[i].p2].opcode == Op_ColumnCmpJump))
+            ops[i].opcode = Op_NextColumn;
+    }
+
+    /* The predecoded and compiled programs are no longer valid */
+    free(stmt->code);
+    stmt->code = NULL;
+    chidb_dbm_jit_free(stmt);
+    stmt->jitFailed = false;
+
     return CHIDB_OK;
 }
 
-/* Forward declaration of instruction handler. See dbm-ops.c for details */
-int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
+/* Kinds of operands. For each opcode, we specify what kind of operand
+ * p1, p2, and p3 are, so the register and jump operands can be resolved
+ * when the program is predecoded. */
+#define OPND_NONE (0)
+#define OPND_REG  (1)
+#define OPND_CUR  (2)
+#define OPND_ADDR (3)
+
+#define OPERANDS(p1, p2, p3) ((OPND_ ## p1) | (OPND_ ## p2) << 2 | (OPND_ ## p3) << 4)
+#define OPERAND_KIND(opnds, n) (((opnds) >> (2 * ((n) - 1))) & 0x3)
+
+static const uint8_t op_operands[] =
+{
+    [Op_Noop]        = OPERANDS(NONE, NONE, NONE),
+    [Op_OpenRead]    = OPERANDS(CUR,  REG,  NONE),
+    [Op_OpenWrite]   = OPERANDS(CUR,  REG,  NONE),
+    [Op_Close]       = OPERANDS(CUR,  NONE, NONE),
+    [Op_Rewind]      = OPERANDS(CUR,  ADDR, NONE),
+    [Op_Next]        = OPERANDS(CUR,  ADDR, NONE),
+    [Op_Prev]        = OPERANDS(CUR,  ADDR, NONE),
+    [Op_Seek]        = OPERANDS(CUR,  ADDR, REG),
+    [Op_SeekGt]      = OPERANDS(CUR,  ADDR, REG),
+    [Op_SeekGe]      = OPERANDS(CUR,  ADDR, REG),
+    [Op_SeekLt]      = OPERANDS(CUR,  ADDR, REG),
+    [Op_SeekLe]      = OPERANDS(CUR,  ADDR, REG),
+    [Op_Column]      = OPERANDS(CUR,  NONE, REG),
+    [Op_Key]         = OPERANDS(CUR,  REG,  NONE),
+    [Op_Integer]     = OPERANDS(NONE, REG,  NONE),
+    [Op_String]      = OPERANDS(NONE, REG,  NONE),
+    [Op_Null]        = OPERANDS(NONE, REG,  NONE),
+    [Op_ResultRow]   = OPERANDS(REG,  NONE, NONE),
+    [Op_MakeRecord]  = OPERANDS(REG,  NONE, REG),
+    [Op_Insert]      = OPERANDS(CUR,  REG,  REG),
+    [Op_Eq]          = OPERANDS(REG,  ADDR, REG),
+    [Op_Ne]          = OPERANDS(REG,  ADDR, REG),
+    [Op_Lt]          = OPERANDS(REG,  ADDR, REG),
+    [Op_Le]          = OPERANDS(REG,  ADDR, REG),
+    [Op_Gt]          = OPERANDS(REG,  ADDR, REG),
+    [Op_Ge]          = OPERANDS(REG,  ADDR, REG),
+    [Op_IdxGt]       = OPERANDS(CUR,  ADDR, REG),
+    [Op_IdxGe]       = OPERANDS(CUR,  ADDR, REG),
+    [Op_IdxLt]       = OPERANDS(CUR,  ADDR, REG),
+    [Op_IdxLe]       = OPERANDS(CUR,  ADDR, REG),
+    [Op_IdxPKey]     = OPERANDS(CUR,  REG,  NONE),
+    [Op_IdxInsert]   = OPERANDS(CUR,  REG,  REG),
+    [Op_CreateTable] = OPERANDS(REG,  NONE, NONE),
+    [Op_CreateIndex] = OPERANDS(REG,  NONE, NONE),
+    [Op_DictEncode]  = OPERANDS(REG,  REG,  NONE),
+    [Op_DictDecode]  = OPERANDS(REG,  REG,  NONE),
+    [Op_Copy]        = OPERANDS(REG,  REG,  NONE),
+    [Op_SCopy]       = OPERANDS(REG,  REG,  NONE),
+    [Op_ColumnCmpJump] = OPERANDS(CUR,  NONE, REG),
+    [Op_NextColumn]  = OPERANDS(CUR,  ADDR, NONE),
+    [Op_BatchOpen]   = OPERANDS(NONE, REG,  NONE),
+    [Op_BatchRewind] = OPERANDS(NONE, ADDR, NONE),
+    [Op_BatchNext]   = OPERANDS(NONE, ADDR, NONE),
+    [Op_BatchClose]  = OPERANDS(NONE, NONE, NONE),
+    [Op_VColumn]     = OPERANDS(NONE, NONE, NONE),
+    [Op_VKey]        = OPERANDS(NONE, NONE, NONE),
+    [Op_VEq]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VNe]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VLt]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VLe]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VGt]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VGe]         = OPERANDS(REG,  NONE, NONE),
+    [Op_VResultRow]  = OPERANDS(REG,  NONE, NONE),
+    [Op_Variable]    = OPERANDS(NONE, REG,  NONE),
+    [Op_Analyze]     = OPERANDS(REG,  NONE, NONE),
+    [Op_Count]       = OPERANDS(REG,  REG,  NONE),
+    [Op_IfPos]       = OPERANDS(REG,  ADDR, NONE),
+    [Op_DecrJumpZero] = OPERANDS(REG, ADDR, NONE),
+    [Op_IsNull]      = OPERANDS(REG,  ADDR, NONE),
+    [Op_Add]         = OPERANDS(REG,  REG,  REG),
+    [Op_Subtract]    = OPERANDS(REG,  REG,  REG),
+    [Op_Multiply]    = OPERANDS(REG,  REG,  REG),
+    [Op_Divide]      = OPERANDS(REG,  REG,  REG),
+    [Op_Negate]      = OPERANDS(REG,  REG,  NONE),
+    [Op_Concat]      = OPERANDS(REG,  REG,  REG),
+    [Op_HashOpen]    = OPERANDS(NONE, NONE, NONE),
+    [Op_HashInsert]  = OPERANDS(NONE, REG,  REG),
+    [Op_HashProbe]   = OPERANDS(NONE, ADDR, REG),
+    [Op_HashUnmatched] = OPERANDS(NONE, ADDR, NONE),
+    [Op_HashNext]    = OPERANDS(NONE, ADDR, NONE),
+    [Op_HashRow]     = OPERANDS(NONE, REG,  NONE),
+    [Op_HashMark]    = OPERANDS(NONE, NONE, NONE),
+    [Op_HashClose]   = OPERANDS(NONE, NONE, NONE),
+    [Op_SorterOpen]  = OPERANDS(NONE, NONE, NONE),
+    [Op_SorterLimit] = OPERANDS(NONE, NONE, NONE),
+    [Op_SorterInsert] = OPERANDS(NONE, REG, NONE),
+    [Op_SorterSort]  = OPERANDS(NONE, ADDR, NONE),
+    [Op_SorterNext]  = OPERANDS(NONE, ADDR, NONE),
+    [Op_SorterRow]   = OPERANDS(NONE, REG,  NONE),
+    [Op_SorterClose] = OPERANDS(NONE, NONE, NONE),
+    [Op_AggOpen]     = OPERANDS(NONE, NONE, NONE),
+    [Op_AggStep]     = OPERANDS(NONE, REG,  REG),
+    [Op_AggBreak]    = OPERANDS(NONE, ADDR, REG),
+    [Op_AggRewind]   = OPERANDS(NONE, ADDR, NONE),
+    [Op_AggNext]     = OPERANDS(NONE, ADDR, NONE),
+    [Op_AggRow]      = OPERANDS(NONE, REG,  NONE),
+    [Op_AggClose]    = OPERANDS(NONE, NONE, NONE),
+    [Op_ListOpen]    = OPERANDS(NONE, NONE, NONE),
+    [Op_ListAdd]     = OPERANDS(NONE, REG,  NONE),
+    [Op_ListIn]      = OPERANDS(NONE, ADDR, REG),
+    [Op_ListNotIn]   = OPERANDS(NONE, ADDR, REG),
+    [Op_ListRewind]  = OPERANDS(NONE, ADDR, NONE),
+    [Op_ListNext]    = OPERANDS(NONE, ADDR, NONE),
+    [Op_ListValue]   = OPERANDS(NONE, REG,  NONE),
+    [Op_ListClose]   = OPERANDS(NONE, NONE, NONE),
+    [Op_MakeKey]     = OPERANDS(REG,  NONE, REG),
+    [Op_KeyCreate]   = OPERANDS(REG,  NONE, NONE),
+    [Op_KeyOpen]     = OPERANDS(NONE, REG,  NONE),
+    [Op_KeyInsert]   = OPERANDS(NONE, REG,  REG),
+    [Op_KeySeekGe]   = OPERANDS(NONE, ADDR, REG),
+    [Op_KeySeekGt]   = OPERANDS(NONE, ADDR, REG),
+    [Op_KeyGt]       = OPERANDS(NONE, ADDR, REG),
+    [Op_KeyGe]       = OPERANDS(NONE, ADDR, REG),
+    [Op_KeyPKey]     = OPERANDS(NONE, REG,  NONE),
+    [Op_KeyNext]     = OPERANDS(NONE, ADDR, NONE),
+    [Op_KeyClose]    = OPERANDS(NONE, NONE, NONE),
+    [Op_Halt]        = OPERANDS(NONE, NONE, NONE),
+};
+
+
+/* Runs the DBM using the dispatch table in dbm-ops.c */
+static int chidb_stmt_exec_table(chidb_stmt *stmt)
+{
+    int rc = CHIDB_OK;
+
+    while(stmt->pc < stmt->endOp)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[stmt->pc++];
+        stmt->nSteps++;
+        rc = chidb_dbm_op_handle(stmt, op);
+
+        if (rc != CHIDB_OK)
+            break;
+    }
+
+    return rc;
+}
+
+
+#ifdef HAVE_COMPUTED_GOTO
+/* Runs the DBM using direct-threaded code.
+ *
+ * Each opcode has its own label (and its own indirect jump to the next
+ * instruction), and calls its handler directly. The address of each
+ * instruction's label is stored in the predecoded program, so dispatching
+ * an instruction doesn't involve looking up the dispatch table.
+ *
+ * A few small, frequent instructions also have a fast path that runs them
+ * inline, using the register and jump operands resolved by
+ * chidb_stmt_resolve. The fast path only handles the common case (e.g.,
+ * integer operands), and falls back to the instruction handler otherwise,
+ * so errors are still reported by the handler. */
+static int chidb_stmt_exec_threaded(chidb_stmt *stmt)
+{
+#define THREADED_LABEL(OP) [Op_ ## OP] = &&op_ ## OP,
+    static const void *labels[] =
+    {
+        FOREACH_OP(THREADED_LABEL)
+        [Op_Halt + 1] = &&end
+    };
+
+    static const void *fast[Op_Halt + 1] =
+    {
+        [Op_Copy]         = &&fast_Copy,
+        [Op_SCopy]        = &&fast_Copy,
+        [Op_IfPos]        = &&fast_IfPos,
+        [Op_DecrJumpZero] = &&fast_DecrJumpZero,
+        [Op_Add]          = &&fast_Add,
+        [Op_Subtract]     = &&fast_Subtract,
+    };
+
+    chidb_dbm_insn_t *insn;
+    uint64_t nSteps = 0;
+    int rc = CHIDB_OK;
+
+    if (stmt->code == NULL)
+    {
+        rc = chidb_stmt_predecode(stmt, labels, fast);
+        if (rc != CHIDB_OK)
+            return rc;
+    }
+
+#define DISPATCH()                           \
+    do                                       \
+    {                                        \
+        insn = &stmt->code[stmt->pc++];      \
+        nSteps++;                            \
+        goto *insn->label;                   \
+    } while(0)
+
+#define JUMP(to)                             \
+    do                                       \
+    {                                        \
+        stmt->pc = (to) - stmt->code;        \
+        DISPATCH();                          \
+    } while(0)
+
+#define THREADED_HANDLER(OP)                         \
+    op_ ## OP:                                       \
+        rc = chidb_dbm_op_ ## OP (stmt, insn->op);   \
+        if (rc != CHIDB_OK)                          \
+            goto done;                               \
+        DISPATCH();
+
+/* Runs Add or Subtract inline if both operands are integers and the
+ * result fits in 32 bits (see arith in dbm-ops.c) */
+#define FAST_ARITH(OP, EXPR)                                                     \
+    fast_ ## OP:                                                                 \
+        if (insn->r1 != NULL && insn->r2 != NULL && insn->r3 != NULL &&          \
+            insn->r1->type == REG_INT32 && insn->r2->type == REG_INT32)          \
+        {                                                                        \
+            int64_t v = (int64_t) insn->r1->value.i EXPR insn->r2->value.i;     \
+            if (v >= INT32_MIN && v <= INT32_MAX && insn->r3->type == REG_INT32) \
+            {                                                                    \
+                insn->r3->value.i = (int32_t) v;                                 \
+                DISPATCH();                                                      \
+            }                                                                    \
+        }                                                                        \
+        goto op_ ## OP;
+
+    if (stmt->pc >= stmt->endOp)
+        return CHIDB_OK;
+
+    DISPATCH();
+
+    FOREACH_OP(THREADED_HANDLER)
+
+fast_Copy:
+    if (insn->r1 != NULL && insn->r2 != NULL && insn->r1->type == REG_INT32)
+    {
+        chidb_dbm_reg_set_int(insn->r2, insn->r1->value.i);
+        DISPATCH();
+    }
+    goto *labels[insn->op->opcode];
+
+fast_IfPos:
+    if (insn->r1 != NULL && insn->target != NULL && insn->r1->type == REG_INT32)
+    {
+        if (insn->r1->value.i > 0)
+        {
+            insn->r1->value.i -= insn->op->p3;
+            JUMP(insn->target);
+        }
+        DISPATCH();
+    }
+    goto op_IfPos;
+
+fast_DecrJumpZero:
+    if (insn->r1 != NULL && insn->target != NULL && insn->r1->type == REG_INT32)
+    {
+        if (--insn->r1->value.i == 0)
+            JUMP(insn->target);
+        DISPATCH();
+    }
+    goto op_DecrJumpZero;
+
+    FAST_ARITH(Add, +)
+    FAST_ARITH(Subtract, -)
+
+end:
+    /* Reached the end of the program (the sentinel instruction) */
+    stmt->pc--;
+    nSteps--;
+
+done:
+    stmt->nSteps += nSteps;
+
+    return rc;
+}
+#endif
 
 
 /* Run the DBM
@@ -197,18 +721,30 @@ int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
  */
 int chidb_stmt_exec(chidb_stmt *stmt)
 {
-    int rc = CHIDB_OK;
+    int rc;
 
-    while(stmt->pc < stmt->endOp)
+    /* Once the program has run for long enough, try to compile it to
+     * native code. If it can't be compiled, we just keep interpreting it. */
+    if (stmt->jit == NULL && !stmt->jitFailed && stmt->jitThreshold > 0 &&
+        stmt->nSteps >= stmt->jitThreshold)
     {
-        chidb_dbm_op_t *op = &stmt->ops[stmt->pc++];
-        rc = chidb_dbm_op_handle(stmt, op);
-
-        if (rc != CHIDB_OK)
-            break;
+        if (chidb_dbm_jit_compile(stmt) != CHIDB_OK)
+            stmt->jitFailed = true;
     }
 
-    assert(stmt->nRR == stmt->nCols);
+    if (stmt->jit != NULL)
+        rc = chidb_dbm_jit_run(stmt);
+    else
+#ifdef HAVE_COMPUTED_GOTO
+    if (stmt->threaded)
+        rc = chidb_stmt_exec_threaded(stmt);
+    else
+#endif
+        rc = chidb_stmt_exec_table(stmt);
+
+    /* A program that produces no rows (e.g., a SELECT with no matching
+     * rows) never sets nRR, so this can only be checked for actual rows */
+    assert(rc != CHIDB_ROW || stmt->nRR == stmt->nCols);
 
     if (rc == CHIDB_OK || rc == CHIDB_DONE)
         rc = CHIDB_DONE;
@@ -216,6 +752,71 @@ int chidb_stmt_exec(chidb_stmt *stmt)
     return rc;
 }
 
+/* Reset a DBM
+ *
+ * Resets a DBM to the state it was in before it was first run, so it
+ * can be run again: the program counter goes back to the first
+ * instruction, any open cursors, batch scans, hash tables, sorters,
+ * aggregators, value lists and key scans are closed, and all registers become
+ * unspecified. The program itself (including its predecoded and compiled
+ * versions) is kept.
+ *
+ * Parameters
+ * - stmt: DBM to reset
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - Any error code returned by the Close instruction handler
+ */
+int chidb_stmt_reset(chidb_stmt *stmt)
+{
+    int rc = CHIDB_OK;
+
+    for(int i=0; i < stmt->nCursors; i++)
+    {
+        if (stmt->cursors[i].type != CURSOR_UNSPECIFIED)
+        {
+            chidb_dbm_op_t close = {Op_Close, i, 0, 0, NULL};
+
+            if (rc == CHIDB_OK)
+                rc = chidb_dbm_op_Close(stmt, &close);
+
+            stmt->cursors[i].type = CURSOR_UNSPECIFIED;
+        }
+    }
+
+    for(int i=0; i < stmt->nBatches; i++)
+    {
+        if (stmt->batches[i].open)
+            chidb_dbm_batch_close(&stmt->batches[i]);
+    }
+
+    for(int i=0; i < stmt->nHashes; i++)
+        chidb_dbm_hash_close(&stmt->hashes[i]);
+
+    for(int i=0; i < stmt->nSorters; i++)
+        chidb_dbm_sorter_close(&stmt->sorters[i]);
+
+    for(int i=0; i < stmt->nAggs; i++)
+        chidb_dbm_agg_close(&stmt->aggs[i]);
+
+    for(int i=0; i < stmt->nLists; i++)
+        chidb_dbm_list_close(&stmt->lists[i]);
+
+    for(int i=0; i < stmt->nKeyScans; i++)
+        chidb_dbm_key_close(&stmt->keyScans[i]);
+
+    /* Registers keep their buffers, so they can be reused */
+    for(int i=0; i < stmt->nReg; i++)
+        stmt->reg[i].type = REG_UNSPECIFIED;
+
+    stmt->pc = 0;
+    stmt->startRR = 0;
+    stmt->nRR = 0;
+
+    return rc;
+}
+
 /* Prints a human-readable representation of an instruction */
 int chidb_stmt_op_print(chidb_dbm_op_t *op)
 {
@@ -386,13 +987,20 @@ int realloc_reg(chidb_stmt *stmt, uint32_t size)
     if(stmt->reg == NULL)
         return CHIDB_ENOMEM;
 
+    /* Values stored inline have moved along with their registers */
+    for(int i=0; i < stmt->nReg && i < size; i++)
+        chidb_dbm_reg_relocate(&stmt->reg[i]);
+
     for(int i=stmt->nReg; i < size; i++)
     {
-        stmt->reg[i].type = REG_UNSPECIFIED;
+        chidb_dbm_reg_init(&stmt->reg[i]);
     }
 
     stmt->nReg = size;
 
+    /* The registers may have moved */
+    chidb_stmt_resolve(stmt);
+
     return CHIDB_OK;
 }
 
@@ -414,3 +1022,74 @@ int realloc_cur(chidb_stmt *stmt, uint32_t size)
     return CHIDB_OK;
 }
 
+
+/* Predecodes the program. "labels" contains the address, in the
+ * threaded interpreter, of the code for each opcode, and "fast" the
+ * address of its fast path (NULL if it doesn't have one). */
+static int chidb_stmt_predecode(chidb_stmt *stmt, const void **labels, const void **fast)
+{
+    /* The program is followed by a sentinel instruction that ends
+     * the execution (since jumps can only be to valid addresses, the
+     * interpreter can only get past the last instruction by reaching
+     * the sentinel) */
+    stmt->code = malloc(sizeof(chidb_dbm_insn_t) * (stmt->endOp + 1));
+    if(stmt->code == NULL)
+        return CHIDB_ENOMEM;
+
+    for(int i=0; i < stmt->endOp; i++)
+    {
+        opcode_t opcode = stmt->ops[i].opcode;
+
+        stmt->code[i].label = fast[opcode] != NULL? fast[opcode] : labels[opcode];
+        stmt->code[i].op = &stmt->ops[i];
+    }
+
+    stmt->code[stmt->endOp].label = labels[Op_Halt + 1];
+    stmt->code[stmt->endOp].op = NULL;
+
+    chidb_stmt_resolve(stmt);
+
+    return CHIDB_OK;
+}
+
+
+/* Resolves a single operand of an instruction */
+static void *resolve_operand(chidb_stmt *stmt, uint8_t kind, int32_t p, uint8_t want)
+{
+    if(kind != want)
+        return NULL;
+
+    switch(kind)
+    {
+    case OPND_REG:
+        return EXISTS_REGISTER(stmt, p)? &stmt->reg[p] : NULL;
+    case OPND_ADDR:
+        return IS_VALID_ADDRESS(stmt, p)? &stmt->code[p] : NULL;
+    }
+
+    return NULL;
+}
+
+
+/* Resolves the register and jump operands of the predecoded program
+ * (if there is one) to pointers. This has to be done again whenever
+ * the registers are reallocated. Cursor operands are not resolved,
+ * since cursor instructions always go through their handlers. */
+static void chidb_stmt_resolve(chidb_stmt *stmt)
+{
+    if(stmt->code == NULL)
+        return;
+
+    for(int i=0; i < stmt->endOp; i++)
+    {
+        chidb_dbm_insn_t *insn = &stmt->code[i];
+        chidb_dbm_op_t *op = insn->op;
+        uint8_t opnds = op_operands[op->opcode];
+
+        insn->r1 = resolve_operand(stmt, OPERAND_KIND(opnds, 1), op->p1, OPND_REG);
+        insn->r2 = resolve_operand(stmt, OPERAND_KIND(opnds, 2), op->p2, OPND_REG);
+        insn->r3 = resolve_operand(stmt, OPERAND_KIND(opnds, 3), op->p3, OPND_REG);
+        insn->target = resolve_operand(stmt, OPERAND_KIND(opnds, 2), op->p2, OPND_ADDR);
+    }
+}
+
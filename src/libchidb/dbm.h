@@ -46,10 +46,22 @@
 
 int chidb_stmt_init(chidb_stmt *stmt, chidb *db);
 int chidb_stmt_free(chidb_stmt *stmt);
+int chidb_stmt_set_params(chidb_stmt *stmt, uint32_t nParams);
+int chidb_stmt_clear_params(chidb_stmt *stmt);
+int chidb_stmt_alloc_regs(chidb_stmt *stmt, uint32_t n, int32_t *first);
+int chidb_stmt_alloc_cursor(chidb_stmt *stmt, int32_t *cursor);
 int chidb_stmt_set_op(chidb_stmt *stmt, chidb_dbm_op_t *op, uint32_t pos);
+int chidb_stmt_peephole(chidb_stmt *stmt);
 int chidb_stmt_exec(chidb_stmt *stmt);
+int chidb_stmt_reset(chidb_stmt *stmt);
 char* chidb_stmt_rr_str(chidb_stmt *stmt, char sep);
 int chidb_stmt_rr_print(chidb_stmt *stmt, char sep);
 int chidb_stmt_print(chidb_stmt *stmt);
 
+/* Instruction handlers. See dbm-ops.c for details */
+int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
+
+#define HANDLER_PROTOTYPE(OP) int chidb_dbm_op_## OP (chidb_stmt *stmt, chidb_dbm_op_t *op);
+FOREACH_OP(HANDLER_PROTOTYPE)
+
 #endif /* DBM_H_ */
@@ -0,0 +1,360 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module contains functions to manipulate dictionaries, which are
+ * used to store low-cardinality TEXT columns in a compact form. Instead
+ * of storing the same string in every record, a dictionary-encoded
+ * column stores a small integer code, and the string for each code is
+ * stored only once, in the dictionary.
+ *
+ * Each dictionary-encoded table has its own dictionary, which is stored
+ * in a table B-Tree (listed in the schema table with type "dictionary"
+ * and the name of the table it belongs to). The TEXT columns of that
+ * table that are declared with DICTIONARY (e.g., "status TEXT DICTIONARY")
+ * are encoded with it, and the table's dictionary is created along with
+ * the table if it has any such columns. Codes start at 1 and are never reused, so
+ * the code 0 can be used to represent a string that is not in the
+ * dictionary (and, thus, can't be equal to any value in the table).
+ *
+ * Since codes are just integers, the DBM can compare them like any other
+ * integer. The code generator compares an encoded column with a constant
+ * by encoding the constant (once, before the loops) and, if that is all
+ * the column is used for, never decodes it. A GROUP BY column (or a
+ * column of a DISTINCT) is grouped by its codes, which are only decoded
+ * in the rows of the aggregator. Otherwise, the column is decoded right
+ * after it is loaded (see the DictEncode and DictDecode instructions,
+ * cg_load_column and cg_agg_row). Codes are assigned in order of first
+ * insertion, so they are not ordered like the strings: an encoded column
+ * in an ORDER BY, or compared with anything other than a constant for
+ * equality, is decoded.
+ *
+ * Encoded columns can't be indexed (CREATE INDEX on one is rejected).
+ * This is a deliberate limitation: an index on the codes would only
+ * support equality lookups, and would not be ordered like the values,
+ * so the code generator couldn't use it for ranges or for sorted scans,
+ * which assume that the entries of an index are ordered by value.
+ *
+ * Dictionaries are small, so the first time a dictionary is used, it is
+ * loaded in its entirety into memory, and kept there until the database
+ * is closed.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <chidb/log.h>
+#include "chidbInt.h"
+#include "dict.h"
+#include "btree.h"
+#include "record.h"
+
+#define DICT_DEFAULT_HASH_SIZE (64)
+
+static int chidb_Dict_load(BTree *bt, npage_t npage, Dict *dict);
+static int chidb_Dict_add(Dict *dict, uint32_t code, char *s);
+
+
+/* FNV-1a hash of a string */
+static uint32_t chidb_Dict_hashString(const char *s)
+{
+    uint32_t h = 2166136261U;
+
+    while (*s)
+        h = (h ^ (uint8_t) *s++) * 16777619U;
+
+    return h;
+}
+
+/* Returns the bucket where string s is (or where it would be inserted) */
+static uint32_t chidb_Dict_findBucket(Dict *dict, const char *s)
+{
+    uint32_t mask = dict->hash_size - 1;
+    uint32_t b = chidb_Dict_hashString(s) & mask;
+
+    while (dict->hash[b] != 0 && strcmp(dict->strings[dict->hash[b]], s) != 0)
+        b = (b + 1) & mask;
+
+    return b;
+}
+
+
+/* Get a dictionary
+ *
+ * Returns the in-memory copy of the dictionary stored in the table
+ * B-Tree rooted at nroot, loading it from the file if this is the
+ * first time it is used.
+ *
+ * Parameters
+ * - db: chidb database
+ * - nroot: Root page of the dictionary's table B-Tree
+ * - dict: Out parameter. Used to return a pointer to the dictionary.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Dict_get(chidb *db, npage_t nroot, Dict **dict)
+{
+    Dict **dicts;
+    int rc;
+
+    for(int i = 0; i < db->nDicts; i++)
+        if (db->dicts[i]->nroot == nroot)
+        {
+            *dict = db->dicts[i];
+            return CHIDB_OK;
+        }
+
+    dicts = realloc(db->dicts, (db->nDicts + 1) * sizeof(Dict *));
+    if (dicts == NULL)
+        return CHIDB_ENOMEM;
+    db->dicts = dicts;
+
+    *dict = malloc(sizeof(Dict));
+    if (*dict == NULL)
+        return CHIDB_ENOMEM;
+    (*dict)->nroot = nroot;
+    (*dict)->strings = NULL;
+    (*dict)->max_code = 0;
+    (*dict)->hash_size = DICT_DEFAULT_HASH_SIZE;
+    (*dict)->hash = calloc((*dict)->hash_size, sizeof(uint32_t));
+    if ((*dict)->hash == NULL)
+    {
+        free(*dict);
+        return CHIDB_ENOMEM;
+    }
+
+    rc = chidb_Dict_load(db->bt, nroot, *dict);
+    if (rc != CHIDB_OK)
+    {
+        for(uint32_t code = 1; code <= (*dict)->max_code; code++)
+            free((*dict)->strings[code]);
+        free((*dict)->strings);
+        free((*dict)->hash);
+        free(*dict);
+        return rc;
+    }
+
+    db->dicts[db->nDicts++] = *dict;
+
+    chilog(DEBUG, "Loaded dictionary rooted at page %i (%i strings)", nroot, (*dict)->max_code);
+
+    return CHIDB_OK;
+}
+
+
+/* Encode a string
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - dict: Dictionary
+ * - s: String to encode
+ * - add: If the string is not in the dictionary, add it (both to the
+ *        in-memory copy and to the dictionary's B-Tree)
+ * - code: Out parameter. Used to return the code of the string. If the
+ *         string is not in the dictionary, and add is false, the code is 0.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Dict_encode(BTree *bt, Dict *dict, const char *s, bool add, uint32_t *code)
+{
+    DBRecordBuffer dbrb;
+    DBRecord *dbr;
+    uint8_t *data;
+    char *sdup;
+    int rc;
+
+    *code = dict->hash[chidb_Dict_findBucket(dict, s)];
+
+    if (*code != 0 || !add)
+        return CHIDB_OK;
+
+    *code = dict->max_code + 1;
+
+    sdup = strdup(s);
+    if (sdup == NULL)
+        return CHIDB_ENOMEM;
+
+    chidb_DBRecord_create_empty(&dbrb, 1);
+    chidb_DBRecord_appendString(&dbrb, sdup);
+    chidb_DBRecord_finalize(&dbrb, &dbr);
+    rc = chidb_DBRecord_pack(dbr, &data);
+    if (rc == CHIDB_OK)
+        rc = chidb_Btree_insertInTable(bt, dict->nroot, *code, data, dbr->packed_len);
+    chidb_DBRecord_destroy(dbr);
+    free(data);
+
+    if (rc != CHIDB_OK)
+    {
+        free(sdup);
+        return rc;
+    }
+
+    return chidb_Dict_add(dict, *code, sdup);
+}
+
+
+/* Decode a string
+ *
+ * Parameters
+ * - dict: Dictionary
+ * - code: Code to decode
+ * - s: Out parameter. Used to return the string with that code. The
+ *      string belongs to the dictionary, and must not be modified or freed.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no string with that code
+ */
+int chidb_Dict_decode(Dict *dict, uint32_t code, const char **s)
+{
+    if (code == 0 || code > dict->max_code || dict->strings[code] == NULL)
+        return CHIDB_ENOTFOUND;
+
+    *s = dict->strings[code];
+
+    return CHIDB_OK;
+}
+
+
+/* Free all the dictionaries that have been loaded into memory
+ *
+ * Parameters
+ * - db: chidb database
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Dict_freeAll(chidb *db)
+{
+    for(int i = 0; i < db->nDicts; i++)
+    {
+        Dict *dict = db->dicts[i];
+
+        for(uint32_t code = 1; code <= dict->max_code; code++)
+            free(dict->strings[code]);
+        free(dict->strings);
+        free(dict->hash);
+        free(dict);
+    }
+
+    free(db->dicts);
+    db->dicts = NULL;
+    db->nDicts = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Adds a string to the in-memory copy of a dictionary (the dictionary
+ * takes ownership of the string) */
+static int chidb_Dict_add(Dict *dict, uint32_t code, char *s)
+{
+    if (code > dict->max_code)
+    {
+        char **strings = realloc(dict->strings, (code + 1) * sizeof(char *));
+        if (strings == NULL)
+            return CHIDB_ENOMEM;
+        memset(&strings[dict->max_code + 1], 0, (code - dict->max_code) * sizeof(char *));
+        dict->strings = strings;
+        dict->max_code = code;
+    }
+    dict->strings[code] = s;
+
+    /* Keep the hash table at most half full */
+    if (2 * code > dict->hash_size)
+    {
+        uint32_t *old = dict->hash, old_size = dict->hash_size;
+
+        dict->hash_size *= 2;
+        dict->hash = calloc(dict->hash_size, sizeof(uint32_t));
+        if (dict->hash == NULL)
+            return CHIDB_ENOMEM;
+
+        for(uint32_t i = 0; i < old_size; i++)
+            if (old[i] != 0)
+                dict->hash[chidb_Dict_findBucket(dict, dict->strings[old[i]])] = old[i];
+        free(old);
+    }
+
+    dict->hash[chidb_Dict_findBucket(dict, s)] = code;
+
+    return CHIDB_OK;
+}
+
+
+/* Loads all the entries in a dictionary's B-Tree into memory */
+static int chidb_Dict_load(BTree *bt, npage_t npage, Dict *dict)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    DBRecord *dbr;
+    char *s;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+
+        if (btn->type == PGTYPE_TABLE_LEAF)
+        {
+            rc = chidb_DBRecord_unpack(&dbr, btc.fields.tableLeaf.data);
+            if (rc != CHIDB_OK)
+                break;
+            rc = chidb_DBRecord_getString(dbr, 0, &s);
+            chidb_DBRecord_destroy(dbr);
+            if (rc == CHIDB_OK)
+                rc = chidb_Dict_add(dict, btc.key, s);
+        }
+        else
+            rc = chidb_Dict_load(bt, btc.fields.tableInternal.child_page, dict);
+    }
+
+    if (rc == CHIDB_OK && btn->type == PGTYPE_TABLE_INTERNAL)
+        rc = chidb_Dict_load(bt, btn->right_page, dict);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
@@ -0,0 +1,63 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Dictionaries for dictionary-encoded TEXT values
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DICT_H_
+#define DICT_H_
+
+#include "chidbInt.h"
+#include "btree.h"
+
+/* In-memory copy of a dictionary. The dictionary itself is stored in a
+ * table B-Tree, where the key of each entry is a code, and its data is
+ * a record with a single TEXT field (the string with that code). */
+struct Dict
+{
+    npage_t nroot;        /* Root page of the dictionary's table B-Tree */
+    char **strings;       /* String with code i is strings[i] (or NULL) */
+    uint32_t max_code;    /* Largest code in the dictionary */
+    uint32_t *hash;       /* Open-addressing hash table of codes, keyed by string */
+    uint32_t hash_size;   /* Number of buckets (a power of two) */
+};
+
+int chidb_Dict_get(chidb *db, npage_t nroot, Dict **dict);
+int chidb_Dict_encode(BTree *bt, Dict *dict, const char *s, bool add, uint32_t *code);
+int chidb_Dict_decode(Dict *dict, uint32_t code, const char **s);
+int chidb_Dict_freeAll(chidb *db);
+
+#endif /*DICT_H_*/
@@ -0,0 +1,704 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module contains functions to manipulate key B-Trees: B-Trees
+ * whose keys are strings of bytes, compared with memcmp (a key that is a
+ * prefix of another one is the lower of the two). They are used where
+ * the 32-bit keys of table and index B-Trees are not enough: the key of
+ * an entry of an index on several columns is the encoding of its values
+ * followed by the row's primary key (see dbm-key.c), and a spilled hash
+ * table is indexed by the hash value and number of its entries (see
+ * dbm-hash.c).
+ *
+ * A key B-Tree only has keys, which are unique, and all of them are in
+ * its leaf nodes. Each cell of an internal node has a key and a child
+ * page, with the keys that are not greater than it (and greater than the
+ * key of the previous cell), and the right page has the keys that are
+ * greater than all of them. The pages have the same header as B-Tree
+ * pages (with the types PGTYPE_KEY_INTERNAL and PGTYPE_KEY_LEAF), and
+ * their cells are:
+ *
+ *  - Leaf cell: length of the key (2 bytes), key
+ *  - Internal cell: child page (4 bytes), length of the key (2 bytes), key
+ *
+ * A node that is full is split in two halves of about the same size: the
+ * first half is moved to a new node, and the last key in it is added to
+ * the parent (with the new node as its child). The root node is never
+ * moved, since its page is the one recorded in the schema: when it is
+ * split, both halves are moved to new nodes. A key can take up to a
+ * quarter of a page (see chidb_KeyTree_maxKey), so both halves always fit.
+ *
+ * The nodes are read and written directly with the Pager.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "keytree.h"
+#include "util.h"
+
+
+/* A node of a key B-Tree, as read from its page */
+typedef struct keytree_node
+{
+    MemPage *page;
+    uint8_t type;
+    ncell_t n_cells;
+    npage_t right_page;     /* Right page (internal nodes only) */
+} keytree_node_t;
+
+/* A cell of a node (its key may be anywhere in memory) */
+typedef struct keytree_cell
+{
+    const uint8_t *key;
+    uint16_t len;
+    npage_t child;          /* Child page (internal nodes only) */
+} keytree_cell_t;
+
+/* Offset of the cell offset array of a node, and size of a cell */
+#define KEYTREE_CELLS_OFFSET(type) \
+    ((type) == PGTYPE_KEY_INTERNAL ? INTPG_CELLSOFFSET_OFFSET : LEAFPG_CELLSOFFSET_OFFSET)
+#define KEYTREE_CELL_SIZE(type, len) \
+    (((type) == PGTYPE_KEY_INTERNAL ? KEYINTCELL_KEY_OFFSET : KEYLEAFCELL_KEY_OFFSET) + (len))
+
+
+/* Compares two keys, like memcmp */
+static int chidb_KeyTree_cmp(const uint8_t *a, uint16_t alen, const uint8_t *b, uint16_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+
+    return c != 0 ? c : (alen > blen) - (alen < blen);
+}
+
+
+/* Parses the header of a node's page */
+static int chidb_KeyTree_parse(MemPage *page, keytree_node_t *node)
+{
+    uint8_t *data = page->data;
+
+    node->page = page;
+    node->type = data[PGHEADER_PGTYPE_OFFSET];
+    node->n_cells = get2byte(&data[PGHEADER_NCELLS_OFFSET]);
+    node->right_page = 0;
+
+    if (node->type == PGTYPE_KEY_INTERNAL)
+        node->right_page = get4byte(&data[PGHEADER_RIGHTPG_OFFSET]);
+    else if (node->type != PGTYPE_KEY_LEAF)
+        return CHIDB_EMISMATCH;
+
+    return CHIDB_OK;
+}
+
+
+/* Reads a node from its page */
+static int chidb_KeyTree_read(BTree *bt, npage_t npage, keytree_node_t *node)
+{
+    MemPage *page;
+    int rc;
+
+    if ((rc = chidb_Pager_readPage(bt->pager, npage, &page)) != CHIDB_OK)
+        return rc;
+
+    if ((rc = chidb_KeyTree_parse(page, node)) != CHIDB_OK)
+        chidb_Pager_releaseMemPage(bt->pager, page);
+
+    return rc;
+}
+
+
+/* Cell ncell of a node */
+static void chidb_KeyTree_cell(keytree_node_t *node, ncell_t ncell, keytree_cell_t *cell)
+{
+    uint8_t *data = node->page->data;
+    uint8_t *c = &data[get2byte(&data[KEYTREE_CELLS_OFFSET(node->type) + 2 * ncell])];
+
+    if (node->type == PGTYPE_KEY_INTERNAL)
+    {
+        cell->child = get4byte(&c[KEYINTCELL_CHILD_OFFSET]);
+        cell->len = get2byte(&c[KEYINTCELL_LEN_OFFSET]);
+        cell->key = &c[KEYINTCELL_KEY_OFFSET];
+    }
+    else
+    {
+        cell->child = 0;
+        cell->len = get2byte(&c[KEYLEAFCELL_LEN_OFFSET]);
+        cell->key = &c[KEYLEAFCELL_KEY_OFFSET];
+    }
+}
+
+
+/* Returns the first cell of a node whose key is not lower than key (or
+ * n_cells, if there is none), and whether its key is key itself. The
+ * cells are in order of their keys, so this is a binary search */
+static ncell_t chidb_KeyTree_find(keytree_node_t *node, const uint8_t *key, uint16_t len, bool *equal)
+{
+    ncell_t lo = 0, hi = node->n_cells;
+    keytree_cell_t cell;
+
+    *equal = false;
+
+    while (lo < hi)
+    {
+        ncell_t mid = lo + (hi - lo) / 2;
+        int c;
+
+        chidb_KeyTree_cell(node, mid, &cell);
+        c = chidb_KeyTree_cmp(cell.key, cell.len, key, len);
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+        {
+            hi = mid;
+            *equal = c == 0;
+        }
+    }
+
+    return lo;
+}
+
+
+/* Do some cells fit in a node? */
+static bool chidb_KeyTree_fits(BTree *bt, uint8_t type, keytree_cell_t *cells, ncell_t n)
+{
+    uint32_t size = KEYTREE_CELLS_OFFSET(type);
+
+    for(ncell_t i = 0; i < n; i++)
+        size += 2 + KEYTREE_CELL_SIZE(type, cells[i].len);
+
+    return size <= bt->pager->page_size;
+}
+
+
+/* Writes a node with the given cells to a page. The node is built in a
+ * scratch buffer first, since the cells may be in the page itself */
+static int chidb_KeyTree_write(BTree *bt, MemPage *page, uint8_t type, keytree_cell_t *cells, ncell_t n,
+                               npage_t right_page, uint8_t *scratch)
+{
+    uint16_t page_size = bt->pager->page_size, offset = page_size;
+    uint16_t cells_offset = KEYTREE_CELLS_OFFSET(type);
+
+    memset(scratch, 0, page_size);
+    scratch[PGHEADER_PGTYPE_OFFSET] = type;
+    put2byte(&scratch[PGHEADER_FREE_OFFSET], cells_offset + 2 * n);
+    put2byte(&scratch[PGHEADER_NCELLS_OFFSET], n);
+    if (type == PGTYPE_KEY_INTERNAL)
+        put4byte(&scratch[PGHEADER_RIGHTPG_OFFSET], right_page);
+
+    /* The cells go at the end of the page, the first one last */
+    for(ncell_t i = 0; i < n; i++)
+    {
+        uint8_t *c;
+
+        offset -= KEYTREE_CELL_SIZE(type, cells[i].len);
+        c = &scratch[offset];
+
+        if (type == PGTYPE_KEY_INTERNAL)
+        {
+            put4byte(&c[KEYINTCELL_CHILD_OFFSET], cells[i].child);
+            put2byte(&c[KEYINTCELL_LEN_OFFSET], cells[i].len);
+            memcpy(&c[KEYINTCELL_KEY_OFFSET], cells[i].key, cells[i].len);
+        }
+        else
+        {
+            put2byte(&c[KEYLEAFCELL_LEN_OFFSET], cells[i].len);
+            memcpy(&c[KEYLEAFCELL_KEY_OFFSET], cells[i].key, cells[i].len);
+        }
+
+        put2byte(&scratch[cells_offset + 2 * i], offset);
+    }
+    put2byte(&scratch[PGHEADER_CELL_OFFSET], offset);
+
+    memcpy(page->data, scratch, page_size);
+
+    return chidb_Pager_writePage(bt->pager, page);
+}
+
+
+/* Allocates a page for a new node */
+static int chidb_KeyTree_newPage(BTree *bt, MemPage **page)
+{
+    npage_t npage;
+    int rc;
+
+    if ((rc = chidb_Pager_allocatePage(bt->pager, &npage)) != CHIDB_OK)
+        return rc;
+
+    return chidb_Pager_readPage(bt->pager, npage, page);
+}
+
+
+/* Create a key B-Tree
+ *
+ * Creates an empty key B-Tree: a root node that is an empty leaf.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Out parameter. Used to return the page number of the root node.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_KeyTree_create(BTree *bt, npage_t *nroot)
+{
+    uint8_t *scratch = malloc(bt->pager->page_size);
+    MemPage *page;
+    int rc;
+
+    if (scratch == NULL)
+        return CHIDB_ENOMEM;
+
+    if ((rc = chidb_KeyTree_newPage(bt, &page)) == CHIDB_OK)
+    {
+        rc = chidb_KeyTree_write(bt, page, PGTYPE_KEY_LEAF, NULL, 0, 0, scratch);
+        *nroot = page->npage;
+        chidb_Pager_releaseMemPage(bt->pager, page);
+    }
+
+    free(scratch);
+
+    return rc;
+}
+
+
+/* Maximum length of a key
+ *
+ * A cell (and its entry in the cell offset array) can take up to a
+ * quarter of the space of a node, so that the two halves of a node
+ * that is split always fit in a page.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ *
+ * Return
+ * - The maximum length of a key, in bytes
+ */
+uint16_t chidb_KeyTree_maxKey(BTree *bt)
+{
+    return (bt->pager->page_size - INTPG_CELLSOFFSET_OFFSET) / 4 - 2 - KEYINTCELL_KEY_OFFSET;
+}
+
+
+/* Returns the cell where a node that is split in two is divided: the
+ * cells before it go to the first half, and they take up about half of
+ * the size of all the cells (there is at least one cell in each half) */
+static ncell_t chidb_KeyTree_splitPoint(uint8_t type, keytree_cell_t *cells, ncell_t n)
+{
+    uint32_t total = 0, size = 0;
+    ncell_t m;
+
+    for(ncell_t i = 0; i < n; i++)
+        total += 2 + KEYTREE_CELL_SIZE(type, cells[i].len);
+
+    for(m = 0; m < n - 1 && size < total / 2; m++)
+        size += 2 + KEYTREE_CELL_SIZE(type, cells[m].len);
+
+    return m > 0 ? m : 1;
+}
+
+
+/* Insert a key into a key B-Tree
+ *
+ * The key goes into the leaf where it belongs. If it doesn't fit, the
+ * leaf is split, and the last key of its first half goes into the parent,
+ * which may have to be split as well, and so on up to the root.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the key B-Tree
+ * - key: Key
+ * - len: Length of the key, in bytes
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: The key is already in the B-Tree
+ * - CHIDB_ECONSTRAINT: The key is longer than chidb_KeyTree_maxKey
+ * - CHIDB_EMISMATCH: The B-Tree is not a key B-Tree
+ * - CHIDB_ECORRUPT: The B-Tree is deeper than KEYTREE_MAX_DEPTH
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_KeyTree_insert(BTree *bt, npage_t nroot, const uint8_t *key, uint16_t len)
+{
+    uint16_t page_size = bt->pager->page_size, maxKey = chidb_KeyTree_maxKey(bt);
+    keytree_node_t path[KEYTREE_MAX_DEPTH];
+    ncell_t pos[KEYTREE_MAX_DEPTH];
+    keytree_cell_t *cells, cell = {key, len, 0}, sep;
+    uint8_t *scratch, *seps;
+    npage_t npage = nroot;
+    uint32_t depth = 0;
+    bool equal;
+    int rc = CHIDB_OK;
+
+    if (len > maxKey)
+        return CHIDB_ECONSTRAINT;
+
+    /* The nodes from the root to the leaf where the key goes, and the
+     * cell (or child) of each node that leads to it */
+    while (rc == CHIDB_OK)
+    {
+        keytree_node_t *node = &path[depth];
+        keytree_cell_t c;
+
+        if (depth == KEYTREE_MAX_DEPTH)
+            rc = CHIDB_ECORRUPT;
+        else if ((rc = chidb_KeyTree_read(bt, npage, node)) == CHIDB_OK)
+        {
+            pos[depth++] = chidb_KeyTree_find(node, key, len, &equal);
+
+            if (node->type == PGTYPE_KEY_LEAF)
+            {
+                if (equal)
+                    rc = CHIDB_EDUPLICATE;
+                break;
+            }
+
+            if (pos[depth - 1] < node->n_cells)
+            {
+                chidb_KeyTree_cell(node, pos[depth - 1], &c);
+                npage = c.child;
+            }
+            else
+                npage = node->right_page;
+        }
+    }
+
+    /* A node has at most one cell for every four bytes of its page. The
+     * key that goes up to the parent of a node that is split is copied
+     * to one of two buffers (one for each of two consecutive levels),
+     * since the node's page is overwritten */
+    cells = malloc(sizeof(keytree_cell_t) * (page_size / 4 + 1));
+    scratch = malloc(page_size);
+    seps = malloc(2 * maxKey);
+    if (rc == CHIDB_OK && (cells == NULL || scratch == NULL || seps == NULL))
+        rc = CHIDB_ENOMEM;
+
+    for(uint32_t level = depth; level-- > 0 && rc == CHIDB_OK; )
+    {
+        keytree_node_t *node = &path[level];
+        ncell_t n = node->n_cells + 1, m, first;
+        bool leaf = node->type == PGTYPE_KEY_LEAF;
+        MemPage *left = NULL, *right = NULL;
+
+        for(ncell_t i = 0, j = 0; i < n; i++)
+            if (i == pos[level])
+                cells[i] = cell;
+            else
+                chidb_KeyTree_cell(node, j++, &cells[i]);
+
+        if (chidb_KeyTree_fits(bt, node->type, cells, n))
+        {
+            rc = chidb_KeyTree_write(bt, node->page, node->type, cells, n, node->right_page, scratch);
+            break;
+        }
+
+        /* In a leaf, the last key of the first half goes up to the parent
+         * (and stays in the leaf). In an internal node, the first cell
+         * after the first half goes up, and its child becomes the right
+         * page of the first half */
+        m = chidb_KeyTree_splitPoint(node->type, cells, n);
+        sep = cells[leaf ? m - 1 : m];
+        first = leaf ? m : m + 1;
+        memcpy(&seps[(level % 2) * maxKey], sep.key, sep.len);
+        sep.key = &seps[(level % 2) * maxKey];
+
+        if ((rc = chidb_KeyTree_newPage(bt, &left)) == CHIDB_OK)
+            rc = chidb_KeyTree_write(bt, left, node->type, cells, m, leaf ? 0 : cells[m].child, scratch);
+
+        if (rc == CHIDB_OK && level == 0)
+        {
+            /* The root becomes an internal node with the two halves as children */
+            if ((rc = chidb_KeyTree_newPage(bt, &right)) == CHIDB_OK)
+                rc = chidb_KeyTree_write(bt, right, node->type, &cells[first], n - first, node->right_page, scratch);
+            sep.child = left->npage;
+            if (rc == CHIDB_OK)
+                rc = chidb_KeyTree_write(bt, node->page, PGTYPE_KEY_INTERNAL, &sep, 1, right->npage, scratch);
+        }
+        else if (rc == CHIDB_OK)
+        {
+            rc = chidb_KeyTree_write(bt, node->page, node->type, &cells[first], n - first, node->right_page, scratch);
+            sep.child = left->npage;
+            cell = sep;
+        }
+
+        if (left != NULL)
+            chidb_Pager_releaseMemPage(bt->pager, left);
+        if (right != NULL)
+            chidb_Pager_releaseMemPage(bt->pager, right);
+    }
+
+    for(uint32_t i = 0; i < depth; i++)
+        chidb_Pager_releaseMemPage(bt->pager, path[i].page);
+    free(cells);
+    free(scratch);
+    free(seps);
+
+    return rc;
+}
+
+
+/* Positions a scan on the entry given by its path. If the path points
+ * past the last cell of a node, the scan continues with the next child of
+ * the parent node. If there are no more entries, the scan is left with
+ * no current entry */
+static int chidb_KeyTree_load(KeyTreeCursor *kc)
+{
+    keytree_node_t node;
+    keytree_cell_t cell;
+    int rc = CHIDB_OK;
+
+    while (kc->depth > 0 && rc == CHIDB_OK)
+    {
+        uint32_t top = kc->depth - 1;
+        ncell_t ncell = kc->path_cell[top];
+
+        /* The leaf at the top of the path stays in memory */
+        if (kc->leaf != NULL)
+            rc = chidb_KeyTree_parse(kc->leaf, &node);
+        else
+            rc = chidb_KeyTree_read(kc->bt, kc->path_page[top], &node);
+        if (rc != CHIDB_OK)
+            break;
+
+        if (node.type == PGTYPE_KEY_LEAF && ncell < node.n_cells)
+        {
+            chidb_KeyTree_cell(&node, ncell, &cell);
+            kc->leaf = node.page;
+            kc->key = cell.key;
+            kc->len = cell.len;
+            return CHIDB_OK;
+        }
+
+        if (node.type == PGTYPE_KEY_LEAF || ncell > node.n_cells)
+        {
+            /* Done with this node */
+            kc->depth--;
+            if (kc->depth > 0)
+                kc->path_cell[kc->depth - 1]++;
+        }
+        else if (kc->depth == KEYTREE_MAX_DEPTH)
+            rc = CHIDB_ECORRUPT;
+        else
+        {
+            /* The child of the cell (or the right page, after the last cell) */
+            if (ncell < node.n_cells)
+            {
+                chidb_KeyTree_cell(&node, ncell, &cell);
+                kc->path_page[kc->depth] = cell.child;
+            }
+            else
+                kc->path_page[kc->depth] = node.right_page;
+            kc->path_cell[kc->depth] = 0;
+            kc->depth++;
+        }
+
+        chidb_Pager_releaseMemPage(kc->bt->pager, node.page);
+        kc->leaf = NULL;
+    }
+
+    kc->key = NULL;
+    kc->len = 0;
+
+    return rc;
+}
+
+
+/* Position a scan of a key B-Tree on the first key not lower than a key
+ *
+ * The current entry's key is in kc->key (NULL if there is none, because
+ * all the keys in the B-Tree are lower). The scan holds on to a page until
+ * it is closed with chidb_KeyTree_close.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the key B-Tree
+ * - kc: Scan (which may be positioned on an entry already)
+ * - key: Key (an empty key positions the scan on the first entry)
+ * - len: Length of the key, in bytes
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The B-Tree is not a key B-Tree
+ * - CHIDB_ECORRUPT: The B-Tree is deeper than KEYTREE_MAX_DEPTH
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_KeyTree_seek(BTree *bt, npage_t nroot, KeyTreeCursor *kc, const uint8_t *key, uint16_t len)
+{
+    keytree_node_t node;
+    keytree_cell_t cell;
+    npage_t npage = nroot;
+    bool equal;
+    int rc;
+
+    chidb_KeyTree_close(kc);
+    kc->bt = bt;
+    kc->depth = 0;
+
+    while (true)
+    {
+        if (kc->depth == KEYTREE_MAX_DEPTH)
+            return CHIDB_ECORRUPT;
+        if ((rc = chidb_KeyTree_read(bt, npage, &node)) != CHIDB_OK)
+            return rc;
+
+        kc->path_page[kc->depth] = npage;
+        kc->path_cell[kc->depth] = chidb_KeyTree_find(&node, key, len, &equal);
+        kc->depth++;
+
+        if (node.type == PGTYPE_KEY_LEAF)
+            break;
+
+        if (kc->path_cell[kc->depth - 1] < node.n_cells)
+        {
+            chidb_KeyTree_cell(&node, kc->path_cell[kc->depth - 1], &cell);
+            npage = cell.child;
+        }
+        else
+            npage = node.right_page;
+
+        chidb_Pager_releaseMemPage(bt->pager, node.page);
+    }
+
+    kc->leaf = node.page;
+
+    return chidb_KeyTree_load(kc);
+}
+
+
+/* Move a scan of a key B-Tree to the next entry
+ *
+ * Parameters
+ * - kc: Scan. If it has no current entry, it is left as it is.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful (kc->key is NULL if there are no
+ *             more entries)
+ * - CHIDB_ECORRUPT: The B-Tree is deeper than KEYTREE_MAX_DEPTH
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_KeyTree_next(KeyTreeCursor *kc)
+{
+    if (kc->key == NULL)
+        return CHIDB_OK;
+
+    kc->path_cell[kc->depth - 1]++;
+
+    return chidb_KeyTree_load(kc);
+}
+
+
+/* Close a scan of a key B-Tree
+ *
+ * Releases the page held by the scan, which is left with no current
+ * entry (it can be positioned again with chidb_KeyTree_seek).
+ *
+ * Parameters
+ * - kc: Scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_KeyTree_close(KeyTreeCursor *kc)
+{
+    if (kc->leaf != NULL)
+        chidb_Pager_releaseMemPage(kc->bt->pager, kc->leaf);
+
+    kc->leaf = NULL;
+    kc->key = NULL;
+    kc->len = 0;
+    kc->depth = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Collect the statistics of a key B-Tree
+ *
+ * Reads all the nodes of a key B-Tree, like ANALYZE does with the other
+ * B-Trees (see stats.c).
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the key B-Tree
+ * - nEntries: Out parameter. Number of keys.
+ * - nPages: Out parameter. Number of nodes.
+ * - depth: Out parameter. Number of levels.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The B-Tree is not a key B-Tree
+ * - CHIDB_ECORRUPT: The B-Tree is deeper than KEYTREE_MAX_DEPTH
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_KeyTree_stats(BTree *bt, npage_t nroot, uint32_t *nEntries, uint32_t *nPages, uint32_t *depth)
+{
+    keytree_node_t node;
+    keytree_cell_t cell;
+    uint32_t n, p, d;
+    int rc;
+
+    if ((rc = chidb_KeyTree_read(bt, nroot, &node)) != CHIDB_OK)
+        return rc;
+
+    *nEntries = node.type == PGTYPE_KEY_LEAF ? node.n_cells : 0;
+    *nPages = 1;
+    *depth = 1;
+
+    /* The children of each cell, and the right page */
+    for(ncell_t i = 0; i <= node.n_cells && node.type == PGTYPE_KEY_INTERNAL && rc == CHIDB_OK; i++)
+    {
+        if (i < node.n_cells)
+            chidb_KeyTree_cell(&node, i, &cell);
+        else
+            cell.child = node.right_page;
+
+        if ((rc = chidb_KeyTree_stats(bt, cell.child, &n, &p, &d)) == CHIDB_OK)
+        {
+            *nEntries += n;
+            *nPages += p;
+            if (d + 1 > *depth)
+                *depth = d + 1;
+        }
+    }
+
+    chidb_Pager_releaseMemPage(bt->pager, node.page);
+
+    return rc;
+}
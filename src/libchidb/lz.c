@@ -0,0 +1,279 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module contains a small LZ77 codec, used by the pager to store
+ * compressed page images. The compressed format is the same one used
+ * by LZ4 "blocks": a sequence of (literals, match) pairs, where each
+ * pair starts with a token byte. The upper four bits of the token hold
+ * the number of literals, and the lower four bits hold the length of
+ * the match (minus LZ_MINMATCH). When either nibble is 15, the length
+ * continues in the following bytes (each byte is added to the length,
+ * and a byte smaller than 255 ends the length). The literals are then
+ * copied verbatim, and the match is encoded as a two-byte little-endian
+ * offset back into the decompressed output. The last pair in a block
+ * only has literals.
+ *
+ * The compressor uses a single hash table of recent positions, so it
+ * only finds "greedy" matches. This is good enough for database pages,
+ * which tend to have long runs of zeroes and repeated field values.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chidbInt.h"
+#include "lz.h"
+
+#define LZ_MINMATCH (4)
+#define LZ_MFLIMIT (12)        /* No match may start in the last LZ_MFLIMIT bytes */
+#define LZ_LASTLITERALS (5)    /* The last LZ_LASTLITERALS bytes are always literals */
+#define LZ_MAX_OFFSET (65535)
+#define LZ_HASH_BITS (12)
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lz_put_length(uint8_t *op, uint32_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+
+    return op;
+}
+
+static int lz_get_length(const uint8_t **ip, const uint8_t *iend, uint32_t *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= iend)
+            return CHIDB_ECORRUPT;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+
+    return CHIDB_OK;
+}
+
+/* Appends a (literals, match) pair to the output. A matchlen of zero
+ * produces the final, literals-only, pair. Returns NULL if the pair
+ * does not fit in the output buffer. */
+static uint8_t *lz_put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, uint32_t litlen,
+                                uint32_t offset, uint32_t matchlen)
+{
+    uint8_t *token;
+    uint32_t mlcode = matchlen ? matchlen - LZ_MINMATCH : 0;
+
+    if (litlen + litlen / 255 + mlcode / 255 + 5 > oend - op)
+        return NULL;
+
+    token = op++;
+    if (litlen >= 15)
+    {
+        *token = 15 << 4;
+        op = lz_put_length(op, litlen - 15);
+    }
+    else
+        *token = litlen << 4;
+
+    memcpy(op, lit, litlen);
+    op += litlen;
+
+    if (matchlen == 0)
+        return op;
+
+    *op++ = (uint8_t) offset;
+    *op++ = (uint8_t) (offset >> 8);
+
+    if (mlcode >= 15)
+    {
+        *token |= 15;
+        op = lz_put_length(op, mlcode - 15);
+    }
+    else
+        *token |= mlcode;
+
+    return op;
+}
+
+
+/* Compress a buffer
+ *
+ * Parameters
+ * - src: Data to compress
+ * - srclen: Number of bytes in src
+ * - dst: Buffer where the compressed data will be stored
+ * - dstcap: Size of dst. LZ_COMPRESS_BOUND(srclen) bytes are always enough.
+ * - dstlen: Out parameter. Number of bytes of compressed data, or zero
+ *           if the compressed data does not fit in dstcap bytes.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_lz_compress(const uint8_t *src, uint32_t srclen, uint8_t *dst, uint32_t dstcap, uint32_t *dstlen)
+{
+    uint32_t table[LZ_HASH_SIZE];
+    const uint8_t *ip = src, *anchor = src, *iend = src + srclen;
+    uint8_t *op = dst, *oend = dst + dstcap;
+
+    /* Positions are stored plus one, so zero means "no position" */
+    memset(table, 0, sizeof(table));
+
+    *dstlen = 0;
+
+    if (srclen > LZ_MFLIMIT)
+    {
+        const uint8_t *mflimit = iend - LZ_MFLIMIT;
+        const uint8_t *matchlimit = iend - LZ_LASTLITERALS;
+
+        while (ip < mflimit)
+        {
+            uint32_t seq = lz_read32(ip);
+            uint32_t h = lz_hash(seq);
+            uint32_t pos = ip - src;
+            uint32_t cand = table[h];
+
+            table[h] = pos + 1;
+
+            if (cand == 0 || pos + 1 - cand > LZ_MAX_OFFSET || lz_read32(src + cand - 1) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *match = src + cand - 1;
+            const uint8_t *mend = ip + LZ_MINMATCH;
+            match += LZ_MINMATCH;
+            while (mend < matchlimit && *mend == *match)
+            {
+                mend++;
+                match++;
+            }
+
+            op = lz_put_sequence(op, oend, anchor, ip - anchor, pos + 1 - cand, mend - ip);
+            if (op == NULL)
+                return CHIDB_OK;
+
+            ip = anchor = mend;
+        }
+    }
+
+    op = lz_put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (op == NULL)
+        return CHIDB_OK;
+
+    *dstlen = op - dst;
+
+    return CHIDB_OK;
+}
+
+
+/* Decompress a buffer
+ *
+ * Parameters
+ * - src: Compressed data
+ * - srclen: Number of bytes in src
+ * - dst: Buffer where the decompressed data will be stored
+ * - dstlen: Expected number of bytes of decompressed data
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: The compressed data is not well formed, or does
+ *                   not decompress to exactly dstlen bytes.
+ */
+int chidb_lz_decompress(const uint8_t *src, uint32_t srclen, uint8_t *dst, uint32_t dstlen)
+{
+    const uint8_t *ip = src, *iend = src + srclen;
+    uint8_t *op = dst, *oend = dst + dstlen;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+        uint32_t len, offset;
+        const uint8_t *match;
+
+        len = token >> 4;
+        if (len == 15 && lz_get_length(&ip, iend, &len) != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+        if (len > iend - ip || len > oend - op)
+            return CHIDB_ECORRUPT;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        /* The last pair has no match */
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return CHIDB_ECORRUPT;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst)
+            return CHIDB_ECORRUPT;
+
+        len = token & 0x0F;
+        if (len == 15 && lz_get_length(&ip, iend, &len) != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+        len += LZ_MINMATCH;
+        if (len > oend - op)
+            return CHIDB_ECORRUPT;
+
+        /* Byte-by-byte, since the match may overlap the output */
+        match = op - offset;
+        while (len--)
+            *op++ = *match++;
+    }
+
+    return op == oend ? CHIDB_OK : CHIDB_ECORRUPT;
+}
@@ -3,6 +3,28 @@
  *
  *  Query Optimizer
  *
+ * This module rewrites the relational algebra of a SELECT statement
+ * (obtained with SRA_desugar) into a plan that the code generator
+ * compiles instead of the statement itself:
+ *
+ * - Constant subexpressions are folded, and conditions that are always
+ *   true are removed.
+ * - The conditions are split into their conjuncts, and each conjunct is
+ *   placed right above the table it refers to or, if it refers to several
+ *   tables, right above the Cross that joins the last of them. Conjuncts
+ *   that don't refer to any table are placed at the top of the plan.
+ * - NATURAL JOINs and JOINs with a USING clause are rewritten into JOINs
+ *   with an ON clause, using the columns of the tables in the schema (and
+ *   so are outer joins with a USING clause, which keep their type).
+ * - If the tables have been analyzed (see stats.c), they are reordered so
+ *   that the estimated cost of the nested loops (and hash joins) that join
+ *   them is as low as possible. Otherwise, they are joined in the order of
+ *   the FROM clause.
+ * - Each table is projected onto the columns that are used above it.
+ *
+ * The plan shares the conditions and expressions of the statement (which
+ * may be modified by constant folding), except for the column lists of
+ * the projections added by the optimizer.
  */
 
 /*
@@ -38,17 +60,1223 @@
  */
 
 #include <chidb/chidb.h>
+#include <chisql/chisql.h>
 #include "dbm-types.h"
+#include "schema.h"
+#include "stats.h"
 
-int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statement_t **sql_stmt_opt)
+
+/* Largest number of tables whose join order is chosen by the optimizer
+ * (the search considers every subset of the tables) */
+#define OPT_MAX_JOIN (10)
+
+/* Value of a condition, as far as the optimizer can tell */
+typedef enum opt_truth
 {
-    /* Your code goes here */
+    OPT_UNKNOWN,            /* It depends on the rows (or on parameters) */
+    OPT_TRUE,
+    OPT_FALSE
+} opt_truth_t;
 
-    /* Right now, the "optimizer" simply returns a copy of the provided statement */
+/* A table in the FROM clause of a SELECT */
+typedef struct opt_leaf
+{
+    RA_t *ra;               /* Table or RhoTable node */
+    const char *name;       /* Name used to refer to the table (its alias, if it has one) */
+    SchemaTable *schema;
+    TableStats *stats;      /* Statistics of the table (NULL if it hasn't been analyzed) */
+    bool *used;             /* Is the column used above the table's own conjuncts? */
+} opt_leaf_t;
 
-    *sql_stmt_opt = malloc(sizeof(chisql_statement_t));
-    memcpy(*sql_stmt_opt, sql_stmt, sizeof(chisql_statement_t));
+/* The tables that a condition or an expression refers to */
+typedef struct opt_refs
+{
+    int32_t first, last;    /* First and last table it refers to (-1 if it refers to no table) */
+    uint32_t leaves;        /* Bit i is set if it refers to table i (only for the first OPT_MAX_JOIN tables) */
+} opt_refs_t;
+
+/* A conjunct of a SELECT's conditions */
+typedef struct opt_conj
+{
+    Condition_t *cond;
+    opt_refs_t refs;
+    double sel;             /* Estimated selectivity (only if the tables have statistics) */
+} opt_conj_t;
+
+/* Optimizer state for a SELECT */
+typedef struct optimizer
+{
+    Schema *schema;
+    Stats *stats;
+    opt_leaf_t *leaves;
+    uint32_t nLeaves;
+    opt_conj_t *conjs;
+    uint32_t nConjs;
+} optimizer_t;
+
+
+/* Grows an array by one element. Returns the new element (or NULL) */
+static void *opt_grow(void **array, uint32_t *n, size_t size)
+{
+    void *a = realloc(*array, size * (*n + 1));
+
+    if (a == NULL)
+        return NULL;
+
+    *array = a;
+    return (char *) a + size * (*n)++;
+}
+
+
+/*
+ * Constant folding
+ */
+
+/* Is an expression a literal of the given type? */
+static bool opt_is_lit(Expression_t *expr, enum data_type type)
+{
+    return expr->t == EXPR_TERM && expr->expr.term.t == TERM_LITERAL &&
+           expr->expr.term.val->t == type;
+}
+
+/* Replaces an expression with a literal, in place (so that it keeps
+ * its alias and its position in its list) */
+static void opt_set_lit(Expression_t *expr, Literal_t *lit)
+{
+    if (expr->t == EXPR_NEG)
+        Expression_free(expr->expr.unary.expr);
+    else if (expr->t != EXPR_TERM)
+    {
+        Expression_free(expr->expr.binary.expr1);
+        Expression_free(expr->expr.binary.expr2);
+    }
+
+    expr->t = EXPR_TERM;
+    expr->expr.term.t = TERM_LITERAL;
+    expr->expr.term.val = lit;
+}
+
+/* Folds the subexpressions of an expression that only involve literals */
+static void opt_fold_expr(Expression_t *expr)
+{
+    Expression_t *e1, *e2;
+    int64_t a, b, v;
+    char *s;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        if (expr->expr.term.t == TERM_FUNC && expr->expr.term.f.expr != NULL)
+            opt_fold_expr(expr->expr.term.f.expr);
+        return;
+    case EXPR_NEG:
+        opt_fold_expr(expr->expr.unary.expr);
+        if (opt_is_lit(expr->expr.unary.expr, TYPE_INT) && expr->expr.unary.expr->expr.term.val->val.ival != INT32_MIN)
+            opt_set_lit(expr, litInt(-expr->expr.unary.expr->expr.term.val->val.ival));
+        return;
+    default:
+        break;
+    }
+
+    e1 = expr->expr.binary.expr1;
+    e2 = expr->expr.binary.expr2;
+    opt_fold_expr(e1);
+    opt_fold_expr(e2);
+
+    if (expr->t == EXPR_CONCAT)
+    {
+        if (!opt_is_lit(e1, TYPE_TEXT) || !opt_is_lit(e2, TYPE_TEXT))
+            return;
+
+        s = malloc(strlen(e1->expr.term.val->val.strval) + strlen(e2->expr.term.val->val.strval) + 1);
+        if (s == NULL)
+            return;
+        strcpy(s, e1->expr.term.val->val.strval);
+        strcat(s, e2->expr.term.val->val.strval);
+        opt_set_lit(expr, litText(s));
+        return;
+    }
+
+    if (!opt_is_lit(e1, TYPE_INT) || !opt_is_lit(e2, TYPE_INT))
+        return;
+
+    a = e1->expr.term.val->val.ival;
+    b = e2->expr.term.val->val.ival;
+
+    switch (expr->t)
+    {
+    case EXPR_PLUS:
+        v = a + b;
+        break;
+    case EXPR_MINUS:
+        v = a - b;
+        break;
+    case EXPR_MULTIPLY:
+        v = a * b;
+        break;
+    case EXPR_DIVIDE:
+        /* A division by zero is left for the program to report */
+        if (b == 0)
+            return;
+        v = a / b;
+        break;
+    default:
+        return;
+    }
+
+    /* Results that overflow are not folded either */
+    if (v < INT32_MIN || v > INT32_MAX)
+        return;
+
+    opt_set_lit(expr, litInt(v));
+}
+
+/* Compares two literals. Returns false if they can't be compared */
+static bool opt_compare(Literal_t *l1, Literal_t *l2, int *cmp)
+{
+    if (l1->t == TYPE_INT && l2->t == TYPE_INT)
+        *cmp = (l1->val.ival > l2->val.ival) - (l1->val.ival < l2->val.ival);
+    else if (l1->t == TYPE_TEXT && l2->t == TYPE_TEXT)
+        *cmp = strcmp(l1->val.strval, l2->val.strval);
+    else
+        return false;
+
+    return true;
+}
+
+/* Folds a condition. Operands of AND and OR that don't affect the result
+ * are removed (and freed, along with the AND or OR), so *cond may be
+ * replaced with one of its subconditions */
+static opt_truth_t opt_fold_cond(Condition_t **cond)
+{
+    Condition_t *c = *cond;
+    Expression_t *e1, *e2;
+    opt_truth_t t1, t2, decisive;
+    bool unknown = false;
+    int cmp;
+
+    switch (c->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        t1 = opt_fold_cond(&c->cond.binary.cond1);
+        t2 = opt_fold_cond(&c->cond.binary.cond2);
+
+        /* A false operand decides an AND, and a true operand an OR. The
+         * opposite value doesn't affect the result */
+        decisive = c->t == RA_COND_AND ? OPT_FALSE : OPT_TRUE;
+        if (t1 == decisive || (t1 == OPT_UNKNOWN && t2 != OPT_UNKNOWN && t2 != decisive))
+        {
+            *cond = c->cond.binary.cond1;
+            Condition_free(c->cond.binary.cond2);
+            free(c);
+            return t1;
+        }
+        if (t2 == decisive || t1 != OPT_UNKNOWN)
+        {
+            *cond = c->cond.binary.cond2;
+            Condition_free(c->cond.binary.cond1);
+            free(c);
+            return t2;
+        }
+        return OPT_UNKNOWN;
+
+    case RA_COND_NOT:
+        t1 = opt_fold_cond(&c->cond.unary.cond);
+        return t1 == OPT_TRUE ? OPT_FALSE : t1 == OPT_FALSE ? OPT_TRUE : OPT_UNKNOWN;
+
+    case RA_COND_IN:
+        e1 = c->cond.in.expr;
+        opt_fold_expr(e1);
+        if (e1->t != EXPR_TERM || e1->expr.term.t != TERM_LITERAL)
+            return OPT_UNKNOWN;
+
+        for (Literal_t *lit = c->cond.in.values_list; lit; lit = lit->next)
+        {
+            if (!opt_compare(e1->expr.term.val, lit, &cmp))
+                unknown = true;
+            else if (cmp == 0)
+                return OPT_TRUE;
+        }
+        return unknown ? OPT_UNKNOWN : OPT_FALSE;
+
+    default:
+        e1 = c->cond.comp.expr1;
+        e2 = c->cond.comp.expr2;
+        opt_fold_expr(e1);
+        opt_fold_expr(e2);
+
+        if (e1->t != EXPR_TERM || e1->expr.term.t != TERM_LITERAL ||
+            e2->t != EXPR_TERM || e2->expr.term.t != TERM_LITERAL ||
+            !opt_compare(e1->expr.term.val, e2->expr.term.val, &cmp))
+            return OPT_UNKNOWN;
+
+        switch (c->t)
+        {
+        case RA_COND_EQ:
+            return cmp == 0 ? OPT_TRUE : OPT_FALSE;
+        case RA_COND_LT:
+            return cmp < 0 ? OPT_TRUE : OPT_FALSE;
+        case RA_COND_GT:
+            return cmp > 0 ? OPT_TRUE : OPT_FALSE;
+        case RA_COND_LEQ:
+            return cmp <= 0 ? OPT_TRUE : OPT_FALSE;
+        case RA_COND_GEQ:
+            return cmp >= 0 ? OPT_TRUE : OPT_FALSE;
+        default:
+            return OPT_UNKNOWN;
+        }
+    }
+}
+
+
+/* Folds the conditions of the selections and joins of a SELECT, in the
+ * parse tree that they belong to */
+static void opt_fold_sra(SRA_t *sra)
+{
+    switch (sra->t)
+    {
+    case SRA_PROJECT:
+        opt_fold_sra(sra->project.sra);
+        return;
+    case SRA_SELECT:
+        opt_fold_cond(&sra->select.cond);
+        opt_fold_sra(sra->select.sra);
+        return;
+    case SRA_JOIN:
+    case SRA_LEFT_OUTER_JOIN:
+    case SRA_RIGHT_OUTER_JOIN:
+    case SRA_FULL_OUTER_JOIN:
+    case SRA_NATURAL_JOIN:
+        if (sra->join.opt_cond != NULL && sra->join.opt_cond->t == JOIN_COND_ON)
+            opt_fold_cond(&sra->join.opt_cond->on);
+        opt_fold_sra(sra->binary.sra1);
+        opt_fold_sra(sra->binary.sra2);
+        return;
+    default:
+        return;
+    }
+}
+
+/*
+ * Column references
+ */
+
+/* Finds the table and column that a column reference refers to */
+static int opt_find_column(optimizer_t *opt, ColumnReference_t *ref, uint32_t *leaf, int32_t *col)
+{
+    uint32_t matches = 0;
+
+    for (uint32_t i = 0; i < opt->nLeaves; i++)
+    {
+        if (ref->tableName != NULL && strcasecmp(ref->tableName, opt->leaves[i].name) != 0)
+            continue;
+
+        if (chidb_Schema_findColumn(opt->leaves[i].schema, ref->columnName, col) == CHIDB_OK)
+        {
+            *leaf = i;
+            matches++;
+        }
+    }
+
+    /* Unknown or ambiguous column */
+    if (matches != 1)
+        return CHIDB_EINVALIDSQL;
+
+    return chidb_Schema_findColumn(opt->leaves[*leaf].schema, ref->columnName, col);
+}
+
+/* Sets refs to no tables */
+static void opt_refs_init(opt_refs_t *refs)
+{
+    refs->first = refs->last = -1;
+    refs->leaves = 0;
+}
+
+/* Records a reference to a column of a table (or to all its columns, if col is -1) */
+static void opt_use(optimizer_t *opt, uint32_t leaf, int32_t col, opt_refs_t *refs, bool mark)
+{
+    opt_leaf_t *l = &opt->leaves[leaf];
+
+    if (refs->first < 0 || (int32_t) leaf < refs->first)
+        refs->first = leaf;
+    if ((int32_t) leaf > refs->last)
+        refs->last = leaf;
+    if (leaf < OPT_MAX_JOIN)
+        refs->leaves |= 1u << leaf;
+
+    if (!mark)
+        return;
+
+    if (col >= 0)
+        l->used[col] = true;
+    else
+        for (uint32_t i = 0; i < l->schema->nCols; i++)
+            l->used[i] = true;
+}
+
+/* Adds the tables that an expression refers to to refs. If mark is
+ * true, the columns it refers to are also marked as used */
+static int opt_expr_refs(optimizer_t *opt, Expression_t *expr, opt_refs_t *refs, bool mark)
+{
+    ColumnReference_t *ref;
+    uint32_t leaf, matches = 0;
+    int32_t col;
+    int rc;
+
+    switch (expr->t)
+    {
+    case EXPR_TERM:
+        if (expr->expr.term.t == TERM_FUNC)
+            return expr->expr.term.f.expr ? opt_expr_refs(opt, expr->expr.term.f.expr, refs, mark) : CHIDB_OK;
+        if (expr->expr.term.t != TERM_COLREF)
+            return CHIDB_OK;
+
+        ref = expr->expr.term.ref;
+        if (strcmp(ref->columnName, "*") == 0)
+        {
+            /* All the columns of all the tables (or of one table) */
+            for (uint32_t i = 0; i < opt->nLeaves; i++)
+                if (ref->tableName == NULL || strcasecmp(ref->tableName, opt->leaves[i].name) == 0)
+                {
+                    opt_use(opt, i, -1, refs, mark);
+                    matches++;
+                }
+            return matches > 0 ? CHIDB_OK : CHIDB_EINVALIDSQL;
+        }
+
+        if ((rc = opt_find_column(opt, ref, &leaf, &col)) != CHIDB_OK)
+            return rc;
+        opt_use(opt, leaf, col, refs, mark);
+        return CHIDB_OK;
+    case EXPR_NEG:
+        return opt_expr_refs(opt, expr->expr.unary.expr, refs, mark);
+    default:
+        if ((rc = opt_expr_refs(opt, expr->expr.binary.expr1, refs, mark)) != CHIDB_OK)
+            return rc;
+        return opt_expr_refs(opt, expr->expr.binary.expr2, refs, mark);
+    }
+}
+
+/* Same as opt_expr_refs, but with a condition */
+static int opt_cond_refs(optimizer_t *opt, Condition_t *cond, opt_refs_t *refs, bool mark)
+{
+    int rc;
+
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        if ((rc = opt_cond_refs(opt, cond->cond.binary.cond1, refs, mark)) != CHIDB_OK)
+            return rc;
+        return opt_cond_refs(opt, cond->cond.binary.cond2, refs, mark);
+    case RA_COND_NOT:
+        return opt_cond_refs(opt, cond->cond.unary.cond, refs, mark);
+    case RA_COND_IN:
+        return opt_expr_refs(opt, cond->cond.in.expr, refs, mark);
+    default:
+        if ((rc = opt_expr_refs(opt, cond->cond.comp.expr1, refs, mark)) != CHIDB_OK)
+            return rc;
+        return opt_expr_refs(opt, cond->cond.comp.expr2, refs, mark);
+    }
+}
+
+
+/*
+ * Joins
+ */
+
+/* Adds the tables of a FROM clause (its SRA_TABLE nodes) to an array.
+ * Returns false if it has anything other than tables and inner joins */
+static bool opt_join_tables(SRA_t *sra, SRA_t ***tables, uint32_t *n)
+{
+    SRA_t **t;
+
+    switch (sra->t)
+    {
+    case SRA_TABLE:
+        t = opt_grow((void **) tables, n, sizeof(SRA_t *));
+        if (t == NULL)
+            return false;
+        *t = sra;
+        return true;
+    case SRA_JOIN:
+    case SRA_NATURAL_JOIN:
+        return opt_join_tables(sra->binary.sra1, tables, n) && opt_join_tables(sra->binary.sra2, tables, n);
+    default:
+        return false;
+    }
+}
+
+/* Finds the first of some tables that has a column. Returns the name
+ * used to refer to it (its alias, if it has one), or NULL */
+static const char *opt_join_col(Schema *schema, SRA_t **tables, uint32_t n, const char *col)
+{
+    SchemaTable *t;
+    int32_t c;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        TableReference_t *ref = tables[i]->table.ref;
+
+        if (chidb_Schema_findTable(schema, ref->table_name, &t) == CHIDB_OK &&
+            chidb_Schema_findColumn(t, col, &c) == CHIDB_OK)
+            return ref->alias ? ref->alias : ref->table_name;
+    }
+
+    return NULL;
+}
+
+/* Adds t1.col = t2.col to a condition (which may be NULL) */
+static Condition_t *opt_join_eq(Condition_t *cond, const char *t1, const char *t2, const char *col)
+{
+    Condition_t *eq = Eq(TermColumnReference(ColumnReference_make(t1, col)),
+                         TermColumnReference(ColumnReference_make(t2, col)));
+
+    return cond ? And(cond, eq) : eq;
+}
+
+/* Rewrites the NATURAL JOINs, and the JOINs with a USING clause, below a
+ * node of a SELECT's SRA into JOINs with an ON clause (which SRA_desugar
+ * can translate, no matter how many tables each side has). An outer join
+ * with a USING clause is rewritten into an outer join with an ON clause
+ * (which the code generator compiles into a hash join). The condition
+ * equates each shared column of the right side with the same column of
+ * the first table on the left side that has it. Unlike in standard SQL,
+ * the shared columns are not merged, so a "*" includes both copies.
+ *
+ * Returns CHIDB_EINVALIDSQL if a join can't be rewritten (for instance,
+ * because one of its sides is an outer join, or a column doesn't exist) */
+static int opt_resolve_joins(Schema *schema, SRA_t *sra)
+{
+    SRA_t **left = NULL, **right = NULL;
+    uint32_t nLeft = 0, nRight = 0;
+    Condition_t *cond = NULL;
+    SchemaTable *t;
+    const char *t1, *t2;
+    int rc;
+
+    switch (sra->t)
+    {
+    case SRA_PROJECT:
+        return opt_resolve_joins(schema, sra->project.sra);
+    case SRA_SELECT:
+        return opt_resolve_joins(schema, sra->select.sra);
+    case SRA_JOIN:
+    case SRA_LEFT_OUTER_JOIN:
+    case SRA_RIGHT_OUTER_JOIN:
+    case SRA_FULL_OUTER_JOIN:
+    case SRA_NATURAL_JOIN:
+        /* The layout of SRA_Join_t starts like that of SRA_Binary_t */
+        if ((rc = opt_resolve_joins(schema, sra->binary.sra1)) != CHIDB_OK ||
+            (rc = opt_resolve_joins(schema, sra->binary.sra2)) != CHIDB_OK)
+            return rc;
+        if (sra->t != SRA_NATURAL_JOIN && (sra->join.opt_cond == NULL || sra->join.opt_cond->t != JOIN_COND_USING))
+            return CHIDB_OK;
+        break;
+    default:
+        return CHIDB_OK;
+    }
+
+    if (!opt_join_tables(sra->binary.sra1, &left, &nLeft) || !opt_join_tables(sra->binary.sra2, &right, &nRight))
+        rc = CHIDB_EINVALIDSQL;
+    else if (sra->t != SRA_NATURAL_JOIN)
+    {
+        for (StrList_t *col = sra->join.opt_cond->col_list; col && rc == CHIDB_OK; col = col->next)
+        {
+            t1 = opt_join_col(schema, left, nLeft, col->str);
+            t2 = opt_join_col(schema, right, nRight, col->str);
+            if (t1 == NULL || t2 == NULL)
+                rc = CHIDB_EINVALIDSQL;
+            else
+                cond = opt_join_eq(cond, t1, t2, col->str);
+        }
+    }
+    else
+    {
+        /* The columns of the right side that the left side also has (a
+         * column that is in several tables on the right side is only
+         * equated with the left side's column once) */
+        for (uint32_t i = 0; i < nRight && rc == CHIDB_OK; i++)
+        {
+            if (chidb_Schema_findTable(schema, right[i]->table.ref->table_name, &t) != CHIDB_OK)
+            {
+                rc = CHIDB_EINVALIDSQL;
+                break;
+            }
+
+            for (uint32_t c = 0; c < t->nCols; c++)
+            {
+                t1 = opt_join_col(schema, left, nLeft, t->cols[c]);
+                if (t1 == NULL || opt_join_col(schema, right, i, t->cols[c]) != NULL)
+                    continue;
+                t2 = opt_join_col(schema, right + i, 1, t->cols[c]);
+                cond = opt_join_eq(cond, t1, t2, t->cols[c]);
+            }
+        }
+    }
+
+    free(left);
+    free(right);
+
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (sra->t == SRA_NATURAL_JOIN)
+        sra->t = SRA_JOIN;
+    else
+    {
+        JoinCondition_free(sra->join.opt_cond);
+        free(sra->join.opt_cond);
+    }
+
+    sra->join.opt_cond = cond ? On(cond) : NULL;
+
+    return CHIDB_OK;
+}
+
+
+/*
+ * Join order
+ */
+
+/* col op v is v op' col */
+static enum CondType opt_flip(enum CondType op)
+{
+    return op == RA_COND_LT ? RA_COND_GT :
+           op == RA_COND_GT ? RA_COND_LT :
+           op == RA_COND_LEQ ? RA_COND_GEQ :
+           op == RA_COND_GEQ ? RA_COND_LEQ : op;
+}
+
+/* Is an expression a column of a table? */
+static bool opt_is_col(optimizer_t *opt, Expression_t *expr, uint32_t *leaf, int32_t *col)
+{
+    return expr->t == EXPR_TERM && expr->expr.term.t == TERM_COLREF &&
+           strcmp(expr->expr.term.ref->columnName, "*") != 0 &&
+           opt_find_column(opt, expr->expr.term.ref, leaf, col) == CHIDB_OK;
+}
+
+/* Returns the literal in an expression (or NULL, if it isn't a literal) */
+static Literal_t *opt_lit(Expression_t *expr)
+{
+    return expr->t == EXPR_TERM && expr->expr.term.t == TERM_LITERAL ? expr->expr.term.val : NULL;
+}
+
+/* Returns a conjunct as (col op v), where col is a column of the given
+ * table (one of the first OPT_MAX_JOIN) and v doesn't refer to that table
+ * (if that is not possible, returns false) */
+static bool opt_col_cmp(optimizer_t *opt, Condition_t *cond, uint32_t leaf,
+                        int32_t *col, enum CondType *op, Expression_t **v)
+{
+    opt_refs_t vrefs;
+    uint32_t l;
+
+    if (cond->t > RA_COND_GEQ)
+        return false;
+
+    if (opt_is_col(opt, cond->cond.comp.expr1, &l, col) && l == leaf)
+    {
+        *op = cond->t;
+        *v = cond->cond.comp.expr2;
+    }
+    else if (opt_is_col(opt, cond->cond.comp.expr2, &l, col) && l == leaf)
+    {
+        *op = opt_flip(cond->t);
+        *v = cond->cond.comp.expr1;
+    }
+    else
+        return false;
+
+    opt_refs_init(&vrefs);
+    return opt_expr_refs(opt, *v, &vrefs, false) == CHIDB_OK && !(vrefs.leaves & (1u << leaf));
+}
+
+/* Estimates the selectivity of a condition (the fraction of the rows of
+ * the tables it refers to for which it is true) */
+static double opt_cond_sel(optimizer_t *opt, Condition_t *cond)
+{
+    Expression_t *e1, *e2;
+    uint32_t l1, l2;
+    int32_t c1, c2;
+    double s1, s2;
+    uint32_t nd1, nd2;
+
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+        return opt_cond_sel(opt, cond->cond.binary.cond1) * opt_cond_sel(opt, cond->cond.binary.cond2);
+    case RA_COND_OR:
+        s1 = opt_cond_sel(opt, cond->cond.binary.cond1);
+        s2 = opt_cond_sel(opt, cond->cond.binary.cond2);
+        return s1 + s2 - s1 * s2;
+    case RA_COND_NOT:
+        return 1 - opt_cond_sel(opt, cond->cond.unary.cond);
+    case RA_COND_IN:
+        if (!opt_is_col(opt, cond->cond.in.expr, &l1, &c1))
+            return STATS_DEFAULT_SEL;
+        s1 = 0;
+        for (Literal_t *lit = cond->cond.in.values_list; lit; lit = lit->next)
+            s1 += chidb_Stats_selectivity(opt->leaves[l1].stats, c1, RA_COND_EQ, lit);
+        return s1 < 1 ? s1 : 1;
+    default:
+        e1 = cond->cond.comp.expr1;
+        e2 = cond->cond.comp.expr2;
+        if (opt_is_col(opt, e1, &l1, &c1))
+        {
+            /* An equijoin: each value of the column with fewer distinct
+             * values is assumed to match a value of the other column */
+            if (cond->t == RA_COND_EQ && opt_is_col(opt, e2, &l2, &c2) && l1 != l2)
+            {
+                nd1 = opt->leaves[l1].stats->cols[c1].nDistinct;
+                nd2 = opt->leaves[l2].stats->cols[c2].nDistinct;
+                if (nd2 > nd1)
+                    nd1 = nd2;
+                return nd1 > 0 ? 1.0 / nd1 : 0;
+            }
+            return chidb_Stats_selectivity(opt->leaves[l1].stats, c1, cond->t, opt_lit(e2));
+        }
+        if (opt_is_col(opt, e2, &l2, &c2))
+            return chidb_Stats_selectivity(opt->leaves[l2].stats, c2, opt_flip(cond->t), opt_lit(e1));
+        return STATS_DEFAULT_SEL;
+    }
+}
+
+/* Estimates the cost of reading the rows of a table, once for each row
+ * of the join of the tables in the set placed (which are joined before
+ * it). The rows can be read with a full scan or, if one of the conjuncts
+ * compares the table's primary key or an indexed column with a value
+ * that is known once the tables in placed have been read, by seeking to
+ * the matching rows (see cg_access_path) */
+static double opt_access_cost(optimizer_t *opt, uint32_t leaf, uint32_t placed)
+{
+    opt_leaf_t *l = &opt->leaves[leaf];
+    IndexStats *is;
+    enum CondType op;
+    Expression_t *v;
+    int32_t col;
+    double best, cost, sel;
+
+    best = chidb_Stats_pathCost(l->stats, NULL, 1, false);
+
+    for (uint32_t i = 0; i < opt->nConjs; i++)
+    {
+        opt_conj_t *conj = &opt->conjs[i];
+
+        if (!(conj->refs.leaves & (1u << leaf)) || (conj->refs.leaves & ~(placed | (1u << leaf))) != 0)
+            continue;
+        if (!opt_col_cmp(opt, conj->cond, leaf, &col, &op, &v))
+            continue;
+
+        sel = chidb_Stats_selectivity(l->stats, col, op, opt_lit(v));
+
+        if (col == l->schema->pk)
+        {
+            cost = chidb_Stats_pathCost(l->stats, NULL, sel, false);
+            if (cost < best)
+                best = cost;
+        }
+
+        for (uint32_t j = 0; j < opt->schema->nIndexes; j++)
+        {
+            SchemaIndex *idx = &opt->schema->indexes[j];
+
+            if (idx->table != l->schema || idx->col != col ||
+                chidb_Stats_findIndex(opt->stats, idx->name, &is) != CHIDB_OK)
+                continue;
+
+            cost = chidb_Stats_pathCost(l->stats, is, sel, false);
+            if (cost < best)
+                best = cost;
+        }
+    }
+
+    return best;
+}
+
+/* Is there an equijoin between a table and the tables in the set placed
+ * (that is, a conjunct col = v, where v is a column of one of those
+ * tables)? If the table would be scanned once for each row of the join
+ * of placed, the code generator turns it into a hash join (see
+ * cg_hash_path) */
+static bool opt_equijoin(optimizer_t *opt, uint32_t leaf, uint32_t placed)
+{
+    enum CondType op;
+    Expression_t *v;
+    int32_t col, vcol;
+    uint32_t vleaf;
+
+    for (uint32_t i = 0; i < opt->nConjs; i++)
+    {
+        opt_conj_t *conj = &opt->conjs[i];
+
+        if (!(conj->refs.leaves & (1u << leaf)) || (conj->refs.leaves & ~(placed | (1u << leaf))) != 0)
+            continue;
+        if (opt_col_cmp(opt, conj->cond, leaf, &col, &op, &v) && op == RA_COND_EQ &&
+            opt_is_col(opt, v, &vleaf, &vcol))
+            return true;
+    }
+
+    return false;
+}
+
+/* Chooses the order in which the tables are joined (that is, the order
+ * of the nested loops in the program), if all of them have been analyzed.
+ *
+ * The cost of a left-deep join of a set of tables is the cost of joining
+ * all of them but the last one, plus the cost of accessing the last table
+ * once for each row produced by that join (see opt_access_cost). If that
+ * means a full scan for each row and there is an equijoin, the last table
+ * is read once into a hash table instead, which is probed for each row
+ * (so the smaller of the two inputs is the one that is hashed). The order
+ * with the lowest cost is found by dynamic programming over the subsets of
+ * the tables, so it is only done for up to OPT_MAX_JOIN tables. Without
+ * statistics, the tables are joined in the order of the FROM clause */
+static int opt_order(optimizer_t *opt)
+{
+    uint32_t n = opt->nLeaves, nsets = 1u << n, set, rest, i;
+    opt_leaf_t *leaves;
+    double *rows, *cost, c, a, scan;
+    uint8_t *last;
+
+    if (n < 2 || n > OPT_MAX_JOIN)
+        return CHIDB_OK;
+
+    for (i = 0; i < n; i++)
+        if (chidb_Stats_findTable(opt->stats, opt->leaves[i].schema->name, &opt->leaves[i].stats) != CHIDB_OK)
+            return CHIDB_OK;
+
+    for (i = 0; i < opt->nConjs; i++)
+        opt->conjs[i].sel = opt_cond_sel(opt, opt->conjs[i].cond);
+
+    rows = malloc(nsets * sizeof(double));
+    cost = malloc(nsets * sizeof(double));
+    last = malloc(nsets * sizeof(uint8_t));
+    leaves = malloc(n * sizeof(opt_leaf_t));
+    if (rows == NULL || cost == NULL || last == NULL || leaves == NULL)
+    {
+        free(rows);
+        free(cost);
+        free(last);
+        free(leaves);
+        return CHIDB_ENOMEM;
+    }
+
+    /* Rows produced by the join of each set of tables (which doesn't
+     * depend on the order in which they are joined) */
+    for (set = 0; set < nsets; set++)
+    {
+        rows[set] = 1;
+        for (i = 0; i < n; i++)
+            if (set & (1u << i))
+                rows[set] *= opt->leaves[i].stats->nRows;
+        for (i = 0; i < opt->nConjs; i++)
+            if (opt->conjs[i].refs.leaves != 0 && (opt->conjs[i].refs.leaves & ~set) == 0)
+                rows[set] *= opt->conjs[i].sel;
+
+        cost[set] = set == 0 ? 0 : -1;
+    }
+
+    /* The tables are tried as the last one from right to left, so that,
+     * on a tie, the order of the FROM clause is kept */
+    for (set = 1; set < nsets; set++)
+        for (i = n; i-- > 0; )
+        {
+            if (!(set & (1u << i)))
+                continue;
+
+            rest = set & ~(1u << i);
+            a = opt_access_cost(opt, i, rest);
+            scan = chidb_Stats_pathCost(opt->leaves[i].stats, NULL, 1, false);
+            if (rest != 0 && a >= scan && opt_equijoin(opt, i, rest))
+                c = cost[rest] + scan + (opt->leaves[i].stats->nRows + rows[rest]) * STATS_HASH_ROW_COST;
+            else
+                c = cost[rest] + rows[rest] * a;
+            if (cost[set] < 0 || c < cost[set])
+            {
+                cost[set] = c;
+                last[set] = i;
+            }
+        }
+
+    for (set = nsets - 1, i = n; set != 0; set &= ~(1u << last[set]))
+        leaves[--i] = opt->leaves[last[set]];
+    memcpy(opt->leaves, leaves, n * sizeof(opt_leaf_t));
+
+    free(rows);
+    free(cost);
+    free(last);
+    free(leaves);
+
+    return CHIDB_OK;
+}
+
+
+/*
+ * Plan
+ */
+
+/* Adds a table to the SELECT's tables */
+static int opt_add_leaf(optimizer_t *opt, RA_t *ra, const char *table_name, const char *name)
+{
+    SchemaTable *schema;
+    opt_leaf_t *leaf;
+
+    if (chidb_Schema_findTable(opt->schema, table_name, &schema) != CHIDB_OK)
+        return CHIDB_EINVALIDSQL;
+
+    leaf = opt_grow((void **) &opt->leaves, &opt->nLeaves, sizeof(opt_leaf_t));
+    if (leaf == NULL)
+        return CHIDB_ENOMEM;
+
+    leaf->ra = ra;
+    leaf->name = name;
+    leaf->schema = schema;
+    leaf->used = calloc(schema->nCols, sizeof(bool));
+
+    return leaf->used != NULL ? CHIDB_OK : CHIDB_ENOMEM;
+}
+
+/* Adds the conjuncts of a (folded) condition to the SELECT's conjuncts */
+static int opt_add_conjuncts(optimizer_t *opt, Condition_t *cond)
+{
+    opt_conj_t *conj;
+    int rc;
+
+    if (cond->t == RA_COND_AND)
+    {
+        if ((rc = opt_add_conjuncts(opt, cond->cond.binary.cond1)) != CHIDB_OK)
+            return rc;
+        return opt_add_conjuncts(opt, cond->cond.binary.cond2);
+    }
+
+    conj = opt_grow((void **) &opt->conjs, &opt->nConjs, sizeof(opt_conj_t));
+    if (conj == NULL)
+        return CHIDB_ENOMEM;
+
+    conj->cond = cond;
+    opt_refs_init(&conj->refs);
 
     return CHIDB_OK;
 }
 
+/* Adds the tables and conjuncts of the RA tree below a SELECT's Pi.
+ * Returns CHIDB_EINVALIDSQL if the tree has other kinds of nodes */
+static int opt_collect(optimizer_t *opt, RA_t *ra)
+{
+    Condition_t *cond;
+    int rc;
+
+    if (ra == NULL)
+        return CHIDB_EINVALIDSQL;
+
+    switch (ra->t)
+    {
+    case RA_TABLE:
+        return opt_add_leaf(opt, ra, ra->table.name, ra->table.name);
+    case RA_RHO_TABLE:
+        if (ra->rho.ra == NULL || ra->rho.ra->t != RA_TABLE)
+            return CHIDB_EINVALIDSQL;
+        return opt_add_leaf(opt, ra, ra->rho.ra->table.name, ra->rho.new_name);
+    case RA_SIGMA:
+        if ((rc = opt_collect(opt, ra->sigma.ra)) != CHIDB_OK)
+            return rc;
+        /* The condition was folded by opt_fold_sra, so this only finds
+         * its value (a true condition has no conjuncts) */
+        cond = ra->sigma.cond;
+        if (opt_fold_cond(&cond) == OPT_TRUE)
+            return CHIDB_OK;
+        return opt_add_conjuncts(opt, cond);
+    case RA_CROSS:
+        if ((rc = opt_collect(opt, ra->binary.ra1)) != CHIDB_OK)
+            return rc;
+        return opt_collect(opt, ra->binary.ra2);
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
+}
+
+/* Adds a selection for each conjunct whose last table is leaf, and that
+ * refers only to that table (local) or also to previous tables (!local).
+ * With leaf -1, adds the conjuncts that don't refer to any table */
+static RA_t *opt_select(optimizer_t *opt, RA_t *ra, int32_t leaf, bool local)
+{
+    for (uint32_t i = 0; i < opt->nConjs; i++)
+    {
+        opt_conj_t *conj = &opt->conjs[i];
+
+        if (conj->refs.last == leaf && (conj->refs.first == conj->refs.last) == local)
+            ra = RA_Sigma(ra, conj->cond);
+    }
+
+    return ra;
+}
+
+/* Projects a table onto the columns used above it (unless all of them,
+ * or none of them, are used) */
+static RA_t *opt_project(optimizer_t *opt, RA_t *ra, uint32_t leaf)
+{
+    opt_leaf_t *l = &opt->leaves[leaf];
+    Expression_t *cols = NULL;
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < l->schema->nCols; i++)
+        if (l->used[i])
+            n++;
+
+    if (n == 0 || n == l->schema->nCols)
+        return ra;
+
+    for (uint32_t i = 0; i < l->schema->nCols; i++)
+        if (l->used[i])
+            cols = append_expression(cols, TermColumnReference(ColumnReference_make(l->name, l->schema->cols[i])));
+
+    return RA_Pi(ra, cols);
+}
+
+/* Builds the plan below the SELECT's Pi: a left-deep tree of cross
+ * products, with each conjunct as close to the tables as possible */
+static RA_t *opt_plan(optimizer_t *opt)
+{
+    RA_t *ra = NULL, *leaf;
+
+    for (uint32_t i = 0; i < opt->nLeaves; i++)
+    {
+        leaf = opt_project(opt, opt_select(opt, opt->leaves[i].ra, i, true), i);
+        ra = i == 0 ? leaf : opt_select(opt, RA_Cross(ra, leaf), i, false);
+    }
+
+    return opt_select(opt, ra, -1, true);
+}
+
+/* Frees the Sigma and Cross nodes of an RA tree (but not its tables,
+ * which are reused in the plan) */
+static void opt_free_joins(RA_t *ra)
+{
+    switch (ra->t)
+    {
+    case RA_SIGMA:
+        opt_free_joins(ra->sigma.ra);
+        break;
+    case RA_CROSS:
+        opt_free_joins(ra->binary.ra1);
+        opt_free_joins(ra->binary.ra2);
+        break;
+    default:
+        return;
+    }
+
+    free(ra);
+}
+
+/* Frees the nodes of a plan, and the column lists of the projections
+ * below its top-level Pi (but not its conditions and expressions,
+ * which belong to the statement) */
+static void opt_free_plan(RA_t *ra, bool top)
+{
+    if (ra == NULL)
+        return;
+
+    switch (ra->t)
+    {
+    case RA_TABLE:
+        free(ra->table.name);
+        break;
+    case RA_SIGMA:
+        opt_free_plan(ra->sigma.ra, false);
+        break;
+    case RA_PI:
+        if (!top)
+            Expression_freeList(ra->pi.expr_list);
+        opt_free_plan(ra->pi.ra, false);
+        break;
+    case RA_RHO_TABLE:
+    case RA_RHO_EXPR:
+        opt_free_plan(ra->rho.ra, false);
+        free(ra->rho.new_name);
+        break;
+    case RA_UNION:
+        /* The plans of the operands of a set operation */
+        opt_free_plan(ra->binary.ra1, top);
+        opt_free_plan(ra->binary.ra2, top);
+        break;
+    default:
+        opt_free_plan(ra->binary.ra1, false);
+        opt_free_plan(ra->binary.ra2, false);
+    }
+
+    free(ra);
+}
+
+/* Rewrites the RA tree of a SELECT (a Pi) into its plan */
+static int opt_rewrite(Schema *schema, Stats *stats, RA_t *ra)
+{
+    optimizer_t opt;
+    RA_t *from;
+    opt_refs_t refs;
+    int rc;
+
+    if (ra == NULL || ra->t != RA_PI)
+        return CHIDB_OK;
+
+    for (Expression_t *expr = ra->pi.expr_list; expr; expr = expr->next)
+        opt_fold_expr(expr);
+
+    memset(&opt, 0, sizeof(optimizer_t));
+    opt.schema = schema;
+    opt.stats = stats;
+
+    rc = opt_collect(&opt, ra->pi.ra);
+
+    /* The columns in the result are used above all the tables */
+    for (Expression_t *expr = ra->pi.expr_list; expr && rc == CHIDB_OK; expr = expr->next)
+    {
+        opt_refs_init(&refs);
+        rc = opt_expr_refs(&opt, expr, &refs, true);
+    }
+
+    /* The tables that each conjunct refers to decide the join order */
+    for (uint32_t i = 0; i < opt.nConjs && rc == CHIDB_OK; i++)
+        rc = opt_cond_refs(&opt, opt.conjs[i].cond, &opt.conjs[i].refs, false);
+
+    if (rc == CHIDB_OK)
+        rc = opt_order(&opt);
+
+    /* The columns in a conjunct that refers to a single table are only
+     * used by its selection, below the table's projection (the tables
+     * are numbered again, since they may have been reordered) */
+    for (uint32_t i = 0; i < opt.nConjs && rc == CHIDB_OK; i++)
+    {
+        opt_conj_t *conj = &opt.conjs[i];
+
+        opt_refs_init(&conj->refs);
+        rc = opt_cond_refs(&opt, conj->cond, &conj->refs, false);
+        if (rc == CHIDB_OK && conj->refs.first != conj->refs.last)
+        {
+            opt_refs_init(&refs);
+            rc = opt_cond_refs(&opt, conj->cond, &refs, true);
+        }
+    }
+
+    if (rc == CHIDB_OK)
+    {
+        from = ra->pi.ra;
+        ra->pi.ra = opt_plan(&opt);
+        opt_free_joins(from);
+    }
+    else if (rc == CHIDB_EINVALIDSQL)
+    {
+        /* The statement is left as it is, so that the code generator
+         * reports the unknown (or unsupported) tables and columns */
+        rc = CHIDB_OK;
+    }
+
+    for (uint32_t i = 0; i < opt.nLeaves; i++)
+        free(opt.leaves[i].used);
+    free(opt.leaves);
+    free(opt.conjs);
+
+    return rc;
+}
+
+
+/* Returns the plan of a SELECT or, for a set operation, a Union of the
+ * plans of its operands (which are optimized separately) */
+static int opt_select_plan(Schema *schema, Stats *stats, SRA_t *sra, RA_t **plan)
+{
+    RA_t *plan1 = NULL, *plan2 = NULL;
+    int rc;
+
+    *plan = NULL;
+
+    if (sra->t == SRA_UNION || sra->t == SRA_INTERSECT || sra->t == SRA_EXCEPT)
+    {
+        rc = opt_select_plan(schema, stats, sra->binary.sra1, &plan1);
+        if (rc == CHIDB_OK)
+            rc = opt_select_plan(schema, stats, sra->binary.sra2, &plan2);
+
+        if (rc == CHIDB_OK && (*plan = RA_Union(plan1, plan2)) == NULL)
+            rc = CHIDB_ENOMEM;
+        if (rc != CHIDB_OK)
+        {
+            opt_free_plan(plan1, true);
+            opt_free_plan(plan2, true);
+        }
+        return rc;
+    }
+
+    if (sra->t != SRA_PROJECT)
+        return CHIDB_OK;
+
+    /* A join that can't be rewritten desugars to NULL, and the code
+     * generator reports it */
+    if ((rc = opt_resolve_joins(schema, sra)) != CHIDB_OK && rc != CHIDB_EINVALIDSQL)
+        return rc;
+
+    opt_fold_sra(sra);
+    *plan = SRA_desugar(sra);
+    return opt_rewrite(schema, stats, *plan);
+}
+
+/* Free an optimized SQL statement (but not the statement it was
+ * obtained from, with which it shares its parse tree)
+ *
+ * Parameters
+ * - sql_stmt_opt: Statement returned by chidb_stmt_optimize
+ */
+void chidb_stmt_optimize_free(chisql_statement_t *sql_stmt_opt)
+{
+    opt_free_plan(sql_stmt_opt->plan, true);
+    free(sql_stmt_opt);
+}
+
+
+/* Optimize a SQL statement
+ *
+ * The optimized statement of a SELECT has a plan (see the description of
+ * this module), which the code generator compiles instead of the SELECT's
+ * parse tree. The plan of a set operation is a Union of the plans of its
+ * operands. Other statements are copied as they are.
+ *
+ * Parameters
+ * - db: Database (its schema is used to resolve the columns of the SELECT)
+ * - sql_stmt: SQL statement
+ * - sql_stmt_opt: Out parameter for the optimized statement, which must
+ *                 be freed with chidb_stmt_optimize_free
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when reading the schema
+ */
+int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statement_t **sql_stmt_opt)
+{
+    Schema *schema;
+    Stats *stats;
+    int rc;
+
+    *sql_stmt_opt = malloc(sizeof(chisql_statement_t));
+    if (*sql_stmt_opt == NULL)
+        return CHIDB_ENOMEM;
+
+    memcpy(*sql_stmt_opt, sql_stmt, sizeof(chisql_statement_t));
+    (*sql_stmt_opt)->plan = NULL;
+
+    if (sql_stmt->type != STMT_SELECT)
+        return CHIDB_OK;
+
+    rc = chidb_Schema_get(db, &schema);
+    if (rc == CHIDB_OK)
+        rc = chidb_Stats_get(db, &stats);
+
+    if (rc == CHIDB_OK)
+        rc = opt_select_plan(schema, stats, sql_stmt->stmt.select, &(*sql_stmt_opt)->plan);
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_stmt_optimize_free(*sql_stmt_opt);
+        *sql_stmt_opt = NULL;
+    }
+
+    return rc;
+}
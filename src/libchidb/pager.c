@@ -16,6 +16,36 @@
  * In a real database, the pager component typically does some caching
  * of pages to reduce the number of disk accesses.
  *
+ * The pager can optionally store pages compressed (see
+ * chidb_Pager_setCompression). This is transparent to the rest of chidb:
+ * pages are compressed when they are written, and decompressed when they
+ * are read, so MemPages always contain the uncompressed page. A compressed
+ * file has the following layout:
+ *
+ *  - A 48-byte pager header (see the CPAGER_* constants below) which
+ *    includes the page size, the number of pages, the location of the
+ *    page mapping table, and the end of the last slot.
+ *  - The page slots. Each page is stored in a variable-size slot, which
+ *    contains the length of the page image, followed by the compressed
+ *    page (or the page as-is, if it does not compress). If a page grows
+ *    and no longer fits in its slot, a new slot is appended at the end
+ *    of the file, and the old one is abandoned.
+ *  - The page mapping table, which is a log of 12-byte entries (the page,
+ *    and the offset and capacity of its slot) in a region of its own. The
+ *    last entry for a page tells where its slot is.
+ *
+ * The page mapping table is kept in memory, and the file is kept
+ * consistent with it at all times, so a file that isn't closed cleanly
+ * can still be read. Rewriting a page that fits in its slot doesn't
+ * change the table. When a page is given a new slot, the page is written
+ * to the new slot first, then its entry is appended to the table, after
+ * the entries that the pager header says are valid, and only then is the
+ * header updated to include the new entry. Since the header fits in a
+ * single sector, it is updated atomically. When the table's region is
+ * full, the whole table is written to a new region, twice as large, which
+ * the header then points to. Slots are always appended after the end of
+ * the table's region, so they never overwrite it.
+ *
  */
 
 /*
@@ -63,6 +93,37 @@
 #include "chidbInt.h"
 
 #include "pager.h"
+#include "util.h"
+#include "lz.h"
+
+/* Compressed file header offsets and sizes */
+#define CPAGER_MAGIC ("chidb lz pages")
+#define CPAGER_MAGIC_SIZE (16)
+#define CPAGER_PAGESIZE_OFFSET (16)
+#define CPAGER_NPAGES_OFFSET (18)
+#define CPAGER_MAP_OFFSET (22)
+#define CPAGER_MAPCAPACITY_OFFSET (26)
+#define CPAGER_MAPCOUNT_OFFSET (30)
+#define CPAGER_SLOTSEND_OFFSET (34)
+#define CPAGER_HEADER_SIZE (48)
+
+#define CPAGER_MAPENTRY_SIZE (12)
+
+/* Minimum number of entries of the page mapping table's region */
+#define CPAGER_MAP_MIN_CAPACITY (64)
+
+/* Each slot starts with the length of its page image */
+#define CPAGER_SLOT_HEADER_SIZE (2)
+
+/* Slots are allocated in multiples of this size, so a page can grow
+ * a bit without having to be moved to a new slot */
+#define CPAGER_SLOT_GRANULE (64)
+
+static int chidb_Pager_loadPageMap(Pager *pager);
+static int chidb_Pager_writePagerHeader(Pager *pager);
+static int chidb_Pager_addMapEntry(Pager *pager, npage_t npage);
+static int chidb_Pager_readSlot(Pager *pager, MemPage *page);
+static int chidb_Pager_writeSlot(Pager *pager, MemPage *page);
 
 /* Open a file
  *
@@ -73,13 +134,21 @@
  *			 newly created Pager.
  * - filename: Database file (might not exist)
  *
+ * If the file is a compressed file (see chidb_Pager_setCompression),
+ * the pager header and the page mapping table are also loaded, and
+ * the page size is set to the one stored in the pager header.
+ *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - CHIDB_ECORRUPTHEADER: The file is a compressed file, but its
+ *                         page mapping table could not be read
  */
 int chidb_Pager_open(Pager **pager, const char *filename)
 {
+    uint8_t magic[CPAGER_MAGIC_SIZE];
+
     *pager = malloc(sizeof(Pager));
     if (*pager == NULL)
         return CHIDB_ENOMEM;
@@ -90,8 +159,24 @@ int chidb_Pager_open(Pager **pager, const char *filename)
 
     if ((*pager)->f == NULL)
         return CHIDB_EIO;
-    else
-        return CHIDB_OK;
+
+    (*pager)->n_pages = 0;
+    (*pager)->page_size = 0;
+    (*pager)->compressed = false;
+    (*pager)->slots = NULL;
+    (*pager)->n_slots = 0;
+    (*pager)->slots_end = CPAGER_HEADER_SIZE;
+    (*pager)->map_offset = 0;
+    (*pager)->map_capacity = 0;
+    (*pager)->map_count = 0;
+    (*pager)->zbuf = NULL;
+
+    /* Compressed files are recognized by their pager header */
+    if (fread(magic, 1, CPAGER_MAGIC_SIZE, (*pager)->f) == CPAGER_MAGIC_SIZE &&
+            memcmp(magic, CPAGER_MAGIC, sizeof(CPAGER_MAGIC)) == 0)
+        return chidb_Pager_loadPageMap(*pager);
+
+    return CHIDB_OK;
 }
 
 
@@ -114,10 +199,65 @@ int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
     pager->page_size = pagesize;
     chidb_Pager_getRealDBSize(pager, &pager->n_pages);
 
+    if (pager->compressed)
+    {
+        pager->zbuf = realloc(pager->zbuf, LZ_COMPRESS_BOUND(pagesize));
+        if (pager->zbuf == NULL)
+            return CHIDB_ENOMEM;
+
+        /* The page size of a compressed file is in its pager header */
+        if (pager->n_slots == 0)
+            return chidb_Pager_writePagerHeader(pager);
+    }
+
     return CHIDB_OK;
 }
 
 
+/* Enable or disable compressed-page mode
+ *
+ * This can only be done on an empty file (i.e., before any page has
+ * been written to it). Enabling it writes the pager header, so the
+ * file is recognized as a compressed file when it is opened again,
+ * even if no pages are written to it. Files that already contain
+ * compressed pages are detected when they are opened, so there is no
+ * need to call this function on them.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - compressed: Whether pages must be stored compressed.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The file is not empty
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Pager_setCompression(Pager *pager, bool compressed)
+{
+    struct stat buf;
+
+    fstat(fileno(pager->f), &buf);
+    if (buf.st_size != 0 || pager->n_slots != 0)
+        return CHIDB_EMISUSE;
+
+    pager->compressed = compressed;
+    pager->slots_end = CPAGER_HEADER_SIZE;
+
+    if (!compressed)
+        return CHIDB_OK;
+
+    if (pager->page_size != 0)
+    {
+        pager->zbuf = realloc(pager->zbuf, LZ_COMPRESS_BOUND(pager->page_size));
+        if (pager->zbuf == NULL)
+            return CHIDB_ENOMEM;
+    }
+
+    return chidb_Pager_writePagerHeader(pager);
+}
+
+
 /* Read the chidb file header
  *
  * This function reads in the header of a chidb file and returns it
@@ -136,6 +276,21 @@ int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
 int chidb_Pager_readHeader(Pager *pager, uint8_t *header)
 {
     int count;
+
+    if (pager->compressed)
+    {
+        MemPage *page;
+
+        if (pager->n_slots == 0 || pager->slots[0].offset == 0)
+            return CHIDB_NOHEADER;
+        if (chidb_Pager_readPage(pager, 1, &page) != CHIDB_OK)
+            return CHIDB_NOHEADER;
+        memcpy(header, page->data, 100);
+        chidb_Pager_releaseMemPage(pager, page);
+
+        return CHIDB_OK;
+    }
+
     count = fseek(pager->f, 0, SEEK_SET);
     count = fread(header, 1, 100, pager->f);
     if (count != 100)
@@ -197,6 +352,8 @@ int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
     (*page)->data = calloc(pager->page_size, 1);
     if ((*page)->data == NULL)
         return CHIDB_ENOMEM;
+    if (pager->compressed)
+        return chidb_Pager_readSlot(pager, *page);
     fseek(pager->f, (npage - 1) * pager->page_size, SEEK_SET);
     n = fread((*page)->data, 1, pager->page_size, pager->f);
     chilog(TRACE, "Read %i bytes from page %i into memory [%x data: %x]", n, npage, *page, (*page)->data);
@@ -223,6 +380,8 @@ int	chidb_Pager_writePage(Pager *pager, MemPage *page)
 {
     if (page->npage > pager->n_pages)
         return CHIDB_EPAGENO;
+    if (pager->compressed)
+        return chidb_Pager_writeSlot(pager, page);
     int n;
     fseek(pager->f, (page->npage - 1) * pager->page_size, SEEK_SET);
     n = fwrite(page->data, 1, pager->page_size, pager->f);
@@ -266,6 +425,13 @@ int	chidb_Pager_releaseMemPage(Pager *pager, MemPage *page)
 int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
 {
     struct stat buf;
+
+    if (pager->compressed)
+    {
+        *npages = pager->n_slots;
+        return CHIDB_OK;
+    }
+
     fstat(fileno(pager->f), &buf);
     *npages = buf.st_size / pager->page_size;
 
@@ -284,8 +450,266 @@ int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
  */
 int chidb_Pager_close(Pager *pager)
 {
-    fclose(pager->f);
+    int rc = CHIDB_OK;
+
+    /* The file of a compressed pager is always consistent (see above),
+     * so there is nothing left to write */
+    if (fclose(pager->f) != 0)
+        rc = CHIDB_EIO;
+
+    free(pager->slots);
+    free(pager->zbuf);
     free(pager);
 
+    return rc;
+}
+
+
+/*** COMPRESSED-PAGE MODE ***/
+
+
+/* Makes sure everything written so far is on disk before anything
+ * else is written */
+static int chidb_Pager_sync(Pager *pager)
+{
+    if (fflush(pager->f) != 0 || fsync(fileno(pager->f)) != 0)
+        return CHIDB_EIO;
+
+    return CHIDB_OK;
+}
+
+
+/* Reads the pager header and the page mapping table of a compressed file */
+static int chidb_Pager_loadPageMap(Pager *pager)
+{
+    uint8_t header[CPAGER_HEADER_SIZE], entry[CPAGER_MAPENTRY_SIZE];
+
+    fseek(pager->f, 0, SEEK_SET);
+    if (fread(header, 1, CPAGER_HEADER_SIZE, pager->f) != CPAGER_HEADER_SIZE)
+        return CHIDB_ECORRUPTHEADER;
+
+    pager->compressed = true;
+    pager->page_size = get2byte(&header[CPAGER_PAGESIZE_OFFSET]);
+    pager->n_slots = get4byte(&header[CPAGER_NPAGES_OFFSET]);
+    pager->n_pages = pager->n_slots;
+    pager->map_offset = get4byte(&header[CPAGER_MAP_OFFSET]);
+    pager->map_capacity = get4byte(&header[CPAGER_MAPCAPACITY_OFFSET]);
+    pager->map_count = get4byte(&header[CPAGER_MAPCOUNT_OFFSET]);
+    pager->slots_end = get4byte(&header[CPAGER_SLOTSEND_OFFSET]);
+
+    if (pager->map_count > pager->map_capacity)
+        return CHIDB_ECORRUPTHEADER;
+
+    pager->slots = calloc(pager->n_slots, sizeof(PageSlot));
+    pager->zbuf = malloc(LZ_COMPRESS_BOUND(pager->page_size));
+    if ((pager->n_slots && pager->slots == NULL) || pager->zbuf == NULL)
+        return CHIDB_ENOMEM;
+
+    /* Later entries for a page replace earlier ones */
+    fseek(pager->f, pager->map_offset, SEEK_SET);
+    for(uint32_t i = 0; i < pager->map_count; i++)
+    {
+        npage_t npage;
+
+        if (fread(entry, 1, CPAGER_MAPENTRY_SIZE, pager->f) != CPAGER_MAPENTRY_SIZE)
+            return CHIDB_ECORRUPTHEADER;
+
+        npage = get4byte(&entry[0]);
+        if (npage < 1 || npage > pager->n_slots)
+            return CHIDB_ECORRUPTHEADER;
+        pager->slots[npage - 1].offset = get4byte(&entry[4]);
+        pager->slots[npage - 1].capacity = get4byte(&entry[8]);
+    }
+
+    chilog(TRACE, "Loaded page map of compressed file (%i pages of %i bytes)", pager->n_slots, pager->page_size);
+
+    return CHIDB_OK;
+}
+
+
+/* Writes the pager header of a compressed file, which makes the
+ * page mapping table entries it counts (and their slots) valid. */
+static int chidb_Pager_writePagerHeader(Pager *pager)
+{
+    uint8_t header[CPAGER_HEADER_SIZE];
+
+    memset(header, 0, CPAGER_HEADER_SIZE);
+    memcpy(header, CPAGER_MAGIC, sizeof(CPAGER_MAGIC));
+    put2byte(&header[CPAGER_PAGESIZE_OFFSET], pager->page_size);
+    put4byte(&header[CPAGER_NPAGES_OFFSET], pager->n_slots);
+    put4byte(&header[CPAGER_MAP_OFFSET], pager->map_offset);
+    put4byte(&header[CPAGER_MAPCAPACITY_OFFSET], pager->map_capacity);
+    put4byte(&header[CPAGER_MAPCOUNT_OFFSET], pager->map_count);
+    put4byte(&header[CPAGER_SLOTSEND_OFFSET], pager->slots_end);
+
+    fseek(pager->f, 0, SEEK_SET);
+    if (fwrite(header, 1, CPAGER_HEADER_SIZE, pager->f) != CPAGER_HEADER_SIZE)
+        return CHIDB_EIO;
+
+    return chidb_Pager_sync(pager);
+}
+
+
+/* Writes an entry of the page mapping table to the file */
+static int chidb_Pager_writeMapEntry(Pager *pager, npage_t npage)
+{
+    uint8_t entry[CPAGER_MAPENTRY_SIZE];
+
+    put4byte(&entry[0], npage);
+    put4byte(&entry[4], pager->slots[npage - 1].offset);
+    put4byte(&entry[8], pager->slots[npage - 1].capacity);
+    if (fwrite(entry, 1, CPAGER_MAPENTRY_SIZE, pager->f) != CPAGER_MAPENTRY_SIZE)
+        return CHIDB_EIO;
+
+    return CHIDB_OK;
+}
+
+
+/* Records the (new) slot of a page in the file's page mapping table, once
+ * the page has been written to it. The entry is appended to the table,
+ * unless its region is full, in which case the whole table is written to
+ * a new region at the end of the file. Either way, the entries are on disk
+ * before the pager header is updated to point to them. */
+static int chidb_Pager_addMapEntry(Pager *pager, npage_t npage)
+{
+    int rc;
+
+    rc = chidb_Pager_sync(pager);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (pager->map_count < pager->map_capacity)
+    {
+        fseek(pager->f, pager->map_offset + pager->map_count * CPAGER_MAPENTRY_SIZE, SEEK_SET);
+        rc = chidb_Pager_writeMapEntry(pager, npage);
+        if (rc != CHIDB_OK)
+            return rc;
+        pager->map_count++;
+    }
+    else
+    {
+        uint32_t capacity = 2 * pager->n_slots;
+
+        if (capacity < CPAGER_MAP_MIN_CAPACITY)
+            capacity = CPAGER_MAP_MIN_CAPACITY;
+
+        fseek(pager->f, pager->slots_end, SEEK_SET);
+        pager->map_count = 0;
+        for(npage_t i = 1; i <= pager->n_slots; i++)
+            if (pager->slots[i - 1].offset != 0)
+            {
+                rc = chidb_Pager_writeMapEntry(pager, i);
+                if (rc != CHIDB_OK)
+                    return rc;
+                pager->map_count++;
+            }
+
+        /* The old region is abandoned, like the slots of pages that moved */
+        pager->map_offset = pager->slots_end;
+        pager->map_capacity = capacity;
+        pager->slots_end += capacity * CPAGER_MAPENTRY_SIZE;
+    }
+
+    rc = chidb_Pager_sync(pager);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_Pager_writePagerHeader(pager);
+}
+
+
+/* Reads a page from its slot into an (already zeroed) MemPage. Pages
+ * that have never been written don't have a slot, and read as zeroes. */
+static int chidb_Pager_readSlot(Pager *pager, MemPage *page)
+{
+    PageSlot *slot;
+    uint8_t len[CPAGER_SLOT_HEADER_SIZE];
+    uint16_t length;
+
+    if (page->npage > pager->n_slots || pager->slots[page->npage - 1].offset == 0)
+        return CHIDB_OK;
+
+    slot = &pager->slots[page->npage - 1];
+    fseek(pager->f, slot->offset, SEEK_SET);
+    if (fread(len, 1, CPAGER_SLOT_HEADER_SIZE, pager->f) != CPAGER_SLOT_HEADER_SIZE)
+        return CHIDB_EIO;
+    length = get2byte(len);
+    if (length == 0 || length > pager->page_size || length + CPAGER_SLOT_HEADER_SIZE > slot->capacity)
+        return CHIDB_ECORRUPT;
+
+    /* Pages that didn't compress are stored as-is */
+    if (length == pager->page_size)
+    {
+        if (fread(page->data, 1, pager->page_size, pager->f) != pager->page_size)
+            return CHIDB_EIO;
+    }
+    else
+    {
+        if (fread(pager->zbuf, 1, length, pager->f) != length)
+            return CHIDB_EIO;
+        if (chidb_lz_decompress(pager->zbuf, length, page->data, pager->page_size) != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+    }
+
+    chilog(TRACE, "Read page %i from slot at %i (%i bytes)", page->npage, slot->offset, length);
+
+    return CHIDB_OK;
+}
+
+
+/* Compresses a page and writes it to its slot, moving it to a new slot
+ * at the end of the file (and recording the move in the page mapping
+ * table) if it doesn't fit in its current one. */
+static int chidb_Pager_writeSlot(Pager *pager, MemPage *page)
+{
+    PageSlot *slot;
+    uint8_t *image, len[CPAGER_SLOT_HEADER_SIZE];
+    uint32_t length;
+    bool moved = false;
+
+    if (page->npage > pager->n_slots)
+    {
+        PageSlot *slots = realloc(pager->slots, page->npage * sizeof(PageSlot));
+        if (slots == NULL)
+            return CHIDB_ENOMEM;
+        memset(&slots[pager->n_slots], 0, (page->npage - pager->n_slots) * sizeof(PageSlot));
+        pager->slots = slots;
+        pager->n_slots = page->npage;
+    }
+    slot = &pager->slots[page->npage - 1];
+
+    /* If the page doesn't compress to less than page_size bytes,
+     * we store it as-is (a length of page_size tells them apart) */
+    chidb_lz_compress(page->data, pager->page_size, pager->zbuf, pager->page_size - 1, &length);
+    if (length == 0)
+    {
+        image = page->data;
+        length = pager->page_size;
+    }
+    else
+        image = pager->zbuf;
+
+    if (length + CPAGER_SLOT_HEADER_SIZE > slot->capacity)
+    {
+        uint32_t capacity = (length + CPAGER_SLOT_HEADER_SIZE + CPAGER_SLOT_GRANULE - 1) / CPAGER_SLOT_GRANULE * CPAGER_SLOT_GRANULE;
+        uint32_t max = pager->page_size + CPAGER_SLOT_HEADER_SIZE;
+
+        slot->offset = pager->slots_end;
+        slot->capacity = capacity < max ? capacity : max;
+        pager->slots_end += slot->capacity;
+        moved = true;
+    }
+
+    put2byte(len, length);
+    fseek(pager->f, slot->offset, SEEK_SET);
+    if (fwrite(len, 1, CPAGER_SLOT_HEADER_SIZE, pager->f) != CPAGER_SLOT_HEADER_SIZE ||
+            fwrite(image, 1, length, pager->f) != length)
+        return CHIDB_EIO;
+
+    chilog(TRACE, "Wrote page %i to slot at %i (%i bytes)", page->npage, slot->offset, length);
+
+    if (moved)
+        return chidb_Pager_addMapEntry(pager, page->npage);
+
     return CHIDB_OK;
 }
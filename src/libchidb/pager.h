@@ -50,16 +50,35 @@ struct MemPage
 };
 typedef struct MemPage MemPage;
 
+/* Location of a page image in a compressed file (see pager.c) */
+struct PageSlot
+{
+    uint32_t offset;     /* Byte offset of the slot in the file (0 if the page was never written) */
+    uint32_t capacity;   /* Number of bytes reserved for the slot */
+};
+typedef struct PageSlot PageSlot;
+
 struct Pager
 {
     FILE *f;
     npage_t n_pages;
     uint16_t page_size;
+
+    /* Compressed-page mode */
+    bool compressed;
+    PageSlot *slots;     /* Page mapping table (slot i holds page i+1) */
+    npage_t n_slots;
+    uint32_t slots_end;  /* Offset where the next slot will be appended */
+    uint32_t map_offset; /* Region of the page mapping table in the file */
+    uint32_t map_capacity;
+    uint32_t map_count;  /* Number of entries of the table in its region */
+    uint8_t *zbuf;       /* Scratch buffer for compressed page images */
 };
 typedef struct Pager Pager;
 
 int chidb_Pager_open(Pager **pager, const char *filename);
 int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize);
+int chidb_Pager_setCompression(Pager *pager, bool compressed);
 int chidb_Pager_readHeader(Pager *pager, uint8_t *header);
 int chidb_Pager_allocatePage(Pager *pager, npage_t *npage);
 int chidb_Pager_releaseMemPage(Pager *pager, MemPage *page);
@@ -482,6 +482,29 @@ int chidb_DBRecord_getString(DBRecord *dbr, uint8_t field, char **v)
 }
 
 
+/* Returns a pointer to the bytes of a string field, in the record
+ *
+ * The bytes are not copied (nor NUL-terminated), so they are only valid
+ * for as long as the record is.
+ *
+ * Parameters
+ * - dbr: The DBRecord
+ * - field: Index of the field
+ * - v: Out parameter used to return the pointer
+ * - len: Out parameter used to return the length
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBRecord_getStringRef(DBRecord *dbr, uint8_t field, const char **v, int *len)
+{
+    chidb_DBRecord_getStringLength(dbr, field, len);
+    *v = (const char *) &dbr->data[dbr->offsets[field]];
+
+    return CHIDB_OK;
+}
+
+
 /* Returns the length of a string field
  *
  * Parameters
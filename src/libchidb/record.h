@@ -82,6 +82,7 @@ int chidb_DBRecord_getInt8(DBRecord *dbr, uint8_t field, int8_t *v);
 int chidb_DBRecord_getInt16(DBRecord *dbr, uint8_t field, int16_t *v);
 int chidb_DBRecord_getInt32(DBRecord *dbr, uint8_t field, int32_t *v);
 int chidb_DBRecord_getString(DBRecord *dbr, uint8_t field, char **v);
+int chidb_DBRecord_getStringRef(DBRecord *dbr, uint8_t field, const char **v, int *len);
 int chidb_DBRecord_getStringLength(DBRecord *dbr, uint8_t field, int *len);
 
 int chidb_DBRecord_print(DBRecord *dbr);
@@ -0,0 +1,447 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module keeps an in-memory copy of the schema table (the table
+ * B-Tree rooted at page 1), which the code generator uses to find the
+ * root page and columns of the tables and indexes referenced in a SQL
+ * statement.
+ *
+ * Each entry of the schema table is a record with five fields: the type
+ * of the entry ("table", "index" or "dictionary"), its name, the name of
+ * the table it belongs to, its root page, and the SQL statement that
+ * created it. The columns of a table are obtained by parsing that SQL
+ * statement. A dictionary has no SQL statement (its entry has an empty
+ * string instead); it belongs to the table whose columns it encodes.
+ *
+ * The schema is loaded the first time it is needed, and is loaded again
+ * whenever the schema version of the database changes (see chidb_step).
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <chisql/chisql.h>
+#include "chidbInt.h"
+#include "schema.h"
+#include "btree.h"
+#include "record.h"
+
+static int chidb_Schema_load(BTree *bt, npage_t npage, Schema *schema, const char *type);
+static int chidb_Schema_addEntry(Schema *schema, chidb_key_t key, DBRecord *dbr, const char *type);
+
+
+/* Get the schema of a database
+ *
+ * Returns the in-memory copy of the schema table, loading it from
+ * the file if it hasn't been loaded yet, or if the schema has been
+ * modified since it was loaded.
+ *
+ * Parameters
+ * - db: chidb database
+ * - schema: Out parameter. Used to return a pointer to the schema.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - CHIDB_ECORRUPT: An entry of the schema table is not valid
+ */
+int chidb_Schema_get(chidb *db, Schema **schema)
+{
+    Schema *s;
+    int rc;
+
+    if (db->schema != NULL && db->schema->version == db->schemaVersion)
+    {
+        *schema = db->schema;
+        return CHIDB_OK;
+    }
+
+    s = calloc(1, sizeof(Schema));
+    if (s == NULL)
+        return CHIDB_ENOMEM;
+    s->version = db->schemaVersion;
+
+    /* The tables are loaded first, so the indexes can point to them */
+    rc = chidb_Schema_load(db->bt, 1, s, "table");
+    if (rc == CHIDB_OK)
+        rc = chidb_Schema_load(db->bt, 1, s, "index");
+    if (rc == CHIDB_OK)
+        rc = chidb_Schema_load(db->bt, 1, s, "dictionary");
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_Schema_free(s);
+        return rc;
+    }
+
+    chidb_Schema_free(db->schema);
+    db->schema = s;
+    *schema = s;
+
+    return CHIDB_OK;
+}
+
+
+/* Find a table in the schema
+ *
+ * Parameters
+ * - schema: Schema
+ * - name: Name of the table
+ * - table: Out parameter. Used to return a pointer to the table.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no table with that name
+ */
+int chidb_Schema_findTable(Schema *schema, const char *name, SchemaTable **table)
+{
+    for(uint32_t i = 0; i < schema->nTables; i++)
+        if (strcasecmp(schema->tables[i].name, name) == 0)
+        {
+            *table = &schema->tables[i];
+            return CHIDB_OK;
+        }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/* Find a column of a table
+ *
+ * Parameters
+ * - table: Table
+ * - name: Name of the column
+ * - col: Out parameter. Used to return the number of the column
+ *        (the first column is column 0)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The table has no column with that name
+ */
+int chidb_Schema_findColumn(SchemaTable *table, const char *name, int32_t *col)
+{
+    for(uint32_t i = 0; i < table->nCols; i++)
+        if (strcasecmp(table->cols[i], name) == 0)
+        {
+            *col = i;
+            return CHIDB_OK;
+        }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/* Find an index in the schema
+ *
+ * Parameters
+ * - schema: Schema
+ * - name: Name of the index
+ * - index: Out parameter. Used to return a pointer to the index.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no index with that name
+ */
+int chidb_Schema_findIndex(Schema *schema, const char *name, SchemaIndex **index)
+{
+    for(uint32_t i = 0; i < schema->nIndexes; i++)
+        if (strcasecmp(schema->indexes[i].name, name) == 0)
+        {
+            *index = &schema->indexes[i];
+            return CHIDB_OK;
+        }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/* Free an in-memory copy of the schema
+ *
+ * Parameters
+ * - schema: Schema (may be NULL)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Schema_free(Schema *schema)
+{
+    if (schema == NULL)
+        return CHIDB_OK;
+
+    for(uint32_t i = 0; i < schema->nTables; i++)
+    {
+        SchemaTable *t = &schema->tables[i];
+
+        for(uint32_t j = 0; j < t->nCols; j++)
+            free(t->cols[j]);
+        free(t->cols);
+        free(t->types);
+        free(t->encoded);
+        free(t->name);
+    }
+    free(schema->tables);
+
+    for(uint32_t i = 0; i < schema->nIndexes; i++)
+        free(schema->indexes[i].name);
+    free(schema->indexes);
+
+    free(schema);
+
+    return CHIDB_OK;
+}
+
+
+/* Reads an integer field of a record, regardless of its size */
+static int chidb_Schema_getInt(DBRecord *dbr, uint8_t field, int32_t *v)
+{
+    int8_t v8;
+    int16_t v16;
+
+    switch (chidb_DBRecord_getType(dbr, field))
+    {
+    case SQL_INTEGER_1BYTE:
+        chidb_DBRecord_getInt8(dbr, field, &v8);
+        *v = v8;
+        return CHIDB_OK;
+    case SQL_INTEGER_2BYTE:
+        chidb_DBRecord_getInt16(dbr, field, &v16);
+        *v = v16;
+        return CHIDB_OK;
+    case SQL_INTEGER_4BYTE:
+        return chidb_DBRecord_getInt32(dbr, field, v);
+    default:
+        return CHIDB_ECORRUPT;
+    }
+}
+
+
+/* Adds a table to the schema, with the columns in its CREATE TABLE statement */
+static int chidb_Schema_addTable(Schema *schema, char *name, npage_t nroot, Table_t *table)
+{
+    SchemaTable *tables, *t;
+    Column_t *col;
+    uint32_t i;
+
+    tables = realloc(schema->tables, sizeof(SchemaTable) * (schema->nTables + 1));
+    if (tables == NULL)
+        return CHIDB_ENOMEM;
+    schema->tables = tables;
+
+    t = &schema->tables[schema->nTables];
+    t->name = name;
+    t->nroot = nroot;
+    t->nCols = 0;
+    t->pk = -1;
+    t->dict = 0;
+
+    for(col = table->columns; col; col = col->next)
+        t->nCols++;
+
+    t->cols = malloc(sizeof(char *) * t->nCols);
+    t->types = malloc(sizeof(enum data_type) * t->nCols);
+    t->encoded = calloc(t->nCols, sizeof(bool));
+    if (t->cols == NULL || t->types == NULL || t->encoded == NULL)
+    {
+        free(t->cols);
+        free(t->types);
+        free(t->encoded);
+        return CHIDB_ENOMEM;
+    }
+
+    for(col = table->columns, i = 0; col; col = col->next, i++)
+    {
+        t->cols[i] = strdup(col->name);
+        t->types[i] = col->type;
+
+        for(Constraint_t *c = col->constraints; c; c = c->next)
+            if (c->t == CONS_PRIMARY_KEY && col->type == TYPE_INT)
+                t->pk = i;
+            else if (c->t == CONS_DICTIONARY && col->type == TYPE_TEXT)
+                t->encoded[i] = true;
+    }
+
+    schema->nTables++;
+
+    return CHIDB_OK;
+}
+
+
+/* Adds an index to the schema (its table must already be in the schema) */
+static int chidb_Schema_addIndex(Schema *schema, char *name, npage_t nroot, Index_t *index)
+{
+    SchemaIndex *indexes, *idx;
+    SchemaTable *t;
+    int32_t cols[SCHEMA_MAX_INDEX_COLS];
+    uint32_t nCols = 0;
+
+    if (chidb_Schema_findTable(schema, index->table_name, &t) != CHIDB_OK)
+        return CHIDB_ECORRUPT;
+
+    for (StrList_t *name = index->columns; name; name = name->next)
+        if (nCols == SCHEMA_MAX_INDEX_COLS ||
+            chidb_Schema_findColumn(t, name->str, &cols[nCols++]) != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+
+    indexes = realloc(schema->indexes, sizeof(SchemaIndex) * (schema->nIndexes + 1));
+    if (indexes == NULL)
+        return CHIDB_ENOMEM;
+    schema->indexes = indexes;
+
+    idx = &schema->indexes[schema->nIndexes++];
+    idx->name = name;
+    idx->nroot = nroot;
+    idx->table = t;
+    idx->col = cols[0];
+    memcpy(idx->cols, cols, sizeof(int32_t) * nCols);
+    idx->nCols = nCols;
+
+    return CHIDB_OK;
+}
+
+
+/* Adds the entry of the schema table with the given key and record,
+ * if it is an entry of the given type ("table" or "index") */
+static int chidb_Schema_addEntry(Schema *schema, chidb_key_t key, DBRecord *dbr, const char *type)
+{
+    chisql_statement_t *sql_stmt;
+    char *etype, *name, *sql;
+    int32_t nroot;
+    int rc;
+
+    if (key > schema->maxKey)
+        schema->maxKey = key;
+
+    if (dbr->nfields != 5 || chidb_DBRecord_getType(dbr, 0) != SQL_TEXT)
+        return CHIDB_ECORRUPT;
+
+    rc = chidb_DBRecord_getString(dbr, 0, &etype);
+    if (rc != CHIDB_OK)
+        return rc;
+    rc = strcmp(etype, type);
+    free(etype);
+    if (rc != 0)
+        return CHIDB_OK;
+
+    /* A dictionary only has to be attached to its table */
+    if (strcmp(type, "dictionary") == 0)
+    {
+        SchemaTable *t;
+        char *tbl_name;
+
+        if (chidb_DBRecord_getType(dbr, 2) != SQL_TEXT ||
+            chidb_Schema_getInt(dbr, 3, &nroot) != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+
+        chidb_DBRecord_getString(dbr, 2, &tbl_name);
+        rc = chidb_Schema_findTable(schema, tbl_name, &t);
+        free(tbl_name);
+        if (rc != CHIDB_OK)
+            return CHIDB_ECORRUPT;
+
+        t->dict = nroot;
+        return CHIDB_OK;
+    }
+
+    if (chidb_DBRecord_getType(dbr, 1) != SQL_TEXT ||
+        chidb_DBRecord_getType(dbr, 4) != SQL_TEXT ||
+        chidb_Schema_getInt(dbr, 3, &nroot) != CHIDB_OK)
+        return CHIDB_ECORRUPT;
+
+    chidb_DBRecord_getString(dbr, 4, &sql);
+    rc = chisql_parser(sql, &sql_stmt);
+    free(sql);
+    if (rc != CHIDB_OK)
+        return CHIDB_ECORRUPT;
+
+    chidb_DBRecord_getString(dbr, 1, &name);
+
+    if (sql_stmt->type != STMT_CREATE)
+        rc = CHIDB_ECORRUPT;
+    else if (strcmp(type, "table") == 0 && sql_stmt->stmt.create->t == CREATE_TABLE)
+        rc = chidb_Schema_addTable(schema, name, nroot, sql_stmt->stmt.create->table);
+    else if (strcmp(type, "index") == 0 && sql_stmt->stmt.create->t == CREATE_INDEX)
+        rc = chidb_Schema_addIndex(schema, name, nroot, sql_stmt->stmt.create->index);
+    else
+        rc = CHIDB_ECORRUPT;
+
+    if (rc != CHIDB_OK)
+        free(name);
+
+    if (sql_stmt->type == STMT_CREATE)
+        Create_free(sql_stmt->stmt.create);
+    free(sql_stmt->text);
+    free(sql_stmt);
+
+    return rc;
+}
+
+
+/* Loads the entries of the given type in the schema table's B-Tree into memory */
+static int chidb_Schema_load(BTree *bt, npage_t npage, Schema *schema, const char *type)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    DBRecord *dbr;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+
+        if (btn->type == PGTYPE_TABLE_LEAF)
+        {
+            rc = chidb_DBRecord_unpack(&dbr, btc.fields.tableLeaf.data);
+            if (rc != CHIDB_OK)
+                break;
+            rc = chidb_Schema_addEntry(schema, btc.key, dbr, type);
+            chidb_DBRecord_destroy(dbr);
+        }
+        else
+            rc = chidb_Schema_load(bt, btc.fields.tableInternal.child_page, schema, type);
+    }
+
+    if (rc == CHIDB_OK && btn->type == PGTYPE_TABLE_INTERNAL)
+        rc = chidb_Schema_load(bt, btn->right_page, schema, type);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
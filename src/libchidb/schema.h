@@ -0,0 +1,94 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Schema header
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SCHEMA_H_
+#define SCHEMA_H_
+
+#include <chisql/chisql.h>
+#include "chidbInt.h"
+
+/* A table, as described by its entry in the schema table */
+typedef struct SchemaTable
+{
+    char *name;
+    npage_t nroot;           /* Root page of the table's B-Tree */
+    uint32_t nCols;
+    char **cols;             /* Column names */
+    enum data_type *types;   /* Column types */
+    int32_t pk;              /* INTEGER PRIMARY KEY column (-1 if none). Its value
+                              * is the key of each entry, and it is stored as
+                              * NULL in the entry's record */
+    npage_t dict;            /* Root page of the table's dictionary (0 if none) */
+    bool *encoded;           /* Is each column dictionary-encoded (see dict.c)? */
+} SchemaTable;
+
+/* Maximum number of columns of an index. An index on several columns is
+ * a key B-Tree (see keytree.c), whose keys are the encoding of their
+ * values followed by the primary key (see MakeKey) */
+#define SCHEMA_MAX_INDEX_COLS (5)
+
+/* An index, as described by its entry in the schema table */
+typedef struct SchemaIndex
+{
+    char *name;
+    npage_t nroot;           /* Root page of the index's B-Tree */
+    SchemaTable *table;      /* Indexed table */
+    int32_t col;             /* Indexed column (the first one, if there are several) */
+    int32_t cols[SCHEMA_MAX_INDEX_COLS];
+    uint32_t nCols;
+} SchemaIndex;
+
+/* In-memory copy of the schema table */
+struct Schema
+{
+    uint32_t version;        /* db->schemaVersion when the schema was loaded */
+    SchemaTable *tables;
+    uint32_t nTables;
+    SchemaIndex *indexes;
+    uint32_t nIndexes;
+    chidb_key_t maxKey;      /* Largest key in the schema table (0 if it is empty) */
+};
+
+int chidb_Schema_get(chidb *db, Schema **schema);
+int chidb_Schema_findTable(Schema *schema, const char *name, SchemaTable **table);
+int chidb_Schema_findColumn(SchemaTable *table, const char *name, int32_t *col);
+int chidb_Schema_findIndex(Schema *schema, const char *name, SchemaIndex **index);
+int chidb_Schema_free(Schema *schema);
+
+#endif /*SCHEMA_H_*/
@@ -0,0 +1,1037 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module collects the statistics that the optimizer and the code
+ * generator use to estimate how many rows a query will visit (ANALYZE),
+ * and keeps an in-memory copy of them.
+ *
+ * The statistics are stored in a regular table, chidb_stat, which is
+ * created by the first ANALYZE:
+ *
+ *   CREATE TABLE chidb_stat(id INTEGER PRIMARY KEY, type TEXT, tbl TEXT,
+ *                           name TEXT, stat TEXT)
+ *
+ * Each entry holds the statistics of a table (type "table", with the
+ * table's name in both tbl and name), of an index (type "index"), or of
+ * a column of a table (type "column"). The statistics themselves are a
+ * list of integers separated by spaces:
+ *
+ * - table: number of rows, number of pages, depth of the B-Tree
+ * - index: number of entries, number of pages, depth of the B-Tree
+ * - column: number of distinct (non-NULL) values, number of NULLs and,
+ *   for an INTEGER column, the bounds of an equi-depth histogram
+ *
+ * ANALYZE reads every table and index B-Tree in full, so the statistics
+ * are exact when they are collected. Since B-Trees don't support deletes,
+ * ANALYZE doesn't replace the previous entries: it appends new ones, and
+ * the entry with the largest key is the one that counts.
+ *
+ * The statistics are loaded the first time they are needed, and are
+ * loaded again whenever the schema version of the database changes
+ * (ANALYZE counts as a schema change, see chidb_step).
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chisql/chisql.h>
+#include "chidbInt.h"
+#include "stats.h"
+#include "schema.h"
+#include "btree.h"
+#include "keytree.h"
+#include "record.h"
+
+
+/* Values of a column, as read by ANALYZE. The values are not kept: the
+ * number of distinct values is estimated from the smallest hashes of
+ * the values (a "k minimum values" sketch), and the histogram from a
+ * reservoir sample of the integer values, so that the memory used by
+ * ANALYZE doesn't depend on the size of the table */
+typedef struct stats_values
+{
+    uint64_t *hashes;        /* Smallest distinct hashes, sorted (at most STATS_SKETCH_SIZE) */
+    uint32_t nHashes;
+    int32_t *sample;         /* Sample of the integer values (at most STATS_SAMPLE_SIZE) */
+    uint32_t nSample;
+    uint32_t nInts;          /* Number of integer values */
+    int32_t min, max;        /* Smallest and largest integer values */
+    uint32_t nValues;        /* Number of non-NULL values */
+    uint32_t nNull;
+} stats_values_t;
+
+/* Statistics of a B-Tree, as read by ANALYZE */
+typedef struct stats_scan
+{
+    SchemaTable *table;      /* Table whose rows are read (NULL for an index) */
+    uint32_t nEntries;
+    uint32_t nPages;
+    uint32_t depth;
+    stats_values_t *values;  /* Values of each column of the table */
+    uint64_t rand;           /* State of the generator that picks the sample */
+} stats_scan_t;
+
+/* An entry of the statistics table, as written by ANALYZE */
+typedef struct stats_entry
+{
+    const char *type;
+    const char *tbl;
+    const char *name;
+    uint8_t *data;           /* Packed record */
+    uint32_t size;
+    bool written;            /* Has it overwritten an existing entry? */
+} stats_entry_t;
+
+/* Widths of a count and of a histogram bound in the statistics of an
+ * entry, which are padded to the largest width that they can have, so
+ * that the entries of an ANALYZE have the same size as those of the
+ * previous one (and can overwrite them) */
+#define STATS_COUNT_WIDTH (11)   /* "4294967295 " */
+#define STATS_BOUND_WIDTH (12)   /* " -2147483648" */
+
+
+/*
+ * ANALYZE
+ */
+
+/* Appends a value to an array that grows in powers of two */
+static int chidb_Stats_push(void **array, uint32_t *n, size_t size, const void *v)
+{
+    if ((*n & (*n - 1)) == 0)
+    {
+        void *a = realloc(*array, size * (*n == 0 ? 1 : *n * 2));
+
+        if (a == NULL)
+            return CHIDB_ENOMEM;
+        *array = a;
+    }
+
+    memcpy((char *) *array + size * (*n)++, v, size);
+
+    return CHIDB_OK;
+}
+
+/* Hash value of a value (FNV-1a over its type and its bytes, with a
+ * final mix so that all the bits of the hash are evenly distributed) */
+static uint64_t chidb_Stats_hash(uint8_t type, const void *bytes, size_t len)
+{
+    const uint8_t *b = bytes;
+    uint64_t h = 14695981039346656037ULL;
+
+    h = (h ^ type) * 1099511628211ULL;
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ b[i]) * 1099511628211ULL;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* Adds the hash of a value to the smallest hashes of a column */
+static int chidb_Stats_addHash(stats_values_t *vals, uint64_t h)
+{
+    uint32_t lo = 0, hi = vals->nHashes, n;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (vals->hashes[mid] < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < vals->nHashes && vals->hashes[lo] == h)
+        return CHIDB_OK;
+
+    /* When the sketch is full, the new hash replaces the largest one */
+    if (vals->nHashes == STATS_SKETCH_SIZE)
+    {
+        if (lo == STATS_SKETCH_SIZE)
+            return CHIDB_OK;
+        n = STATS_SKETCH_SIZE - 1;
+    }
+    else if (chidb_Stats_push((void **) &vals->hashes, &vals->nHashes, sizeof(uint64_t), &h) != CHIDB_OK)
+        return CHIDB_ENOMEM;
+    else
+        n = vals->nHashes - 1;
+
+    memmove(&vals->hashes[lo + 1], &vals->hashes[lo], sizeof(uint64_t) * (n - lo));
+    vals->hashes[lo] = h;
+    vals->nHashes = n + 1;
+
+    return CHIDB_OK;
+}
+
+/* Records an integer value of a column. The sample is a reservoir
+ * sample: the n-th value replaces a random value of the sample with
+ * probability STATS_SAMPLE_SIZE / n */
+static int chidb_Stats_addInt(stats_scan_t *scan, stats_values_t *vals, int32_t v)
+{
+    uint64_t j;
+
+    if (vals->nInts == 0 || v < vals->min)
+        vals->min = v;
+    if (vals->nInts == 0 || v > vals->max)
+        vals->max = v;
+    vals->nInts++;
+    vals->nValues++;
+
+    if (chidb_Stats_addHash(vals, chidb_Stats_hash(SQL_INTEGER_4BYTE, &v, sizeof(int32_t))) != CHIDB_OK)
+        return CHIDB_ENOMEM;
+
+    if (vals->nSample < STATS_SAMPLE_SIZE)
+        return chidb_Stats_push((void **) &vals->sample, &vals->nSample, sizeof(int32_t), &v);
+
+    /* xorshift64 */
+    scan->rand ^= scan->rand << 13;
+    scan->rand ^= scan->rand >> 7;
+    scan->rand ^= scan->rand << 17;
+    j = scan->rand % vals->nInts;
+    if (j < STATS_SAMPLE_SIZE)
+        vals->sample[j] = v;
+
+    return CHIDB_OK;
+}
+
+/* Records the value of a column of a table entry */
+static int chidb_Stats_addValue(stats_scan_t *scan, stats_values_t *vals, DBRecord *dbr, uint8_t field)
+{
+    int8_t v8;
+    int16_t v16;
+    int32_t v32;
+    const char *s;
+    int len;
+
+    switch (chidb_DBRecord_getType(dbr, field))
+    {
+    case SQL_NULL:
+        vals->nNull++;
+        return CHIDB_OK;
+    case SQL_INTEGER_1BYTE:
+        chidb_DBRecord_getInt8(dbr, field, &v8);
+        return chidb_Stats_addInt(scan, vals, v8);
+    case SQL_INTEGER_2BYTE:
+        chidb_DBRecord_getInt16(dbr, field, &v16);
+        return chidb_Stats_addInt(scan, vals, v16);
+    case SQL_INTEGER_4BYTE:
+        chidb_DBRecord_getInt32(dbr, field, &v32);
+        return chidb_Stats_addInt(scan, vals, v32);
+    default:
+        vals->nValues++;
+        chidb_DBRecord_getStringRef(dbr, field, &s, &len);
+        return chidb_Stats_addHash(vals, chidb_Stats_hash(SQL_TEXT, s, len));
+    }
+}
+
+/* Reads the nodes of a B-Tree (and, for a table, the values of its
+ * columns), starting at the node in page npage, which is at the given
+ * level of the tree (1 for the root) */
+static int chidb_Stats_scan(BTree *bt, npage_t npage, uint32_t level, stats_scan_t *scan)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    DBRecord *dbr;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    scan->nPages++;
+    if (level > scan->depth)
+        scan->depth = level;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+
+        switch (btn->type)
+        {
+        case PGTYPE_TABLE_LEAF:
+            rc = chidb_DBRecord_unpack(&dbr, btc.fields.tableLeaf.data);
+            if (rc != CHIDB_OK)
+                break;
+
+            /* The primary key is the key of the entry */
+            for(uint32_t c = 0; c < scan->table->nCols && rc == CHIDB_OK; c++)
+                if ((int32_t) c == scan->table->pk)
+                    rc = chidb_Stats_addInt(scan, &scan->values[c], btc.key);
+                else if (c < dbr->nfields)
+                    rc = chidb_Stats_addValue(scan, &scan->values[c], dbr, c);
+                else
+                    scan->values[c].nNull++;
+
+            chidb_DBRecord_destroy(dbr);
+            scan->nEntries++;
+            break;
+        case PGTYPE_TABLE_INTERNAL:
+            rc = chidb_Stats_scan(bt, btc.fields.tableInternal.child_page, level + 1, scan);
+            break;
+        case PGTYPE_INDEX_INTERNAL:
+            /* The cells of an index's internal nodes are also entries */
+            scan->nEntries++;
+            rc = chidb_Stats_scan(bt, btc.fields.indexInternal.child_page, level + 1, scan);
+            break;
+        default:
+            scan->nEntries++;
+        }
+    }
+
+    if (rc == CHIDB_OK && (btn->type == PGTYPE_TABLE_INTERNAL || btn->type == PGTYPE_INDEX_INTERNAL))
+        rc = chidb_Stats_scan(bt, btn->right_page, level + 1, scan);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
+
+static int chidb_Stats_cmpInt(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *) a, y = *(const int32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Pads the statistics of an entry with spaces, up to a given width */
+static void chidb_Stats_pad(char *stat, size_t size, size_t width)
+{
+    size_t len = strlen(stat);
+
+    if (width >= size)
+        width = size - 1;
+    memset(stat + len, ' ', len < width ? width - len : 0);
+    stat[len < width ? width : len] = '\0';
+}
+
+/* Writes the statistics of a column */
+static void chidb_Stats_formatColumn(stats_values_t *vals, bool histogram, char *stat, size_t size)
+{
+    uint32_t nDistinct, nb;
+    size_t len;
+
+    /* If the sketch is full, the largest of the k smallest hashes is
+     * about k/nDistinct of the way through the range of the hashes */
+    if (vals->nHashes < STATS_SKETCH_SIZE)
+        nDistinct = vals->nHashes;
+    else
+    {
+        double d = (STATS_SKETCH_SIZE - 1) / ((double) vals->hashes[STATS_SKETCH_SIZE - 1] / 18446744073709551616.0);
+
+        nDistinct = d < vals->nValues ? (uint32_t) d : vals->nValues;
+    }
+
+    len = snprintf(stat, size, "%u %u", nDistinct, vals->nNull);
+
+    /* The bounds of bucket i are the values at positions i*n/nb and
+     * (i+1)*n/nb of the sorted sample, except for the first and the
+     * last ones, which are the smallest and the largest values */
+    if (histogram && vals->nInts > 0)
+    {
+        qsort(vals->sample, vals->nSample, sizeof(int32_t), chidb_Stats_cmpInt);
+
+        nb = vals->nSample < STATS_NBUCKETS ? vals->nSample : STATS_NBUCKETS;
+        for(uint32_t i = 0; i <= nb && len < size; i++)
+            len += snprintf(stat + len, size - len, " %d",
+                            i == 0 ? vals->min : i == nb ? vals->max :
+                            vals->sample[(uint64_t) i * (vals->nSample - 1) / nb]);
+    }
+
+    chidb_Stats_pad(stat, size, 2 * STATS_COUNT_WIDTH + (histogram ? (STATS_NBUCKETS + 1) * STATS_BOUND_WIDTH : 0));
+}
+
+/* Adds an entry to the entries that ANALYZE writes */
+static int chidb_Stats_entry(stats_entry_t **entries, uint32_t *n,
+                             const char *type, const char *tbl, const char *name, char *stat)
+{
+    DBRecordBuffer dbrb;
+    DBRecord *dbr;
+    stats_entry_t e;
+    int rc;
+
+    chidb_DBRecord_create_empty(&dbrb, 5);
+    chidb_DBRecord_appendNull(&dbrb);
+    chidb_DBRecord_appendString(&dbrb, (char *) type);
+    chidb_DBRecord_appendString(&dbrb, (char *) tbl);
+    chidb_DBRecord_appendString(&dbrb, (char *) name);
+    chidb_DBRecord_appendString(&dbrb, stat);
+    chidb_DBRecord_finalize(&dbrb, &dbr);
+
+    e.type = type;
+    e.tbl = tbl;
+    e.name = name;
+    e.written = false;
+    e.data = NULL;
+
+    rc = chidb_DBRecord_pack(dbr, &e.data);
+    e.size = dbr->packed_len;
+    chidb_DBRecord_destroy(dbr);
+
+    if (rc == CHIDB_OK && (rc = chidb_Stats_push((void **) entries, n, sizeof(stats_entry_t), &e)) != CHIDB_OK)
+        free(e.data);
+
+    return rc;
+}
+
+/* Reads a table and adds the entries with its statistics, and those of
+ * its columns */
+static int chidb_Stats_analyzeTable(BTree *bt, SchemaTable *t, stats_entry_t **entries, uint32_t *nEntries)
+{
+    stats_scan_t scan;
+    char stat[MAX_STR_LEN];
+    int rc;
+
+    memset(&scan, 0, sizeof(stats_scan_t));
+    scan.table = t;
+    scan.rand = 88172645463325252ULL;
+    scan.values = calloc(t->nCols, sizeof(stats_values_t));
+    if (scan.values == NULL)
+        return CHIDB_ENOMEM;
+
+    rc = chidb_Stats_scan(bt, t->nroot, 1, &scan);
+
+    if (rc == CHIDB_OK)
+    {
+        snprintf(stat, sizeof(stat), "%u %u %u", scan.nEntries, scan.nPages, scan.depth);
+        chidb_Stats_pad(stat, sizeof(stat), 3 * STATS_COUNT_WIDTH);
+        rc = chidb_Stats_entry(entries, nEntries, "table", t->name, t->name, stat);
+    }
+
+    for(uint32_t c = 0; c < t->nCols; c++)
+    {
+        stats_values_t *vals = &scan.values[c];
+
+        if (rc == CHIDB_OK)
+        {
+            chidb_Stats_formatColumn(vals, t->types[c] == TYPE_INT, stat, sizeof(stat));
+            rc = chidb_Stats_entry(entries, nEntries, "column", t->name, t->cols[c], stat);
+        }
+
+        free(vals->hashes);
+        free(vals->sample);
+    }
+    free(scan.values);
+
+    return rc;
+}
+
+/* Does a field of a record have a given string value? */
+static bool chidb_Stats_fieldIs(DBRecord *dbr, uint8_t field, const char *v)
+{
+    const char *s;
+    int len;
+
+    if (field >= dbr->nfields || chidb_DBRecord_getType(dbr, field) != SQL_TEXT)
+        return false;
+
+    chidb_DBRecord_getStringRef(dbr, field, &s, &len);
+
+    return (size_t) len == strlen(v) && memcmp(s, v, len) == 0;
+}
+
+/* Overwrites the existing entries of the statistics table (starting at
+ * the node in page npage) with the new entries for the same table,
+ * column or index, if they have the same size. All the existing entries
+ * for the same table, column or index are overwritten, so that an older
+ * one can't replace the new one when the statistics are loaded */
+static int chidb_Stats_overwrite(BTree *bt, npage_t npage, stats_entry_t *entries, uint32_t n)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    DBRecord *dbr;
+    bool dirty = false;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+
+        if (btn->type != PGTYPE_TABLE_LEAF)
+        {
+            rc = chidb_Stats_overwrite(bt, btc.fields.tableInternal.child_page, entries, n);
+            continue;
+        }
+
+        if ((rc = chidb_DBRecord_unpack(&dbr, btc.fields.tableLeaf.data)) != CHIDB_OK)
+            break;
+
+        for(uint32_t e = 0; e < n; e++)
+            if (entries[e].size == btc.fields.tableLeaf.data_size &&
+                chidb_Stats_fieldIs(dbr, 1, entries[e].type) &&
+                chidb_Stats_fieldIs(dbr, 2, entries[e].tbl) &&
+                chidb_Stats_fieldIs(dbr, 3, entries[e].name))
+            {
+                memcpy(btc.fields.tableLeaf.data, entries[e].data, entries[e].size);
+                entries[e].written = true;
+                dirty = true;
+                break;
+            }
+
+        chidb_DBRecord_destroy(dbr);
+    }
+
+    if (rc == CHIDB_OK && btn->type == PGTYPE_TABLE_INTERNAL)
+        rc = chidb_Stats_overwrite(bt, btn->right_page, entries, n);
+
+    if (rc == CHIDB_OK && dirty)
+        rc = chidb_Btree_writeNode(bt, btn);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
+
+/* Returns the largest key in a table B-Tree (0 if it is empty), which
+ * is the last key of its rightmost leaf */
+static int chidb_Stats_maxKey(BTree *bt, npage_t npage, chidb_key_t *key)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    int rc;
+
+    *key = 0;
+
+    while ((rc = chidb_Btree_getNodeByPage(bt, npage, &btn)) == CHIDB_OK)
+    {
+        if (btn->type != PGTYPE_TABLE_INTERNAL)
+        {
+            if (btn->n_cells > 0)
+            {
+                chidb_Btree_getCell(btn, btn->n_cells - 1, &btc);
+                *key = btc.key;
+            }
+            chidb_Btree_freeMemNode(bt, btn);
+            break;
+        }
+
+        npage = btn->right_page;
+        chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    return rc;
+}
+
+
+/* Collect the statistics of all the tables and indexes of a database
+ *
+ * Writes the statistics of each table (and of each of its columns)
+ * and of each index in the schema to the statistics table. The entries
+ * of a previous ANALYZE are overwritten (the statistics are padded, so
+ * that the entries for the same table, column or index have the same
+ * size), so analyzing a database again doesn't make the statistics
+ * table grow. Only the entries for tables, columns or indexes that
+ * hadn't been analyzed yet are appended.
+ *
+ * Parameters
+ * - db: chidb database
+ * - nroot: Root page of the statistics table
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - CHIDB_ECORRUPT: The schema table is not valid
+ */
+int chidb_Stats_analyze(chidb *db, npage_t nroot)
+{
+    Schema *schema;
+    stats_scan_t scan;
+    stats_entry_t *entries = NULL;
+    uint32_t nEntries = 0;
+    chidb_key_t key = 0;
+    char stat[MAX_STR_LEN];
+    int rc;
+
+    if ((rc = chidb_Schema_get(db, &schema)) != CHIDB_OK)
+        return rc;
+
+    /* The statistics table itself is not analyzed, since it is modified
+     * while the other tables are analyzed */
+    for(uint32_t i = 0; i < schema->nTables && rc == CHIDB_OK; i++)
+        if (schema->tables[i].nroot != nroot)
+            rc = chidb_Stats_analyzeTable(db->bt, &schema->tables[i], &entries, &nEntries);
+
+    for(uint32_t i = 0; i < schema->nIndexes && rc == CHIDB_OK; i++)
+    {
+        SchemaIndex *idx = &schema->indexes[i];
+
+        /* An index on several columns is a key B-Tree (see keytree.c) */
+        memset(&scan, 0, sizeof(stats_scan_t));
+        if (idx->nCols > 1)
+            rc = chidb_KeyTree_stats(db->bt, idx->nroot, &scan.nEntries, &scan.nPages, &scan.depth);
+        else
+            rc = chidb_Stats_scan(db->bt, idx->nroot, 1, &scan);
+
+        if (rc == CHIDB_OK)
+        {
+            snprintf(stat, sizeof(stat), "%u %u %u", scan.nEntries, scan.nPages, scan.depth);
+            chidb_Stats_pad(stat, sizeof(stat), 3 * STATS_COUNT_WIDTH);
+            rc = chidb_Stats_entry(&entries, &nEntries, "index", idx->table->name, idx->name, stat);
+        }
+    }
+
+    if (rc == CHIDB_OK)
+        rc = chidb_Stats_overwrite(db->bt, nroot, entries, nEntries);
+    if (rc == CHIDB_OK)
+        rc = chidb_Stats_maxKey(db->bt, nroot, &key);
+
+    for(uint32_t i = 0; i < nEntries; i++)
+    {
+        if (rc == CHIDB_OK && !entries[i].written)
+            rc = chidb_Btree_insertInTable(db->bt, nroot, ++key, entries[i].data, entries[i].size);
+        free(entries[i].data);
+    }
+    free(entries);
+
+    return rc;
+}
+
+
+/*
+ * Loading the statistics
+ */
+
+/* Finds the statistics of a table or, if there are none, adds them */
+static int chidb_Stats_addTable(Stats *stats, SchemaTable *t, TableStats **ts)
+{
+    TableStats *a;
+
+    if (chidb_Stats_findTable(stats, t->name, ts) == CHIDB_OK)
+        return CHIDB_OK;
+
+    a = realloc(stats->tables, sizeof(TableStats) * (stats->nTables + 1));
+    if (a == NULL)
+        return CHIDB_ENOMEM;
+    stats->tables = a;
+
+    *ts = &stats->tables[stats->nTables];
+    memset(*ts, 0, sizeof(TableStats));
+    (*ts)->name = strdup(t->name);
+    (*ts)->nCols = t->nCols;
+    (*ts)->cols = calloc(t->nCols, sizeof(ColumnStats));
+    stats->nTables++;
+
+    return (*ts)->name != NULL && (*ts)->cols != NULL ? CHIDB_OK : CHIDB_ENOMEM;
+}
+
+/* Finds the statistics of an index or, if there are none, adds them */
+static int chidb_Stats_addIndex(Stats *stats, SchemaIndex *idx, IndexStats **is)
+{
+    IndexStats *a;
+
+    if (chidb_Stats_findIndex(stats, idx->name, is) == CHIDB_OK)
+        return CHIDB_OK;
+
+    a = realloc(stats->indexes, sizeof(IndexStats) * (stats->nIndexes + 1));
+    if (a == NULL)
+        return CHIDB_ENOMEM;
+    stats->indexes = a;
+
+    *is = &stats->indexes[stats->nIndexes];
+    memset(*is, 0, sizeof(IndexStats));
+    (*is)->name = strdup(idx->name);
+    stats->nIndexes++;
+
+    return (*is)->name != NULL ? CHIDB_OK : CHIDB_ENOMEM;
+}
+
+/* Parses the statistics of a column */
+static int chidb_Stats_parseColumn(ColumnStats *cs, const char *stat)
+{
+    char *end;
+    long v;
+
+    if (sscanf(stat, "%u %u", &cs->nDistinct, &cs->nNull) != 2)
+        return CHIDB_ECORRUPT;
+
+    /* Skip the two counts, and read the histogram's bounds */
+    for(int i = 0; i < 2; i++)
+        strtol(stat, (char **) &stat, 10);
+
+    free(cs->bounds);
+    cs->bounds = NULL;
+    cs->nBounds = 0;
+
+    for (v = strtol(stat, &end, 10); end != stat; v = strtol(stat, &end, 10))
+    {
+        int32_t b = v;
+
+        if (chidb_Stats_push((void **) &cs->bounds, &cs->nBounds, sizeof(int32_t), &b) != CHIDB_OK)
+            return CHIDB_ENOMEM;
+        stat = end;
+    }
+
+    return CHIDB_OK;
+}
+
+/* Adds an entry of the statistics table to the in-memory statistics
+ * (entries for tables, indexes or columns that no longer exist are ignored) */
+static int chidb_Stats_addEntry(Stats *stats, Schema *schema, DBRecord *dbr)
+{
+    SchemaTable *t;
+    SchemaIndex *idx;
+    TableStats *ts;
+    IndexStats *is;
+    char *f[4];
+    int32_t col;
+    int rc = CHIDB_OK;
+
+    if (dbr->nfields != 5)
+        return CHIDB_ECORRUPT;
+
+    for(int i = 0; i < 4; i++)
+        f[i] = NULL;
+    for(int i = 0; i < 4 && rc == CHIDB_OK; i++)
+        if (chidb_DBRecord_getType(dbr, i + 1) < SQL_TEXT)
+            rc = CHIDB_ECORRUPT;
+        else
+            rc = chidb_DBRecord_getString(dbr, i + 1, &f[i]);
+
+    if (rc != CHIDB_OK)
+        ;
+    else if (strcmp(f[0], "index") == 0)
+    {
+        if (chidb_Schema_findIndex(schema, f[2], &idx) == CHIDB_OK &&
+            (rc = chidb_Stats_addIndex(stats, idx, &is)) == CHIDB_OK &&
+            sscanf(f[3], "%u %u %u", &is->nEntries, &is->nPages, &is->depth) != 3)
+            rc = CHIDB_ECORRUPT;
+    }
+    else if (chidb_Schema_findTable(schema, f[1], &t) == CHIDB_OK)
+    {
+        if (strcmp(f[0], "table") == 0)
+        {
+            if ((rc = chidb_Stats_addTable(stats, t, &ts)) == CHIDB_OK &&
+                sscanf(f[3], "%u %u %u", &ts->nRows, &ts->nPages, &ts->depth) != 3)
+                rc = CHIDB_ECORRUPT;
+        }
+        else if (strcmp(f[0], "column") == 0 && chidb_Schema_findColumn(t, f[2], &col) == CHIDB_OK)
+        {
+            if ((rc = chidb_Stats_addTable(stats, t, &ts)) == CHIDB_OK)
+                rc = chidb_Stats_parseColumn(&ts->cols[col], f[3]);
+        }
+    }
+
+    for(int i = 0; i < 4; i++)
+        free(f[i]);
+
+    return rc;
+}
+
+/* Loads the entries in the statistics table's B-Tree into memory, in
+ * the order of their keys (so that the latest entries come last) */
+static int chidb_Stats_load(BTree *bt, npage_t npage, Stats *stats, Schema *schema)
+{
+    BTreeNode *btn;
+    BTreeCell btc;
+    DBRecord *dbr;
+    int rc;
+
+    rc = chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    for(ncell_t i = 0; i < btn->n_cells && rc == CHIDB_OK; i++)
+    {
+        chidb_Btree_getCell(btn, i, &btc);
+
+        if (btn->type == PGTYPE_TABLE_LEAF)
+        {
+            rc = chidb_DBRecord_unpack(&dbr, btc.fields.tableLeaf.data);
+            if (rc != CHIDB_OK)
+                break;
+            rc = chidb_Stats_addEntry(stats, schema, dbr);
+            chidb_DBRecord_destroy(dbr);
+        }
+        else
+            rc = chidb_Stats_load(bt, btc.fields.tableInternal.child_page, stats, schema);
+    }
+
+    if (rc == CHIDB_OK && btn->type == PGTYPE_TABLE_INTERNAL)
+        rc = chidb_Stats_load(bt, btn->right_page, stats, schema);
+
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return rc;
+}
+
+
+/* Get the statistics of a database
+ *
+ * Returns the in-memory copy of the statistics table, loading it from
+ * the file if it hasn't been loaded yet, or if the schema has been
+ * modified since it was loaded. If the database has never been analyzed,
+ * the statistics are empty.
+ *
+ * Parameters
+ * - db: chidb database
+ * - stats: Out parameter. Used to return a pointer to the statistics.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - CHIDB_ECORRUPT: The schema table or the statistics table is not valid
+ */
+int chidb_Stats_get(chidb *db, Stats **stats)
+{
+    Schema *schema;
+    SchemaTable *t;
+    Stats *s;
+    int rc;
+
+    if (db->stats != NULL && db->stats->version == db->schemaVersion)
+    {
+        *stats = db->stats;
+        return CHIDB_OK;
+    }
+
+    if ((rc = chidb_Schema_get(db, &schema)) != CHIDB_OK)
+        return rc;
+
+    s = calloc(1, sizeof(Stats));
+    if (s == NULL)
+        return CHIDB_ENOMEM;
+    s->version = db->schemaVersion;
+
+    if (chidb_Schema_findTable(schema, STATS_TABLE, &t) == CHIDB_OK)
+        rc = chidb_Stats_load(db->bt, t->nroot, s, schema);
+
+    if (rc != CHIDB_OK)
+    {
+        chidb_Stats_free(s);
+        return rc;
+    }
+
+    chidb_Stats_free(db->stats);
+    db->stats = s;
+    *stats = s;
+
+    return CHIDB_OK;
+}
+
+
+/* Find the statistics of a table
+ *
+ * Parameters
+ * - stats: Statistics
+ * - name: Name of the table
+ * - table: Out parameter. Used to return a pointer to the table's statistics.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The table has not been analyzed
+ */
+int chidb_Stats_findTable(Stats *stats, const char *name, TableStats **table)
+{
+    for(uint32_t i = 0; i < stats->nTables; i++)
+        if (strcasecmp(stats->tables[i].name, name) == 0)
+        {
+            *table = &stats->tables[i];
+            return CHIDB_OK;
+        }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/* Find the statistics of an index
+ *
+ * Parameters
+ * - stats: Statistics
+ * - name: Name of the index
+ * - index: Out parameter. Used to return a pointer to the index's statistics.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The index has not been analyzed
+ */
+int chidb_Stats_findIndex(Stats *stats, const char *name, IndexStats **index)
+{
+    for(uint32_t i = 0; i < stats->nIndexes; i++)
+        if (strcasecmp(stats->indexes[i].name, name) == 0)
+        {
+            *index = &stats->indexes[i];
+            return CHIDB_OK;
+        }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/*
+ * Estimates
+ */
+
+/* Fraction of the histogram's values that are smaller than v, assuming
+ * that the values are evenly spread within each bucket */
+static double chidb_Stats_below(ColumnStats *cs, int64_t v)
+{
+    uint32_t nb = cs->nBounds - 1;
+
+    if (v <= cs->bounds[0])
+        return 0;
+    if (v > cs->bounds[nb])
+        return 1;
+
+    for(uint32_t i = 0; i < nb; i++)
+        if (v <= cs->bounds[i + 1])
+            return (i + (double) (v - cs->bounds[i]) / ((int64_t) cs->bounds[i + 1] - cs->bounds[i])) / nb;
+
+    return 1;
+}
+
+
+/* Estimate the selectivity of a comparison
+ *
+ * Parameters
+ * - table: Statistics of the table
+ * - col: Column of the table
+ * - op: Comparison (col op v)
+ * - v: Value the column is compared with (NULL if it isn't known, e.g.,
+ *      because it is a parameter or a column of another table)
+ *
+ * Return
+ * - The estimated fraction of the table's rows for which the comparison
+ *   is true (between 0 and 1)
+ */
+double chidb_Stats_selectivity(TableStats *table, int32_t col, enum CondType op, Literal_t *v)
+{
+    ColumnStats *cs = &table->cols[col];
+    bool hist = v != NULL && v->t == TYPE_INT && cs->nBounds > 0;
+    double nonNull;
+
+    if (table->nRows == 0)
+        return 0;
+
+    /* A comparison with NULL is never true */
+    nonNull = (double) (table->nRows - (cs->nNull < table->nRows ? cs->nNull : table->nRows)) / table->nRows;
+
+    switch (op)
+    {
+    case RA_COND_EQ:
+        if (cs->nDistinct == 0)
+            return 0;
+        if (hist && (v->val.ival < cs->bounds[0] || v->val.ival > cs->bounds[cs->nBounds - 1]))
+            return 0;
+        return nonNull / cs->nDistinct;
+    case RA_COND_LT:
+        return nonNull * (hist ? chidb_Stats_below(cs, v->val.ival) : STATS_DEFAULT_SEL);
+    case RA_COND_LEQ:
+        return nonNull * (hist ? chidb_Stats_below(cs, (int64_t) v->val.ival + 1) : STATS_DEFAULT_SEL);
+    case RA_COND_GT:
+        return nonNull * (hist ? 1 - chidb_Stats_below(cs, (int64_t) v->val.ival + 1) : STATS_DEFAULT_SEL);
+    case RA_COND_GEQ:
+        return nonNull * (hist ? 1 - chidb_Stats_below(cs, v->val.ival) : STATS_DEFAULT_SEL);
+    default:
+        return STATS_DEFAULT_SEL;
+    }
+}
+
+
+/* Estimate the cost of reading some of the rows of a table
+ *
+ * The rows are read from a range of the table's B-Tree (if index is
+ * NULL) or from a range of one of its indexes, followed by a seek of
+ * each entry's row in the table (unless the index is covering: then
+ * the entries have all the columns that are needed, and the table is
+ * not read). The cost is the number of pages that are read, plus
+ * STATS_ROW_COST for each row.
+ *
+ * Parameters
+ * - table: Statistics of the table
+ * - index: Statistics of the index (NULL to read the table's B-Tree)
+ * - sel: Fraction of the rows within the range (1 for a full scan)
+ * - covering: Is the index covering?
+ *
+ * Return
+ * - The estimated cost
+ */
+double chidb_Stats_pathCost(TableStats *table, IndexStats *index, double sel, bool covering)
+{
+    double rows = sel * table->nRows;
+
+    if (index == NULL)
+        return table->depth + sel * table->nPages + rows * STATS_ROW_COST;
+
+    if (covering)
+        return index->depth + sel * index->nPages + rows * STATS_ROW_COST;
+
+    return index->depth + sel * index->nPages + rows * (table->depth + STATS_ROW_COST);
+}
+
+
+/* Free an in-memory copy of the statistics
+ *
+ * Parameters
+ * - stats: Statistics (may be NULL)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Stats_free(Stats *stats)
+{
+    if (stats == NULL)
+        return CHIDB_OK;
+
+    for(uint32_t i = 0; i < stats->nTables; i++)
+    {
+        TableStats *t = &stats->tables[i];
+
+        for(uint32_t j = 0; j < t->nCols; j++)
+            free(t->cols[j].bounds);
+        free(t->cols);
+        free(t->name);
+    }
+    free(stats->tables);
+
+    for(uint32_t i = 0; i < stats->nIndexes; i++)
+        free(stats->indexes[i].name);
+    free(stats->indexes);
+
+    free(stats);
+
+    return CHIDB_OK;
+}
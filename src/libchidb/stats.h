@@ -0,0 +1,120 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Statistics header
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <chisql/chisql.h>
+#include "chidbInt.h"
+
+/* Name of the table where ANALYZE stores the statistics */
+#define STATS_TABLE "chidb_stat"
+
+/* Number of buckets in the histogram of an integer column */
+#define STATS_NBUCKETS (16)
+
+/* Number of integer values of a column that ANALYZE samples to build
+ * its histogram */
+#define STATS_SAMPLE_SIZE (4096)
+
+/* Number of hashes that ANALYZE keeps to estimate the number of distinct
+ * values of a column (columns with fewer distinct values are counted
+ * exactly) */
+#define STATS_SKETCH_SIZE (4096)
+
+/* Selectivity of a condition that the statistics can't estimate */
+#define STATS_DEFAULT_SEL (1.0 / 3)
+
+/* Cost of processing a row, relative to the cost of reading a page */
+#define STATS_ROW_COST (0.01)
+
+/* Cost of adding a row to a hash table, or of probing the hash table */
+#define STATS_HASH_ROW_COST (0.02)
+
+/* Statistics of a column */
+typedef struct ColumnStats
+{
+    uint32_t nDistinct;      /* Number of distinct non-NULL values */
+    uint32_t nNull;          /* Number of NULL values */
+    uint32_t nBounds;        /* Number of bounds in the histogram (0 if there is none) */
+    int32_t *bounds;         /* Equi-depth histogram of an integer column: each
+                              * bucket [bounds[i], bounds[i+1]] has the same number
+                              * of rows, and bounds[nBounds-1] is the largest value */
+} ColumnStats;
+
+/* Statistics of a table */
+typedef struct TableStats
+{
+    char *name;
+    uint32_t nRows;
+    uint32_t nPages;         /* Pages in the table's B-Tree */
+    uint32_t depth;          /* Levels in the table's B-Tree (1 if it is only a leaf) */
+    uint32_t nCols;
+    ColumnStats *cols;       /* Statistics of each column (same order as in the schema) */
+} TableStats;
+
+/* Statistics of an index */
+typedef struct IndexStats
+{
+    char *name;
+    uint32_t nEntries;
+    uint32_t nPages;
+    uint32_t depth;
+} IndexStats;
+
+/* In-memory copy of the statistics table */
+struct Stats
+{
+    uint32_t version;        /* db->schemaVersion when the statistics were loaded */
+    TableStats *tables;
+    uint32_t nTables;
+    IndexStats *indexes;
+    uint32_t nIndexes;
+};
+
+int chidb_Stats_analyze(chidb *db, npage_t nroot);
+int chidb_Stats_get(chidb *db, Stats **stats);
+int chidb_Stats_findTable(Stats *stats, const char *name, TableStats **table);
+int chidb_Stats_findIndex(Stats *stats, const char *name, IndexStats **index);
+double chidb_Stats_selectivity(TableStats *table, int32_t col, enum CondType op, Literal_t *v);
+double chidb_Stats_pathCost(TableStats *table, IndexStats *index, double sel, bool covering);
+int chidb_Stats_free(Stats *stats);
+
+#endif /*STATS_H_*/
@@ -0,0 +1,327 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Prepared statement cache
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include "dbm.h"
+#include "stmt-cache.h"
+
+/* The statement cache keeps compiled statements so that preparing the
+ * same SQL statement again doesn't have to parse, optimize and generate
+ * code for it. chidb_prepare takes a statement out of the cache (if there
+ * is one for the same SQL text), and chidb_finalize resets the statement
+ * and returns it to the cache (instead of freeing it).
+ *
+ * Each statement records the schema version of the database when it was
+ * compiled. Any statement that modifies the schema (e.g., CREATE TABLE)
+ * increments the schema version, which invalidates all the statements
+ * compiled before the change.
+ */
+
+
+/* FNV-1a hash of a string */
+static uint32_t chidb_StmtCache_hash(const char *s)
+{
+    uint32_t h = 2166136261U;
+
+    while (*s)
+        h = (h ^ (uint8_t) *s++) * 16777619U;
+
+    return h;
+}
+
+/* Frees a statement allocated by chidb_prepare */
+static void chidb_StmtCache_freeStmt(chidb_stmt *stmt)
+{
+    chidb_stmt_free(stmt);
+    free(stmt);
+}
+
+/* Removes an entry from the LRU list */
+static void chidb_StmtCache_unlink(StmtCache *cache, StmtCacheEntry *e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+}
+
+/* Removes an entry from the cache, and frees it (but not its statement) */
+static void chidb_StmtCache_remove(StmtCache *cache, StmtCacheEntry *e)
+{
+    StmtCacheEntry **p = &cache->buckets[e->hash & (cache->nbuckets - 1)];
+
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+
+    chidb_StmtCache_unlink(cache, e);
+    cache->n--;
+    free(e);
+}
+
+/* Returns the entry with the given key, or NULL if there is none */
+static StmtCacheEntry *chidb_StmtCache_find(StmtCache *cache, const char *key, uint32_t hash)
+{
+    StmtCacheEntry *e = cache->buckets[hash & (cache->nbuckets - 1)];
+
+    while (e != NULL && (e->hash != hash || strcmp(e->key, key) != 0))
+        e = e->next;
+
+    return e;
+}
+
+
+/* Create a statement cache
+ *
+ * Parameters
+ * - cache: Out-parameter used to return the cache
+ * - capacity: Maximum number of statements in the cache
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_StmtCache_create(StmtCache **cache, uint32_t capacity)
+{
+    *cache = malloc(sizeof(StmtCache));
+    if (*cache == NULL)
+        return CHIDB_ENOMEM;
+
+    /* Keep the hash table at most half full */
+    (*cache)->nbuckets = 1;
+    while ((*cache)->nbuckets < 2 * capacity)
+        (*cache)->nbuckets *= 2;
+
+    (*cache)->buckets = calloc((*cache)->nbuckets, sizeof(StmtCacheEntry *));
+    if ((*cache)->buckets == NULL)
+    {
+        free(*cache);
+        return CHIDB_ENOMEM;
+    }
+
+    (*cache)->n = 0;
+    (*cache)->capacity = capacity;
+    (*cache)->newest = NULL;
+    (*cache)->oldest = NULL;
+
+    return CHIDB_OK;
+}
+
+
+/* Normalize a SQL statement
+ *
+ * Produces the key under which a statement is cached. Leading and
+ * trailing whitespace, and trailing semicolons, are removed, and any
+ * other run of whitespace is replaced with a single space. Quoted
+ * strings are left untouched.
+ *
+ * Parameters
+ * - sql: SQL text
+ * - key: Out-parameter used to return the normalized SQL text
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_StmtCache_normalize(const char *sql, char **key)
+{
+    char *k, quote = '\0';
+    size_t len = 0;
+
+    k = malloc(strlen(sql) + 1);
+    if (k == NULL)
+        return CHIDB_ENOMEM;
+
+    for(const char *c = sql; *c != '\0'; c++)
+    {
+        if (quote != '\0')
+        {
+            if (*c == quote)
+                quote = '\0';
+        }
+        else if (*c == '\'' || *c == '"')
+            quote = *c;
+        else if (isspace((unsigned char) *c))
+        {
+            if (len > 0 && k[len - 1] != ' ')
+                k[len++] = ' ';
+            continue;
+        }
+
+        k[len++] = *c;
+    }
+
+    while (len > 0 && (k[len - 1] == ' ' || k[len - 1] == ';'))
+        len--;
+    k[len] = '\0';
+
+    *key = k;
+
+    return CHIDB_OK;
+}
+
+
+/* Take a statement out of the cache
+ *
+ * If the cache contains a statement for the given (normalized) SQL text,
+ * compiled against the current schema version, the statement is removed
+ * from the cache and returned. The statement is ready to run (it was
+ * reset when it was returned to the cache).
+ *
+ * Parameters
+ * - cache: Statement cache
+ * - key: Normalized SQL text (see chidb_StmtCache_normalize)
+ * - schemaVersion: Current schema version of the database
+ * - stmt: Out-parameter used to return the statement
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no (valid) statement for that SQL text
+ */
+int chidb_StmtCache_get(StmtCache *cache, const char *key, uint32_t schemaVersion, chidb_stmt **stmt)
+{
+    StmtCacheEntry *e = chidb_StmtCache_find(cache, key, chidb_StmtCache_hash(key));
+
+    if (e == NULL)
+        return CHIDB_ENOTFOUND;
+
+    *stmt = e->stmt;
+    chidb_StmtCache_remove(cache, e);
+
+    /* The statement was compiled against an older schema */
+    if ((*stmt)->schemaVersion != schemaVersion)
+    {
+        chidb_StmtCache_freeStmt(*stmt);
+        *stmt = NULL;
+        return CHIDB_ENOTFOUND;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Return a statement to the cache
+ *
+ * Resets the statement (clearing the values bound to its parameters)
+ * and adds it to the cache, under the statement's
+ * cache key. If the cache already contains a statement with the same key,
+ * or the statement can't be reset, the statement is freed instead. If the
+ * cache is full, the least recently used statement is evicted (and freed).
+ *
+ * Parameters
+ * - cache: Statement cache
+ * - stmt: Statement allocated by chidb_prepare, with a cache key
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_StmtCache_put(StmtCache *cache, chidb_stmt *stmt)
+{
+    StmtCacheEntry *e;
+    uint32_t hash;
+
+    assert(stmt->cacheKey != NULL);
+
+    hash = chidb_StmtCache_hash(stmt->cacheKey);
+
+    if (cache->capacity == 0 || chidb_StmtCache_find(cache, stmt->cacheKey, hash) != NULL ||
+        chidb_stmt_reset(stmt) != CHIDB_OK || chidb_stmt_clear_params(stmt) != CHIDB_OK ||
+        (e = malloc(sizeof(StmtCacheEntry))) == NULL)
+    {
+        chidb_StmtCache_freeStmt(stmt);
+        return CHIDB_OK;
+    }
+
+    if (cache->n == cache->capacity)
+    {
+        chidb_stmt *old = cache->oldest->stmt;
+        chidb_StmtCache_remove(cache, cache->oldest);
+        chidb_StmtCache_freeStmt(old);
+    }
+
+    e->key = stmt->cacheKey;
+    e->hash = hash;
+    e->stmt = stmt;
+
+    e->next = cache->buckets[hash & (cache->nbuckets - 1)];
+    cache->buckets[hash & (cache->nbuckets - 1)] = e;
+
+    e->older = cache->newest;
+    e->newer = NULL;
+    if (cache->newest != NULL)
+        cache->newest->newer = e;
+    else
+        cache->oldest = e;
+    cache->newest = e;
+
+    cache->n++;
+
+    return CHIDB_OK;
+}
+
+
+/* Free a statement cache, and all the statements in it
+ *
+ * Parameters
+ * - cache: Statement cache
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_StmtCache_destroy(StmtCache *cache)
+{
+    while (cache->oldest != NULL)
+    {
+        chidb_stmt *stmt = cache->oldest->stmt;
+        chidb_StmtCache_remove(cache, cache->oldest);
+        chidb_StmtCache_freeStmt(stmt);
+    }
+
+    free(cache->buckets);
+    free(cache);
+
+    return CHIDB_OK;
+}
@@ -0,0 +1,80 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Prepared statement cache header
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef STMT_CACHE_H_
+#define STMT_CACHE_H_
+
+#include "chidbInt.h"
+#include "dbm-types.h"
+
+/* Default number of statements kept in a database's statement cache */
+#define STMT_CACHE_DEFAULT_SIZE (256)
+
+/* An entry in the statement cache */
+typedef struct StmtCacheEntry
+{
+    char *key;                      /* Normalized SQL text */
+    uint32_t hash;                  /* Hash of the key */
+    chidb_stmt *stmt;               /* Compiled statement */
+    struct StmtCacheEntry *next;    /* Next entry in the same bucket */
+    struct StmtCacheEntry *newer;   /* Next more recently used entry */
+    struct StmtCacheEntry *older;   /* Next less recently used entry */
+} StmtCacheEntry;
+
+/* A cache of compiled statements that are not currently in use, keyed
+ * by their normalized SQL text. Entries are kept in a hash table (with
+ * chaining) and in a list ordered by how recently they were used, so
+ * the least recently used entry can be evicted when the cache is full. */
+struct StmtCache
+{
+    StmtCacheEntry **buckets;
+    uint32_t nbuckets;      /* Number of buckets (a power of two) */
+    uint32_t n;             /* Number of entries */
+    uint32_t capacity;      /* Maximum number of entries */
+    StmtCacheEntry *newest; /* Most recently used entry */
+    StmtCacheEntry *oldest; /* Least recently used entry */
+};
+
+int chidb_StmtCache_create(StmtCache **cache, uint32_t capacity);
+int chidb_StmtCache_normalize(const char *sql, char **key);
+int chidb_StmtCache_get(StmtCache *cache, const char *key, uint32_t schemaVersion, chidb_stmt **stmt);
+int chidb_StmtCache_put(StmtCache *cache, chidb_stmt *stmt);
+int chidb_StmtCache_destroy(StmtCache *cache);
+
+#endif /*STMT_CACHE_H_*/
@@ -54,6 +54,13 @@ Constraint_t *Check(Condition_t *cond)
     return con;
 }
 
+Constraint_t *Dictionary(void)
+{
+    Constraint_t *con = (Constraint_t *)calloc(1, sizeof(Constraint_t));
+    con->t = CONS_DICTIONARY;
+    return con;
+}
+
 Constraint_t *ColumnSize(unsigned size)
 {
     Constraint_t *con = (Constraint_t *)calloc(1, sizeof(Constraint_t));
@@ -113,6 +120,8 @@ size_t Column_getSize(Column_t *col)
         return sizeof(int);
     case TYPE_TEXT:
         return 250; /* default text length */
+    case TYPE_PARAM:
+        break;
     }
 
     return 0;
@@ -227,6 +236,9 @@ void Constraint_print(void *constraint_voidp)
         printf("Check: ");
         Condition_print(constraint->constraint.check);
         break;
+    case CONS_DICTIONARY:
+        printf("Dictionary");
+        break;
     case CONS_SIZE:
         printf("Size: %u", constraint->constraint.size);
         break;
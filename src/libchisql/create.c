@@ -145,6 +145,15 @@ Index_t *Index_make(char *name, char *table_name, char *column_name)
     idx->name = name;
     idx->table_name = table_name;
     idx->column_name = column_name;
+    idx->columns = StrList_make(column_name);
+    return idx;
+}
+
+Index_t *Index_makeColumns(char *name, char *table_name, StrList_t *columns)
+{
+    Index_t *idx = Index_make(name, table_name, columns->str);
+    StrList_free(idx->columns);
+    idx->columns = columns;
     return idx;
 }
 
@@ -156,9 +165,10 @@ Index_t *Index_makeUnique(Index_t *idx)
 
 void Index_print(Index_t *idx)
 {
-    printf("Index '%s' on %s (%s)", idx->column_name,
-           idx->table_name,
-           idx->column_name);
+    printf("Index '%s' on %s (", idx->column_name,
+           idx->table_name);
+    for (StrList_t *col = idx->columns; col; col = col->next)
+        printf("%s%s", col->str, col->next ? ", " : ")");
     if (idx->unique) printf(", unique");
     puts("");
 }
@@ -166,6 +176,9 @@ void Index_print(Index_t *idx)
 void Index_free(Index_t *idx)
 {
     free(idx->name);
+    for (StrList_t *col = idx->columns->next; col; col = col->next)
+        free(col->str);
+    StrList_free(idx->columns);
     free(idx->column_name);
     free(idx->table_name);
     free(idx);
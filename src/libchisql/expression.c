@@ -117,6 +117,7 @@ static void Term_free(ExprTerm term)
         if (term.ref->tableName)
             free(term.ref->tableName);
         free(term.ref->columnName);
+        free(term.ref);
         break;
     case TERM_FUNC:
         switch (term.f.t)
@@ -139,6 +140,7 @@ static void Term_free(ExprTerm term)
         default:
             printf("Can't delete unknown function\n");
         }
+        break;
     default:
         printf("Can't delete, unknown term type");
     }
@@ -325,7 +327,12 @@ void Expression_free(Expression_t *expr)
 
 void Expression_freeList(Expression_t *expr)
 {
-
+    while (expr)
+    {
+        Expression_t *next = expr->next;
+        Expression_free(expr);
+        expr = next;
+    }
 }
 
 /*#define EXPRESSION_TEST*/
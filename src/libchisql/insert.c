@@ -37,6 +37,21 @@ Insert_t *Insert_make(const char *table_name, StrList_t *opt_col_names, Literal_
     return new_insert;
 }
 
+Insert_t *Insert_addRow(Insert_t *insert, Literal_t *values)
+{
+    InsertRow_t **last, *row;
+
+    if (!insert)
+        return NULL;
+
+    row = (InsertRow_t *)calloc(1, sizeof(InsertRow_t));
+    row->values = values;
+    for (last = &insert->more_rows; *last; last = &(*last)->next)
+        ;
+    *last = row;
+    return insert;
+}
+
 void Insert_print(Insert_t *insert)
 {
     Literal_t *val = insert->values;
@@ -56,7 +71,19 @@ void Insert_print(Insert_t *insert)
         Literal_print(val);
         val = val->next;
     }
-    printf("] into %s", insert->table_name);
+    printf("]");
+    for (InsertRow_t *row = insert->more_rows; row; row = row->next)
+    {
+        printf(", [");
+        for (val = row->values; val; val = val->next)
+        {
+            Literal_print(val);
+            if (val->next)
+                printf(", ");
+        }
+        printf("]");
+    }
+    printf(" into %s", insert->table_name);
     if (insert->col_names)
     {
         StrList_t *list = insert->col_names;
@@ -91,5 +118,12 @@ void Insert_free(Insert_t *insert)
     free(insert->table_name);
     StrList_free(insert->col_names);
     Literal_free(insert->values);
+    while (insert->more_rows)
+    {
+        InsertRow_t *next = insert->more_rows->next;
+        Literal_free(insert->more_rows->values);
+        free(insert->more_rows);
+        insert->more_rows = next;
+    }
     free(insert);
 }
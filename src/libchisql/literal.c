@@ -33,6 +33,16 @@ Literal_t *litText(char *str)
     return lval;
 }
 
+/* A parameter ("?"). Parameters are numbered from 1, in
+ * the order in which they appear in the statement */
+Literal_t *litParam(int n)
+{
+    Literal_t *lval = (Literal_t *)calloc(1, sizeof(Literal_t));
+    lval->t = TYPE_PARAM;
+    lval->val.ival = n;
+    return lval;
+}
+
 void Literal_print(Literal_t *val)
 {
     char buf[100];
@@ -51,6 +61,9 @@ void Literal_print(Literal_t *val)
     case TYPE_TEXT:
         printf("\"%s\"", val->val.strval);
         break;
+    case TYPE_PARAM:
+        printf("?%d", val->val.ival);
+        break;
     default:
         printf("(unknown type)");
     }
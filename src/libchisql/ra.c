@@ -144,6 +144,7 @@ RA_t *RA_RhoTable (RA_t *ra, const char *new_name)
 {
     RA_t *new_ra = (RA_t *)calloc(1, sizeof(RA_t));
     new_ra->t = RA_RHO_TABLE;
+    new_ra->rho.ra = ra;
     new_ra->rho.new_name = strdup(new_name);
     new_ra->columns = NULL; // See comment in RA_Table.  list_deepCopy(&ra->columns);
     return new_ra;
@@ -153,6 +154,7 @@ RA_t *RA_RhoExpr (RA_t *ra, Expression_t *expr, const char *new_name)
 {
     RA_t *new_ra = (RA_t *)calloc(1, sizeof(RA_t));
     new_ra->t = RA_RHO_EXPR;
+    new_ra->rho.ra = ra;
     new_ra->rho.to_rename = expr;
     new_ra->rho.new_name = strdup(new_name);
     new_ra->columns = NULL; // See comment in RA_Table.  list_deepCopy(&ra->columns);
@@ -52,7 +52,7 @@ chisql_statement_t *__stmt;
 %token VALUES AUTO_INCREMENT ASC DESC UNIQUE IN ON
 %token COUNT SUM AVG MIN MAX INTERSECT EXCEPT DISTINCT
 %token CONCAT TRUE FALSE CASE WHEN DECLARE BIT GROUP
-%token INDEX EXPLAIN
+%token INDEX EXPLAIN ANALYZE LIMIT OFFSET DICTIONARY
 %token <strval> IDENTIFIER
 %token <strval> STRING_LITERAL
 %token <dval> DOUBLE_LITERAL
@@ -74,7 +74,7 @@ chisql_statement_t *__stmt;
 %type <colref> column_reference
 %type <del> delete_from
 %type <sra> select select_statement table
-%type <opt> order_by group_by opt_options
+%type <opt> order_by group_by opt_options opt_limit
 %type <tref> table_ref
 %type <tbl> create_table
 %type <jcond> join_condition opt_join_condition
@@ -100,6 +100,7 @@ sql_line
 	| select 		{ __stmt->stmt.select = $1; __stmt->type = STMT_SELECT; }
 	| insert_into 	{ __stmt->stmt.insert = $1; __stmt->type = STMT_INSERT; }
 	| delete_from 	{ __stmt->stmt.delete = $1; __stmt->type = STMT_DELETE; }
+	| ANALYZE 		{ __stmt->type = STMT_ANALYZE; }
 	| /* empty */
 	;
 
@@ -109,9 +110,9 @@ create
 	;
 
 create_index
-        : CREATE opt_unique INDEX index_name ON table_name '(' column_name ')'
+        : CREATE opt_unique INDEX index_name ON table_name '(' column_names_list ')'
 		{ 
-			$$ = Index_make($4, $6, $8); 
+			$$ = Index_makeColumns($4, $6, $8); 
 		  	if ($2 == UNIQUE) $$ = Index_makeUnique($$); 
 		}
 	;
@@ -209,6 +210,7 @@ constraint
 	| DEFAULT literal_value { $$ = Default($2); }
 	| AUTO_INCREMENT { $$ = AutoIncrement(); }
 	| CHECK condition { $$ = Check($2); }
+	| DICTIONARY { $$ = Dictionary(); }
 	;
 
 select
@@ -228,7 +230,7 @@ select_combo
 	;
 
 select_statement
-	: SELECT opt_distinct expression_list FROM table opt_where_condition opt_options
+	: SELECT opt_distinct expression_list FROM table opt_where_condition opt_options opt_limit
 		{
 			if ($6 != NULL) 
 				$$ = SRAProject(SRASelect($5, $6), $3);
@@ -236,6 +238,11 @@ select_statement
 				$$ = SRAProject($5, $3);
 			if ($7 != NULL)
 				$$ = SRA_applyOption($$, $7); 
+			if ($8 != NULL)
+			{
+				$$ = SRA_applyOption($$, $8);
+				free($8);
+			}
 			if ($2 == DISTINCT)
 				$$ = SRA_makeDistinct($$);
 		}
@@ -255,6 +262,12 @@ opt_options
 	| /* empty */ { $$ = NULL; }
 	;
 
+opt_limit
+	: LIMIT INT_LITERAL { $$ = Limit_make($2, 0); }
+	| LIMIT INT_LITERAL OFFSET INT_LITERAL { $$ = Limit_make($2, $4); }
+	| /* empty */ { $$ = NULL; }
+	;
+
 opt_where_condition
 	: where_condition {$$ = $1;}
 	| /* empty */		{$$ = NULL;}
@@ -444,6 +457,10 @@ insert_into
 		{
 			$$ = Insert_make($3, $4, $7);
 		}
+	| insert_into ',' '(' values_list ')'
+		{
+			$$ = Insert_addRow($1, $4);
+		}
 	;
 
 opt_column_names
@@ -475,6 +492,7 @@ literal_value
 			else
 				$$ = litText($1);
 		}
+	| '?' { $$ = litParam(++__stmt->nparams); }
 	;
 
 delete_from
@@ -498,7 +516,11 @@ int chisql_stmt_print(chisql_statement_t *stmt)
         Create_print(stmt->stmt.create);
         break;
     case STMT_SELECT:
-        SRA_print(stmt->stmt.select);
+        /* An optimized statement is printed as its plan */
+        if (stmt->plan != NULL)
+            RA_print(stmt->plan);
+        else
+            SRA_print(stmt->stmt.select);
         break;
     case STMT_INSERT:
         Insert_print(stmt->stmt.insert);
@@ -506,6 +528,9 @@ int chisql_stmt_print(chisql_statement_t *stmt)
     case STMT_DELETE:
         Delete_print(stmt->stmt.delete);
         break;
+    case STMT_ANALYZE:
+        puts("Analyze");
+        break;
     }
 
     return 0;
@@ -529,6 +554,8 @@ int chisql_parser(const char *sql, chisql_statement_t **stmt)
   int rc;
   
   __stmt = malloc(sizeof(chisql_statement_t));
+  __stmt->nparams = 0;
+  __stmt->plan = NULL;
   char *tsql = __sql_semicolon(sql);
     
   YY_BUFFER_STATE my_string_buffer = yy_scan_string (tsql);
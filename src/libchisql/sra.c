@@ -17,6 +17,7 @@ SRA_t *SRAProject(SRA_t *sra, Expression_t *expr)
     new_sra->t = SRA_PROJECT;
     new_sra->project.sra = sra;
     new_sra->project.expr_list = expr;
+    new_sra->project.limit = -1;
     return new_sra;
 }
 
@@ -122,7 +123,8 @@ void SRA_print(SRA_t *sra)
         SRA_print(sra->project.sra);
         if (sra->project.distinct ||
                 sra->project.group_by ||
-                sra->project.order_by)
+                sra->project.order_by ||
+                sra->project.limit >= 0)
         {
             printf(",\n");
             indent_print("Options: ");
@@ -141,6 +143,8 @@ void SRA_print(SRA_t *sra)
                 printf(sra->project.asc_desc == ORDER_BY_ASC ? " a" : " de");
                 printf("scending");
             }
+            if (sra->project.limit >= 0)
+                printf(" Limit %d offset %d", sra->project.limit, sra->project.offset);
         }
         downInd();
         indent_print(")");
@@ -257,6 +261,11 @@ SRA_t *SRA_applyOption(SRA_t *sra, ProjectOption_t *option)
         {
             sra->project.group_by = option->group_by;
         }
+        if (option->limit >= 0)
+        {
+            sra->project.limit = option->limit;
+            sra->project.offset = option->offset;
+        }
     }
     return sra;
 }
@@ -275,6 +284,7 @@ ProjectOption_t *OrderBy_make(Expression_t *expr, enum OrderBy asc_desc)
     ProjectOption_t *ob = (ProjectOption_t *)calloc(1, sizeof(ProjectOption_t));
     ob->asc_desc = asc_desc;
     ob->order_by = expr;
+    ob->limit = -1;
     return ob;
 }
 
@@ -282,9 +292,18 @@ ProjectOption_t *GroupBy_make(Expression_t *expr)
 {
     ProjectOption_t *gb = (ProjectOption_t *)calloc(1, sizeof(ProjectOption_t));
     gb->group_by = expr;
+    gb->limit = -1;
     return gb;
 }
 
+ProjectOption_t *Limit_make(int limit, int offset)
+{
+    ProjectOption_t *lim = (ProjectOption_t *)calloc(1, sizeof(ProjectOption_t));
+    lim->limit = limit;
+    lim->offset = offset;
+    return lim;
+}
+
 ProjectOption_t *ProjectOption_combine(ProjectOption_t *op1,
                                        ProjectOption_t *op2)
 {
@@ -356,7 +375,11 @@ void ProjectOption_print(ProjectOption_t *op)
         printf("Group by: (%p) ", op->group_by);
         Expression_print(op->group_by);
     }
-    if (!op->order_by && !op->group_by)
+    if (op->limit >= 0)
+    {
+        printf("Limit %d offset %d", op->limit, op->offset);
+    }
+    if (!op->order_by && !op->group_by && op->limit < 0)
     {
         printf("Empty ProjectOption\n");
     }
@@ -516,14 +539,58 @@ static RA_t *desugar_natural_join(SRA_t *sra)
     return NULL;
 }
 
+/* Name by which the columns of a table are referred to (its alias, if it has one) */
+static const char *table_ref_name(SRA_t *sra)
+{
+    return sra->table.ref->alias ? sra->table.ref->alias : sra->table.ref->table_name;
+}
+
 RA_t *desugar_join(SRA_t *sra)
 {
-    return NULL;
+    /*
+    An inner join is the cross product of both sides, followed by a Sigma
+    with the join condition (if there is one). A USING clause is the same
+    as an ON clause that equates each of the listed columns on both sides;
+    we can only refer to the left side's column if the left side is a
+    single table. Outer joins can't be expressed in our RA, so they are not
+    desugared.
+    */
+    RA_t *res;
+    Condition_t *cond = NULL;
+
+    if (sra->t != SRA_JOIN)
+        return NULL;
+
+    if (sra->join.opt_cond && sra->join.opt_cond->t == JOIN_COND_ON)
+        cond = sra->join.opt_cond->on;
+    else if (sra->join.opt_cond && sra->join.opt_cond->t == JOIN_COND_USING)
+    {
+        if (sra->join.sra1->t != SRA_TABLE || sra->join.sra2->t != SRA_TABLE)
+            return NULL;
+
+        for (StrList_t *col = sra->join.opt_cond->col_list; col; col = col->next)
+        {
+            Condition_t *eq = Eq(
+                TermColumnReference(ColumnReference_make(table_ref_name(sra->join.sra1), col->str)),
+                TermColumnReference(ColumnReference_make(table_ref_name(sra->join.sra2), col->str)));
+            cond = cond ? And(cond, eq) : eq;
+        }
+    }
+
+    res = RA_Cross(SRA_desugar(sra->join.sra1), SRA_desugar(sra->join.sra2));
+
+    return cond ? RA_Sigma(res, cond) : res;
 }
 
+/* Translates an SRA tree into an RA tree. Conditions and expressions are
+ * shared with the SRA tree, not copied, so the SRA tree must outlive the
+ * RA tree. Parts of the SRA that have no RA equivalent (outer joins)
+ * desugar to NULL. */
 RA_t *SRA_desugar(SRA_t *sra)
 {
     RA_t *t1, *t2, *res;
+    if (sra == NULL)
+        return NULL;
     switch (sra->t)
     {
     case SRA_TABLE:
@@ -554,7 +621,7 @@ RA_t *SRA_desugar(SRA_t *sra)
         return RA_Union(SRA_desugar(sra->binary.sra1),
                         SRA_desugar(sra->binary.sra2));
     case SRA_EXCEPT:
-        return RA_Union(SRA_desugar(sra->binary.sra1),
+        return RA_Difference(SRA_desugar(sra->binary.sra1),
                         SRA_desugar(sra->binary.sra2));
     case SRA_INTERSECT:
         t1 = SRA_desugar(sra->binary.sra1);
@@ -568,7 +635,6 @@ RA_t *SRA_desugar(SRA_t *sra)
         fprintf(stderr, "Error: unhandled SRA type\n");
         exit(1);
     }
-    SRA_free(sra);
     return res;
 }
 /*
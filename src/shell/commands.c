@@ -271,6 +271,7 @@ int chidb_shell_handle_cmd_parse(chidb_shell_ctx_t *ctx, struct handler_entry *e
 int chidb_stmt_optimize(chidb *db,
             chisql_statement_t *sql_stmt,
             chisql_statement_t **sql_stmt_opt);
+void chidb_stmt_optimize_free(chisql_statement_t *sql_stmt_opt);
 
 int chidb_shell_handle_cmd_opt(chidb_shell_ctx_t *ctx, struct handler_entry *e, const char **tokens, int ntokens)
 {
@@ -309,6 +310,8 @@ int chidb_shell_handle_cmd_opt(chidb_shell_ctx_t *ctx, struct handler_entry *e,
     chisql_stmt_print(sql_stmt_opt);
     printf("\n");
 
+    chidb_stmt_optimize_free(sql_stmt_opt);
+
     return CHIDB_OK;
 }
 
@@ -0,0 +1,172 @@
+/* Benchmark for the DBM interpreters
+ *
+ * Runs DBM programs (.dbmf files) with both the dispatch-table
+ * interpreter and the threaded interpreter, and reports the average
+ * time per executed instruction with each of them.
+ *
+ * Usage: bench_dbm [-n RUNS] FILE|DIRECTORY...
+ *
+ * For example:
+ *
+ *     tests/bench_dbm -n 10000 tests/files/dbm-programs/register
+ *
+ * Each program is loaded once, and then run RUNS times with each
+ * interpreter (the program counter is reset before each run, but
+ * the registers and the database are not). */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <chidb/chidb.h>
+#include "libchidb/dbm.h"
+#include "libchidb/dbm-file.h"
+#include "libchidb/dbm-types.h"
+
+#ifndef TEST_DIR
+#define TEST_DIR "./tests/"
+#endif
+
+#define DATABASES_DIR TEST_DIR "files/databases/"
+#define GENERATED_DIR TEST_DIR "files/generated/"
+
+int runs = 1000;
+
+double total_ns[2];
+uint64_t total_steps[2];
+
+static double now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Runs a program "runs" times with one of the interpreters. Returns
+ * false if the program could not be run to completion. */
+static bool bench_run(chidb_dbm_file_t *dbmf, bool threaded, double *ns, uint64_t *steps)
+{
+    chidb_stmt *stmt = &dbmf->stmt;
+    uint64_t nSteps = stmt->nSteps;
+    double start = now_ns();
+    int rc;
+
+    stmt->threaded = threaded;
+
+    for(int i=0; i < runs; i++)
+    {
+        stmt->pc = 0;
+        do
+        {
+            rc = chidb_stmt_exec(stmt);
+        } while(rc == CHIDB_ROW);
+
+        if(rc != CHIDB_DONE)
+            return false;
+    }
+
+    *ns = now_ns() - start;
+    *steps = stmt->nSteps - nSteps;
+
+    return true;
+}
+
+static void bench_file(const char *filename)
+{
+    chidb_dbm_file_t *dbmf;
+    double ns[2];
+    uint64_t steps[2];
+    int rc;
+
+    rc = chidb_dbm_file_load2(filename, &dbmf, DATABASES_DIR, GENERATED_DIR, true);
+    if(rc != CHIDB_OK)
+    {
+        printf("%-40s could not load file\n", filename);
+        return;
+    }
+
+    for(int t=0; t < 2; t++)
+    {
+        if(!bench_run(dbmf, t == 1, &ns[t], &steps[t]))
+        {
+            printf("%-40s error while running program\n", dbmf->filename);
+            chidb_dbm_file_close(dbmf);
+            return;
+        }
+    }
+
+    printf("%-40s %10lu %12.2f %12.2f\n", dbmf->filename, (unsigned long) steps[0],
+           ns[0] / steps[0], ns[1] / steps[1]);
+
+    for(int t=0; t < 2; t++)
+    {
+        total_ns[t] += ns[t];
+        total_steps[t] += steps[t];
+    }
+
+    chidb_dbm_file_close(dbmf);
+}
+
+static void bench_path(const char *path)
+{
+    DIR *dir = opendir(path);
+
+    if(dir == NULL)
+    {
+        bench_file(path);
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir (dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        char *subpath = malloc(strlen(path) + strlen(ent->d_name) + 2);
+        sprintf(subpath, "%s/%s", path, ent->d_name);
+        bench_path(subpath);
+        free(subpath);
+    }
+
+    closedir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n RUNS] FILE|DIRECTORY...\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || runs <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-n RUNS] FILE|DIRECTORY...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-40s %10s %12s %12s\n", "Program", "Steps", "Table ns/op", "Thread ns/op");
+
+    for(int i=optind; i < argc; i++)
+        bench_path(argv[i]);
+
+    if(total_steps[0] > 0)
+        printf("%-40s %10lu %12.2f %12.2f\n", "TOTAL", (unsigned long) total_steps[0],
+               total_ns[0] / total_steps[0], total_ns[1] / total_steps[1]);
+
+    return EXIT_SUCCESS;
+}
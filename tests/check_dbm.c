@@ -5,6 +5,11 @@
 #include <chidb/chidb.h>
 #include "libchidb/dbm.h"
 #include "libchidb/dbm-file.h"
+#include "libchidb/dbm-hash.h"
+#include "libchidb/dbm-jit.h"
+#include "libchidb/dbm-reg.h"
+#include "libchidb/stmt-cache.h"
+#include "libchidb/stats.h"
 #include "libchidb/dbm-types.h"
 #include "check_common.h"
 
@@ -90,6 +95,1365 @@ END_TEST
 
 
 
+START_TEST (test_peephole)
+{
+    chidb db;
+    chidb_stmt stmt;
+    chidb_dbm_op_t ops[] =
+    {
+        {Op_Integer,   2, 0, 0, NULL},
+        {Op_OpenRead,  0, 0, 4, NULL},
+        {Op_Rewind,    0, 9, 0, NULL},
+        {Op_Integer, 100, 1, 0, NULL},
+        {Op_Column,    0, 2, 2, NULL},
+        {Op_Le,        1, 8, 2, NULL},
+        {Op_Column,    0, 1, 3, NULL},
+        {Op_ResultRow, 3, 1, 0, NULL},
+        {Op_Next,      0, 4, 0, NULL},
+        {Op_Close,     0, 0, 0, NULL},
+        {Op_Halt,      0, 0, 0, NULL},
+    };
+    int nops = sizeof(ops) / sizeof(chidb_dbm_op_t);
+
+    chidb_stmt_init(&stmt, &db);
+    for(int i=0; i < nops; i++)
+        chidb_stmt_set_op(&stmt, &ops[i], i);
+
+    ck_assert(chidb_stmt_peephole(&stmt) == CHIDB_OK);
+
+    for(int i=0; i < nops; i++)
+    {
+        opcode_t expected = ops[i].opcode;
+
+        if (i == 4)
+            expected = Op_ColumnCmpJump;
+        else if (i == 8)
+            expected = Op_NextColumn;
+
+        ck_assert_msg(stmt.ops[i].opcode == expected, "Expected instruction %i to be %s, but it is %s", i,
+                opcode_to_str(expected), opcode_to_str(stmt.ops[i].opcode));
+    }
+
+    chidb_stmt_free(&stmt);
+}
+END_TEST
+
+
+START_TEST (test_jit)
+{
+    chidb db;
+    chidb_stmt stmt;
+    chidb_dbm_op_t ops[] =
+    {
+        {Op_Integer,   5, 1, 0, NULL},
+        {Op_Integer,   7, 2, 0, NULL},
+        {Op_Lt,        1, 5, 2, NULL},
+        {Op_Integer,   1, 3, 0, NULL},
+        {Op_Gt,        1, 6, 2, NULL},
+        {Op_Integer,   0, 3, 0, NULL},
+        {Op_Null,      0, 4, 0, NULL},
+    };
+    int nops = sizeof(ops) / sizeof(chidb_dbm_op_t);
+
+    chidb_stmt_init(&stmt, &db);
+    for(int i=0; i < nops; i++)
+        chidb_stmt_set_op(&stmt, &ops[i], i);
+
+    /* The JIT compiler is optional, and requires a C compiler */
+    if (chidb_dbm_jit_compile(&stmt) != CHIDB_OK)
+    {
+        chidb_stmt_free(&stmt);
+        return;
+    }
+
+    ck_assert(stmt.jit != NULL);
+    ck_assert(chidb_stmt_exec(&stmt) == CHIDB_DONE);
+    ck_assert(stmt.pc == nops);
+    ck_assert(stmt.reg[3].type == REG_INT32 && stmt.reg[3].value.i == 1);
+    ck_assert(stmt.reg[4].type == REG_NULL);
+
+    /* Modifying the program discards the compiled code */
+    chidb_stmt_set_op(&stmt, &ops[0], 0);
+    ck_assert(stmt.jit == NULL);
+
+    chidb_stmt_free(&stmt);
+}
+END_TEST
+
+
+START_TEST (test_reg)
+{
+    chidb_dbm_register_t r1, r2;
+    const char *small = "small", *large = "a string that does not fit in a register";
+    uint8_t *buf;
+
+    chidb_dbm_reg_init(&r1);
+    chidb_dbm_reg_init(&r2);
+
+    /* Small strings are stored inline */
+    ck_assert(chidb_dbm_reg_set_text(&r1, small, strlen(small)) == CHIDB_OK);
+    ck_assert(r1.storage == REG_STORE_INLINE && r1.value.s == r1.inl);
+    ck_assert(strcmp(r1.value.s, small) == 0);
+
+    /* Large strings are stored in a buffer, which is reused */
+    ck_assert(chidb_dbm_reg_set_text(&r1, large, strlen(large)) == CHIDB_OK);
+    ck_assert(r1.storage == REG_STORE_BUFFER);
+    ck_assert(strcmp(r1.value.s, large) == 0);
+    buf = r1.buf->data;
+    ck_assert(chidb_dbm_reg_set_int(&r1, 42) == CHIDB_OK);
+    ck_assert(chidb_dbm_reg_set_text(&r1, large + 1, strlen(large) - 1) == CHIDB_OK);
+    ck_assert((uint8_t *) r1.value.s == buf);
+    ck_assert(strcmp(r1.value.s, large + 1) == 0);
+
+    /* Copies share the buffer until one of the registers is modified */
+    ck_assert(chidb_dbm_reg_copy(&r2, &r1) == CHIDB_OK);
+    ck_assert(r2.value.s == r1.value.s && r1.buf->refs == 2);
+    ck_assert(chidb_dbm_reg_set_text(&r1, large, strlen(large)) == CHIDB_OK);
+    ck_assert(r2.value.s != r1.value.s);
+    ck_assert(strcmp(r1.value.s, large) == 0);
+    ck_assert(strcmp(r2.value.s, large + 1) == 0);
+
+    /* Borrowed strings are not copied */
+    ck_assert(chidb_dbm_reg_set_text_ref(&r2, large, strlen(large)) == CHIDB_OK);
+    ck_assert(r2.value.s == large);
+
+    chidb_dbm_reg_free(&r1);
+    chidb_dbm_reg_free(&r2);
+}
+END_TEST
+
+
+/* Creates a statement, as chidb_prepare would */
+static chidb_stmt *cache_stmt(chidb *db, const char *sql, uint32_t schemaVersion)
+{
+    chidb_stmt *stmt = malloc(sizeof(chidb_stmt));
+
+    chidb_stmt_init(stmt, db);
+    chidb_StmtCache_normalize(sql, &stmt->cacheKey);
+    stmt->schemaVersion = schemaVersion;
+
+    return stmt;
+}
+
+START_TEST (test_stmt_cache)
+{
+    chidb db;
+    StmtCache *cache;
+    chidb_stmt *s1, *s2, *s3, *stmt;
+    char *key;
+
+    ck_assert(chidb_StmtCache_normalize("  SELECT *\n  FROM t\tWHERE a = '  x ' ;  ", &key) == CHIDB_OK);
+    ck_assert(strcmp(key, "SELECT * FROM t WHERE a = '  x '") == 0);
+    free(key);
+
+    ck_assert(chidb_StmtCache_create(&cache, 2) == CHIDB_OK);
+
+    s1 = cache_stmt(&db, "SELECT * FROM t1", 0);
+    s2 = cache_stmt(&db, "SELECT * FROM t2", 0);
+    s3 = cache_stmt(&db, "SELECT * FROM t3", 0);
+
+    /* Statements are reset when they are returned to the cache */
+    s1->pc = 3;
+    ck_assert(chidb_StmtCache_put(cache, s1) == CHIDB_OK);
+    ck_assert(chidb_StmtCache_get(cache, "SELECT * FROM t1", 0, &stmt) == CHIDB_OK);
+    ck_assert(stmt == s1 && stmt->pc == 0);
+    ck_assert(chidb_StmtCache_get(cache, "SELECT * FROM t1", 0, &stmt) == CHIDB_ENOTFOUND);
+
+    /* The least recently used statement is evicted */
+    ck_assert(chidb_StmtCache_put(cache, s1) == CHIDB_OK);
+    ck_assert(chidb_StmtCache_put(cache, s2) == CHIDB_OK);
+    ck_assert(chidb_StmtCache_put(cache, s3) == CHIDB_OK);
+    ck_assert(cache->n == 2);
+    ck_assert(chidb_StmtCache_get(cache, "SELECT * FROM t1", 0, &stmt) == CHIDB_ENOTFOUND);
+
+    /* Statements compiled against an older schema are discarded */
+    ck_assert(chidb_StmtCache_get(cache, "SELECT * FROM t2", 1, &stmt) == CHIDB_ENOTFOUND);
+    ck_assert(chidb_StmtCache_get(cache, "SELECT * FROM t3", 0, &stmt) == CHIDB_OK);
+    ck_assert(stmt == s3);
+    ck_assert(cache->n == 0);
+
+    ck_assert(chidb_StmtCache_put(cache, s3) == CHIDB_OK);
+    ck_assert(chidb_StmtCache_destroy(cache) == CHIDB_OK);
+}
+END_TEST
+
+
+START_TEST (test_bind)
+{
+    chidb db;
+    chidb_stmt stmt;
+    chisql_statement_t *sql;
+    const char *text = "a string that does not fit in a register";
+    chidb_dbm_op_t ops[] =
+    {
+        {Op_Variable, 1, 0, 0, NULL},
+        {Op_Variable, 2, 1, 0, NULL},
+    };
+    int nops = sizeof(ops) / sizeof(chidb_dbm_op_t);
+
+    ck_assert(chisql_parser("SELECT * FROM t WHERE a = ? AND b = ?;", &sql) == CHIDB_OK);
+    ck_assert(sql->nparams == 2);
+
+    chidb_stmt_init(&stmt, &db);
+    for(int i=0; i < nops; i++)
+        chidb_stmt_set_op(&stmt, &ops[i], i);
+    chidb_stmt_set_params(&stmt, sql->nparams);
+
+    ck_assert(chidb_bind_int(&stmt, 0, 1) == CHIDB_EMISUSE);
+    ck_assert(chidb_bind_int(&stmt, 3, 1) == CHIDB_EMISUSE);
+
+    /* Unbound parameters are NULL */
+    ck_assert(chidb_bind_int(&stmt, 1, 42) == CHIDB_OK);
+    ck_assert(chidb_stmt_exec(&stmt) == CHIDB_DONE);
+    ck_assert(stmt.reg[0].type == REG_INT32 && stmt.reg[0].value.i == 42);
+    ck_assert(stmt.reg[1].type == REG_NULL);
+
+    /* The statement can be run again with different values */
+    ck_assert(chidb_reset(&stmt) == CHIDB_OK);
+    ck_assert(stmt.pc == 0 && stmt.reg[0].type == REG_UNSPECIFIED);
+    ck_assert(chidb_bind_text(&stmt, 2, text) == CHIDB_OK);
+    ck_assert(chidb_stmt_exec(&stmt) == CHIDB_DONE);
+    ck_assert(stmt.reg[0].type == REG_INT32 && stmt.reg[0].value.i == 42);
+    ck_assert(stmt.reg[1].type == REG_STRING && strcmp(stmt.reg[1].value.s, text) == 0);
+
+    /* A value can be replaced with NULL */
+    ck_assert(chidb_reset(&stmt) == CHIDB_OK);
+    ck_assert(chidb_bind_null(&stmt, 2) == CHIDB_OK);
+    ck_assert(chidb_bind_null(&stmt, 3) == CHIDB_EMISUSE);
+    ck_assert(chidb_stmt_exec(&stmt) == CHIDB_DONE);
+    ck_assert(stmt.reg[1].type == REG_NULL);
+
+    chidb_stmt_free(&stmt);
+}
+END_TEST
+
+
+/* Runs a SQL statement that doesn't return any rows */
+static void exec_sql(chidb *db, const char *sql)
+{
+    chidb_stmt *stmt;
+
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+}
+
+/* From libchidb/optimizer.c */
+int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statement_t **sql_stmt_opt);
+void chidb_stmt_optimize_free(chisql_statement_t *sql_stmt_opt);
+
+/* Runs a query, and returns the number of rows it produces (and, in
+ * nnull, the number of those rows that have NULL in column col) */
+static int count_rows(chidb *db, const char *sql, int col, int *nnull)
+{
+    chidb_stmt *stmt;
+    int rc, nrows = 0;
+
+    *nnull = 0;
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    while ((rc = chidb_step(stmt)) == CHIDB_ROW)
+    {
+        nrows++;
+        if (chidb_column_type(stmt, col) == SQL_NULL)
+            (*nnull)++;
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    return nrows;
+}
+
+START_TEST (test_analyze)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    chisql_statement_t *sql, *opt;
+    Stats *stats;
+    TableStats *t;
+    IndexStats *idx;
+    RA_t *cross;
+    double sel;
+    int nrows = 0, nstats, nnull;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-analyze.cdb");
+    const char *join = "SELECT numbers.code, s.id FROM numbers, s WHERE numbers.altcode = s.alt;";
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* A database that has never been analyzed has no statistics */
+    ck_assert(chidb_Stats_get(db, &stats) == CHIDB_OK);
+    ck_assert(stats->nTables == 0 && stats->nIndexes == 0);
+
+    exec_sql(db, "CREATE TABLE s(id INTEGER PRIMARY KEY, alt INTEGER);");
+    exec_sql(db, "INSERT INTO s VALUES(1, 9910);");
+    exec_sql(db, "INSERT INTO s VALUES(2, 9915);");
+    exec_sql(db, "INSERT INTO s VALUES(3, 5);");
+
+    /* The entries written by the second ANALYZE replace those of the first */
+    exec_sql(db, "ANALYZE;");
+    nstats = count_rows(db, "SELECT id FROM chidb_stat;", 0, &nnull);
+    exec_sql(db, "INSERT INTO s VALUES(4, 12);");
+    exec_sql(db, "ANALYZE;");
+    ck_assert(count_rows(db, "SELECT id FROM chidb_stat;", 0, &nnull) == nstats);
+
+    ck_assert(chidb_Stats_get(db, &stats) == CHIDB_OK);
+    ck_assert(stats->nTables == 2 && stats->nIndexes == 1);
+    ck_assert(chidb_Stats_findTable(stats, "s", &t) == CHIDB_OK);
+    ck_assert(t->nRows == 4 && t->nPages == 1 && t->depth == 1);
+    ck_assert(chidb_Stats_findTable(stats, "numbers", &t) == CHIDB_OK);
+    ck_assert(t->nRows == 2048 && t->nPages == 161 && t->depth == 3);
+    ck_assert(chidb_Stats_findIndex(stats, "idxNumbers", &idx) == CHIDB_OK);
+    ck_assert(idx->nEntries == 2048 && idx->depth == 2);
+
+    ck_assert(t->cols[2].nDistinct == 2048 && t->cols[2].nNull == 0);
+    ck_assert(t->cols[2].nBounds == STATS_NBUCKETS + 1);
+
+    /* The histogram of altcode, whose values are spread over [0, 10000) */
+    sel = chidb_Stats_selectivity(t, 2, RA_COND_LT, litInt(5000));
+    ck_assert(sel > 0.45 && sel < 0.55);
+    sel = chidb_Stats_selectivity(t, 2, RA_COND_GEQ, litInt(20000));
+    ck_assert(sel == 0);
+    sel = chidb_Stats_selectivity(t, 2, RA_COND_EQ, litInt(9910));
+    ck_assert(sel == 1.0 / 2048);
+
+    /* The small table is joined first, so that the large one is accessed
+     * through its index (instead of being scanned for each row of s) */
+    ck_assert(chisql_parser(join, &sql) == CHIDB_OK);
+    ck_assert(chidb_stmt_optimize(db, sql, &opt) == CHIDB_OK);
+    cross = opt->plan->pi.ra->sigma.ra;
+    ck_assert(cross->t == RA_CROSS);
+    ck_assert(cross->binary.ra1->t == RA_TABLE && strcmp(cross->binary.ra1->table.name, "s") == 0);
+    chidb_stmt_optimize_free(opt);
+
+    ck_assert(chidb_prepare(db, join, &stmt) == CHIDB_OK);
+    while (chidb_step(stmt) == CHIDB_ROW)
+        nrows++;
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(nrows == 2);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+/* A hash table whose entries don't fit in its budget, with more entries
+ * with the same key (and hash value) than a partition had room for when
+ * they were keyed by part of their hash value */
+START_TEST (test_hash_spill)
+{
+    chidb_dbm_hash_t h;
+    chidb_dbm_register_t key, *row, val;
+    int nkey = 0, nmatched = 0, nunmatched = 0;
+    bool found, spilled = false;
+
+    memset(&h, 0, sizeof(h));
+    chidb_dbm_reg_init(&key);
+    chidb_dbm_reg_init(&val);
+    ck_assert(chidb_dbm_hash_open(&h, 1, 4096) == CHIDB_OK);
+
+    for (int i = 0; i < 72000; i++)
+    {
+        ck_assert(chidb_dbm_reg_set_int(&key, i < 70000 ? 7 : i) == CHIDB_OK);
+        ck_assert(chidb_dbm_reg_set_int(&val, i) == CHIDB_OK);
+        ck_assert(chidb_dbm_hash_insert(&h, &key, &val) == CHIDB_OK);
+    }
+    for (uint32_t i = 0; i < DBM_HASH_NPART; i++)
+        spilled = spilled || h.spill[i].nroot != 0;
+    ck_assert(spilled);
+
+    /* Every entry with the key, and only those, are visited by a probe */
+    ck_assert(chidb_dbm_reg_set_int(&key, 7) == CHIDB_OK);
+    ck_assert(chidb_dbm_hash_probe(&h, &key, &found) == CHIDB_OK);
+    while (found)
+    {
+        ck_assert(chidb_dbm_hash_row(&h, &row) == CHIDB_OK);
+        ck_assert(row[0].type == REG_INT32 && row[0].value.i < 70000);
+        if (row[0].value.i % 2 == 0)
+        {
+            ck_assert(chidb_dbm_hash_mark(&h) == CHIDB_OK);
+            nmatched++;
+        }
+        nkey++;
+        ck_assert(chidb_dbm_hash_next(&h, &found) == CHIDB_OK);
+    }
+    ck_assert(nkey == 70000 && nmatched == 35000);
+
+    ck_assert(chidb_dbm_reg_set_int(&key, 71234) == CHIDB_OK);
+    ck_assert(chidb_dbm_hash_probe(&h, &key, &found) == CHIDB_OK && found);
+    ck_assert(chidb_dbm_hash_row(&h, &row) == CHIDB_OK && row[0].value.i == 71234);
+    ck_assert(chidb_dbm_hash_next(&h, &found) == CHIDB_OK && !found);
+    ck_assert(chidb_dbm_reg_set_int(&key, 8) == CHIDB_OK);
+    ck_assert(chidb_dbm_hash_probe(&h, &key, &found) == CHIDB_OK && !found);
+
+    ck_assert(chidb_dbm_hash_unmatched(&h, &found) == CHIDB_OK);
+    while (found)
+    {
+        nunmatched++;
+        ck_assert(chidb_dbm_hash_next(&h, &found) == CHIDB_OK);
+    }
+    ck_assert(nunmatched == 35000 + 2000);
+
+    ck_assert(chidb_dbm_hash_close(&h) == CHIDB_OK);
+    chidb_dbm_reg_free(&key);
+    chidb_dbm_reg_free(&val);
+}
+END_TEST
+
+START_TEST (test_hash_join)
+{
+    chidb *db;
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-hash-join.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* An equijoin with no index is a hash join */
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a JOIN courses AS b ON a.dept = b.dept;", 1, &nnull) == 5);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a, courses AS b "
+                             "WHERE a.dept = b.dept AND b.code > 21000;", 1, &nnull) == 3);
+
+    /* NULL keys never match */
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a JOIN courses AS b ON a.prof = b.prof;", 1, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a LEFT JOIN courses AS b ON a.prof = b.prof;", 1, &nnull) == 3);
+    ck_assert(nnull == 2);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a RIGHT JOIN courses AS b ON a.prof = b.prof;", 0, &nnull) == 3);
+    ck_assert(nnull == 2);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a FULL OUTER JOIN courses AS b ON a.prof = b.prof;", 0, &nnull) == 5);
+    ck_assert(nnull == 2);
+
+    /* The conditions in the ON clause decide which rows match, and the
+     * WHERE conditions which rows are produced */
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a LEFT JOIN courses AS b "
+                             "ON a.dept = b.dept AND b.code > 21000;", 1, &nnull) == 3);
+    ck_assert(nnull == 0);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a FULL JOIN courses AS b "
+                             "ON a.dept = b.dept AND b.code > 21000;", 0, &nnull) == 4);
+    ck_assert(nnull == 1);
+    ck_assert(count_rows(db, "SELECT a.name, b.name FROM courses AS a RIGHT JOIN courses AS b "
+                             "ON a.dept = b.dept AND a.code = 21000 WHERE b.code < 27000;", 0, &nnull) == 2);
+    ck_assert(nnull == 1);
+    ck_assert(count_rows(db, "SELECT * FROM courses AS a LEFT JOIN courses AS b USING (dept) "
+                             "WHERE a.code > 21000;", 4, &nnull) == 3);
+    ck_assert(nnull == 0);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+/* Runs a query, and checks that column col (an integer) of the rows it
+ * produces is sorted (in descending order, if desc). Returns the number
+ * of rows */
+static int check_sorted(chidb *db, const char *sql, int col, bool desc)
+{
+    chidb_stmt *stmt;
+    int rc, nrows = 0, prev = 0, v;
+
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    while ((rc = chidb_step(stmt)) == CHIDB_ROW)
+    {
+        v = chidb_column_int(stmt, col);
+        if (nrows > 0)
+            ck_assert(desc ? v <= prev : v >= prev);
+        prev = v;
+        nrows++;
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    return nrows;
+}
+
+START_TEST (test_order_by)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-order-by.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(check_sorted(db, "SELECT code, altcode FROM numbers ORDER BY altcode;", 1, false) == 2048);
+    ck_assert(check_sorted(db, "SELECT code, altcode FROM numbers ORDER BY altcode DESC;", 1, true) == 2048);
+
+    /* The sort key does not have to be in the result row */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE altcode > 9989 ORDER BY altcode DESC;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 7912);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 597);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+START_TEST (test_group_by)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-group-by.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "SELECT dept, COUNT(*), COUNT(prof), SUM(code), AVG(code), MIN(name), MAX(name) "
+                                "FROM courses GROUP BY dept ORDER BY dept;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 42);
+    ck_assert(chidb_column_int(stmt, 1) == 1);
+    ck_assert(chidb_column_int(stmt, 2) == 0);
+    ck_assert(chidb_column_int(stmt, 3) == 23500);
+    ck_assert(chidb_column_int(stmt, 4) == 23500);
+    ck_assert(!strcmp(chidb_column_text(stmt, 5), "Databases"));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 89);
+    ck_assert(chidb_column_int(stmt, 1) == 2);
+    ck_assert(chidb_column_int(stmt, 2) == 1);
+    ck_assert(chidb_column_int(stmt, 3) == 48500);
+    ck_assert(chidb_column_int(stmt, 4) == 24250);
+    ck_assert(!strcmp(chidb_column_text(stmt, 5), "Operating Systems"));
+    ck_assert(!strcmp(chidb_column_text(stmt, 6), "Programming Languages"));
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* NULL keys form a single group, and an aggregate with no GROUP BY
+     * produces exactly one row, even if there are no rows */
+    ck_assert(count_rows(db, "SELECT prof, COUNT(*) FROM courses GROUP BY prof;", 0, &nnull) == 2);
+    ck_assert(nnull == 1);
+    ck_assert(chidb_prepare(db, "SELECT COUNT(*), SUM(code) FROM courses WHERE code > 30000;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 0);
+    ck_assert(chidb_column_type(stmt, 1) == SQL_NULL);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* Every column in the result must be grouped or aggregated */
+    ck_assert(chidb_prepare(db, "SELECT name, COUNT(*) FROM courses GROUP BY dept;", &stmt) != CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+/* Does a DBM program have an instruction with a given opcode? */
+static bool has_op(chidb_stmt *stmt, opcode_t opcode)
+{
+    for (uint32_t i = 0; i <= stmt->endOp; i++)
+        if (stmt->ops[i].opcode == opcode)
+            return true;
+
+    return false;
+}
+
+/* Number of instructions with a given opcode in a DBM program */
+static int count_op(chidb_stmt *stmt, opcode_t opcode)
+{
+    int n = 0;
+
+    for (uint32_t i = 0; i <= stmt->endOp; i++)
+        n += stmt->ops[i].opcode == opcode;
+
+    return n;
+}
+
+START_TEST (test_sorted_agg)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-sorted-agg.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* altcode is indexed, so the rows are aggregated in index order, and
+     * the groups are already sorted */
+    ck_assert(check_sorted(db, "SELECT altcode, COUNT(*) FROM numbers GROUP BY altcode ORDER BY altcode;", 0, false) == 2048);
+    ck_assert(chidb_prepare(db, "SELECT altcode, COUNT(*), SUM(code) FROM numbers GROUP BY altcode;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_AggBreak));
+    ck_assert(!has_op(stmt, Op_SorterOpen));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 11);
+    ck_assert(chidb_column_int(stmt, 1) == 1);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* A bare MIN or MAX is a single seek */
+    ck_assert(chidb_prepare(db, "SELECT MAX(altcode) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_Next) && !has_op(stmt, Op_NextColumn));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9992);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "SELECT MIN(altcode) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 11);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "SELECT MAX(code) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9995);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+START_TEST (test_count)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-count.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* COUNT(*) of a whole table counts its entries, without a loop */
+    ck_assert(chidb_prepare(db, "SELECT COUNT(*) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_Count));
+    ck_assert(!has_op(stmt, Op_OpenRead));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 2048);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* With a WHERE, the rows are still read */
+    ck_assert(chidb_prepare(db, "SELECT COUNT(*) FROM numbers WHERE altcode > 9980;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_Count));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 4);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+
+START_TEST (test_set_ops)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-set-ops.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* dept is 89, 42, 89 and prof is 75, NULL, NULL */
+    ck_assert(count_rows(db, "SELECT DISTINCT dept FROM courses;", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT DISTINCT prof FROM courses;", 0, &nnull) == 2);
+    ck_assert(nnull == 1);
+    ck_assert(count_rows(db, "SELECT DISTINCT prof, dept FROM courses;", 0, &nnull) == 3);
+    ck_assert(check_sorted(db, "SELECT DISTINCT dept FROM courses ORDER BY dept DESC;", 0, true) == 2);
+    ck_assert(count_rows(db, "SELECT dept FROM courses UNION SELECT prof FROM courses;", 0, &nnull) == 4);
+    ck_assert(nnull == 1);
+    ck_assert(count_rows(db, "SELECT dept FROM courses INTERSECT SELECT dept FROM courses WHERE code > 21000;", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT dept FROM courses EXCEPT SELECT dept FROM courses WHERE code > 21000;", 0, &nnull) == 0);
+    ck_assert(count_rows(db, "SELECT dept FROM courses UNION SELECT prof FROM courses "
+                             "EXCEPT SELECT prof FROM courses;", 0, &nnull) == 2);
+
+    ck_assert(chidb_prepare(db, "SELECT dept FROM courses EXCEPT SELECT dept FROM courses WHERE code = 23500;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 89);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* The rows of a table are distinct if its primary key is in them */
+    ck_assert(chidb_prepare(db, "SELECT DISTINCT code, dept FROM courses;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_AggOpen));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* The operands must have the same number of columns, and no ORDER BY */
+    ck_assert(chidb_prepare(db, "SELECT dept FROM courses UNION SELECT prof, dept FROM courses;", &stmt) != CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT dept FROM courses ORDER BY dept UNION SELECT prof FROM courses;", &stmt) != CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+
+    /* altcode is indexed, so the distinct values are produced in index order */
+    fname = create_copy("1table-largebtree.cdb", "dbm-set-ops.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    ck_assert(check_sorted(db, "SELECT DISTINCT altcode FROM numbers ORDER BY altcode;", 0, false) == 2048);
+    ck_assert(chidb_prepare(db, "SELECT DISTINCT altcode FROM numbers ORDER BY altcode;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_AggBreak));
+    ck_assert(!has_op(stmt, Op_SorterOpen));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE code > 5000 "
+                             "INTERSECT SELECT code FROM numbers WHERE code < 6000;", 0, &nnull) == 195);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_in_list)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-in-list.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* The primary key seeks each value of the list, once and in order */
+    ck_assert(check_sorted(db, "SELECT code FROM numbers WHERE code IN (9995, 8, 12345, 8);", 0, false) == 2);
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE code IN (9995, 8);", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_ListRewind));
+    ck_assert(!has_op(stmt, Op_Next));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* altcode is indexed, so its index seeks each value of the list */
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE altcode IN (11, 9992, 5);", 0, &nnull) == 2);
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE altcode IN (11, 9992, 5);", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_ListRewind));
+    ck_assert(has_op(stmt, Op_SeekGe));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* Any other IN is looked up in the list */
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE code < 20 AND NOT code IN (8, 13);", 0, &nnull) == 3);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+
+    fname = create_copy("1table-1page.cdb", "dbm-in-list.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* dept is 89, 42, 89 and prof is 75, NULL, NULL */
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE dept IN (42, 99);", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT dept IN (42);", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE prof IN (75, 89);", 0, &nnull) == 1);
+
+    /* The NOT of a comparison (or an IN) with NULL is NULL, so it is false */
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT prof IN (1, 2);", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT prof > 80;", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT prof = 75;", 0, &nnull) == 0);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT NOT prof IN (75);", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT prof < 50 OR dept = 42;", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT (prof = 75 AND dept = 42);", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT code FROM courses WHERE NOT (prof = 75 OR dept = 42);", 0, &nnull) == 0);
+    ck_assert(chidb_prepare(db, "SELECT code FROM courses WHERE NOT prof IN (1, 2);", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_IsNull));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT code FROM courses WHERE dept IN (42, 99);", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_ListIn) || has_op(stmt, Op_ListNotIn));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_limit)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-limit.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* The primary key and the index on altcode are scanned backwards,
+     * and the scan stops after the last row */
+    ck_assert(check_sorted(db, "SELECT code FROM numbers ORDER BY code DESC LIMIT 50;", 0, true) == 50);
+    ck_assert(check_sorted(db, "SELECT altcode FROM numbers ORDER BY altcode DESC LIMIT 50;", 0, true) == 50);
+    ck_assert(chidb_prepare(db, "SELECT altcode FROM numbers ORDER BY altcode DESC LIMIT 50;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_Prev));
+    ck_assert(!has_op(stmt, Op_SorterOpen));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9992);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* textcode is not indexed, so its rows go through a top-n sort */
+    ck_assert(chidb_prepare(db, "SELECT code, textcode FROM numbers ORDER BY textcode DESC LIMIT 2;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_SorterLimit));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9995);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9994);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* OFFSET skips the first rows */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers ORDER BY code LIMIT 3 OFFSET 2;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 13);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT code FROM numbers ORDER BY textcode LIMIT 10 OFFSET 2045;", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE code > 9000 LIMIT 5;", 0, &nnull) == 5);
+    ck_assert(count_rows(db, "SELECT code FROM numbers LIMIT 0;", 0, &nnull) == 0);
+    ck_assert(count_rows(db, "SELECT COUNT(*) FROM numbers LIMIT 1;", 0, &nnull) == 1);
+
+    /* The operands of a set operation can't have a LIMIT */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers UNION SELECT altcode FROM numbers LIMIT 1;", &stmt) != CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_expr)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-expr.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* code + 1 is computed once per row, for the WHERE and the result row */
+    ck_assert(chidb_prepare(db, "SELECT code, code + 1 FROM numbers WHERE code + 1 > 9992;", &stmt) == CHIDB_OK);
+    ck_assert(count_op(stmt, Op_Add) == 1);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9994);
+    ck_assert(chidb_column_int(stmt, 1) == 9995);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE -code > -12;", 0, &nnull) == 2);
+    ck_assert(check_sorted(db, "SELECT code * 2 - altcode FROM numbers ORDER BY code * 2 - altcode;", 0, false) == 2048);
+
+    /* Expressions of literals are folded, and a computed value can be sought */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE code = 4 * 2 + 1;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_Add) && !has_op(stmt, Op_Multiply));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE 1 = 2 OR code < 12;", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE code < 12 AND 2 > 1;", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE 1 = 1 OR code < 12;", 0, &nnull) == 2048);
+    ck_assert(chidb_prepare(db, "SELECT a.code FROM numbers a, numbers b WHERE b.code = a.code + 1;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_Seek));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 8);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* Aggregate functions of an expression */
+    ck_assert(chidb_prepare(db, "SELECT SUM(code * 2), SUM(code) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 2 * chidb_column_int(stmt, 1));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* An overflow or a division by zero is an error */
+    ck_assert(chidb_prepare(db, "SELECT code * 1000000 FROM numbers WHERE code > 9990;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_EMISMATCH);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT code / 0 FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_EMISMATCH);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+
+    fname = create_copy("1table-1page.cdb", "dbm-expr.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* prof is 75, NULL, NULL, and an expression of NULL is NULL */
+    ck_assert(chidb_prepare(db, "SELECT name || ' (' || code || ')', prof + 1 FROM courses;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(!strcmp(chidb_column_text(stmt, 0), "Programming Languages (21000)"));
+    ck_assert(chidb_column_int(stmt, 1) == 76);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_type(stmt, 1) == SQL_NULL);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_covering)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    uint32_t version;
+    int nnull;
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-covering.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* altcode and the primary key are in the index, so the table is not read */
+    ck_assert(chidb_prepare(db, "SELECT code, altcode FROM numbers WHERE altcode > 9980 AND altcode < 9990;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_IdxPKey));
+    ck_assert(!has_op(stmt, Op_Seek) && !has_op(stmt, Op_Column));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9861);
+    ck_assert(chidb_column_int(stmt, 1) == 9987);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(check_sorted(db, "SELECT altcode FROM numbers ORDER BY altcode DESC LIMIT 20;", 0, true) == 20);
+    ck_assert(chidb_prepare(db, "SELECT MAX(altcode) FROM numbers;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_Seek));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(chidb_column_int(stmt, 0) == 9992);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* textcode is not in the index, so each row is sought in the table */
+    ck_assert(chidb_prepare(db, "SELECT textcode FROM numbers WHERE altcode > 9980 AND altcode < 9990;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_Seek));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT code FROM numbers WHERE altcode > 9980 AND altcode < 9990 AND textcode > 'PK: 9';", 0, &nnull) == 1);
+
+    /* With statistics, a covering index is cheaper than the table even
+     * for a range with one bound */
+    exec_sql(db, "ANALYZE;");
+    ck_assert(chidb_prepare(db, "SELECT altcode FROM numbers WHERE altcode > 5000;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_SeekGt) && !has_op(stmt, Op_Column));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT altcode FROM numbers WHERE altcode > 5000;", 0, &nnull) == 1000);
+
+    /* An index that can't be filled (its keys must be unique) is not
+     * added to the schema */
+    exec_sql(db, "CREATE TABLE dup (id INTEGER PRIMARY KEY, v INTEGER);");
+    exec_sql(db, "INSERT INTO dup VALUES (1, 5);");
+    exec_sql(db, "INSERT INTO dup VALUES (2, 5);");
+    version = db->schemaVersion;
+    ck_assert(chidb_prepare(db, "CREATE INDEX idxDup ON dup (v);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) != CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(db->schemaVersion == version);
+    ck_assert(chidb_prepare(db, "SELECT id FROM dup WHERE v = 5;", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_IdxPKey));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    exec_sql(db, "CREATE INDEX idxDup ON dup (id);");
+    ck_assert(db->schemaVersion == version + 1);
+
+    /* A statement that can't be prepared is not returned */
+    ck_assert(chidb_prepare(db, "CREATE INDEX idxDup ON dup (v);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(stmt == NULL);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_open_compressed)
+{
+    chidb *db;
+    FILE *f;
+    char magic[14];
+    int nnull;
+    char *fname = create_tmp_file();
+
+    ck_assert(chidb_open_v2(fname, &db, CHIDB_OPEN_COMPRESSED) == CHIDB_OK);
+    exec_sql(db, "CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT);");
+    exec_sql(db, "INSERT INTO t VALUES (1, 'one');");
+    exec_sql(db, "INSERT INTO t VALUES (2, 'two');");
+    ck_assert(chidb_close(db) == CHIDB_OK);
+
+    /* The file has compressed pages, which are recognized without the flag */
+    f = fopen(fname, "r");
+    ck_assert(f != NULL && fread(magic, 1, sizeof(magic), f) == sizeof(magic));
+    ck_assert(memcmp(magic, "chidb lz pages", sizeof(magic)) == 0);
+    fclose(f);
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT name FROM t;", 0, &nnull) == 2);
+    ck_assert(chidb_close(db) == CHIDB_OK);
+
+    delete_tmp_file(fname);
+}
+END_TEST
+
+START_TEST (test_composite)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char sql[512], name[301];
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-composite.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    exec_sql(db, "CREATE TABLE events (id INTEGER PRIMARY KEY, tenant INTEGER, ts INTEGER);");
+    for (int i = 1; i <= 60; i++)
+    {
+        snprintf(sql, sizeof(sql), "INSERT INTO events VALUES (%d, %d, %d);", i, i % 4, 1000 + (i * 7 % 50) * 3);
+        exec_sql(db, sql);
+    }
+    exec_sql(db, "CREATE INDEX idxEvents ON events (tenant, ts);");
+    exec_sql(db, "INSERT INTO events (id, tenant) VALUES (61, 2);");
+
+    /* The index is scanned from the key of (2, 1030) to the key of (2, 1090) */
+    ck_assert(chidb_prepare(db, "SELECT id FROM events WHERE tenant = 2 AND ts >= 1030 AND ts <= 1090;", &stmt) == CHIDB_OK);
+    ck_assert(count_op(stmt, Op_MakeKey) == 2);
+    ck_assert(has_op(stmt, Op_KeySeekGe) && has_op(stmt, Op_KeyGt) && has_op(stmt, Op_KeyNext));
+    ck_assert(!has_op(stmt, Op_Rewind));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 2 AND ts >= 1030 AND ts <= 1090;", 0, &nnull) == 7);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant + 0 = 2 AND ts >= 1030 AND ts <= 1090;", 0, &nnull) == 7);
+    ck_assert(check_sorted(db, "SELECT ts FROM events WHERE tenant = 2 AND ts >= 1030 AND ts <= 1090;", 0, false) == 7);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 2 AND ts > 1030 AND ts < 1090;", 0, &nnull) == 6);
+    ck_assert(count_rows(db, "SELECT ts FROM events WHERE tenant = 2;", 0, &nnull) == 16);
+    ck_assert(nnull == 1);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 3 AND ts = 1021;", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant >= 1 AND tenant <= 2;", 0, &nnull) == 31);
+
+    /* Entries with the same values are kept apart by their primary keys */
+    exec_sql(db, "INSERT INTO events VALUES (70, 3, 1021), (71, 3, 1021), (72, 0, -5);");
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 3 AND ts = 1021;", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 0 AND ts < 1000;", 0, &nnull) == 1);
+
+    /* The index's columns are read back from the schema table */
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT id FROM events WHERE tenant = 1 AND ts < 1050;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_KeySeekGe) && has_op(stmt, Op_KeyGe));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant = 1 AND ts < 1050;", 0, &nnull) == 5);
+    ck_assert(count_rows(db, "SELECT id FROM events WHERE tenant + 0 = 1 AND ts < 1050;", 0, &nnull) == 5);
+
+    /* Strings are compared byte by byte, as the registers compare them */
+    exec_sql(db, "CREATE TABLE people (id INTEGER PRIMARY KEY, last TEXT, first TEXT);");
+    exec_sql(db, "CREATE INDEX idxPeople ON people (last, first);");
+    exec_sql(db, "INSERT INTO people VALUES (1, 'Smith', 'Ann'), (2, 'Smith', 'Bob'), (3, 'Smithson', 'Al'), "
+                 "(4, 'Smit', 'Zoe'), (5, 'Jones', 'Ann');");
+    ck_assert(count_rows(db, "SELECT id FROM people WHERE last = 'Smith';", 0, &nnull) == 2);
+    ck_assert(count_rows(db, "SELECT id FROM people WHERE last = 'Smith' AND first > 'Ann';", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM people WHERE last > 'Smit';", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT id FROM people WHERE last >= 'Smit' AND last < 'Smithson';", 0, &nnull) == 3);
+
+    /* An entry whose values don't fit in the index is not inserted, and
+     * neither is its row */
+    memset(name, 'x', 300);
+    name[300] = '\0';
+    snprintf(sql, sizeof(sql), "INSERT INTO people VALUES (6, '%s', 'Ann');", name);
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ECONSTRAINT);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM people WHERE id = 6;", 0, &nnull) == 0);
+
+    /* Nor is an index whose entries don't fit */
+    exec_sql(db, "CREATE TABLE notes (id INTEGER PRIMARY KEY, title TEXT, body TEXT);");
+    snprintf(sql, sizeof(sql), "INSERT INTO notes VALUES (1, 'a', '%s');", name);
+    exec_sql(db, sql);
+    ck_assert(chidb_prepare(db, "CREATE INDEX idxNotes ON notes (title, body);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ECONSTRAINT);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT id FROM notes WHERE title = 'a';", &stmt) == CHIDB_OK);
+    ck_assert(!has_op(stmt, Op_KeyOpen));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_batch_insert)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    chidb_value values[300 * 3];
+    char names[300][8];
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-batch-insert.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    exec_sql(db, "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, qty INTEGER);");
+    exec_sql(db, "CREATE INDEX idxItems ON items (qty);");
+
+    /* The rows are inserted in order of their keys, each followed by its index entry */
+    ck_assert(chidb_prepare(db, "INSERT INTO items VALUES (30, 'c', 3), (10, 'a', 1), (20, 'b', 2);", &stmt) == CHIDB_OK);
+    ck_assert(count_op(stmt, Op_SorterSort) == 1);
+    ck_assert(count_op(stmt, Op_OpenWrite) == 2);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM items;", 0, &nnull) == 3);
+    ck_assert(check_sorted(db, "SELECT id FROM items;", 0, false) == 3);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty = 2;", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE name = 'c' AND qty = 3;", 0, &nnull) == 1);
+
+    exec_sql(db, "INSERT INTO items (qty, id) VALUES (5, 50), (4, 40);");
+    ck_assert(count_rows(db, "SELECT name FROM items WHERE qty >= 4;", 0, &nnull) == 2);
+    ck_assert(nnull == 2);
+
+    /* A duplicate key (50) stops the INSERT, but the rows inserted before
+     * it (45) are in the index too */
+    ck_assert(chidb_prepare(db, "INSERT INTO items VALUES (60, 'f', 6), (50, 'e', 7), (45, 'd', 9);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) != CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE id >= 60;", 0, &nnull) == 0);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty = 7;", 0, &nnull) == 0);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty = 9;", 0, &nnull) == 1);
+    exec_sql(db, "INSERT INTO items VALUES (60, 'f', 6), (70, 'g', 8);");
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty = 8;", 0, &nnull) == 1);
+
+    /* The rows of a batch don't have to be given in order either */
+    for (int i = 0; i < 300; i++)
+    {
+        int key = 1000 + (i * 37) % 300;
+
+        snprintf(names[i], sizeof(names[i]), "n%d", key);
+        values[3 * i].type = SQL_INTEGER_4BYTE;
+        values[3 * i].i = key;
+        values[3 * i + 1].type = key % 10 ? SQL_TEXT : SQL_NULL;
+        values[3 * i + 1].s = names[i];
+        values[3 * i + 2].type = SQL_INTEGER_4BYTE;
+        values[3 * i + 2].i = 5000 + key;
+    }
+    ck_assert(chidb_insert_batch(db, "items", values, 300) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM items;", 0, &nnull) == 308);
+    ck_assert(check_sorted(db, "SELECT id FROM items;", 0, false) == 308);
+    ck_assert(count_rows(db, "SELECT name FROM items WHERE id >= 1000;", 0, &nnull) == 300);
+    ck_assert(nnull == 30);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE name = 'n1234';", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty = 6234;", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE qty > 6200;", 0, &nnull) == 99);
+
+    /* The primary key must be an integer, and every value must have one
+     * of the types of chidb_value (if not, no row is inserted) */
+    values[0].i = 2000;
+    values[3].i = 2001;
+    values[5].type = SQL_INTEGER_1BYTE;
+    ck_assert(chidb_insert_batch(db, "items", values, 2) == CHIDB_EMISMATCH);
+    ck_assert(count_rows(db, "SELECT id FROM items WHERE id >= 2000;", 0, &nnull) == 0);
+    values[0].type = SQL_NULL;
+    ck_assert(chidb_insert_batch(db, "items", values, 1) == CHIDB_EMISMATCH);
+    ck_assert(chidb_insert_batch(db, "nosuchtable", values, 1) == CHIDB_EINVALIDSQL);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_dictionary)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char *fname = create_copy("1table-1page.cdb", "dbm-dictionary.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    exec_sql(db, "CREATE TABLE orders (id INTEGER PRIMARY KEY, status TEXT DICTIONARY, note TEXT);");
+
+    /* The values of the column are encoded when they are inserted */
+    ck_assert(chidb_prepare(db, "INSERT INTO orders VALUES (1, 'open', 'a');", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_DictEncode));
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    exec_sql(db, "INSERT INTO orders VALUES (2, 'closed', 'b'), (3, 'open', 'c');");
+    exec_sql(db, "INSERT INTO orders (id, note) VALUES (4, 'd');");
+    exec_sql(db, "INSERT INTO orders VALUES (5, 'open', 'e');");
+
+    /* A column that is only compared with a constant is never decoded */
+    ck_assert(chidb_prepare(db, "SELECT id FROM orders WHERE status = 'open';", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_DictEncode));
+    ck_assert(!has_op(stmt, Op_DictDecode));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM orders WHERE status = 'open';", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT id FROM orders WHERE 'closed' = status;", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT id FROM orders WHERE status = 'shipped';", 0, &nnull) == 0);
+
+    /* Otherwise, it is decoded after it is loaded */
+    ck_assert(chidb_prepare(db, "SELECT status FROM orders WHERE id = 2;", &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_DictDecode));
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(strcmp(chidb_column_text(stmt, 0), "closed") == 0);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT status FROM orders WHERE status = 'open';", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT status FROM orders;", 0, &nnull) == 5);
+    ck_assert(nnull == 1);
+
+    /* The rows are sorted by the strings, not by their codes ('open' was encoded first) */
+    ck_assert(chidb_prepare(db, "SELECT status FROM orders WHERE id < 4 ORDER BY status;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(strcmp(chidb_column_text(stmt, 0), "closed") == 0);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(strcmp(chidb_column_text(stmt, 0), "open") == 0);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* Rows are grouped (and made distinct) by the codes, which are only
+     * decoded in the rows of the aggregator */
+    ck_assert(chidb_prepare(db, "SELECT status, COUNT(*) FROM orders WHERE id < 4 GROUP BY status ORDER BY status;", &stmt) == CHIDB_OK);
+    ck_assert(count_op(stmt, Op_DictDecode) == 1);
+    for (uint32_t i = 1; i <= stmt->endOp; i++)
+        ck_assert(stmt->ops[i].opcode != Op_DictDecode || stmt->ops[i - 1].opcode == Op_AggRow);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(strcmp(chidb_column_text(stmt, 0), "closed") == 0 && chidb_column_int(stmt, 1) == 1);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert(strcmp(chidb_column_text(stmt, 0), "open") == 0 && chidb_column_int(stmt, 1) == 2);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT DISTINCT status FROM orders;", &stmt) == CHIDB_OK);
+    ck_assert(count_op(stmt, Op_DictDecode) == 1);
+    for (uint32_t i = 1; i <= stmt->endOp; i++)
+        ck_assert(stmt->ops[i].opcode != Op_DictDecode || stmt->ops[i - 1].opcode == Op_AggRow);
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT DISTINCT status FROM orders;", 0, &nnull) == 3 && nnull == 1);
+    ck_assert(count_rows(db, "SELECT DISTINCT status, note FROM orders WHERE status = 'open';", 0, &nnull) == 3);
+    ck_assert(count_rows(db, "SELECT status FROM orders WHERE status = 'open' GROUP BY status;", 0, &nnull) == 1);
+
+    /* Only TEXT columns can be encoded, and encoded columns can't be indexed */
+    ck_assert(chidb_prepare(db, "CREATE TABLE bad (id INTEGER PRIMARY KEY, n INTEGER DICTIONARY);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "CREATE INDEX idxStatus ON orders (status);", &stmt) == CHIDB_EINVALIDSQL);
+
+    /* The dictionary is found again when the database is reopened */
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT id FROM orders WHERE status = 'open';", 0, &nnull) == 3);
+    exec_sql(db, "INSERT INTO orders VALUES (6, 'shipped', 'f');");
+    ck_assert(count_rows(db, "SELECT id FROM orders WHERE status = 'shipped';", 0, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT note FROM orders WHERE status = 'closed';", 0, &nnull) == 1);
+
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_batch_scan)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int nnull;
+    char sql[256];
+    const char *queries[] =
+    {
+        "SELECT code, textcode FROM numbers",
+        "SELECT code, textcode FROM numbers WHERE textcode > '5'",
+        "SELECT textcode, code FROM numbers WHERE '5' >= textcode AND textcode >= '1'",
+        "SELECT altcode FROM numbers WHERE textcode = '1000'",
+    };
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-batch-scan.cdb");
+
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* A full scan of a table, with conditions that compare its columns
+     * with constants, reads the rows in batches */
+    ck_assert(chidb_prepare(db, queries[1], &stmt) == CHIDB_OK);
+    ck_assert(has_op(stmt, Op_BatchOpen));
+    ck_assert(has_op(stmt, Op_VLe));
+    ck_assert(!has_op(stmt, Op_OpenRead));
+    ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+    /* It produces the same rows as reading them one at a time (which
+     * a LIMIT forces) */
+    for (int i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+    {
+        snprintf(sql, sizeof(sql), "%s LIMIT 4096;", queries[i]);
+        ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+        ck_assert(!has_op(stmt, Op_BatchOpen));
+        ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+
+        int nrows = count_rows(db, sql, 0, &nnull);
+        snprintf(sql, sizeof(sql), "%s;", queries[i]);
+        ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+        ck_assert(has_op(stmt, Op_BatchOpen));
+        ck_assert(chidb_finalize(stmt) == CHIDB_OK);
+        ck_assert(count_rows(db, sql, 0, &nnull) == nrows);
+    }
+    ck_assert(count_rows(db, "SELECT code FROM numbers;", 0, &nnull) == 2048);
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+
+    /* prof is 75, NULL, NULL. NULL comes before every integer */
+    fname = create_copy("1table-1page.cdb", "dbm-batch-scan.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    ck_assert(count_rows(db, "SELECT name, prof FROM courses WHERE prof > 10;", 1, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT name, prof FROM courses WHERE prof > 10 LIMIT 5;", 1, &nnull) == 1);
+    ck_assert(count_rows(db, "SELECT name, dept FROM courses WHERE dept = 89;", 1, &nnull) == 2);
+    ck_assert(chidb_close(db) == CHIDB_OK);
+    delete_copy(fname);
+}
+END_TEST
+
+Suite* make_dbm_api_suite (void)
+{
+    Suite *s = suite_create ("dbm-api");
+
+    TCase *tc_peephole = tcase_create ("Peephole optimization");
+    tcase_add_test (tc_peephole, test_peephole);
+    suite_add_tcase (s, tc_peephole);
+
+    TCase *tc_reg = tcase_create ("Registers");
+    tcase_add_test (tc_reg, test_reg);
+    suite_add_tcase (s, tc_reg);
+
+    TCase *tc_stmt_cache = tcase_create ("Statement cache");
+    tcase_add_test (tc_stmt_cache, test_stmt_cache);
+    suite_add_tcase (s, tc_stmt_cache);
+
+    TCase *tc_bind = tcase_create ("Bound parameters");
+    tcase_add_test (tc_bind, test_bind);
+    suite_add_tcase (s, tc_bind);
+
+    TCase *tc_analyze = tcase_create ("Statistics");
+    tcase_add_test (tc_analyze, test_analyze);
+    suite_add_tcase (s, tc_analyze);
+
+    TCase *tc_hash_join = tcase_create ("Hash joins");
+    tcase_add_test (tc_hash_join, test_hash_join);
+    suite_add_tcase (s, tc_hash_join);
+
+    TCase *tc_hash_spill = tcase_create ("Spilled hash tables");
+    tcase_add_test (tc_hash_spill, test_hash_spill);
+    suite_add_tcase (s, tc_hash_spill);
+
+    TCase *tc_order_by = tcase_create ("ORDER BY");
+    tcase_add_test (tc_order_by, test_order_by);
+    suite_add_tcase (s, tc_order_by);
+
+    TCase *tc_group_by = tcase_create ("GROUP BY");
+    tcase_add_test (tc_group_by, test_group_by);
+    suite_add_tcase (s, tc_group_by);
+
+    TCase *tc_sorted_agg = tcase_create ("Sorted aggregation");
+    tcase_add_test (tc_sorted_agg, test_sorted_agg);
+    suite_add_tcase (s, tc_sorted_agg);
+
+    TCase *tc_count = tcase_create ("COUNT");
+    tcase_add_test (tc_count, test_count);
+    suite_add_tcase (s, tc_count);
+
+    TCase *tc_set_ops = tcase_create ("Set operations");
+    tcase_add_test (tc_set_ops, test_set_ops);
+    suite_add_tcase (s, tc_set_ops);
+
+    TCase *tc_in_list = tcase_create ("IN lists");
+    tcase_add_test (tc_in_list, test_in_list);
+    suite_add_tcase (s, tc_in_list);
+
+    TCase *tc_limit = tcase_create ("LIMIT");
+    tcase_add_test (tc_limit, test_limit);
+    suite_add_tcase (s, tc_limit);
+
+    TCase *tc_expr = tcase_create ("Expressions");
+    tcase_add_test (tc_expr, test_expr);
+    suite_add_tcase (s, tc_expr);
+
+    TCase *tc_covering = tcase_create ("Covering indexes");
+    tcase_add_test (tc_covering, test_covering);
+    suite_add_tcase (s, tc_covering);
+
+    TCase *tc_composite = tcase_create ("Indexes on several columns");
+    tcase_add_test (tc_composite, test_composite);
+    suite_add_tcase (s, tc_composite);
+
+    TCase *tc_batch_insert = tcase_create ("Batch inserts");
+    tcase_add_test (tc_batch_insert, test_batch_insert);
+    suite_add_tcase (s, tc_batch_insert);
+
+    TCase *tc_dictionary = tcase_create ("Dictionary encoding");
+    tcase_add_test (tc_dictionary, test_dictionary);
+    suite_add_tcase (s, tc_dictionary);
+
+    TCase *tc_batch_scan = tcase_create ("Batch scans");
+    tcase_add_test (tc_batch_scan, test_batch_scan);
+    suite_add_tcase (s, tc_batch_scan);
+
+    TCase *tc_open_compressed = tcase_create ("Compressed files");
+    tcase_add_test (tc_open_compressed, test_open_compressed);
+    suite_add_tcase (s, tc_open_compressed);
+
+    TCase *tc_jit = tcase_create ("JIT compilation");
+    tcase_add_test (tc_jit, test_jit);
+    suite_add_tcase (s, tc_jit);
+
+    return s;
+}
+
 int main (void)
 {
     SRunner *sr;
@@ -152,6 +1516,8 @@ int main (void)
         exit(1);
     }
 
+    srunner_add_suite (sr, make_dbm_api_suite ());
+
     srunner_run_all (sr, CK_NORMAL);
     number_failed = srunner_ntests_failed (sr);
     srunner_free (sr);
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <check.h>
+#include <sys/stat.h>
 #include "check_common.h"
 #include "libchidb/pager.h"
 
@@ -146,6 +147,137 @@ START_TEST (test_readwrite)
 END_TEST
 
 
+START_TEST (test_readwrite_compressed)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+    struct stat buf;
+
+    for(int i=0; i<NMULT; i++)
+    {
+        char *fname = create_tmp_file();
+
+        rc = chidb_Pager_open(&pg, fname);
+        ck_assert(rc == CHIDB_OK);
+
+        rc = chidb_Pager_setCompression(pg, true);
+        ck_assert(rc == CHIDB_OK);
+
+        chidb_Pager_setPageSize(pg, PAGE_SIZE * pagemult[i]);
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_allocatePage(pg, &npage);
+            ck_assert(npage == j);
+        }
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_readPage(pg, j, &page);
+            for(int k=0; k<NVALUES; k++)
+                page->data[pagepos[k]*(i+1)] = values[k];
+            chidb_Pager_writePage(pg, page);
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+
+        chidb_Pager_close(pg);
+
+        /* The pages are mostly zeroes, so they must take up less space */
+        stat(fname, &buf);
+        ck_assert(buf.st_size < MAXPAGES * PAGE_SIZE * pagemult[i]);
+
+        /* The compressed file must be detected when it is reopened */
+        rc = chidb_Pager_open(&pg, fname);
+        ck_assert(rc == CHIDB_OK);
+        ck_assert(pg->compressed);
+        ck_assert_int_eq(pg->page_size, PAGE_SIZE * pagemult[i]);
+        ck_assert_int_eq(pg->n_pages, MAXPAGES);
+
+        rc = chidb_Pager_setCompression(pg, false);
+        ck_assert(rc == CHIDB_EMISUSE);
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_readPage(pg, j, &page);
+            for(int k=0; k<NVALUES; k++)
+                if(page->data[pagepos[k]*(i+1)] != values[k])
+                {
+                    ck_abort_msg("Incorrect value read from compressed page");
+                    break;
+                }
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+
+        chidb_Pager_close(pg);
+        delete_tmp_file(fname);
+    }
+}
+END_TEST
+
+
+START_TEST (test_compressed_unclosed)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg, *pg2;
+    MemPage *page;
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    rc = chidb_Pager_setCompression(pg, true);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+
+    /* More pages than fit in the first region of the page mapping table */
+    for(int j=1; j<=100; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        page->data[j] = j;
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+
+        /* Pages that no longer fit in their slot move to a new one */
+        if (j % 10 == 0)
+        {
+            chidb_Pager_readPage(pg, j / 10, &page);
+            for(int k=0; k<PAGE_SIZE; k++)
+                page->data[k] = values[(k * j) % NVALUES];
+            chidb_Pager_writePage(pg, page);
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+    }
+
+    /* The file is read while pg is still open, as if it had not
+     * been closed cleanly */
+    rc = chidb_Pager_open(&pg2, fname);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert(pg2->compressed);
+    ck_assert_int_eq(pg2->n_pages, 100);
+
+    for(int j=1; j<=100; j++)
+    {
+        rc = chidb_Pager_readPage(pg2, j, &page);
+        ck_assert(rc == CHIDB_OK);
+        for(int k=0; k<PAGE_SIZE; k++)
+            if(page->data[k] != (j <= 10 ? values[(k * j * 10) % NVALUES] : k == j ? j : 0))
+            {
+                ck_abort_msg("Incorrect value read from compressed page");
+                break;
+            }
+        chidb_Pager_releaseMemPage(pg2, page);
+    }
+
+    chidb_Pager_close(pg2);
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
 Suite* make_pager_suite (void)
 {
     Suite *s = suite_create ("Pager");
@@ -160,6 +292,8 @@ Suite* make_pager_suite (void)
 
     TCase *tc_readwrite = tcase_create ("Reading/writing a file");
     tcase_add_test (tc_readwrite, test_readwrite);
+    tcase_add_test (tc_readwrite, test_readwrite_compressed);
+    tcase_add_test (tc_readwrite, test_compressed_unclosed);
     suite_add_tcase (s, tc_readwrite);
 
     return s;